@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -105,6 +105,11 @@ protected:
 			return ptr;
 		}
 
+		void Rewind()
+		{
+			m_Size = 0;
+		}
+
 	private:
 		size_t m_Size = 0;
 		uint8_t* m_Data = nullptr;
@@ -121,6 +126,7 @@ public:
 	void AllocateNewBlock()
 	{
 		m_Blocks.emplace_back();
+		m_CurrentBlock = m_Blocks.size() - 1;
 	}
 
 	void* allocate(size_t n, const void*, size_t alignment)
@@ -135,10 +141,16 @@ public:
 			throw std::bad_alloc();
 		}
 
-		if (!m_Blocks.back().Available(n, alignment))
-			AllocateNewBlock();
+		if (!m_Blocks[m_CurrentBlock].Available(n, alignment))
+		{
+			// Reuse the blocks kept by Rewind before allocating new ones.
+			if (m_CurrentBlock + 1 < m_Blocks.size())
+				++m_CurrentBlock;
+			else
+				AllocateNewBlock();
+		}
 
-		return reinterpret_cast<void*>(m_Blocks.back().Allocate(n, alignment));
+		return reinterpret_cast<void*>(m_Blocks[m_CurrentBlock].Allocate(n, alignment));
 	}
 
 	void deallocate(void* UNUSED(p), size_t UNUSED(n))
@@ -152,8 +164,25 @@ public:
 		AllocateNewBlock();
 	}
 
+	/**
+	 * Like clear(), but keeps the blocks allocated so far to serve the following
+	 * allocations, so that an arena reused in a loop stops hitting the heap.
+	 */
+	void Rewind()
+	{
+		for (size_t i = 0; i <= m_CurrentBlock; ++i)
+			m_Blocks[i].Rewind();
+		m_CurrentBlock = 0;
+	}
+
+	size_t GetNumberOfBlocks() const
+	{
+		return m_Blocks.size();
+	}
+
 protected:
 	std::vector<Block> m_Blocks;
+	size_t m_CurrentBlock = 0;
 };
 
 } // namespace Allocators
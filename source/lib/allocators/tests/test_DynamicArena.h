@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -72,4 +72,23 @@ public:
 		p2 = static_cast<u8*>(testArena.allocate(1, nullptr, 8));
 		TS_ASSERT_EQUALS(p + 32, p2);
 	}
+
+	void test_rewind()
+	{
+		Allocators::DynamicArena<100> testArena;
+		u8* p = static_cast<u8*>(testArena.allocate(60, nullptr, 1));
+		u8* p2 = static_cast<u8*>(testArena.allocate(60, nullptr, 1));
+		TS_ASSERT_EQUALS(testArena.GetNumberOfBlocks(), 2u);
+
+		testArena.Rewind();
+		TS_ASSERT_EQUALS(testArena.allocate(60, nullptr, 1), p);
+		TS_ASSERT_EQUALS(testArena.allocate(60, nullptr, 1), p2);
+		TS_ASSERT_EQUALS(testArena.GetNumberOfBlocks(), 2u);
+
+		testArena.allocate(60, nullptr, 1);
+		TS_ASSERT_EQUALS(testArena.GetNumberOfBlocks(), 3u);
+
+		testArena.clear();
+		TS_ASSERT_EQUALS(testArena.GetNumberOfBlocks(), 1u);
+	}
 };
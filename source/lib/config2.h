@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -86,6 +86,13 @@
 # define CONFIG2_MINIUPNPC 1
 #endif
 
+// allow use of Zstandard (as an alternative to zlib for archives, savegames
+// and the rejoin state). disabled by default because archives and savegames
+// written with it can't be read by builds without it.
+#ifndef CONFIG2_ZSTD
+# define CONFIG2_ZSTD 0
+#endif
+
 // default disable valgrind
 #ifndef CONFIG2_VALGRIND
 # define CONFIG2_VALGRIND 0
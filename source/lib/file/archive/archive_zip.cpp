@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -34,9 +34,11 @@
 #include "lib/bits.h"
 #include "lib/byte_order.h"
 #include "lib/allocators/pool.h"
+#include "lib/posix/posix_mman.h"
 #include "lib/sysdep/filesystem.h"
 #include "lib/file/archive/archive.h"
 #include "lib/file/archive/codec_zlib.h"
+#include "lib/file/archive/codec_zstd.h"
 #include "lib/file/archive/stream.h"
 #include "lib/file/file.h"
 #include "lib/file/io/io.h"
@@ -101,7 +103,8 @@ static const u32 ecdr_magic = FOURCC_LE('P','K','\5','\6');
 enum ZipMethod
 {
 	ZIP_METHOD_NONE    = 0,
-	ZIP_METHOD_DEFLATE = 8
+	ZIP_METHOD_DEFLATE = 8,
+	ZIP_METHOD_ZSTD    = 93
 };
 
 #pragma pack(push, 1)
@@ -332,6 +335,11 @@ public:
 		case ZIP_METHOD_DEFLATE:
 			codec = CreateDecompressor_ZLibDeflate();
 			break;
+#if CONFIG2_ZSTD
+		case ZIP_METHOD_ZSTD:
+			codec = CreateDecompressor_ZStd();
+			break;
+#endif
 		default:
 			WARN_RETURN(ERR::ARCHIVE_UNKNOWN_METHOD);
 		}
@@ -349,6 +357,35 @@ public:
 		return INFO::OK;
 	}
 
+	virtual Status Map(const OsPath& UNUSED(name), std::shared_ptr<u8>& buf, size_t size) const
+	{
+		// only stored entries can be used as they are.
+		// (mapping small files is slower than reading them)
+		if(m_method != ZIP_METHOD_NONE || off_t(size) != m_csize || size < minMappedSize)
+			return INFO::SKIPPED;
+
+		AdjustOffset();
+
+		// accessing a mapping beyond the end of the file raises SIGBUS, whereas
+		// reading it merely fails (e.g. if the archive is corrupt or was truncated)
+		struct stat s;
+		if(m_ofs < 0 || wstat(m_file->Pathname(), &s) != 0 || m_ofs + m_csize > off_t(s.st_size))
+			return INFO::SKIPPED;
+
+		// each caller gets its own copy-on-write view, because some
+		// modify the contents in-place (e.g. texture transforms).
+		const off_t mappingOfs = round_down(m_ofs, off_t(mappingAlignment));
+		const size_t mappingSize = size_t(m_ofs - mappingOfs) + size;
+		void* mapping = mmap(0, mappingSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, m_file->Descriptor(), mappingOfs);
+		if(mapping == MAP_FAILED)
+			return INFO::SKIPPED;	// not fatal; the caller uses Load instead
+
+		// the view remains valid for as long as the contents are in use
+		std::shared_ptr<u8> view(static_cast<u8*>(mapping), [mappingSize](u8* p) { munmap(p, mappingSize); });
+		buf = std::shared_ptr<u8>(view, view.get() + (m_ofs - mappingOfs));
+		return INFO::OK;
+	}
+
 private:
 	enum Flags
 	{
@@ -418,6 +455,11 @@ private:
 			m_ofs += (off_t)lfh.Size();
 	}
 
+	// mapping offsets must be multiples of the allocation granularity on Windows
+	// (which is a multiple of the page size elsewhere).
+	static const size_t mappingAlignment = 64*KiB;
+	static const size_t minMappedSize = 64*KiB;
+
 	PFile m_file;
 
 	// all relevant LFH/CDFH fields not covered by CFileInfo
@@ -436,18 +478,25 @@ private:
 class ArchiveReader_Zip : public IArchiveReader
 {
 public:
-	ArchiveReader_Zip(const OsPath& pathname)
-		: m_file(new File(pathname, O_RDONLY))
+	ArchiveReader_Zip(const OsPath& pathname, const PDirectoryIndex& index)
+		: m_file(new File(pathname, O_RDONLY)), m_index(index)
 	{
 		CFileInfo fileInfo;
 		GetFileInfo(pathname, &fileInfo);
 		m_fileSize = fileInfo.Size();
+		m_fileMTime = fileInfo.MTime();
 		const size_t minFileSize = sizeof(LFH)+sizeof(CDFH)+sizeof(ECDR);
 		ENSURE(m_fileSize >= off_t(minFileSize));
 	}
 
 	virtual Status ReadEntries(ArchiveEntryCallback cb, uintptr_t cbData)
 	{
+		// (the index remembers the number of entries followed by the
+		// Central Directory, which spares locating and reading it)
+		const std::vector<u8>* centralDirectory = m_index ? m_index->GetArchiveData(m_file->Pathname(), m_fileSize, m_fileMTime) : 0;
+		if(centralDirectory && centralDirectory->size() >= 4)
+			return ReadCentralDirectory(centralDirectory->data()+4, centralDirectory->size()-4, read_le32(centralDirectory->data()), cb, cbData);
+
 		// locate and read Central Directory
 		off_t cd_ofs = 0;
 		size_t cd_numEntries = 0;
@@ -458,12 +507,28 @@ public:
 		io::Operation op(*m_file.get(), buf.get(), cd_size, cd_ofs);
 		RETURN_STATUS_IF_ERR(io::Run(op));
 
+		RETURN_STATUS_IF_ERR(ReadCentralDirectory(buf.get(), cd_size, cd_numEntries, cb, cbData));
+
+		if(m_index)
+		{
+			std::vector<u8> data(4+cd_size);
+			write_le32(data.data(), u32_from_larger(cd_numEntries));
+			std::copy(buf.get(), buf.get()+cd_size, data.begin()+4);
+			m_index->SetArchiveData(m_file->Pathname(), m_fileSize, m_fileMTime, data);
+		}
+
+		return INFO::OK;
+	}
+
+private:
+	Status ReadCentralDirectory(const u8* buf, size_t cd_size, size_t cd_numEntries, ArchiveEntryCallback cb, uintptr_t cbData)
+	{
 		// iterate over Central Directory
-		const u8* pos = buf.get();
+		const u8* pos = buf;
 		for(size_t i = 0; i < cd_numEntries; i++)
 		{
 			// scan for next CDFH
-			CDFH* cdfh = (CDFH*)FindRecord(buf.get(), cd_size, pos, cdfh_magic, sizeof(CDFH));
+			CDFH* cdfh = (CDFH*)FindRecord(buf, cd_size, pos, cdfh_magic, sizeof(CDFH));
 			if(!cdfh)
 				WARN_RETURN(ERR::CORRUPTED);
 
@@ -482,7 +547,6 @@ public:
 		return INFO::OK;
 	}
 
-private:
 	/**
 	 * Scan buffer for a Zip file record.
 	 *
@@ -594,13 +658,15 @@ private:
 
 	PFile m_file;
 	off_t m_fileSize;
+	time_t m_fileMTime;
+	PDirectoryIndex m_index;
 };
 
-PIArchiveReader CreateArchiveReader_Zip(const OsPath& archivePathname)
+PIArchiveReader CreateArchiveReader_Zip(const OsPath& archivePathname, const PDirectoryIndex& index)
 {
 	try
 	{
-		return PIArchiveReader(new ArchiveReader_Zip(archivePathname));
+		return PIArchiveReader(new ArchiveReader_Zip(archivePathname, index));
 	}
 	catch(Status)
 	{
@@ -616,10 +682,13 @@ PIArchiveReader CreateArchiveReader_Zip(const OsPath& archivePathname)
 class ArchiveWriter_Zip : public IArchiveWriter
 {
 public:
-	ArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate)
+	ArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate, bool useZStd)
 		: m_file(new File(archivePathname, O_WRONLY)), m_fileSize(0)
-		, m_numEntries(0), m_noDeflate(noDeflate)
+		, m_numEntries(0), m_noDeflate(noDeflate), m_useZStd(useZStd)
 	{
+#if !CONFIG2_ZSTD
+		ENSURE(!m_useZStd);
+#endif
 		THROW_STATUS_IF_ERR(pool_create(&m_cdfhPool, 10*MiB, 0));
 	}
 
@@ -684,6 +753,13 @@ public:
 			method = ZIP_METHOD_NONE;
 			codec = CreateCodec_ZLibNone();
 		}
+#if CONFIG2_ZSTD
+		else if(m_useZStd)
+		{
+			method = ZIP_METHOD_ZSTD;
+			codec = CreateCompressor_ZStd();
+		}
+#endif
 		else
 		{
 			method = ZIP_METHOD_DEFLATE;
@@ -770,13 +846,14 @@ private:
 	size_t m_numEntries;
 
 	bool m_noDeflate;
+	bool m_useZStd;
 };
 
-PIArchiveWriter CreateArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate)
+PIArchiveWriter CreateArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate, bool useZStd)
 {
 	try
 	{
-		return PIArchiveWriter(new ArchiveWriter_Zip(archivePathname, noDeflate));
+		return PIArchiveWriter(new ArchiveWriter_Zip(archivePathname, noDeflate, useZStd));
 	}
 	catch(Status)
 	{
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -28,15 +28,21 @@
 #define INCLUDED_ARCHIVE_ZIP
 
 #include "lib/file/archive/archive.h"
+#include "lib/file/common/directory_index.h"
 
 /**
+ * @param index (optional) remembers the Central Directory across runs,
+ * so that it needn't be read from the archive again if that is unchanged.
  * @return 0 if opening the archive failed (e.g. because an external program is holding on to it)
  **/
-PIArchiveReader CreateArchiveReader_Zip(const OsPath& archivePathname);
+PIArchiveReader CreateArchiveReader_Zip(const OsPath& archivePathname, const PDirectoryIndex& index = PDirectoryIndex());
 
 /**
+ * @param noDeflate store all files uncompressed.
+ * @param useZStd compress files with Zstandard (Zip method 93) instead of deflate.
+ * requires CONFIG2_ZSTD; the archive can then only be read by builds with it.
  * @return 0 if opening the archive failed (e.g. because an external program is holding on to it)
  **/
-PIArchiveWriter CreateArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate);
+PIArchiveWriter CreateArchiveWriter_Zip(const OsPath& archivePathname, bool noDeflate, bool useZStd = false);
 
 #endif	// #ifndef INCLUDED_ARCHIVE_ZIP
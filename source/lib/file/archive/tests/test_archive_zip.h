@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -22,10 +22,12 @@
 
 #include "lib/self_test.h"
 
+#include "lib/config2.h"
 #include "lib/file/archive/archive_zip.h"
 #include "lib/file/file_system.h"
 #include "lib/file/io/io.h"
 #include "lib/status.h"
+#include "lib/sysdep/filesystem.h"
 
 #include <iterator>
 #include <string>
@@ -103,7 +105,100 @@ public:
 		TS_ASSERT_EQUALS("buildzipwithcomment.sh", g_ResultBuffer);
 	}
 
+	void test_map_stored()
+	{
+		OsPath testDir = MOD_PATH / "file" / "archive";
+		OsPath testPath = testDir / "stored.zip";
+		TS_ASSERT_EQUALS(INFO::OK, CreateDirectories(testDir, 0700, false));
+
+		// (small entries aren't mapped)
+		std::string contents;
+		for(size_t i = 0; contents.size() < 100*KiB; ++i)
+			contents += "stored archive entry contents " + std::to_string(i);
+		const time_t mtime = 1500000000;
+		{
+			// (deflated unless noDeflate is set)
+			PIArchiveWriter writer = CreateArchiveWriter_Zip(testPath, true);
+			TS_ASSERT_EQUALS(INFO::OK, writer->AddMemory((const u8*)contents.data(), contents.size(), mtime, L"stored.txt"));
+		}
+		{
+			PIArchiveWriter writer = CreateArchiveWriter_Zip(testDir / "deflated.zip", false);
+			TS_ASSERT_EQUALS(INFO::OK, writer->AddMemory((const u8*)contents.data(), contents.size(), mtime, L"deflated.txt"));
+		}
+
+		PIArchiveFile storedFile;
+		{
+			PIArchiveReader reader = CreateArchiveReader_Zip(testPath);
+			TS_ASSERT_DIFFERS(nullptr, reader);
+			TS_ASSERT_EQUALS(INFO::OK, reader->ReadEntries(TestArchiveZip::StoreEntryCallback, (uintptr_t)&storedFile));
+		}
+		TS_ASSERT(storedFile);
+
+		std::shared_ptr<u8> mapped;
+		TS_ASSERT_EQUALS(INFO::OK, storedFile->Map(L"stored.txt", mapped, contents.size()));
+		TS_ASSERT_EQUALS(contents, std::string((const char*)mapped.get(), contents.size()));
+
+		// modifying the contents must neither affect the archive nor later loads
+		mapped.get()[0] = 'X';
+		std::shared_ptr<u8> mappedAgain;
+		TS_ASSERT_EQUALS(INFO::OK, storedFile->Map(L"stored.txt", mappedAgain, contents.size()));
+		TS_ASSERT_EQUALS(contents, std::string((const char*)mappedAgain.get(), contents.size()));
+		std::shared_ptr<u8> loaded(new u8[contents.size()], std::default_delete<u8[]>());
+		TS_ASSERT_EQUALS(INFO::OK, storedFile->Load(L"stored.txt", loaded, contents.size()));
+		TS_ASSERT_EQUALS(contents, std::string((const char*)loaded.get(), contents.size()));
+
+		// entries beyond the end of the archive must be read (which fails) instead of mapped
+		TS_ASSERT_EQUALS(0, wtruncate(testPath, off_t(contents.size()/2)));
+		std::shared_ptr<u8> truncated;
+		TS_ASSERT_EQUALS(INFO::SKIPPED, storedFile->Map(L"stored.txt", truncated, contents.size()));
+
+		PIArchiveFile deflatedFile;
+		PIArchiveReader reader = CreateArchiveReader_Zip(testDir / "deflated.zip");
+		TS_ASSERT_EQUALS(INFO::OK, reader->ReadEntries(TestArchiveZip::StoreEntryCallback, (uintptr_t)&deflatedFile));
+		std::shared_ptr<u8> notMapped;
+		TS_ASSERT_EQUALS(INFO::SKIPPED, deflatedFile->Map(L"deflated.txt", notMapped, contents.size()));
+	}
+
+	void test_zstd()
+	{
+#if CONFIG2_ZSTD
+		OsPath testDir = MOD_PATH / "file" / "archive";
+		OsPath testPath = testDir / "zstd.zip";
+		TS_ASSERT_EQUALS(INFO::OK, CreateDirectories(testDir, 0700, false));
+
+		std::string contents;
+		for(size_t i = 0; contents.size() < 300*KiB; ++i)
+			contents += "zstd archive entry contents " + std::to_string(i);
+		{
+			PIArchiveWriter writer = CreateArchiveWriter_Zip(testPath, false, true);
+			TS_ASSERT_EQUALS(INFO::OK, writer->AddMemory((const u8*)contents.data(), contents.size(), 1500000000, L"zstd.txt"));
+		}
+
+		PIArchiveFile archiveFile;
+		PIArchiveReader reader = CreateArchiveReader_Zip(testPath);
+		TS_ASSERT_DIFFERS(nullptr, reader);
+		TS_ASSERT_EQUALS(INFO::OK, reader->ReadEntries(TestArchiveZip::StoreEntryCallback, (uintptr_t)&archiveFile));
+		TS_ASSERT(archiveFile);
+
+		std::shared_ptr<u8> loaded(new u8[contents.size()], std::default_delete<u8[]>());
+		TS_ASSERT_EQUALS(INFO::OK, archiveFile->Load(L"zstd.txt", loaded, contents.size()));
+		TS_ASSERT_EQUALS(contents, std::string((const char*)loaded.get(), contents.size()));
+
+		std::shared_ptr<u8> notMapped;
+		TS_ASSERT_EQUALS(INFO::SKIPPED, archiveFile->Map(L"zstd.txt", notMapped, contents.size()));
+#endif
+	}
+
 private:
+	static void StoreEntryCallback(
+		const VfsPath& UNUSED(path),
+		const CFileInfo& UNUSED(fileInfo),
+		PIArchiveFile archiveFile,
+		uintptr_t cbData)
+	{
+		*reinterpret_cast<PIArchiveFile*>(cbData) = archiveFile;
+	}
+
 	static void ArchiveEntryCallback(
 		const VfsPath& path,
 		const CFileInfo& UNUSED(fileInfo),
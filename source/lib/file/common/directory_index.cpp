@@ -0,0 +1,408 @@
+/* Copyright (C) 2023 Wildfire Games.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * persistent index of real directory entries
+ */
+
+#include "precompiled.h"
+#include "lib/file/common/directory_index.h"
+
+#include "lib/byte_order.h"
+#include "lib/posix/posix_mman.h"
+#include "lib/sysdep/filesystem.h"
+#include "lib/file/file.h"
+#include "lib/file/io/io.h"
+#include "lib/timer.h"
+#include "lib/utf8.h"
+
+#include <ctime>
+#include <vector>
+
+namespace {
+
+const u32 indexMagic = FOURCC_LE('D','I','D','X');
+// (must be incremented whenever the format changes)
+const u32 indexVersion = 3;
+
+// the index is a sequence of little-endian integers and
+// length-prefixed UTF-8 strings:
+// - magic, version, number of directories
+// - for each directory: path, mtime, number of files, for each file:
+//   name, size and mtime, number of subdirectories, their names.
+// - number of archives, for each: path, size, mtime, length of the
+//   data and the data itself.
+
+class IndexWriter
+{
+public:
+	void U32(u32 x)
+	{
+		u8 bytes[4];
+		write_le32(bytes, x);
+		m_data.insert(m_data.end(), bytes, bytes+ARRAY_SIZE(bytes));
+	}
+
+	void U64(u64 x)
+	{
+		u8 bytes[8];
+		write_le64(bytes, x);
+		m_data.insert(m_data.end(), bytes, bytes+ARRAY_SIZE(bytes));
+	}
+
+	void String(const OsPath& path)
+	{
+		const std::string utf8 = path.string8();
+		U32((u32)utf8.size());
+		m_data.insert(m_data.end(), utf8.begin(), utf8.end());
+	}
+
+	void Bytes(const std::vector<u8>& bytes)
+	{
+		U32((u32)bytes.size());
+		m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+	}
+
+	const std::vector<u8>& Data() const
+	{
+		return m_data;
+	}
+
+private:
+	std::vector<u8> m_data;
+};
+
+// (returns false instead of reading beyond the end of a truncated or corrupt index)
+class IndexReader
+{
+public:
+	IndexReader(const u8* data, size_t size)
+		: m_pos(data), m_end(data+size)
+	{
+	}
+
+	bool U32(u32& x)
+	{
+		if(size_t(m_end-m_pos) < 4)
+			return false;
+		x = read_le32(m_pos);
+		m_pos += 4;
+		return true;
+	}
+
+	bool U64(u64& x)
+	{
+		if(size_t(m_end-m_pos) < 8)
+			return false;
+		x = read_le64(m_pos);
+		m_pos += 8;
+		return true;
+	}
+
+	bool String(OsPath& path)
+	{
+		u32 size;
+		if(!U32(size) || size_t(m_end-m_pos) < size)
+			return false;
+		Status err;
+		path = wstring_from_utf8(std::string((const char*)m_pos, size), &err);
+		m_pos += size;
+		return err == INFO::OK;
+	}
+
+	bool Bytes(std::vector<u8>& bytes)
+	{
+		u32 size;
+		if(!U32(size) || size_t(m_end-m_pos) < size)
+			return false;
+		bytes.assign(m_pos, m_pos+size);
+		m_pos += size;
+		return true;
+	}
+
+	bool AtEnd() const
+	{
+		return m_pos == m_end;
+	}
+
+private:
+	const u8* m_pos;
+	const u8* const m_end;
+};
+
+} // anonymous namespace
+
+
+DirectoryIndex::DirectoryIndex(const OsPath& pathname)
+	: m_pathname(pathname)
+	, m_changed(false), m_numRestored(0), m_numScanned(0), m_numArchivesRestored(0)
+	, m_restoreTime(0.0), m_scanTime(0.0)
+{
+	Load();
+}
+
+
+Status DirectoryIndex::GetDirectoryEntries(const OsPath& path, CFileInfos* files, DirectoryNames* subdirectoryNames)
+{
+	ENSURE(files && subdirectoryNames);
+
+	const double startTime = timer_Time();
+	const time_t scanTime = time(0);
+
+	// (Windows doesn't allow the trailing separator of directory paths)
+	struct stat s;
+	const bool haveMTime = wstat(path.Parent(), &s) == 0;
+
+	std::map<OsPath, Entries>::iterator it = m_entries.find(path);
+	if(haveMTime && it != m_entries.end() && !it->second.used && it->second.mtime == s.st_mtime && FilesUnchanged(path, it->second.files))
+	{
+		files->insert(files->end(), it->second.files.begin(), it->second.files.end());
+		subdirectoryNames->insert(subdirectoryNames->end(), it->second.subdirectoryNames.begin(), it->second.subdirectoryNames.end());
+		it->second.used = true;
+
+		m_numRestored++;
+		m_restoreTime += timer_Time() - startTime;
+		return INFO::OK;
+	}
+
+	CFileInfos scannedFiles;
+	DirectoryNames scannedSubdirectoryNames;
+	RETURN_STATUS_IF_ERR(::GetDirectoryEntries(path, &scannedFiles, &scannedSubdirectoryNames));
+	files->insert(files->end(), scannedFiles.begin(), scannedFiles.end());
+	subdirectoryNames->insert(subdirectoryNames->end(), scannedSubdirectoryNames.begin(), scannedSubdirectoryNames.end());
+
+	// directories and files modified during the current second may change
+	// again without affecting their mtime, so they aren't remembered.
+	bool recentlyModified = !haveMTime || s.st_mtime >= scanTime;
+	for(const CFileInfo& file : scannedFiles)
+		recentlyModified = recentlyModified || file.MTime() >= scanTime;
+	if(!recentlyModified)
+	{
+		Entries& entries = m_entries[path];
+		entries.mtime = s.st_mtime;
+		entries.files.swap(scannedFiles);
+		entries.subdirectoryNames.swap(scannedSubdirectoryNames);
+		entries.used = true;
+	}
+	else
+		m_entries.erase(path);
+
+	m_changed = true;
+	m_numScanned++;
+	m_scanTime += timer_Time() - startTime;
+	return INFO::OK;
+}
+
+
+void DirectoryIndex::Invalidate(const OsPath& path)
+{
+	if(m_entries.erase(path))
+		m_changed = true;
+}
+
+
+const std::vector<u8>* DirectoryIndex::GetArchiveData(const OsPath& pathname, off_t size, time_t mtime)
+{
+	std::map<OsPath, ArchiveData>::iterator it = m_archives.find(pathname);
+	if(it == m_archives.end() || it->second.size != size || it->second.mtime != mtime)
+		return 0;
+
+	it->second.used = true;
+	m_numArchivesRestored++;
+	return &it->second.data;
+}
+
+
+void DirectoryIndex::SetArchiveData(const OsPath& pathname, off_t size, time_t mtime, const std::vector<u8>& data)
+{
+	m_changed = true;
+
+	// (see GetDirectoryEntries)
+	if(mtime >= time(0))
+	{
+		m_archives.erase(pathname);
+		return;
+	}
+
+	ArchiveData& archive = m_archives[pathname];
+	archive.size = size;
+	archive.mtime = mtime;
+	archive.data = data;
+	archive.used = true;
+}
+
+
+Status DirectoryIndex::Save() const
+{
+	u32 numDirectories = 0;
+	bool unchanged = !m_changed;
+	for(const std::pair<const OsPath, Entries>& entries : m_entries)
+	{
+		if(entries.second.used)
+			numDirectories++;
+		else
+			unchanged = false;
+	}
+	u32 numArchives = 0;
+	for(const std::pair<const OsPath, ArchiveData>& archive : m_archives)
+	{
+		if(archive.second.used)
+			numArchives++;
+		else
+			unchanged = false;
+	}
+	if(unchanged)
+		return INFO::SKIPPED;
+
+	IndexWriter writer;
+	writer.U32(indexMagic);
+	writer.U32(indexVersion);
+	writer.U32(numDirectories);
+	for(const std::pair<const OsPath, Entries>& entries : m_entries)
+	{
+		if(!entries.second.used)
+			continue;
+
+		writer.String(entries.first);
+		writer.U64((u64)entries.second.mtime);
+		writer.U32((u32)entries.second.files.size());
+		for(const CFileInfo& file : entries.second.files)
+		{
+			writer.String(file.Name());
+			writer.U64((u64)file.Size());
+			writer.U64((u64)file.MTime());
+		}
+		writer.U32((u32)entries.second.subdirectoryNames.size());
+		for(const OsPath& subdirectoryName : entries.second.subdirectoryNames)
+			writer.String(subdirectoryName);
+	}
+	writer.U32(numArchives);
+	for(const std::pair<const OsPath, ArchiveData>& archive : m_archives)
+	{
+		if(!archive.second.used)
+			continue;
+
+		writer.String(archive.first);
+		writer.U64((u64)archive.second.size);
+		writer.U64((u64)archive.second.mtime);
+		writer.Bytes(archive.second.data);
+	}
+
+	RETURN_STATUS_IF_ERR(CreateDirectories(m_pathname.Parent()/"", 0700, false));
+	return io::Store(m_pathname, writer.Data().data(), writer.Data().size());
+}
+
+
+void DirectoryIndex::Report() const
+{
+	debug_printf("Directory index \"%s\": restored %lu directories in %.1f ms, scanned %lu in %.1f ms, restored %lu archives",
+		m_pathname.string8().c_str(), (unsigned long)m_numRestored, m_restoreTime*1e3, (unsigned long)m_numScanned, m_scanTime*1e3, (unsigned long)m_numArchivesRestored);
+	// (assuming the restored directories would have taken as long to scan as the others)
+	if(m_numScanned && m_numRestored)
+		debug_printf(", saving about %.1f ms", (m_scanTime/m_numScanned - m_restoreTime/m_numRestored) * m_numRestored * 1e3);
+	debug_printf("\n");
+}
+
+
+void DirectoryIndex::Load()
+{
+	if(!FileExists(m_pathname))
+		return;
+
+	File file;
+	const size_t size = (size_t)FileSize(m_pathname);
+	if(size == 0 || file.Open(m_pathname, O_RDONLY) != INFO::OK)
+		return;
+
+	// (parsing the mapping avoids copying the index into a buffer first)
+	void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, file.Descriptor(), 0);
+	if(mapping == MAP_FAILED)
+		return;
+
+	IndexReader reader(static_cast<const u8*>(mapping), size);
+	u32 magic, version, numDirectories;
+	bool ok = reader.U32(magic) && reader.U32(version) && reader.U32(numDirectories)
+		&& magic == indexMagic && version == indexVersion;
+	for(u32 i = 0; ok && i < numDirectories; ++i)
+	{
+		OsPath path;
+		u64 mtime;
+		u32 numFiles;
+		ok = reader.String(path) && reader.U64(mtime) && reader.U32(numFiles);
+		Entries& entries = m_entries[path];
+		entries.mtime = (time_t)mtime;
+		entries.used = false;
+		for(u32 j = 0; ok && j < numFiles; ++j)
+		{
+			OsPath name;
+			u64 fileSize, fileMTime;
+			ok = reader.String(name) && reader.U64(fileSize) && reader.U64(fileMTime);
+			entries.files.push_back(CFileInfo(name, (off_t)fileSize, (time_t)fileMTime));
+		}
+		u32 numSubdirectories;
+		ok = ok && reader.U32(numSubdirectories);
+		for(u32 j = 0; ok && j < numSubdirectories; ++j)
+		{
+			OsPath name;
+			ok = reader.String(name);
+			entries.subdirectoryNames.push_back(name);
+		}
+	}
+	u32 numArchives;
+	ok = ok && reader.U32(numArchives);
+	for(u32 i = 0; ok && i < numArchives; ++i)
+	{
+		OsPath pathname;
+		u64 size, mtime;
+		ok = reader.String(pathname) && reader.U64(size) && reader.U64(mtime);
+		ArchiveData& archive = m_archives[pathname];
+		archive.size = (off_t)size;
+		archive.mtime = (time_t)mtime;
+		archive.used = false;
+		ok = ok && reader.Bytes(archive.data);
+	}
+	ok = ok && reader.AtEnd();
+
+	munmap(mapping, size);
+
+	if(!ok)
+	{
+		// not fatal; the directories are then scanned and the index rewritten.
+		debug_printf("Ignoring invalid directory index \"%s\"\n", m_pathname.string8().c_str());
+		m_entries.clear();
+		m_archives.clear();
+	}
+}
+
+
+bool DirectoryIndex::FilesUnchanged(const OsPath& path, const CFileInfos& files) const
+{
+	// (modifying a file in-place doesn't change the directory's mtime)
+	for(const CFileInfo& file : files)
+	{
+		struct stat s;
+		if(wstat(path / file.Name(), &s) != 0 || s.st_size != file.Size() || s.st_mtime != file.MTime())
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,157 @@
+/* Copyright (C) 2023 Wildfire Games.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * persistent index of real directory entries
+ */
+
+#ifndef INCLUDED_DIRECTORY_INDEX
+#define INCLUDED_DIRECTORY_INDEX
+
+#include "lib/file/file_system.h"	// CFileInfo
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/**
+ * remembers the entries of real directories and the contents of archives
+ * across runs, so that they need not be read again if unchanged (which is
+ * slow on some filesystems, e.g. network shares).
+ *
+ * a directory is considered unchanged if its modification time is.
+ * that is updated whenever entries are added, removed or renamed,
+ * but not when a file is modified in-place, so the size and modification
+ * time of each file are also checked (which only requires a stat per file
+ * rather than reading the directory). archives are checked likewise.
+ **/
+class DirectoryIndex
+{
+	NONCOPYABLE(DirectoryIndex);
+public:
+	/**
+	 * @param pathname of the file in which the index is stored.
+	 * it is loaded immediately (if it exists and is valid) and
+	 * written by Save.
+	 **/
+	DirectoryIndex(const OsPath& pathname);
+
+	/**
+	 * retrieve the entries of a directory, either from the index if
+	 * they are unchanged, or by scanning the directory (and updating the
+	 * index). each directory is only restored once; later calls (e.g. when
+	 * repopulating it after its files have changed) always scan it.
+	 *
+	 * like ::GetDirectoryEntries, the entries are appended to the vectors.
+	 *
+	 * @return Status (see ::GetDirectoryEntries)
+	 **/
+	Status GetDirectoryEntries(const OsPath& path, CFileInfos* files, DirectoryNames* subdirectoryNames);
+
+	/**
+	 * forget the entries of a directory, so that it is scanned
+	 * next time. required after modifying one of its files in-place.
+	 **/
+	void Invalidate(const OsPath& path);
+
+	/**
+	 * write the entries of all directories retrieved since the index was
+	 * loaded. (others are dropped, which ensures the index doesn't keep
+	 * accumulating directories that have since been removed.)
+	 **/
+	Status Save() const;
+
+	/**
+	 * retrieve the data remembered for an archive (e.g. its
+	 * central directory), if its size and mtime are unchanged.
+	 *
+	 * @return 0 if there is none.
+	 **/
+	const std::vector<u8>* GetArchiveData(const OsPath& pathname, off_t size, time_t mtime);
+
+	/**
+	 * remember data describing the contents of an archive, so that it
+	 * can be retrieved next time instead of reading the archive.
+	 **/
+	void SetArchiveData(const OsPath& pathname, off_t size, time_t mtime, const std::vector<u8>& data);
+
+	/**
+	 * log how many directories were restored and scanned so far,
+	 * how long that took and how much time the index saved.
+	 **/
+	void Report() const;
+
+	size_t NumRestored() const
+	{
+		return m_numRestored;
+	}
+
+	size_t NumScanned() const
+	{
+		return m_numScanned;
+	}
+
+	size_t NumArchivesRestored() const
+	{
+		return m_numArchivesRestored;
+	}
+
+private:
+	struct Entries
+	{
+		time_t mtime;
+		CFileInfos files;
+		DirectoryNames subdirectoryNames;
+
+		// whether the entries were retrieved since the index was loaded
+		bool used;
+	};
+
+	struct ArchiveData
+	{
+		off_t size;
+		time_t mtime;
+		std::vector<u8> data;
+
+		// whether the data was retrieved or set since the index was loaded
+		bool used;
+	};
+
+	void Load();
+	bool FilesUnchanged(const OsPath& path, const CFileInfos& files) const;
+
+	OsPath m_pathname;
+	std::map<OsPath, Entries> m_entries;
+	std::map<OsPath, ArchiveData> m_archives;
+	// (whether the entries differ from the stored index)
+	bool m_changed;
+
+	size_t m_numRestored;
+	size_t m_numScanned;
+	size_t m_numArchivesRestored;
+	double m_restoreTime;
+	double m_scanTime;
+};
+
+typedef std::shared_ptr<DirectoryIndex> PDirectoryIndex;
+
+#endif	// #ifndef INCLUDED_DIRECTORY_INDEX
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -34,6 +34,19 @@ struct IFileLoader
 	virtual OsPath Path() const = 0;
 
 	virtual Status Load(const OsPath& name, const std::shared_ptr<u8>& buf, size_t size) const = 0;
+
+	/**
+	 * Optionally provide the file contents without copying them
+	 * (e.g. from a memory mapping), instead of loading them into a new buffer.
+	 * Writing to the returned buffer must not affect the file.
+	 *
+	 * @return INFO::SKIPPED if not supported for this file, in which case
+	 * the caller uses Load.
+	 **/
+	virtual Status Map(const OsPath& UNUSED(name), std::shared_ptr<u8>& UNUSED(buf), size_t UNUSED(size)) const
+	{
+		return INFO::SKIPPED;
+	}
 };
 
 typedef std::shared_ptr<IFileLoader> PIFileLoader;
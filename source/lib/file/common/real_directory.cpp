@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -28,8 +28,8 @@
 #include "lib/file/io/io.h"
 
 
-RealDirectory::RealDirectory(const OsPath& path, size_t priority, size_t flags)
-	: m_path(path), m_priority(priority), m_flags(flags)
+RealDirectory::RealDirectory(const OsPath& path, size_t priority, size_t flags, const PDirectoryIndex& index)
+	: m_path(path), m_priority(priority), m_flags(flags), m_index(index)
 {
 	ENSURE(path.IsDirectory());
 }
@@ -55,6 +55,10 @@ RealDirectory::RealDirectory(const OsPath& path, size_t priority, size_t flags)
 
 Status RealDirectory::Store(const OsPath& name, const std::shared_ptr<u8>& fileContents, size_t size)
 {
+	// (overwriting a file doesn't change the directory's mtime)
+	if(m_index)
+		m_index->Invalidate(m_path);
+
 	return io::Store(m_path / name, fileContents.get(), size);
 }
 
@@ -69,5 +73,5 @@ void RealDirectory::Watch()
 PRealDirectory CreateRealSubdirectory(const PRealDirectory& realDirectory, const OsPath& subdirectoryName)
 {
 	const OsPath path = realDirectory->Path() / subdirectoryName/"";
-	return PRealDirectory(new RealDirectory(path, realDirectory->Priority(), realDirectory->Flags()));
+	return PRealDirectory(new RealDirectory(path, realDirectory->Priority(), realDirectory->Flags(), realDirectory->Index()));
 }
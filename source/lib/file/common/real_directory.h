@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -23,6 +23,7 @@
 #ifndef INCLUDED_REAL_DIRECTORY
 #define INCLUDED_REAL_DIRECTORY
 
+#include "lib/file/common/directory_index.h"
 #include "lib/file/common/file_loader.h"
 #include "lib/sysdep/dir_watch.h"
 
@@ -30,7 +31,11 @@ class RealDirectory : public IFileLoader
 {
 	NONCOPYABLE(RealDirectory);
 public:
-	RealDirectory(const OsPath& path, size_t priority, size_t flags);
+	/**
+	 * @param index (optional) used to retrieve the directory's entries
+	 * when populating it.
+	 **/
+	RealDirectory(const OsPath& path, size_t priority, size_t flags, const PDirectoryIndex& index = PDirectoryIndex());
 
 	size_t Priority() const
 	{
@@ -42,6 +47,11 @@ public:
 		return m_flags;
 	}
 
+	const PDirectoryIndex& Index() const
+	{
+		return m_index;
+	}
+
 	// IFileLoader
 	virtual size_t Precedence() const;
 	virtual wchar_t LocationCode() const;
@@ -65,6 +75,9 @@ private:
 
 	const size_t m_flags;
 
+	// (shared with all subdirectories of the mount)
+	const PDirectoryIndex m_index;
+
 	// note: watches are needed in each directory because some APIs
 	// (e.g. FAM) cannot watch entire trees with one call.
 	PDirWatch m_watch;
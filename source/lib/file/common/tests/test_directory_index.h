@@ -0,0 +1,216 @@
+/* Copyright (C) 2023 Wildfire Games.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "lib/self_test.h"
+
+#include "lib/file/archive/archive_zip.h"
+#include "lib/file/common/directory_index.h"
+#include "lib/file/io/io.h"
+#include "lib/sysdep/filesystem.h"
+
+#include <chrono>
+#include <thread>
+
+class TestDirectoryIndex : public CxxTest::TestSuite
+{
+	OsPath m_testPath;
+	OsPath m_indexPathname;
+
+	void Store(const OsPath& pathname, const std::string& contents)
+	{
+		TS_ASSERT_OK(io::Store(pathname, contents.data(), contents.size()));
+	}
+
+	static void AddArchiveEntry(const VfsPath& pathname, const CFileInfo& fileInfo, PIArchiveFile UNUSED(archiveFile), uintptr_t cbData)
+	{
+		std::vector<std::pair<VfsPath, off_t>>* entries = (std::vector<std::pair<VfsPath, off_t>>*)cbData;
+		entries->emplace_back(pathname, fileInfo.Size());
+	}
+
+public:
+	void setUp()
+	{
+		m_testPath = DataDir() / "_test.index" / "";
+		m_indexPathname = DataDir() / "_test.index.idx";
+		tearDown();
+	}
+
+	void tearDown()
+	{
+		if(DirectoryExists(m_testPath))
+			DeleteDirectory(m_testPath);
+		if(FileExists(m_indexPathname))
+			wunlink(m_indexPathname);
+	}
+
+	void test_restore()
+	{
+		const OsPath path = m_testPath / "directory" / "";
+		TS_ASSERT_OK(CreateDirectories(path / "subdirectory" / "", 0700, false));
+		Store(path / "archive.zip", "archive");
+
+		// (directories modified during the current second aren't remembered)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+		CFileInfos files;
+		DirectoryNames subdirectoryNames;
+		{
+			DirectoryIndex index(m_indexPathname);
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_EQUALS(index.NumRestored(), (size_t)0);
+			TS_ASSERT_OK(index.Save());
+		}
+		TS_ASSERT_EQUALS(files.size(), (size_t)1);
+		TS_ASSERT_EQUALS(subdirectoryNames.size(), (size_t)1);
+
+		{
+			DirectoryIndex index(m_indexPathname);
+			CFileInfos restoredFiles;
+			DirectoryNames restoredSubdirectoryNames;
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &restoredFiles, &restoredSubdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)0);
+			TS_ASSERT_EQUALS(index.NumRestored(), (size_t)1);
+			TS_ASSERT_EQUALS(restoredFiles.size(), files.size());
+			for(size_t i = 0; i < files.size(); ++i)
+			{
+				TS_ASSERT_PATH_EQUALS(restoredFiles[i].Name(), files[i].Name());
+				TS_ASSERT_EQUALS(restoredFiles[i].Size(), files[i].Size());
+				TS_ASSERT_EQUALS(restoredFiles[i].MTime(), files[i].MTime());
+			}
+			TS_ASSERT_EQUALS(restoredSubdirectoryNames.size(), (size_t)1);
+			TS_ASSERT_PATH_EQUALS(restoredSubdirectoryNames[0], subdirectoryNames[0]);
+
+			// (repopulating must pick up changes to the files)
+			restoredFiles.clear();
+			restoredSubdirectoryNames.clear();
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &restoredFiles, &restoredSubdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_OK(index.Save());
+		}
+
+		// modifying an archive in-place doesn't change the directory's mtime
+		Store(path / "archive.zip", "modified archive");
+		files.clear();
+		subdirectoryNames.clear();
+		{
+			DirectoryIndex index(m_indexPathname);
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_EQUALS(index.NumRestored(), (size_t)0);
+			TS_ASSERT_OK(index.Save());
+		}
+
+		// adding an archive does
+		Store(path / "added.zip", "added");
+		files.clear();
+		subdirectoryNames.clear();
+		{
+			DirectoryIndex index(m_indexPathname);
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_EQUALS(files.size(), (size_t)2);
+		}
+	}
+
+	void test_loose_files()
+	{
+		// (modifying loose files in-place doesn't change the directory's mtime)
+		const OsPath path = m_testPath / "directory" / "";
+		TS_ASSERT_OK(CreateDirectories(path, 0700, false));
+		Store(path / "file.txt", "contents");
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+		{
+			DirectoryIndex index(m_indexPathname);
+			CFileInfos files;
+			DirectoryNames subdirectoryNames;
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_OK(index.Save());
+		}
+
+		Store(path / "file.txt", "modified contents");
+		{
+			DirectoryIndex index(m_indexPathname);
+			CFileInfos files;
+			DirectoryNames subdirectoryNames;
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+			TS_ASSERT_EQUALS(index.NumRestored(), (size_t)0);
+			TS_ASSERT_EQUALS(files.size(), (size_t)1);
+			TS_ASSERT_EQUALS(files[0].Size(), (off_t)17);
+		}
+	}
+
+	void test_mod()
+	{
+		// (installed mods consist of mod.json and mod.zip)
+		const OsPath path = m_testPath / "mod" / "";
+		TS_ASSERT_OK(CreateDirectories(path, 0700, false));
+		Store(path / "mod.json", "{}");
+		{
+			PIArchiveWriter writer = CreateArchiveWriter_Zip(path / "mod.zip", false);
+			const std::string contents = "contents";
+			TS_ASSERT_OK(writer->AddMemory((const u8*)contents.data(), contents.size(), 1600000000, "art/file.txt"));
+			TS_ASSERT_OK(writer->AddMemory((const u8*)contents.data(), contents.size(), 1600000000, "gui/file.txt"));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+		for(size_t i = 0; i < 2; ++i)
+		{
+			DirectoryIndex index(m_indexPathname);
+			PDirectoryIndex archiveIndex(&index, [](DirectoryIndex*) {});
+			CFileInfos files;
+			DirectoryNames subdirectoryNames;
+			TS_ASSERT_OK(index.GetDirectoryEntries(path, &files, &subdirectoryNames));
+			TS_ASSERT_EQUALS(files.size(), (size_t)2);
+			TS_ASSERT_EQUALS(index.NumScanned(), (size_t)(i == 0));
+			TS_ASSERT_EQUALS(index.NumRestored(), (size_t)(i == 1));
+
+			std::vector<std::pair<VfsPath, off_t>> entries;
+			PIArchiveReader reader = CreateArchiveReader_Zip(path / "mod.zip", archiveIndex);
+			TS_ASSERT(reader);
+			TS_ASSERT_OK(reader->ReadEntries(AddArchiveEntry, (uintptr_t)&entries));
+			TS_ASSERT_EQUALS(index.NumArchivesRestored(), (size_t)i);
+			TS_ASSERT_EQUALS(entries.size(), (size_t)2);
+			for(const std::pair<VfsPath, off_t>& entry : entries)
+				TS_ASSERT_EQUALS(entry.second, (off_t)8);
+
+			index.Save();
+		}
+	}
+
+	void test_invalid_index()
+	{
+		TS_ASSERT_OK(CreateDirectories(m_testPath, 0700, false));
+		Store(m_indexPathname, "not an index");
+
+		DirectoryIndex index(m_indexPathname);
+		CFileInfos files;
+		DirectoryNames subdirectoryNames;
+		TS_ASSERT_OK(index.GetDirectoryEntries(m_testPath, &files, &subdirectoryNames));
+		TS_ASSERT_EQUALS(index.NumScanned(), (size_t)1);
+	}
+};
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -24,7 +24,9 @@
 #include "lib/file/vfs/vfs.h"
 
 #include "lib/allocators/shared_ptr.h"
+#include "lib/fnv_hash.h"
 #include "lib/file/file_system.h"
+#include "lib/file/common/directory_index.h"
 #include "lib/file/common/file_stats.h"
 #include "lib/file/common/trace.h"
 #include "lib/file/archive/archive.h"
@@ -48,10 +50,21 @@ static std::mutex vfs_mutex;
 class VFS : public IVFS
 {
 public:
-	VFS() : m_trace(CreateDummyTrace(8*MiB))
+	VFS(const OsPath& indexDirectory)
+		: m_trace(CreateDummyTrace(8*MiB)), m_indexDirectory(indexDirectory)
 	{
 	}
 
+	~VFS()
+	{
+		// remember the directories populated during this run
+		for(const std::pair<const OsPath, PDirectoryIndex>& index : m_indices)
+		{
+			if(index.second->Save() < 0)
+				debug_printf("Failed to save the directory index of \"%s\"\n", index.first.string8().c_str());
+		}
+	}
+
 	virtual Status Mount(const VfsPath& mountPoint, const OsPath& path, size_t flags /* = 0 */, size_t priority /* = 0 */)
 	{
 		ENSURE(path.IsDirectory());
@@ -68,7 +81,11 @@ public:
 		VfsDirectory* directory;
 		WARN_RETURN_STATUS_IF_ERR(vfs_Lookup(mountPoint, &m_rootDirectory, directory, 0, VFS_LOOKUP_ADD|VFS_LOOKUP_SKIP_POPULATE));
 
-		PRealDirectory realDirectory(new RealDirectory(path, priority, flags));
+		PDirectoryIndex index;
+		if((flags & VFS_MOUNT_INDEX) && !m_indexDirectory.empty())
+			index = GetIndex(path);
+
+		PRealDirectory realDirectory(new RealDirectory(path, priority, flags, index));
 		RETURN_STATUS_IF_ERR(vfs_Attach(directory, realDirectory));
 		return INFO::OK;
 	}
@@ -161,8 +178,15 @@ public:
 		fileContents = DummySharedPtr((u8*)0);
 		size = file->Size();
 
-		RETURN_STATUS_IF_ERR(AllocateAligned(fileContents, size, maxSectorSize));
-		RETURN_STATUS_IF_ERR(file->Loader()->Load(file->Name(), fileContents, file->Size()));
+		// avoid allocating and copying if the loader can provide the contents directly
+		const Status mapped = file->Loader()->Map(file->Name(), fileContents, size);
+		if(mapped == INFO::SKIPPED)
+		{
+			RETURN_STATUS_IF_ERR(AllocateAligned(fileContents, size, maxSectorSize));
+			RETURN_STATUS_IF_ERR(file->Loader()->Load(file->Name(), fileContents, file->Size()));
+		}
+		else
+			RETURN_STATUS_IF_ERR(mapped);
 
 		stats_io_user_request(size);
 		m_trace->NotifyLoad(pathname, size);
@@ -248,7 +272,35 @@ public:
 		m_rootDirectory.Clear();
 	}
 
+	virtual void ReportPopulation() const
+	{
+		std::lock_guard<std::mutex> lock(vfs_mutex);
+		size_t numDirectories;
+		double time;
+		vfs_GetPopulateStatistics(numDirectories, time);
+		debug_printf("VFS: populated %lu directories in %.1f ms\n", (unsigned long)numDirectories, time*1e3);
+		for(const std::pair<const OsPath, PDirectoryIndex>& index : m_indices)
+			index.second->Report();
+	}
+
 private:
+	/**
+	 * @return the index of the given mounted real directory,
+	 * which is shared if the directory is mounted multiple times.
+	 **/
+	PDirectoryIndex GetIndex(const OsPath& path)
+	{
+		PDirectoryIndex& index = m_indices[path];
+		if(!index)
+		{
+			const std::string pathString = path.string8();
+			char name[32];
+			sprintf_s(name, ARRAY_SIZE(name), "%016llx.idx", (unsigned long long)fnv_hash64(pathString.c_str(), pathString.length()));
+			index = std::make_shared<DirectoryIndex>(m_indexDirectory / name);
+		}
+		return index;
+	}
+
 	Status FindRealPathR(const OsPath& realPath, const VfsDirectory& directory, const VfsPath& curPath, VfsPath& path)
 	{
 		PRealDirectory realDirectory = directory.AssociatedDirectory();
@@ -273,11 +325,14 @@ private:
 
 	PITrace m_trace;
 	mutable VfsDirectory m_rootDirectory;
+
+	OsPath m_indexDirectory;
+	std::map<OsPath, PDirectoryIndex> m_indices;
 };
 
 //-----------------------------------------------------------------------------
 
-PIVFS CreateVfs()
+PIVFS CreateVfs(const OsPath& indexDirectory)
 {
-	return PIVFS(new VFS());
+	return PIVFS(new VFS(indexDirectory));
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -68,7 +68,17 @@ enum VfsMountFlags
 	 * ".DELETED" suffix will still apply.
 	 * (the default behavior is to hide both the suffixed and unsuffixed files)
 	 **/
-	VFS_MOUNT_KEEP_DELETED = 8
+	VFS_MOUNT_KEEP_DELETED = 8,
+
+	/**
+	 * remember the entries of all real directories mounted during this
+	 * operation, so that those which haven't changed needn't be scanned
+	 * when they are populated in later runs (see DirectoryIndex).
+	 * only suitable for directories whose files aren't edited in-place
+	 * by other programs. has no effect unless the VFS was created with
+	 * an index directory.
+	 **/
+	VFS_MOUNT_INDEX = 16
 };
 
 // (member functions are thread-safe after the instance has been
@@ -215,6 +225,12 @@ struct IVFS
 	 * NB: open files are not affected.
 	 **/
 	virtual void Clear() = 0;
+
+	/**
+	 * log how long populating the directories has taken so far and, for
+	 * mounts with VFS_MOUNT_INDEX, how much of that their indices saved.
+	 **/
+	virtual void ReportPopulation() const = 0;
 };
 
 typedef std::shared_ptr<IVFS> PIVFS;
@@ -224,7 +240,11 @@ typedef std::shared_ptr<IVFS> PIVFS;
  *
  * note: there is no limitation to a single instance, it may make sense
  * to create and destroy VFS instances during each unit test.
+ *
+ * @param indexDirectory (optional) real directory in which the indices of
+ * mounts with VFS_MOUNT_INDEX are stored. they are written when the
+ * VFS is destroyed.
  **/
-PIVFS CreateVfs();
+PIVFS CreateVfs(const OsPath& indexDirectory = OsPath());
 
 #endif	// #ifndef INCLUDED_VFS
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -131,11 +131,12 @@ Status vfs_Lookup(const VfsPath& pathname, VfsDirectory* startDirectory, VfsDire
 			else if (!DirectoryExists(currentPath))
 				return ERR::VFS_DIR_NOT_FOUND;
 
-			// Propagate priority and flags to the subdirectory.
+			// Propagate priority, flags and index to the subdirectory.
 			// If it already existed, it will be replaced & the memory freed.
 			PRealDirectory realDirectory(new RealDirectory(currentPath,
 				realDir ? realDir->Priority() : 0,
-				realDir ? realDir->Flags() : 0)
+				realDir ? realDir->Flags() : 0,
+				realDir ? realDir->Index() : PDirectoryIndex())
 			);
 			RETURN_STATUS_IF_ERR(vfs_Attach(subdirectory, realDirectory));
 		}
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -31,6 +31,12 @@
 #include "lib/file/vfs/vfs_tree.h"
 #include "lib/file/vfs/vfs_lookup.h"
 #include "lib/file/vfs/vfs.h"	// error codes
+#include "lib/timer.h"
+
+// (guarded by the VFS mutex, like the rest of this module)
+static size_t numPopulatedDirectories;
+static double populateTime;
+static size_t populateDepth;
 
 struct CompareFileInfoByName
 {
@@ -55,7 +61,11 @@ public:
 	{
 		CFileInfos files; files.reserve(500);
 		DirectoryNames subdirectoryNames; subdirectoryNames.reserve(50);
-		RETURN_STATUS_IF_ERR(GetDirectoryEntries(m_realDirectory->Path(), &files, &subdirectoryNames));
+		const PDirectoryIndex& index = m_realDirectory->Index();
+		if(index)
+			RETURN_STATUS_IF_ERR(index->GetDirectoryEntries(m_realDirectory->Path(), &files, &subdirectoryNames));
+		else
+			RETURN_STATUS_IF_ERR(GetDirectoryEntries(m_realDirectory->Path(), &files, &subdirectoryNames));
 
 		// Since .DELETED files only remove files in lower priority mods
 		// loose files and archive files have no conflicts so we do not need
@@ -116,7 +126,7 @@ private:
 			const OsPath pathname = path / files[i].Name();
 			if(pathname.Extension() == L".zip")
 			{
-				PIArchiveReader archiveReader = CreateArchiveReader_Zip(pathname);
+				PIArchiveReader archiveReader = CreateArchiveReader_Zip(pathname, m_realDirectory->Index());
 				// archiveReader == nullptr if file could not be opened (e.g. because
 				// archive is currently open in another program)
 				if(archiveReader)
@@ -159,13 +169,28 @@ Status vfs_Populate(VfsDirectory* directory)
 	if(realDirectory->Flags() & VFS_MOUNT_WATCH)
 		realDirectory->Watch();
 
+	// (populating a directory may populate others, which mustn't be counted twice)
+	const double startTime = timer_Time();
+	populateDepth++;
 	PopulateHelper helper(directory, realDirectory);
-	RETURN_STATUS_IF_ERR(helper.AddEntries());
+	const Status ret = helper.AddEntries();
+	populateDepth--;
+	numPopulatedDirectories++;
+	if(populateDepth == 0)
+		populateTime += timer_Time() - startTime;
+	RETURN_STATUS_IF_ERR(ret);
 
 	return INFO::OK;
 }
 
 
+void vfs_GetPopulateStatistics(size_t& numDirectories, double& time)
+{
+	numDirectories = numPopulatedDirectories;
+	time = populateTime;
+}
+
+
 Status vfs_Attach(VfsDirectory* directory, const PRealDirectory& realDirectory)
 {
 	PRealDirectory existingRealDir = directory->AssociatedDirectory();
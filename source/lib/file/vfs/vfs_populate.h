@@ -1,4 +1,4 @@
-/* Copyright (C) 2010 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -54,4 +54,10 @@ extern Status vfs_Attach(VfsDirectory* directory, const PRealDirectory& realDire
  **/
 extern Status vfs_Populate(VfsDirectory* directory);
 
+/**
+ * retrieve how many directories (of all VFS instances) have been
+ * populated so far, and the total time [s] that took.
+ **/
+extern void vfs_GetPopulateStatistics(size_t& numDirectories, double& time);
+
 #endif	// #ifndef INCLUDED_VFS_POPULATE
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -24,7 +24,7 @@
 
 #include "lib/sysdep/arch/x86_x64/simd.h"
 
-#if COMPILER_HAS_SSE
+#if COMPILER_HAS_SSE || COMPILER_HAS_SSE2
 #include "lib/code_generation.h"
 #include "lib/debug.h"
 #include "lib/sysdep/arch.h"
@@ -32,7 +32,9 @@
 #if ARCH_X86_X64
 #include "lib/sysdep/arch/x86_x64/x86_x64.h"
 #endif
+#endif
 
+#if COMPILER_HAS_SSE
 bool HostHasSSE()
 {
 #if ARCH_X86_X64
@@ -44,3 +46,16 @@ bool HostHasSSE()
 #endif
 }
 #endif
+
+#if COMPILER_HAS_SSE2
+bool HostHasSSE2()
+{
+#if ARCH_X86_X64
+	return x86_x64::Cap(x86_x64::CAP_SSE2);
+#elif ARCH_E2K
+	return true;
+#else
+	return false;
+#endif
+}
+#endif
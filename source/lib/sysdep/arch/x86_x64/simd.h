@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  *
  * Permission is hereby granted, free of charge, to any person obtaining
  * a copy of this software and associated documentation files (the
@@ -29,4 +29,8 @@
 extern bool HostHasSSE();
 #endif
 
+#if COMPILER_HAS_SSE2
+extern bool HostHasSSE2();
+#endif
+
 #endif // INCLUDED_SSE
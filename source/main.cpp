@@ -525,6 +525,7 @@ static void RunGameOrAtlas(const PS::span<const char* const> argv)
 
 	const bool isVisualReplay = args.Has("replay-visual");
 	const bool isNonVisualReplay = args.Has("replay");
+	const bool isBatchReplay = args.Has("replay-batch");
 	const bool isNonVisual = args.Has("autostart-nonvisual");
 	const bool isUsingRLInterface = args.Has("rl-interface");
 
@@ -546,6 +547,16 @@ static void RunGameOrAtlas(const PS::span<const char* const> argv)
 		}
 	}
 
+	if (isBatchReplay)
+	{
+		for (const CStr& path : args.GetMultiple("replay-batch"))
+			if (!FileExists(OsPath(path)) && !DirectoryExists(OsPath(path)))
+			{
+				debug_printf("ERROR: The requested replay path '%s' does not exist!\n", path.c_str());
+				return;
+			}
+	}
+
 	std::vector<OsPath> modsToInstall;
 	for (const CStr& arg : args.GetArgsWithoutName())
 	{
@@ -606,6 +617,30 @@ static void RunGameOrAtlas(const PS::span<const char* const> argv)
 		return;
 	}
 
+	if (isBatchReplay)
+	{
+		Paths paths(args);
+		g_VFS = CreateVfs();
+		// Mount with highest priority, we don't want mods overwriting this.
+		g_VFS->Mount(L"cache/", paths.Cache(), VFS_MOUNT_ARCHIVABLE, VFS_MAX_PRIORITY);
+
+		{
+			CBatchReplayPlayer replays;
+			for (const CStr& path : args.GetMultiple("replay-batch"))
+				replays.Add(OsPath(path));
+			replays.Replay(
+				args.Has("replay-jobs") ? args.Get("replay-jobs").ToUInt() : 0,
+				!args.Has("hashtest-full") || args.Get("hashtest-full") == "true",
+				args.Has("hashtest-quick") && args.Get("hashtest-quick") == "true",
+				args.Has("replay-report") ? OsPath(args.Get("replay-report")) : psLogDir() / L"replay-batch.json");
+		}
+
+		g_VFS.reset();
+
+		CXeromyces::Terminate();
+		return;
+	}
+
 	// run in archive-building mode if requested
 	if (args.Has("archivebuild"))
 	{
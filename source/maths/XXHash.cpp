@@ -0,0 +1,162 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "precompiled.h"
+
+// Implements the XXH64 algorithm as specified in
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+#include "XXHash.h"
+
+#include "lib/byte_order.h"
+
+namespace
+{
+const u64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const u64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const u64 PRIME64_3 = 0x165667B19E3779F9ULL;
+const u64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const u64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// (Unaligned little-endian reads, inlined unlike read_le64/read_le32)
+inline u64 Read64(const u8* p)
+{
+	u64 x;
+	memcpy(&x, p, sizeof(x));
+	return to_le64(x);
+}
+
+inline u32 Read32(const u8* p)
+{
+	u32 x;
+	memcpy(&x, p, sizeof(x));
+	return to_le32(x);
+}
+
+inline u64 RotateLeft(u64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline u64 Round(u64 acc, u64 input)
+{
+	acc += input * PRIME64_2;
+	acc = RotateLeft(acc, 31);
+	return acc * PRIME64_1;
+}
+
+inline u64 MergeRound(u64 acc, u64 val)
+{
+	acc ^= Round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+} // anonymous namespace
+
+XXHash64::XXHash64()
+{
+	InitState();
+}
+
+void XXHash64::InitState()
+{
+	// We always use a seed of 0
+	m_Acc[0] = PRIME64_1 + PRIME64_2;
+	m_Acc[1] = PRIME64_2;
+	m_Acc[2] = 0;
+	m_Acc[3] = 0 - PRIME64_1;
+	m_BufLen = 0;
+	m_InputLen = 0;
+}
+
+void XXHash64::Transform(const u8* in)
+{
+	for (size_t i = 0; i < 4; ++i)
+		m_Acc[i] = Round(m_Acc[i], Read64(in + i * 8));
+}
+
+void XXHash64::UpdateRest(const u8* data, size_t len)
+{
+	const size_t CHUNK_SIZE = sizeof(m_Buf);
+
+	// Add as much data as possible to the buffer
+	size_t n = CHUNK_SIZE - m_BufLen;
+	memcpy(m_Buf + m_BufLen, data, n);
+	data += n;
+	len -= n;
+
+	// Flush the (now full) buffer
+	Transform(m_Buf);
+
+	// Process whole chunks of the input
+	while (len >= CHUNK_SIZE)
+	{
+		Transform(data);
+		data += CHUNK_SIZE;
+		len -= CHUNK_SIZE;
+	}
+
+	// Add the remaining data to the buffer
+	memcpy(m_Buf, data, len);
+	m_BufLen = len;
+}
+
+void XXHash64::Final(u8* digest)
+{
+	u64 h;
+	if (m_InputLen >= sizeof(m_Buf))
+	{
+		h = RotateLeft(m_Acc[0], 1) + RotateLeft(m_Acc[1], 7) + RotateLeft(m_Acc[2], 12) + RotateLeft(m_Acc[3], 18);
+		for (size_t i = 0; i < 4; ++i)
+			h = MergeRound(h, m_Acc[i]);
+	}
+	else
+		h = PRIME64_5;
+
+	h += m_InputLen;
+
+	// Consume the buffered bytes
+	const u8* p = m_Buf;
+	size_t len = m_BufLen;
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		h ^= Round(0, Read64(p));
+		h = RotateLeft(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (len >= 4)
+	{
+		h ^= (u64)Read32(p) * PRIME64_1;
+		h = RotateLeft(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+		len -= 4;
+	}
+	for (; len > 0; ++p, --len)
+	{
+		h ^= *p * PRIME64_5;
+		h = RotateLeft(h, 11) * PRIME64_1;
+	}
+
+	// Avalanche
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	write_be64(digest, h);
+
+	InitState();
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_XXHASH
+#define INCLUDED_XXHASH
+
+#include <cstring>
+
+/**
+ * XXH64 non-cryptographic hashing algorithm. Much faster than MD5, and good
+ * enough for detecting unintended changes, but must not be used for anything
+ * that requires security.
+ *
+ * The digest is written in the canonical (big-endian) byte order.
+ */
+class XXHash64
+{
+public:
+	static const size_t DIGESTSIZE = 8;
+
+	XXHash64();
+
+	void Update(const u8* data, size_t len)
+	{
+		// (Defined inline for efficiency in the common small-input case)
+
+		const size_t CHUNK_SIZE = sizeof(m_Buf);
+
+		m_InputLen += len;
+
+		// If we have enough space in m_Buf and won't flush, simply append the input
+		if (m_BufLen + len < CHUNK_SIZE)
+		{
+			memcpy(m_Buf + m_BufLen, data, len);
+			m_BufLen += len;
+			return;
+		}
+
+		// Fall back to non-inline function if we have to do more work
+		UpdateRest(data, len);
+	}
+
+	/**
+	 * Writes the digest of the input and resets the state, like MD5::Final.
+	 */
+	void Final(u8* digest);
+
+private:
+	void InitState();
+	void UpdateRest(const u8* data, size_t len);
+	void Transform(const u8* in);
+	u64 m_Acc[4]; // internal state
+	u8 m_Buf[32]; // buffered input bytes
+	size_t m_BufLen; // bytes in m_Buf that are valid
+	u64 m_InputLen; // bytes
+};
+
+#endif // INCLUDED_XXHASH
@@ -0,0 +1,89 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "maths/XXHash.h"
+#include "ps/Util.h"
+
+class TestXXHash : public CxxTest::TestSuite
+{
+public:
+	std::string decode(u8* digest)
+	{
+		return Hexify(digest, XXHash64::DIGESTSIZE);
+	}
+
+	void compare(const char* input, const char* expected)
+	{
+		u8 digest[XXHash64::DIGESTSIZE];
+
+		XXHash64 m;
+		m.Update((const u8*)input, strlen(input));
+		m.Final(digest);
+
+		TSM_ASSERT_STR_EQUALS(input, decode(digest), expected);
+	}
+
+	void test_reference()
+	{
+		compare("", "ef46db3751d8e999");
+		compare("a", "d24ec4f1a98c6e5b");
+		compare("abc", "44bc2cf5ad770999");
+		compare("message digest", "066ed728fceeb3be");
+		compare("abcdefghijklmnopqrstuvwxyz", "cfe1f278fa89835c");
+		compare("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+			"aaa46907d3047814");
+	}
+
+	void test_align_long()
+	{
+		// Make sure it's not sensitive to alignment
+		// when processing long chunks (where it won't memcpy to an intermediate buffer)
+		std::string a0 (1000, 'a');
+		std::string a1 ("?" + a0);
+		std::string a2 ("??" + a0);
+		std::string a3 ("???" + a0);
+		compare(a0.c_str()+0, "56e43b712eda4223");
+		compare(a1.c_str()+1, "56e43b712eda4223");
+		compare(a2.c_str()+2, "56e43b712eda4223");
+		compare(a3.c_str()+3, "56e43b712eda4223");
+	}
+
+	void test_split()
+	{
+		// Make sure the result doesn't depend on how the input is split across Update calls
+		std::string a0 (1000, 'a');
+		u8 digest[XXHash64::DIGESTSIZE];
+		for (size_t step : { 1, 7, 31, 32, 33, 500 })
+		{
+			XXHash64 m;
+			for (size_t i = 0; i < a0.size(); i += step)
+				m.Update((const u8*)a0.data() + i, std::min(step, a0.size() - i));
+			m.Final(digest);
+			TS_ASSERT_STR_EQUALS(decode(digest), "56e43b712eda4223");
+		}
+
+		// Final resets the state
+		XXHash64 m;
+		m.Update((const u8*)a0.data(), a0.size());
+		m.Final(digest);
+		m.Update((const u8*)"abc", 3);
+		m.Final(digest);
+		TS_ASSERT_STR_EQUALS(decode(digest), "44bc2cf5ad770999");
+	}
+};
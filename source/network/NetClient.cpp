@@ -51,8 +51,25 @@
  */
 constexpr u32 NETWORK_BAD_PING = DEFAULT_TURN_LENGTH * COMMAND_DELAY_MP / 2;
 
+/**
+ * Size of the compressed chunks of the game state handed to the file transferer
+ * while serializing it for a rejoining player.
+ */
+constexpr size_t REJOIN_STATE_CHUNK_SIZE = 16 * KiB;
+
 CNetClient *g_NetClient = NULL;
 
+// The rejoin state is compressed with Zstandard if available, since it
+// decompresses much faster than zlib while the rejoining player waits.
+// (All players of a game need to be built with the same CONFIG2_ZSTD.)
+#if CONFIG2_ZSTD
+using RejoinStateCompressor = CZStdStreamCompressor;
+using RejoinStateDecompressor = CZStdStreamDecompressor;
+#else
+using RejoinStateCompressor = CZLibStreamCompressor;
+using RejoinStateDecompressor = CZLibStreamDecompressor;
+#endif
+
 /**
  * Async task for receiving the initial game state when rejoining an
  * in-progress network game.
@@ -66,12 +83,24 @@ public:
 	{
 	}
 
+	virtual bool OnData(const std::string& data)
+	{
+		// Decompress the state while it's being downloaded
+		return m_Decompressor.Decompress(data, m_State);
+	}
+
 	virtual void OnComplete()
 	{
 		// We've received the game state from the server
 
+		if (!m_Decompressor.IsFinished())
+		{
+			LOGERROR("Net client: Received incomplete game state");
+			return;
+		}
+
 		// Save it so we can use it after the map has finished loading
-		m_Client.m_JoinSyncBuffer = m_Buffer;
+		m_Client.m_JoinSyncBuffer = std::move(m_State);
 
 		// Pretend the server told us to start the game
 		CGameStartMessage start;
@@ -82,6 +111,8 @@ public:
 private:
 	CNetClient& m_Client;
 	CStr m_InitAttributes;
+	RejoinStateDecompressor m_Decompressor;
+	std::string m_State;
 };
 
 CNetClient::CNetClient(CGame* game) :
@@ -560,7 +591,19 @@ bool CNetClient::HandleMessage(CNetMessage* message)
 		// TODO: we should support different transfer request types, instead of assuming
 		// it's always requesting the simulation state
 
-		std::stringstream stream;
+		CNetFileTransferer& fileTransferer = m_Session->GetFileTransferer();
+		const u32 requestID = reqMessage->m_RequestID;
+		fileTransferer.StartStreamedResponse(requestID);
+
+		// Compress the content to save bandwidth while serializing it,
+		// and start sending the compressed chunks as soon as they are ready
+		// (no acks are processed while serializing, so that's only the first window;
+		// the rest is sent by later polls)
+		// (TODO: if this is still too large, compressing with e.g. LZMA works much better)
+		RejoinStateCompressor compressor(REJOIN_STATE_CHUNK_SIZE, [&fileTransferer, requestID](const std::string& chunk) {
+			fileTransferer.AppendResponseData(requestID, chunk);
+		});
+		std::ostream stream(&compressor);
 
 		LOGMESSAGERENDER("Serializing game at turn %u for rejoining player", m_ClientTurnManager->GetCurrentTurn());
 		u32 turn = to_le32(m_ClientTurnManager->GetCurrentTurn());
@@ -569,12 +612,8 @@ bool CNetClient::HandleMessage(CNetMessage* message)
 		bool ok = m_Game->GetSimulation2()->SerializeState(stream);
 		ENSURE(ok);
 
-		// Compress the content with zlib to save bandwidth
-		// (TODO: if this is still too large, compressing with e.g. LZMA works much better)
-		std::string compressed;
-		CompressZLib(stream.str(), compressed, true);
-
-		m_Session->GetFileTransferer().StartResponse(reqMessage->m_RequestID, compressed);
+		compressor.Finish();
+		fileTransferer.FinishResponse(requestID);
 
 		return true;
 	}
@@ -593,10 +632,9 @@ void CNetClient::LoadFinished()
 		// We're rejoining a game, and just finished loading the initial map,
 		// so deserialize the saved game state now
 
-		std::string state;
-		DecompressZLib(m_JoinSyncBuffer, state, true);
-
-		std::stringstream stream(state);
+		// The state was already decompressed while downloading it
+		std::stringstream stream(std::move(m_JoinSyncBuffer));
+		m_JoinSyncBuffer.clear();
 
 		u32 turn;
 		stream.read((char*)&turn, sizeof(turn));
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -51,16 +51,22 @@ Status CNetFileTransferer::OnFileTransferResponse(const CFileTransferResponseMes
 		return ERR::FAIL;
 	}
 
-	if (message.m_Length == 0 || message.m_Length > MAX_FILE_TRANSFER_SIZE)
+	CNetFileReceiveTask& task = *it->second;
+
+	if (message.m_Length == 0 || message.m_Length > MAX_FILE_TRANSFER_SIZE || message.m_Length < task.m_ReceivedLength)
 	{
-		LOGERROR("Net transfer: Invalid size for file transfer response (length=%lu)", message.m_Length);
+		LOGERROR("Net transfer: Invalid size for file transfer response (length=%lu received=%zu)", message.m_Length, task.m_ReceivedLength);
 		return ERR::FAIL;
 	}
 
-	CNetFileReceiveTask& task = *it->second;
-
 	task.m_Length = message.m_Length;
-	task.m_Buffer.reserve(message.m_Length);
+
+	// Streamed responses are only sent after their data, which might all have arrived already
+	if (task.m_ReceivedLength == task.m_Length)
+	{
+		CompleteTask(task);
+		return INFO::OK;
+	}
 
 	LOGMESSAGERENDER("Downloading data over network (%lu KB) - please wait...", task.m_Length / 1024);
 	m_LastProgressReportTime = timer_Time();
@@ -79,11 +85,19 @@ Status CNetFileTransferer::OnFileTransferData(const CFileTransferDataMessage& me
 
 	CNetFileReceiveTask& task = *it->second;
 
-	task.m_Buffer += message.m_Data;
+	task.m_ReceivedLength += message.m_Data.size();
+
+	// The length is unknown until the response of a streamed transfer
+	const size_t maxLength = task.m_Length != 0 ? task.m_Length : MAX_FILE_TRANSFER_SIZE;
+	if (task.m_ReceivedLength > maxLength)
+	{
+		LOGERROR("Net transfer: Invalid size for file transfer data (length=%lu actual=%zu)", task.m_Length, task.m_ReceivedLength);
+		return ERR::FAIL;
+	}
 
-	if (task.m_Buffer.size() > task.m_Length)
+	if (!task.OnData(message.m_Data))
 	{
-		LOGERROR("Net transfer: Invalid size for file transfer data (length=%lu actual=%zu)", task.m_Length, task.m_Buffer.size());
+		LOGERROR("Net transfer: Invalid file transfer data (id=%lu)", message.m_RequestID);
 		return ERR::FAIL;
 	}
 
@@ -92,12 +106,9 @@ Status CNetFileTransferer::OnFileTransferData(const CFileTransferDataMessage& me
 	ackMessage.m_NumPackets = 1; // TODO: would be nice to send a single ack for multiple packets at once
 	m_Session->SendMessage(&ackMessage);
 
-	if (task.m_Buffer.size() == task.m_Length)
+	if (task.m_ReceivedLength == task.m_Length)
 	{
-		LOGMESSAGERENDER("Download completed");
-
-		task.OnComplete();
-		m_FileReceiveTasks.erase(message.m_RequestID);
+		CompleteTask(task);
 		return INFO::OK;
 	}
 
@@ -107,13 +118,26 @@ Status CNetFileTransferer::OnFileTransferData(const CFileTransferDataMessage& me
 	double t = timer_Time();
 	if (t > m_LastProgressReportTime + 0.5)
 	{
-		LOGMESSAGERENDER("Downloading data: %.1f%% of %lu KB", 100.f * task.m_Buffer.size() / task.m_Length, task.m_Length / 1024);
+		if (task.m_Length != 0)
+			LOGMESSAGERENDER("Downloading data: %.1f%% of %lu KB", 100.f * task.m_ReceivedLength / task.m_Length, task.m_Length / 1024);
+		else
+			LOGMESSAGERENDER("Downloading data: %lu KB", task.m_ReceivedLength / 1024);
 		m_LastProgressReportTime = t;
 	}
 
 	return INFO::OK;
 }
 
+void CNetFileTransferer::CompleteTask(CNetFileReceiveTask& task)
+{
+	LOGMESSAGERENDER("Download completed");
+
+	// Keep the task alive until OnComplete returns
+	const std::shared_ptr<CNetFileReceiveTask> taskPtr = m_FileReceiveTasks.at(task.m_RequestID);
+	m_FileReceiveTasks.erase(task.m_RequestID);
+	task.OnComplete();
+}
+
 Status CNetFileTransferer::OnFileTransferAck(const CFileTransferAckMessage& message)
 {
 	FileSendTasksMap::iterator it = m_FileSendTasks.find(message.m_RequestID);
@@ -151,40 +175,85 @@ void CNetFileTransferer::StartTask(const std::shared_ptr<CNetFileReceiveTask>& t
 }
 
 void CNetFileTransferer::StartResponse(u32 requestID, const std::string& data)
+{
+	StartStreamedResponse(requestID);
+	CNetFileSendTask& task = m_FileSendTasks[requestID];
+	task.buffer = data;
+	task.length = data.size();
+
+	// Send the length first, so the receiver can report progress
+	CFileTransferResponseMessage respMessage;
+	respMessage.m_RequestID = requestID;
+	respMessage.m_Length = task.length;
+	m_Session->SendMessage(&respMessage);
+}
+
+void CNetFileTransferer::StartStreamedResponse(u32 requestID)
 {
 	CNetFileSendTask task;
 	task.requestID = requestID;
-	task.buffer = data;
 	task.offset = 0;
+	task.length = 0;
 	task.packetsInFlight = 0;
 	task.maxWindowSize = DEFAULT_FILE_TRANSFER_WINDOW_SIZE;
 
 	m_FileSendTasks[task.requestID] = task;
+}
+
+void CNetFileTransferer::AppendResponseData(u32 requestID, const std::string& data)
+{
+	FileSendTasksMap::iterator it = m_FileSendTasks.find(requestID);
+	ENSURE(it != m_FileSendTasks.end());
+
+	CNetFileSendTask& task = it->second;
+	task.buffer += data;
+	task.length += data.size();
+
+	// Start sending immediately instead of waiting for the next Poll
+	SendPackets(task);
+}
+
+void CNetFileTransferer::FinishResponse(u32 requestID)
+{
+	FileSendTasksMap::iterator it = m_FileSendTasks.find(requestID);
+	ENSURE(it != m_FileSendTasks.end());
+
+	// The receiver completes the transfer once it has both this and all the data,
+	// in whichever order they arrive
 	CFileTransferResponseMessage respMessage;
 	respMessage.m_RequestID = requestID;
-	respMessage.m_Length = task.buffer.size();
+	respMessage.m_Length = it->second.length;
 	m_Session->SendMessage(&respMessage);
 }
 
+void CNetFileTransferer::SendPackets(CNetFileSendTask& task)
+{
+	while (task.packetsInFlight < task.maxWindowSize && task.offset < task.buffer.size())
+	{
+		CFileTransferDataMessage dataMessage;
+		dataMessage.m_RequestID = task.requestID;
+		ssize_t packetSize = std::min(DEFAULT_FILE_TRANSFER_PACKET_SIZE, task.buffer.size() - task.offset);
+		dataMessage.m_Data = task.buffer.substr(task.offset, packetSize);
+		task.offset += packetSize;
+		++task.packetsInFlight;
+		m_Session->SendMessage(&dataMessage);
+	}
+
+	// Drop the data that has been sent, once it's a large enough part
+	// of the buffer for the cost of moving the rest to be amortised
+	if (task.offset > task.buffer.size() / 2)
+	{
+		task.buffer.erase(0, task.offset);
+		task.offset = 0;
+	}
+}
+
 void CNetFileTransferer::Poll()
 {
 	// Find tasks which have fewer packets in flight than their window size,
 	// and send more packets
 	for (std::pair<const u32, CNetFileSendTask>& p : m_FileSendTasks)
-	{
-		CNetFileSendTask& task = p.second;
-
-		while (task.packetsInFlight < task.maxWindowSize && task.offset < task.buffer.size())
-		{
-			CFileTransferDataMessage dataMessage;
-			dataMessage.m_RequestID = task.requestID;
-			ssize_t packetSize = std::min(DEFAULT_FILE_TRANSFER_PACKET_SIZE, task.buffer.size() - task.offset);
-			dataMessage.m_Data = task.buffer.substr(task.offset, packetSize);
-			task.offset += packetSize;
-			++task.packetsInFlight;
-			m_Session->SendMessage(&dataMessage);
-		}
-	}
+		SendPackets(p.second);
 
 	// TODO: need to garbage-collect finished tasks
 }
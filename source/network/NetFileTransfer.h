@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -48,11 +48,24 @@ static const size_t MAX_FILE_TRANSFER_SIZE = 8*MiB;
 class CNetFileReceiveTask
 {
 public:
-	CNetFileReceiveTask() : m_RequestID(0), m_Length(0) { }
+	CNetFileReceiveTask() : m_RequestID(0), m_Length(0), m_ReceivedLength(0) { }
 	virtual ~CNetFileReceiveTask() {}
 
 	/**
-	 * Called when m_Buffer contains the full received data.
+	 * Called for each piece of data as it is received.
+	 * By default the data is appended to m_Buffer; subclasses can override this
+	 * to process the data incrementally instead.
+	 * Returns false if the data is invalid.
+	 */
+	virtual bool OnData(const std::string& data)
+	{
+		m_Buffer += data;
+		return true;
+	}
+
+	/**
+	 * Called when all the data has been received (i.e. m_Buffer contains the full data,
+	 * unless OnData is overridden).
 	 */
 	virtual void OnComplete() = 0;
 
@@ -64,8 +77,14 @@ public:
 	 */
 	u32 m_RequestID;
 
+	/**
+	 * Total length of the data, or 0 while it isn't known yet
+	 * (streamed responses only send it once all the data has been sent).
+	 */
 	size_t m_Length;
 
+	size_t m_ReceivedLength;
+
 	std::string m_Buffer;
 };
 
@@ -100,6 +119,15 @@ public:
 	 */
 	void StartResponse(u32 requestID, const std::string& data);
 
+	/**
+	 * Registers a response whose data isn't known in advance.
+	 * The data is given in pieces with AppendResponseData, which are sent
+	 * as soon as the window allows, and the response must be completed with FinishResponse.
+	 */
+	void StartStreamedResponse(u32 requestID);
+	void AppendResponseData(u32 requestID, const std::string& data);
+	void FinishResponse(u32 requestID);
+
 	/**
 	 * Call frequently (e.g. once per frame) to trigger any necessary
 	 * packet processing.
@@ -111,18 +139,25 @@ private:
 	Status OnFileTransferData(const CFileTransferDataMessage& message);
 	Status OnFileTransferAck(const CFileTransferAckMessage& message);
 
+	void CompleteTask(CNetFileReceiveTask& task);
+
 	/**
 	 * Asynchronous file-sending task.
 	 */
 	struct CNetFileSendTask
 	{
 		u32 requestID;
+		/// Data which hasn't been sent yet, starting at offset
 		std::string buffer;
 		size_t offset;
+		/// Total length of the data given so far
+		size_t length;
 		size_t maxWindowSize;
 		size_t packetsInFlight;
 	};
 
+	void SendPackets(CNetFileSendTask& task);
+
 	INetSession* m_Session;
 
 	u32 m_NextRequestID;
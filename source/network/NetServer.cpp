@@ -90,55 +90,91 @@ static CStr DebugName(CNetServerSession* session)
 }
 
 /**
- * Async task for receiving the initial game state to be forwarded to another
- * client that is rejoining an in-progress network game.
+ * Async task for receiving the initial game state from an existing client
+ * and relaying it to another client that is rejoining an in-progress network game.
+ * The data is forwarded as soon as it arrives, once the rejoining client has requested it.
  */
 class CNetFileReceiveTask_ServerRejoin : public CNetFileReceiveTask
 {
 	NONCOPYABLE(CNetFileReceiveTask_ServerRejoin);
 public:
 	CNetFileReceiveTask_ServerRejoin(CNetServerWorker& server, u32 hostID)
-		: m_Server(server), m_RejoinerHostID(hostID)
+		: m_Server(server), m_RejoinerHostID(hostID), m_RelayRequestID(0), m_Relaying(false), m_Complete(false)
 	{
 	}
 
-	virtual void OnComplete()
+	/**
+	 * Called when the rejoining client requests the state; sends what has
+	 * been received so far, and the rest as it arrives.
+	 */
+	void StartRelay(CNetServerSession& session, u32 requestID)
 	{
-		// We've received the game state from an existing player - now
-		// we need to send it onwards to the newly rejoining player
+		m_RelayRequestID = requestID;
+		m_Relaying = true;
 
-		// Find the session corresponding to the rejoining host (if any)
-		CNetServerSession* session = NULL;
-		for (CNetServerSession* serverSession : m_Server.m_Sessions)
+		CNetFileTransferer& fileTransferer = session.GetFileTransferer();
+		fileTransferer.StartStreamedResponse(requestID);
+		if (!m_Buffer.empty())
+			fileTransferer.AppendResponseData(requestID, m_Buffer);
+		m_Buffer.clear();
+
+		if (m_Complete)
+			FinishRelay(&session);
+	}
+
+	virtual bool OnData(const std::string& data)
+	{
+		if (!m_Relaying)
 		{
-			if (serverSession->GetHostID() == m_RejoinerHostID)
-			{
-				session = serverSession;
-				break;
-			}
+			m_Buffer += data;
+			return true;
 		}
 
+		// (the data is dropped if the rejoining client has disconnected meanwhile)
+		CNetServerSession* session = FindRejoiner();
+		if (session)
+			session->GetFileTransferer().AppendResponseData(m_RelayRequestID, data);
+		return true;
+	}
+
+	virtual void OnComplete()
+	{
+		m_Complete = true;
+
+		CNetServerSession* session = FindRejoiner();
 		if (!session)
 		{
 			LOGMESSAGE("Net server: rejoining client disconnected before we sent to it");
+			m_Server.m_JoinSyncRelays.erase(m_RejoinerHostID);
 			return;
 		}
 
-		// Store the received state file, and tell the client to start downloading it from us
-		// TODO: this will get kind of confused if there's multiple clients downloading in parallel;
-		// they'll race and get whichever happens to be the latest received by the server,
-		// which should still work but isn't great
-		m_Server.m_JoinSyncFile = m_Buffer;
-
-		// Send the init attributes alongside - these should be correct since the game should be started.
-		CJoinSyncStartMessage message;
-		message.m_InitAttributes = Script::StringifyJSON(ScriptRequest(m_Server.GetScriptInterface()), &m_Server.m_InitAttributes);
-		session->SendMessage(&message);
+		// Otherwise the rest is sent once the rejoining client has requested it
+		if (m_Relaying)
+			FinishRelay(session);
 	}
 
 private:
+	CNetServerSession* FindRejoiner() const
+	{
+		for (CNetServerSession* serverSession : m_Server.m_Sessions)
+			if (serverSession->GetHostID() == m_RejoinerHostID)
+				return serverSession;
+		return nullptr;
+	}
+
+	void FinishRelay(CNetServerSession* session)
+	{
+		session->GetFileTransferer().FinishResponse(m_RelayRequestID);
+		// (the caller keeps this task alive until it returns)
+		m_Server.m_JoinSyncRelays.erase(m_RejoinerHostID);
+	}
+
 	CNetServerWorker& m_Server;
 	u32 m_RejoinerHostID;
+	u32 m_RelayRequestID;
+	bool m_Relaying;
+	bool m_Complete;
 };
 
 /*
@@ -660,11 +696,18 @@ void CNetServerWorker::HandleMessageReceive(const CNetMessage* message, CNetServ
 	{
 		CFileTransferRequestMessage* reqMessage = (CFileTransferRequestMessage*)message;
 
-		// Rejoining client got our JoinSyncStart after we received the state from
-		// another client, and has now requested that we forward it to them
+		// Rejoining client got our JoinSyncStart, and has now requested that we
+		// forward the state we're receiving from another client to them
+		const std::map<u32, std::shared_ptr<CNetFileReceiveTask_ServerRejoin>>::iterator it = m_JoinSyncRelays.find(session->GetHostID());
+		if (it == m_JoinSyncRelays.end())
+		{
+			LOGERROR("Net server: Unexpected file transfer request from host %u", session->GetHostID());
+			return;
+		}
 
-		ENSURE(!m_JoinSyncFile.empty());
-		session->GetFileTransferer().StartResponse(reqMessage->m_RequestID, m_JoinSyncFile);
+		// (the relay is removed from the map once it's finished)
+		const std::shared_ptr<CNetFileReceiveTask_ServerRejoin> relay = it->second;
+		relay->StartRelay(*session, reqMessage->m_RequestID);
 
 		return;
 	}
@@ -1161,9 +1204,16 @@ bool CNetServerWorker::OnAuthenticate(void* context, CFsmEvent* event)
 		// the most efficient client to request a copy from
 		CNetServerSession* sourceSession = server.m_Sessions.at(0);
 
-		sourceSession->GetFileTransferer().StartTask(
-			std::shared_ptr<CNetFileReceiveTask>(new CNetFileReceiveTask_ServerRejoin(server, newHostID))
-		);
+		std::shared_ptr<CNetFileReceiveTask_ServerRejoin> relay = std::make_shared<CNetFileReceiveTask_ServerRejoin>(server, newHostID);
+		server.m_JoinSyncRelays[newHostID] = relay;
+		sourceSession->GetFileTransferer().StartTask(relay);
+
+		// Tell the new player to start downloading the state from us right away,
+		// so that we can forward it while it's being received.
+		// Send the init attributes alongside - these should be correct since the game should be started.
+		CJoinSyncStartMessage joinSyncStart;
+		joinSyncStart.m_InitAttributes = Script::StringifyJSON(ScriptRequest(server.GetScriptInterface()), &server.m_InitAttributes);
+		session->SendMessage(&joinSyncStart);
 
 		session->SetNextState(NSS_JOIN_SYNCING);
 	}
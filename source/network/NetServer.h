@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -25,6 +25,8 @@
 #include "scriptinterface/ScriptTypes.h"
 
 #include <ctime>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <utility>
@@ -42,6 +44,7 @@ class ScriptInterface;
 class ScriptRequest;
 
 class CNetServerWorker;
+class CNetFileReceiveTask_ServerRejoin;
 
 enum NetServerState
 {
@@ -395,10 +398,10 @@ private:
 	std::vector<std::vector<CSimulationMessage>> m_SavedCommands;
 
 	/**
-	 * The latest copy of the simulation state, received from an existing
-	 * client when a new client has asked to rejoin the game.
+	 * Transfers of the simulation state from an existing client to the clients
+	 * rejoining the game, indexed by the host ID of the rejoining client.
 	 */
-	std::string m_JoinSyncFile;
+	std::map<u32, std::shared_ptr<CNetFileReceiveTask_ServerRejoin>> m_JoinSyncRelays;
 
 	/**
 	 *  Time when the clients connections were last checked for timeouts and latency.
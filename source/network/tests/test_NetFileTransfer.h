@@ -0,0 +1,149 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "network/NetFileTransfer.h"
+#include "network/NetMessage.h"
+#include "network/NetSession.h"
+#include "scriptinterface/ScriptInterface.h"
+
+#include <deque>
+#include <memory>
+
+class TestNetFileTransfer : public CxxTest::TestSuite
+{
+	/**
+	 * Keeps the messages sent through it until they're delivered to the other end.
+	 */
+	class LoopbackSession : public INetSession
+	{
+	public:
+		LoopbackSession(const ScriptInterface& scriptInterface) : m_ScriptInterface(scriptInterface)
+		{
+		}
+
+		bool SendMessage(const CNetMessage* message) override
+		{
+			std::vector<u8> buffer(message->GetSerializedLength());
+			message->Serialize(buffer.data());
+			m_Messages.emplace_back(CNetMessageFactory::CreateMessage(buffer.data(), buffer.size(), m_ScriptInterface));
+			return true;
+		}
+
+		std::deque<std::unique_ptr<CNetMessage>> m_Messages;
+
+	private:
+		const ScriptInterface& m_ScriptInterface;
+	};
+
+	class ReceiveTask : public CNetFileReceiveTask
+	{
+	public:
+		void OnComplete() override
+		{
+			m_Completed = true;
+		}
+
+		bool m_Completed = false;
+	};
+
+	/**
+	 * Delivers the messages sent by either end until there are none left.
+	 */
+	static void Deliver(LoopbackSession& senderSession, CNetFileTransferer& sender,
+		LoopbackSession& receiverSession, CNetFileTransferer& receiver)
+	{
+		while (!senderSession.m_Messages.empty() || !receiverSession.m_Messages.empty())
+		{
+			while (!senderSession.m_Messages.empty())
+			{
+				TS_ASSERT_EQUALS(receiver.HandleMessageReceive(*senderSession.m_Messages.front()), INFO::OK);
+				senderSession.m_Messages.pop_front();
+			}
+			while (!receiverSession.m_Messages.empty())
+			{
+				TS_ASSERT_EQUALS(sender.HandleMessageReceive(*receiverSession.m_Messages.front()), INFO::OK);
+				receiverSession.m_Messages.pop_front();
+			}
+			sender.Poll();
+		}
+	}
+
+	static std::string MakeData(size_t size)
+	{
+		std::string data(size, '\0');
+		for (size_t i = 0; i < size; ++i)
+			data[i] = static_cast<char>(i * 7 + i / 251);
+		return data;
+	}
+
+public:
+	void test_streamed_data_before_length()
+	{
+		ScriptInterface script("Test", "Test", g_ScriptContext);
+		LoopbackSession senderSession(script), receiverSession(script);
+		CNetFileTransferer sender(&senderSession), receiver(&receiverSession);
+
+		std::shared_ptr<ReceiveTask> task = std::make_shared<ReceiveTask>();
+		receiver.StartTask(task);
+		TS_ASSERT_EQUALS(receiverSession.m_Messages.size(), (size_t)1);
+		TS_ASSERT_EQUALS(receiverSession.m_Messages.front()->GetType(), NMT_FILE_TRANSFER_REQUEST);
+		const u32 requestID = static_cast<CFileTransferRequestMessage&>(*receiverSession.m_Messages.front()).m_RequestID;
+		receiverSession.m_Messages.pop_front();
+
+		// More data than fits in the window, so some is only sent once acked
+		const std::string data = MakeData(DEFAULT_FILE_TRANSFER_WINDOW_SIZE * DEFAULT_FILE_TRANSFER_PACKET_SIZE * 2 + 123);
+		sender.StartStreamedResponse(requestID);
+		sender.AppendResponseData(requestID, data.substr(0, 1000));
+		sender.AppendResponseData(requestID, data.substr(1000));
+		Deliver(senderSession, sender, receiverSession, receiver);
+
+		// All the data has arrived, but the transfer only completes with the length
+		TS_ASSERT_EQUALS(task->m_ReceivedLength, data.size());
+		TS_ASSERT(!task->m_Completed);
+
+		sender.FinishResponse(requestID);
+		Deliver(senderSession, sender, receiverSession, receiver);
+		TS_ASSERT(task->m_Completed);
+		TS_ASSERT_EQUALS(task->m_Length, data.size());
+		TS_ASSERT(task->m_Buffer == data);
+	}
+
+	void test_streamed_length_before_data()
+	{
+		ScriptInterface script("Test", "Test", g_ScriptContext);
+		LoopbackSession senderSession(script), receiverSession(script);
+		CNetFileTransferer sender(&senderSession), receiver(&receiverSession);
+
+		std::shared_ptr<ReceiveTask> task = std::make_shared<ReceiveTask>();
+		receiver.StartTask(task);
+		const u32 requestID = static_cast<CFileTransferRequestMessage&>(*receiverSession.m_Messages.front()).m_RequestID;
+		receiverSession.m_Messages.pop_front();
+
+		// The length is sent before the data beyond the first window
+		const std::string data = MakeData(DEFAULT_FILE_TRANSFER_WINDOW_SIZE * DEFAULT_FILE_TRANSFER_PACKET_SIZE + 456);
+		sender.StartStreamedResponse(requestID);
+		sender.AppendResponseData(requestID, data);
+		sender.FinishResponse(requestID);
+		TS_ASSERT(!task->m_Completed);
+
+		Deliver(senderSession, sender, receiverSession, receiver);
+		TS_ASSERT(task->m_Completed);
+		TS_ASSERT(task->m_Buffer == data);
+	}
+};
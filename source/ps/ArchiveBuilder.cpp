@@ -23,11 +23,201 @@
 #include "graphics/ColladaManager.h"
 #include "lib/tex/tex_codec.h"
 #include "lib/file/archive/archive_zip.h"
+#include "lib/file/io/io.h"
 #include "lib/file/vfs/vfs_util.h"
+#include "ps/Future.h"
+#include "ps/TaskManager.h"
 #include "ps/XML/Xeromyces.h"
 #include "renderer/backend/dummy/Device.h"
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <condition_variable>
+#include <mutex>
+
+namespace
+{
+/**
+ * A file to be stored in the archive.
+ */
+struct ArchiveEntry
+{
+	OsPath realPath;
+	VfsPath pathInArchive;
+	// Converted files are stored with the mtime of their source, since their own
+	// depends on when they were converted. 0 for the others, to use their own.
+	time_t mtime;
+};
+
+/**
+ * Converters which may only be used by one thread at a time.
+ */
+struct Converters
+{
+	Converters(const PIVFS& vfs, Renderer::Backend::IDevice* device)
+		: textureManager(vfs, true, device)
+	{
+	}
+
+	// Use CTextureManager instead of CTextureConverter directly,
+	// so it can deal with all the loading of settings.xml files
+	CTextureManager textureManager;
+
+	CXeromyces xero;
+};
+
+/**
+ * Hands out the converters to the conversion tasks, so that
+ * each set of converters is used by a single task at a time.
+ */
+class ConvertersPool
+{
+public:
+	/**
+	 * The converters are created upfront since they can only be
+	 * constructed by the main thread (they register hotload callbacks).
+	 */
+	ConvertersPool(const PIVFS& vfs, Renderer::Backend::IDevice* device, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			m_Available.emplace_back(std::make_unique<Converters>(vfs, device));
+	}
+
+	std::unique_ptr<Converters> Acquire()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_ConditionVariable.wait(lock, [this]() { return !m_Available.empty(); });
+		std::unique_ptr<Converters> converters = std::move(m_Available.back());
+		m_Available.pop_back();
+		return converters;
+	}
+
+	void Release(std::unique_ptr<Converters>&& converters)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Available.emplace_back(std::move(converters));
+		}
+		m_ConditionVariable.notify_one();
+	}
+
+private:
+	std::mutex m_Mutex;
+	std::condition_variable m_ConditionVariable;
+	std::vector<std::unique_ptr<Converters>> m_Available;
+};
+
+/**
+ * Converts the given file if needed.
+ * @return the files to store in the archive in its place, in order.
+ */
+std::vector<ArchiveEntry> ConvertFile(const PIVFS& vfs, const VfsPath& path, Converters& converters,
+	CColladaManager& colladaManager, std::mutex& colladaMutex)
+{
+	Status ret;
+	OsPath realPath;
+	ret = vfs->GetRealPath(path, realPath);
+	ENSURE(ret == INFO::OK);
+
+	CFileInfo fileInfo;
+	ret = vfs->GetFileInfo(path, &fileInfo);
+	ENSURE(ret == INFO::OK);
+
+	// Compress textures and store the new cached version instead of the original
+	if ((boost::algorithm::starts_with(path.string(), L"art/textures/") ||
+		 boost::algorithm::starts_with(path.string(), L"fonts/")
+		) &&
+		tex_is_known_extension(path) &&
+		// Skip some subdirectories where the engine doesn't use CTextureManager yet:
+		!boost::algorithm::starts_with(path.string(), L"art/textures/cursors/") &&
+		!boost::algorithm::starts_with(path.string(), L"art/textures/terrain/alphamaps/")
+	)
+	{
+		VfsPath cachedPath;
+		debug_printf("Converting texture \"%s\"\n", realPath.string8().c_str());
+		bool ok = converters.textureManager.GenerateCachedTexture(path, cachedPath);
+		ENSURE(ok);
+
+		OsPath cachedRealPath;
+		ret = vfs->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
+		ENSURE(ret == INFO::OK);
+
+		// We don't want to store the original file too (since it's a
+		// large waste of space)
+		return { { cachedRealPath, cachedPath, fileInfo.MTime() } };
+	}
+
+	// Convert DAE models and store the new cached version instead of the original
+	if (path.Extension() == L".dae")
+	{
+		CColladaManager::FileType type;
+
+		if (boost::algorithm::starts_with(path.string(), L"art/meshes/"))
+			type = CColladaManager::PMD;
+		else if (boost::algorithm::starts_with(path.string(), L"art/animation/"))
+			type = CColladaManager::PSA;
+		else
+		{
+			// Unknown type of DAE, just add to archive
+			return { { realPath, path, 0 } };
+		}
+
+		VfsPath cachedPath;
+		debug_printf("Converting model %s\n", realPath.string8().c_str());
+		bool ok;
+		{
+			std::lock_guard<std::mutex> lock(colladaMutex);
+			ok = colladaManager.GenerateCachedFile(path, type, cachedPath);
+		}
+
+		// The DAE might fail to convert for whatever reason, and in that case
+		//	it can't be used in the game, so we just exclude it
+		//  (alternatively we could throw release blocking errors on useless files)
+		if (!ok)
+			return {};
+
+		OsPath cachedRealPath;
+		ret = vfs->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
+		ENSURE(ret == INFO::OK);
+
+		// We don't want to store the original file too (since it's a
+		// large waste of space)
+		return { { cachedRealPath, cachedPath, fileInfo.MTime() } };
+	}
+
+	debug_printf("Adding %s\n", realPath.string8().c_str());
+	std::vector<ArchiveEntry> entries = { { realPath, path, 0 } };
+
+	// Also cache XMB versions of all XML files
+	if (path.Extension() == L".xml")
+	{
+		VfsPath cachedPath;
+		debug_printf("Converting XML file \"%s\"\n", realPath.string8().c_str());
+		bool ok = converters.xero.GenerateCachedXMB(vfs, path, cachedPath);
+		ENSURE(ok);
+
+		OsPath cachedRealPath;
+		ret = vfs->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
+		ENSURE(ret == INFO::OK);
+
+		entries.push_back({ cachedRealPath, cachedPath, fileInfo.MTime() });
+	}
+
+	return entries;
+}
+
+Status AddEntry(IArchiveWriter& writer, const ArchiveEntry& entry)
+{
+	if (!entry.mtime)
+		return writer.AddFile(entry.realPath, entry.pathInArchive);
+
+	CFileInfo fileInfo;
+	RETURN_STATUS_IF_ERR(GetFileInfo(entry.realPath, &fileInfo));
+	const size_t size = static_cast<size_t>(fileInfo.Size());
+	io::BufferPtr buf(io::Allocate(std::max<size_t>(size, 1)));
+	RETURN_STATUS_IF_ERR(io::Load(entry.realPath, buf.get(), size));
+	return writer.AddMemory(buf.get(), size, entry.mtime, entry.pathInArchive);
+}
+} // anonymous namespace
 
 CArchiveBuilder::CArchiveBuilder(const OsPath& mod, const OsPath& tempdir) :
 	m_TempDir(tempdir), m_NumBaseMods(0)
@@ -75,103 +265,31 @@ void CArchiveBuilder::Build(const OsPath& archive, bool compress)
 		return;
 	}
 
-	// Use CTextureManager instead of CTextureConverter directly,
-	// so it can deal with all the loading of settings.xml files
+	Threading::TaskManager& taskManager = Threading::TaskManager::Instance();
+
 	Renderer::Backend::Dummy::CDevice device;
-	CTextureManager textureManager(m_VFS, true, &device);
+	ConvertersPool converters(m_VFS, &device, std::max<size_t>(taskManager.GetNumberOfWorkers(), 1));
 
+	// The COLLADA DLL has global state (the logger and skeleton definitions),
+	// so models are converted one at a time
 	CColladaManager colladaManager(m_VFS);
+	std::mutex colladaMutex;
 
-	CXeromyces xero;
-
+	std::vector<Future<std::vector<ArchiveEntry>>> conversions;
+	conversions.reserve(m_Files.size());
 	for (const VfsPath& path : m_Files)
-	{
-		Status ret;
-		OsPath realPath;
-		ret = m_VFS->GetRealPath(path, realPath);
-		ENSURE(ret == INFO::OK);
-
-		// Compress textures and store the new cached version instead of the original
-		if ((boost::algorithm::starts_with(path.string(), L"art/textures/") ||
-			 boost::algorithm::starts_with(path.string(), L"fonts/")
-			) &&
-			tex_is_known_extension(path) &&
-			// Skip some subdirectories where the engine doesn't use CTextureManager yet:
-			!boost::algorithm::starts_with(path.string(), L"art/textures/cursors/") &&
-			!boost::algorithm::starts_with(path.string(), L"art/textures/terrain/alphamaps/")
-		)
-		{
-			VfsPath cachedPath;
-			debug_printf("Converting texture \"%s\"\n", realPath.string8().c_str());
-			bool ok = textureManager.GenerateCachedTexture(path, cachedPath);
-			ENSURE(ok);
-
-			OsPath cachedRealPath;
-			ret = m_VFS->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
-			ENSURE(ret == INFO::OK);
-
-			writer->AddFile(cachedRealPath, cachedPath);
-
-			// We don't want to store the original file too (since it's a
-			// large waste of space), so skip to the next file
-			continue;
-		}
-
-		// Convert DAE models and store the new cached version instead of the original
-		if (path.Extension() == L".dae")
-		{
-			CColladaManager::FileType type;
-
-			if (boost::algorithm::starts_with(path.string(), L"art/meshes/"))
-				type = CColladaManager::PMD;
-			else if (boost::algorithm::starts_with(path.string(), L"art/animation/"))
-				type = CColladaManager::PSA;
-			else
-			{
-				// Unknown type of DAE, just add to archive and continue
-				writer->AddFile(realPath, path);
-				continue;
-			}
-
-			VfsPath cachedPath;
-			debug_printf("Converting model %s\n", realPath.string8().c_str());
-			bool ok = colladaManager.GenerateCachedFile(path, type, cachedPath);
-
-			// The DAE might fail to convert for whatever reason, and in that case
-			//	it can't be used in the game, so we just exclude it
-			//  (alternatively we could throw release blocking errors on useless files)
-			if (ok)
-			{
-				OsPath cachedRealPath;
-				ret = m_VFS->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
-				ENSURE(ret == INFO::OK);
-
-				writer->AddFile(cachedRealPath, cachedPath);
-			}
-
-			// We don't want to store the original file too (since it's a
-			// large waste of space), so skip to the next file
-			continue;
-		}
-
-		debug_printf("Adding %s\n", realPath.string8().c_str());
-		writer->AddFile(realPath, path);
-
-		// Also cache XMB versions of all XML files
-		if (path.Extension() == L".xml")
-		{
-			VfsPath cachedPath;
-			debug_printf("Converting XML file \"%s\"\n", realPath.string8().c_str());
-			bool ok = xero.GenerateCachedXMB(m_VFS, path, cachedPath);
-			ENSURE(ok);
-
-			OsPath cachedRealPath;
-			ret = m_VFS->GetRealPath(VfsPath("cache")/cachedPath, cachedRealPath);
-			ENSURE(ret == INFO::OK);
-
-			writer->AddFile(cachedRealPath, cachedPath);
-		}
-	}
+		conversions.emplace_back(taskManager.PushTask([this, path, &converters, &colladaManager, &colladaMutex]() {
+			std::unique_ptr<Converters> fileConverters = converters.Acquire();
+			std::vector<ArchiveEntry> entries = ConvertFile(m_VFS, path, *fileConverters, colladaManager, colladaMutex);
+			converters.Release(std::move(fileConverters));
+			return entries;
+		}));
+
+	// Add the files in their original order, regardless of which conversions
+	// finish first, so that the archive doesn't depend on the number of threads
+	for (Future<std::vector<ArchiveEntry>>& conversion : conversions)
+		for (const ArchiveEntry& entry : conversion.Get())
+			AddEntry(*writer, entry);
 
 	debug_printf("Finished packaging \"%s\".", archive.string8().c_str());
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2014 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -52,6 +52,8 @@ public:
 
 	/**
 	 * Do all the processing and packing of files into the archive.
+	 * The files are converted in parallel by the task manager's workers,
+	 * but are always stored in the same order.
 	 * @param archive path of .zip file to generate (will be overwritten if it exists)
 	 * @param compress whether to compress the contents of the .zip file
 	 */
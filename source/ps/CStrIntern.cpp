@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,8 +21,8 @@
 
 #include "lib/fnv_hash.h"
 #include "ps/CLogger.h"
-#include "ps/ThreadUtil.h"
 
+#include <mutex>
 #include <unordered_map>
 
 class CStrInternInternals
@@ -86,6 +86,8 @@ struct StringsKeyProxyEq
 };
 
 static std::unordered_map<StringsKey, std::shared_ptr<CStrInternInternals>, StringsKeyHash> g_Strings;
+// Interned strings are created by simulations running on other threads too (e.g. batch replays).
+static std::mutex g_StringsMutex;
 
 #define X(id) CStrIntern str_##id(#id);
 #define X2(id, str) CStrIntern str_##id(str);
@@ -95,10 +97,7 @@ static std::unordered_map<StringsKey, std::shared_ptr<CStrInternInternals>, Stri
 
 static CStrInternInternals* GetString(const char* str, size_t len)
 {
-	// g_Strings is not thread-safe, so complain if anyone is using this
-	// type in non-main threads. (If that's desired, g_Strings should be changed
-	// to be thread-safe, preferably without sacrificing performance.)
-	ENSURE(Threading::IsMainThread());
+	std::lock_guard<std::mutex> lock(g_StringsMutex);
 
 	std::unordered_map<StringsKey, std::shared_ptr<CStrInternInternals> >::iterator it = g_Strings.find(str);
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2011 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,6 +21,7 @@
 
 #include "lib/byte_order.h"
 #include "lib/external_libraries/zlib.h"
+#include "lib/external_libraries/zstd.h"
 
 void CompressZLib(const std::string& data, std::string& out, bool includeLengthHeader)
 {
@@ -61,3 +62,261 @@ void DecompressZLib(const std::string& data, std::string& out, bool includeLengt
 
 	// TODO: better error reporting might be nice
 }
+
+namespace
+{
+// Size of the uncompressed data buffered before being compressed.
+constexpr size_t STREAM_INPUT_BUFFER_SIZE = 64 * KiB;
+// Minimum output space given to the decompressor at once.
+constexpr size_t STREAM_MIN_OUTPUT_SIZE = 16 * KiB;
+} // anonymous namespace
+
+CZLibStreamCompressor::CZLibStreamCompressor(size_t chunkSize, const ChunkCallback& callback)
+	: m_Stream(std::make_unique<z_stream>()), m_Input(STREAM_INPUT_BUFFER_SIZE, '\0'), m_Output(chunkSize, '\0'), m_Callback(callback)
+{
+	ENSURE(chunkSize > 0);
+
+	int zok = deflateInit(m_Stream.get(), Z_DEFAULT_COMPRESSION);
+	ENSURE(zok == Z_OK);
+
+	m_Stream->next_out = reinterpret_cast<Bytef*>(&m_Output[0]);
+	m_Stream->avail_out = m_Output.size();
+
+	setp(&m_Input[0], &m_Input[0] + m_Input.size());
+}
+
+CZLibStreamCompressor::~CZLibStreamCompressor()
+{
+	deflateEnd(m_Stream.get());
+}
+
+CZLibStreamCompressor::int_type CZLibStreamCompressor::overflow(int_type c)
+{
+	if (m_Finished)
+		return traits_type::eof();
+
+	Deflate(Z_NO_FLUSH);
+
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+void CZLibStreamCompressor::Finish()
+{
+	ENSURE(!m_Finished);
+
+	Deflate(Z_FINISH);
+	m_Finished = true;
+
+	const size_t length = m_Output.size() - m_Stream->avail_out;
+	if (length > 0)
+		SendChunk(length);
+}
+
+void CZLibStreamCompressor::Deflate(int flush)
+{
+	m_Stream->next_in = reinterpret_cast<Bytef*>(pbase());
+	m_Stream->avail_in = pptr() - pbase();
+	m_InputLength += m_Stream->avail_in;
+
+	for (;;)
+	{
+		int zok = deflate(m_Stream.get(), flush);
+		ENSURE(zok == Z_OK || zok == Z_STREAM_END || zok == Z_BUF_ERROR);
+
+		if (m_Stream->avail_out == 0)
+		{
+			SendChunk(m_Output.size());
+			continue;
+		}
+
+		// deflate stops early only when it runs out of output space.
+		if (flush != Z_FINISH || zok == Z_STREAM_END)
+			break;
+	}
+	ENSURE(m_Stream->avail_in == 0);
+
+	setp(&m_Input[0], &m_Input[0] + m_Input.size());
+}
+
+void CZLibStreamCompressor::SendChunk(size_t length)
+{
+	m_OutputLength += length;
+	m_Callback(length == m_Output.size() ? m_Output : m_Output.substr(0, length));
+
+	m_Stream->next_out = reinterpret_cast<Bytef*>(&m_Output[0]);
+	m_Stream->avail_out = m_Output.size();
+}
+
+CZLibStreamDecompressor::CZLibStreamDecompressor()
+	: m_Stream(std::make_unique<z_stream>())
+{
+	int zok = inflateInit(m_Stream.get());
+	ENSURE(zok == Z_OK);
+}
+
+CZLibStreamDecompressor::~CZLibStreamDecompressor()
+{
+	inflateEnd(m_Stream.get());
+}
+
+bool CZLibStreamDecompressor::Decompress(const std::string& data, std::string& out)
+{
+	if (data.empty())
+		return true;
+	if (m_Finished)
+		return false;
+
+	m_Stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	m_Stream->avail_in = data.size();
+
+	do
+	{
+		const size_t offset = out.size();
+		out.resize(offset + std::max(STREAM_MIN_OUTPUT_SIZE, data.size() * 4));
+		m_Stream->next_out = reinterpret_cast<Bytef*>(&out[offset]);
+		m_Stream->avail_out = out.size() - offset;
+
+		int zok = inflate(m_Stream.get(), Z_NO_FLUSH);
+		out.resize(out.size() - m_Stream->avail_out);
+
+		if (zok == Z_STREAM_END)
+		{
+			m_Finished = true;
+			// Nothing is expected after the end of the stream.
+			return m_Stream->avail_in == 0;
+		}
+		// Z_BUF_ERROR only means that all the input has been used.
+		if (zok != Z_OK && !(zok == Z_BUF_ERROR && m_Stream->avail_in == 0))
+			return false;
+	}
+	while (m_Stream->avail_in > 0 || m_Stream->avail_out == 0);
+
+	return true;
+}
+
+#if CONFIG2_ZSTD
+
+CZStdStreamCompressor::CZStdStreamCompressor(size_t chunkSize, const ChunkCallback& callback)
+	: m_Context(ZSTD_createCCtx()), m_Input(STREAM_INPUT_BUFFER_SIZE, '\0'), m_Output(chunkSize, '\0'), m_Callback(callback)
+{
+	ENSURE(chunkSize > 0);
+	ENSURE(m_Context);
+
+	setp(&m_Input[0], &m_Input[0] + m_Input.size());
+}
+
+CZStdStreamCompressor::~CZStdStreamCompressor()
+{
+	ZSTD_freeCCtx(m_Context);
+}
+
+CZStdStreamCompressor::int_type CZStdStreamCompressor::overflow(int_type c)
+{
+	if (m_Finished)
+		return traits_type::eof();
+
+	Compress(false);
+
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+void CZStdStreamCompressor::Finish()
+{
+	ENSURE(!m_Finished);
+
+	Compress(true);
+	m_Finished = true;
+
+	if (m_OutputPos > 0)
+		SendChunk(m_OutputPos);
+}
+
+void CZStdStreamCompressor::Compress(bool finish)
+{
+	ZSTD_inBuffer input = { pbase(), static_cast<size_t>(pptr() - pbase()), 0 };
+	m_InputLength += input.size;
+
+	for (;;)
+	{
+		ZSTD_outBuffer output = { &m_Output[0], m_Output.size(), m_OutputPos };
+		const size_t remaining = ZSTD_compressStream2(m_Context, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+		ENSURE(!ZSTD_isError(remaining));
+		m_OutputPos = output.pos;
+
+		if (m_OutputPos == m_Output.size())
+		{
+			SendChunk(m_Output.size());
+			continue;
+		}
+
+		// Without finishing, the input is consumed unless the output is full;
+		// when finishing, zero means the frame is complete.
+		if (finish ? remaining == 0 : input.pos == input.size)
+			break;
+	}
+	ENSURE(input.pos == input.size);
+
+	setp(&m_Input[0], &m_Input[0] + m_Input.size());
+}
+
+void CZStdStreamCompressor::SendChunk(size_t length)
+{
+	m_OutputLength += length;
+	m_Callback(length == m_Output.size() ? m_Output : m_Output.substr(0, length));
+	m_OutputPos = 0;
+}
+
+CZStdStreamDecompressor::CZStdStreamDecompressor()
+	: m_Context(ZSTD_createDCtx())
+{
+	ENSURE(m_Context);
+}
+
+CZStdStreamDecompressor::~CZStdStreamDecompressor()
+{
+	ZSTD_freeDCtx(m_Context);
+}
+
+bool CZStdStreamDecompressor::Decompress(const std::string& data, std::string& out)
+{
+	if (data.empty())
+		return true;
+	if (m_Finished)
+		return false;
+
+	ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+	ZSTD_outBuffer output;
+	do
+	{
+		const size_t offset = out.size();
+		out.resize(offset + std::max(STREAM_MIN_OUTPUT_SIZE, data.size() * 4));
+		output = { &out[offset], out.size() - offset, 0 };
+
+		const size_t remaining = ZSTD_decompressStream(m_Context, &output, &input);
+		out.resize(offset + output.pos);
+		if (ZSTD_isError(remaining))
+			return false;
+
+		if (remaining == 0)
+		{
+			m_Finished = true;
+			// Nothing is expected after the end of the frame.
+			return input.pos == input.size;
+		}
+	}
+	while (input.pos < input.size || output.pos == output.size);
+
+	return true;
+}
+
+#endif // CONFIG2_ZSTD
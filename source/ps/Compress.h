@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -18,15 +18,164 @@
 #ifndef INCLUDED_COMPRESS
 #define INCLUDED_COMPRESS
 
+#include "lib/config2.h"
+
+#include <functional>
+#include <memory>
+#include <streambuf>
 #include <string>
 
+struct z_stream_s;
+#if CONFIG2_ZSTD
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+#endif
+
 /**
  * @file
- * Simple (non-streaming) compression functions.
+ * Simple (non-streaming) compression functions, and streaming zlib
+ * (and, with CONFIG2_ZSTD, Zstandard) compression.
  */
 
 void CompressZLib(const std::string& data, std::string& out, bool includeLengthHeader);
 
 void DecompressZLib(const std::string& data, std::string& out, bool includeLengthHeader);
 
+/**
+ * Stream buffer compressing the data written to it (e.g. through an std::ostream),
+ * so that large outputs don't need to be held uncompressed in memory.
+ * The compressed data is passed to the callback in chunks of chunkSize bytes
+ * (except for the last one) as soon as they are ready.
+ * The data can be decompressed with CZLibStreamDecompressor.
+ */
+class CZLibStreamCompressor : public std::streambuf
+{
+	NONCOPYABLE(CZLibStreamCompressor);
+public:
+	using ChunkCallback = std::function<void(const std::string&)>;
+
+	CZLibStreamCompressor(size_t chunkSize, const ChunkCallback& callback);
+	~CZLibStreamCompressor();
+
+	/**
+	 * Compresses the remaining data and passes the last chunk to the callback.
+	 * Nothing can be written afterwards.
+	 */
+	void Finish();
+
+	size_t GetInputLength() const { return m_InputLength; }
+	size_t GetOutputLength() const { return m_OutputLength; }
+
+protected:
+	int_type overflow(int_type c) override;
+
+private:
+	void Deflate(int flush);
+	void SendChunk(size_t length);
+
+	std::unique_ptr<z_stream_s> m_Stream;
+	std::string m_Input;
+	std::string m_Output;
+	ChunkCallback m_Callback;
+	bool m_Finished = false;
+	size_t m_InputLength = 0;
+	size_t m_OutputLength = 0;
+};
+
+/**
+ * Decompresses zlib data given in arbitrary pieces, as they become available.
+ */
+class CZLibStreamDecompressor
+{
+	NONCOPYABLE(CZLibStreamDecompressor);
+public:
+	CZLibStreamDecompressor();
+	~CZLibStreamDecompressor();
+
+	/**
+	 * Decompresses the next piece of compressed data, appending the result to @p out.
+	 * Returns false if the data is invalid.
+	 */
+	bool Decompress(const std::string& data, std::string& out);
+
+	/**
+	 * Returns whether the end of the compressed data has been reached.
+	 */
+	bool IsFinished() const { return m_Finished; }
+
+private:
+	std::unique_ptr<z_stream_s> m_Stream;
+	bool m_Finished = false;
+};
+
+#if CONFIG2_ZSTD
+
+/**
+ * Same as CZLibStreamCompressor, but compressing with Zstandard, which
+ * decompresses several times faster.
+ * The data can be decompressed with CZStdStreamDecompressor.
+ */
+class CZStdStreamCompressor : public std::streambuf
+{
+	NONCOPYABLE(CZStdStreamCompressor);
+public:
+	using ChunkCallback = std::function<void(const std::string&)>;
+
+	CZStdStreamCompressor(size_t chunkSize, const ChunkCallback& callback);
+	~CZStdStreamCompressor();
+
+	/**
+	 * Compresses the remaining data and passes the last chunk to the callback.
+	 * Nothing can be written afterwards.
+	 */
+	void Finish();
+
+	size_t GetInputLength() const { return m_InputLength; }
+	size_t GetOutputLength() const { return m_OutputLength; }
+
+protected:
+	int_type overflow(int_type c) override;
+
+private:
+	void Compress(bool finish);
+	void SendChunk(size_t length);
+
+	ZSTD_CCtx_s* m_Context;
+	std::string m_Input;
+	std::string m_Output;
+	size_t m_OutputPos = 0;
+	ChunkCallback m_Callback;
+	bool m_Finished = false;
+	size_t m_InputLength = 0;
+	size_t m_OutputLength = 0;
+};
+
+/**
+ * Decompresses Zstandard data given in arbitrary pieces, as they become available.
+ */
+class CZStdStreamDecompressor
+{
+	NONCOPYABLE(CZStdStreamDecompressor);
+public:
+	CZStdStreamDecompressor();
+	~CZStdStreamDecompressor();
+
+	/**
+	 * Decompresses the next piece of compressed data, appending the result to @p out.
+	 * Returns false if the data is invalid.
+	 */
+	bool Decompress(const std::string& data, std::string& out);
+
+	/**
+	 * Returns whether the end of the compressed data has been reached.
+	 */
+	bool IsFinished() const { return m_Finished; }
+
+private:
+	ZSTD_DCtx_s* m_Context;
+	bool m_Finished = false;
+};
+
+#endif // CONFIG2_ZSTD
+
 #endif // INCLUDED_COMPRESS
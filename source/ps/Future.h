@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -22,7 +22,6 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <functional>
 #include <mutex>
 #include <optional>
 #include <type_traits>
@@ -45,18 +44,17 @@ using ResultHolder = std::conditional_t<std::is_void_v<T>, std::nullopt_t, std::
 
 /**
  * The shared state between futures and packaged state.
- * Holds all relevant data.
+ * Holds all relevant data, except for the function (see SharedStateWithFunc).
  */
 template<typename ResultType>
 class SharedState : public ResultHolder<ResultType>
 {
 	static constexpr bool VoidResult = std::is_same_v<ResultType, void>;
 public:
-	SharedState(std::function<ResultType()>&& func) :
-		ResultHolder<ResultType>{std::nullopt},
-		m_Func(std::move(func))
+	SharedState() :
+		ResultHolder<ResultType>{std::nullopt}
 	{}
-	~SharedState()
+	virtual ~SharedState()
 	{
 		// For safety, wait on started task completion, but not on pending ones (auto-cancelled).
 		if (!Cancel())
@@ -119,11 +117,36 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Call the wrapped function.
+	 */
+	virtual ResultType Call() = 0;
+
 	std::atomic<Status> m_Status = Status::PENDING;
 	std::mutex m_Mutex;
 	std::condition_variable m_ConditionVariable;
+};
+
+/**
+ * The shared state together with the function, so that both are allocated at once
+ * (rather than type-erasing the function into a std::function, which allocates too unless it's tiny).
+ */
+template<typename ResultType, typename Func>
+class SharedStateWithFunc final : public SharedState<ResultType>
+{
+public:
+	template<typename F>
+	SharedStateWithFunc(F&& func) :
+		m_Func(std::forward<F>(func))
+	{}
+
+	ResultType Call() override
+	{
+		return m_Func();
+	}
 
-	std::function<ResultType()> m_Func;
+private:
+	Func m_Func;
 };
 
 } // namespace FutureSharedStateDetail
@@ -247,9 +270,9 @@ public:
 			return;
 
 		if constexpr (VoidResult)
-			m_SharedState->m_Func();
+			m_SharedState->Call();
 		else
-			m_SharedState->emplace(m_SharedState->m_Func());
+			m_SharedState->emplace(m_SharedState->Call());
 
 		// Because we might have threads waiting on us, we need to make sure that they either:
 		// - don't wait on our condition variable
@@ -281,7 +304,8 @@ template<typename T>
 PackagedTask<ResultType> Future<ResultType>::Wrap(T&& func)
 {
 	static_assert(std::is_convertible_v<std::invoke_result_t<T>, ResultType>, "The return type of the wrapped function cannot be converted to the type of the Future.");
-	m_SharedState = std::make_shared<SharedState>(std::move(func));
+	using Func = std::decay_t<T>;
+	m_SharedState = std::make_shared<FutureSharedStateDetail::SharedStateWithFunc<ResultType, Func>>(std::move(func));
 	return PackagedTask<ResultType>(m_SharedState);
 }
 
@@ -138,6 +138,11 @@ void MountMods(const Paths& paths, const std::vector<CStr>& mods)
 
 	size_t userFlags = VFS_MOUNT_WATCH|VFS_MOUNT_ARCHIVABLE;
 	size_t baseFlags = userFlags|VFS_MOUNT_MUST_EXIST;
+	// Mods installed alongside the game aren't edited (unlike those in the user
+	// mod path or in development copies), so remember their directories instead
+	// of scanning them at every startup.
+	if (!InDevelopmentCopy())
+		baseFlags |= VFS_MOUNT_INDEX;
 	size_t priority = 0;
 	for (size_t i = 0; i < mods.size(); ++i)
 	{
@@ -176,7 +181,7 @@ static void InitVfs(const CmdLineArgs& args, int flags)
 		hooks.display_error = psDisplayError;
 	app_hooks_update(&hooks);
 
-	g_VFS = CreateVfs();
+	g_VFS = CreateVfs(paths.Cache()/"directory_index"/"");
 
 	const OsPath readonlyConfig = paths.RData()/"config"/"";
 
@@ -707,11 +712,16 @@ void InitGraphics(const CmdLineArgs& args, int flags, const std::vector<CStr>& i
 		//	(delete game data, switch GUI page, show error, etc.)
 		CancelLoad(CStr(e.what()).FromUTF8());
 	}
+
+	// (by now, the directories needed at startup have been populated)
+	g_VFS->ReportPopulation();
 }
 
 bool InitNonVisual(const CmdLineArgs& args)
 {
-	return Autostart(args);
+	const bool ret = Autostart(args);
+	g_VFS->ReportPopulation();
+	return ret;
 }
 
 /**
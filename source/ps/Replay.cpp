@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -24,6 +24,7 @@
 #include "lib/file/file_system.h"
 #include "lib/tex/tex.h"
 #include "ps/CLogger.h"
+#include "ps/Errors.h"
 #include "ps/Game.h"
 #include "ps/GameSetup/GameSetup.h"
 #include "ps/GameSetup/CmdLineArgs.h"
@@ -49,8 +50,12 @@
 #include "simulation2/Simulation2.h"
 #include "simulation2/system/CmpPtr.h"
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 /**
  * Number of turns between two saved profiler snapshots.
@@ -58,6 +63,9 @@
  */
 static const int PROFILE_TURN_INTERVAL = 20;
 
+static const int REPLAY_CONTEXT_SIZE = 384 * 1024 * 1024;
+static const int REPLAY_HEAP_GROWTH_BYTES_GCTRIGGER = 20 * 1024 * 1024;
+
 CReplayLogger::CReplayLogger(const ScriptInterface& scriptInterface) :
 	m_ScriptInterface(scriptInterface), m_Stream(NULL)
 {
@@ -196,9 +204,7 @@ void CReplayPlayer::Replay(const bool serializationtest, const int rejointesttur
 	g_ScriptStatsTable = new CScriptStatsTable;
 	g_ProfileViewer.AddRootTable(g_ScriptStatsTable);
 
-	const int contextSize = 384 * 1024 * 1024;
-	const int heapGrowthBytesGCTrigger = 20 * 1024 * 1024;
-	g_ScriptContext = ScriptContext::CreateContext(contextSize, heapGrowthBytesGCTrigger);
+	g_ScriptContext = ScriptContext::CreateContext(REPLAY_CONTEXT_SIZE, REPLAY_HEAP_GROWTH_BYTES_GCTRIGGER);
 
 	std::vector<SimulationCommand> commands;
 	u32 turn = 0;
@@ -347,3 +353,339 @@ void CReplayPlayer::TestHash(const std::string& hashType, const std::string& rep
 	else
 		debug_printf("%s MISMATCH (%s != %s)\n", hashType.c_str(), hexHash.c_str(), replayHash.c_str());
 }
+
+////////////////////////////////////////////////////////////////
+
+namespace
+{
+/**
+ * Loading a game goes through global state (the loader queue, the light environment,
+ * the list of script contexts of the engine), so the batch replays set up and
+ * tear down their games one at a time. Only the turns run concurrently.
+ */
+std::mutex g_BatchReplaySetupMutex;
+
+bool ReadReplayMods(const ScriptRequest& rq, const OsPath& path, std::vector<Mod::ModData>& replayMods)
+{
+	std::ifstream stream(OsString(path).c_str());
+	std::string type;
+	if (!(stream >> type).good() || type != "start")
+		return false;
+
+	std::string attribsStr;
+	std::getline(stream, attribsStr);
+	JS::RootedValue attribs(rq.cx);
+	return Script::ParseJSON(rq, attribsStr, &attribs) && Script::GetProperty(rq, attribs, "mods", replayMods);
+}
+
+struct HashMismatch
+{
+	u32 turn;
+	bool quick;
+	std::string expected;
+	std::string computed;
+};
+} // anonymous namespace
+
+struct CBatchReplayPlayer::Result
+{
+	OsPath path;
+	// Empty if the replay could be run until the end.
+	std::string error;
+	double loadTime = 0.0;
+	std::vector<double> turnTimes;
+	u32 hashChecks = 0;
+	std::vector<HashMismatch> hashMismatches;
+	std::string finalHash;
+	u32 peakScriptHeapBytes = 0;
+};
+
+void CBatchReplayPlayer::Add(const OsPath& path)
+{
+	if (!DirectoryExists(path))
+	{
+		m_Paths.push_back(path);
+		return;
+	}
+
+	if (FileExists(path / L"commands.txt"))
+	{
+		m_Paths.push_back(path / L"commands.txt");
+		return;
+	}
+
+	DirectoryNames directories;
+	if (GetDirectoryEntries(path, nullptr, &directories) != INFO::OK)
+	{
+		LOGERROR("Could not list the replays of '%s'", path.string8());
+		return;
+	}
+
+	std::sort(directories.begin(), directories.end());
+	for (const OsPath& directory : directories)
+		if (FileExists(path / directory / L"commands.txt"))
+			m_Paths.push_back(path / directory / L"commands.txt");
+}
+
+void CBatchReplayPlayer::Replay(size_t jobs, const bool testHashFull, const bool testHashQuick, const OsPath& reportPath)
+{
+	if (jobs == 0)
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	jobs = std::min(jobs, m_Paths.size());
+
+	g_ScriptContext = ScriptContext::CreateContext(REPLAY_CONTEXT_SIZE, REPLAY_HEAP_GROWTH_BYTES_GCTRIGGER);
+
+	std::vector<Result> results(m_Paths.size());
+	for (size_t i = 0; i < m_Paths.size(); ++i)
+		results[i].path = m_Paths[i];
+
+	{
+		// The VFS is shared by all the replays, so enable the mods of the first one
+		// and only run the replays that are compatible with them.
+		ScriptInterface scriptInterface("Engine", "Replay", g_ScriptContext);
+		ScriptRequest rq(scriptInterface);
+		bool modsMounted = false;
+		for (Result& result : results)
+		{
+			std::vector<Mod::ModData> replayMods;
+			if (!ReadReplayMods(rq, result.path, replayMods))
+			{
+				result.error = "Could not read the game attributes.";
+				continue;
+			}
+
+			if (!modsMounted)
+			{
+				std::vector<CStr> mods;
+				for (const Mod::ModData& data : replayMods)
+					mods.emplace_back(data.m_Pathname);
+
+				g_Mods.UpdateAvailableMods(scriptInterface);
+				g_Mods.EnableMods(mods, false);
+				MountMods(Paths(g_CmdLineArgs), g_Mods.GetEnabledMods());
+				modsMounted = true;
+			}
+
+			std::vector<const Mod::ModData*> replayData;
+			for (const Mod::ModData& data : replayMods)
+				replayData.push_back(&data);
+			if (!Mod::AreModsPlayCompatible(g_Mods.GetEnabledModsData(), replayData))
+				result.error = "Incompatible replay mods.";
+		}
+	}
+
+	debug_printf("Running %zu replays on %zu threads\n", results.size(), jobs);
+	const double startTime = timer_Time();
+
+	std::atomic<size_t> nextReplay = 0;
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < jobs; ++i)
+		threads.emplace_back([&results, &nextReplay, i, testHashFull, testHashQuick]() {
+			const std::string name = "Replay #" + std::to_string(i);
+			debug_SetThreadName(name.c_str());
+			g_Profiler2.RegisterCurrentThread(name);
+
+			for (size_t replay = nextReplay++; replay < results.size(); replay = nextReplay++)
+				if (results[replay].error.empty())
+					RunReplay(results[replay], testHashFull, testHashQuick);
+		});
+	for (std::thread& thread : threads)
+		thread.join();
+
+	const double totalTime = timer_Time() - startTime;
+
+	{
+		ScriptInterface scriptInterface("Engine", "Replay", g_ScriptContext);
+		ScriptRequest rq(scriptInterface);
+
+		JS::RootedValue replays(rq.cx);
+		Script::CreateArray(rq, &replays, results.size());
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& result = results[i];
+
+			double totalTurnTime = 0.0;
+			double maxTurnTime = 0.0;
+			JS::RootedValue turnTimes(rq.cx);
+			Script::CreateArray(rq, &turnTimes, result.turnTimes.size());
+			for (size_t turn = 0; turn < result.turnTimes.size(); ++turn)
+			{
+				totalTurnTime += result.turnTimes[turn];
+				maxTurnTime = std::max(maxTurnTime, result.turnTimes[turn]);
+				Script::SetPropertyInt(rq, turnTimes, turn, result.turnTimes[turn] * 1000.0);
+			}
+
+			JS::RootedValue hashMismatches(rq.cx);
+			Script::CreateArray(rq, &hashMismatches, result.hashMismatches.size());
+			for (size_t j = 0; j < result.hashMismatches.size(); ++j)
+			{
+				const HashMismatch& mismatch = result.hashMismatches[j];
+				JS::RootedValue value(rq.cx);
+				Script::CreateObject(
+					rq,
+					&value,
+					"turn", mismatch.turn,
+					"type", std::string(mismatch.quick ? "hash-quick" : "hash"),
+					"expected", mismatch.expected,
+					"computed", mismatch.computed);
+				Script::SetPropertyInt(rq, hashMismatches, j, value);
+			}
+
+			JS::RootedValue replay(rq.cx);
+			Script::CreateObject(
+				rq,
+				&replay,
+				"path", result.path.string8(),
+				"success", result.error.empty() && result.hashMismatches.empty(),
+				"loadTimeMs", result.loadTime * 1000.0,
+				"turns", static_cast<u32>(result.turnTimes.size()),
+				"totalTurnTimeMs", totalTurnTime * 1000.0,
+				"maxTurnTimeMs", maxTurnTime * 1000.0,
+				"turnTimesMs", turnTimes,
+				"hashChecks", result.hashChecks,
+				"hashMismatches", hashMismatches,
+				"finalHash", result.finalHash,
+				"peakScriptHeapBytes", result.peakScriptHeapBytes);
+			if (!result.error.empty())
+				Script::SetProperty(rq, replay, "error", result.error);
+			Script::SetPropertyInt(rq, replays, i, replay);
+
+			if (!result.error.empty())
+				debug_printf("%s: ERROR (%s)\n", result.path.string8().c_str(), result.error.c_str());
+			else
+				debug_printf("%s: %zu turns, %zu hash mismatches\n", result.path.string8().c_str(), result.turnTimes.size(), result.hashMismatches.size());
+		}
+
+		JS::RootedValue report(rq.cx);
+		Script::CreateObject(
+			rq,
+			&report,
+			"engine_version", std::string(engine_version),
+			"threads", static_cast<u32>(jobs),
+			"totalTimeMs", totalTime * 1000.0,
+			"replays", replays);
+
+		CreateDirectories(reportPath.Parent(), 0700);
+		std::ofstream stream(OsString(reportPath).c_str(), std::ofstream::out | std::ofstream::trunc);
+		if (stream)
+		{
+			stream << Script::StringifyJSON(rq, &report, true);
+			debug_printf("FILES| Replay report written to '%s'\n", reportPath.string8().c_str());
+		}
+		else
+			LOGERROR("Failed to write the replay report to '%s'", reportPath.string8());
+	}
+
+	g_ScriptContext.reset();
+}
+
+void CBatchReplayPlayer::RunReplay(Result& result, const bool testHashFull, const bool testHashQuick)
+{
+	const double startTime = timer_Time();
+
+	std::ifstream stream(OsString(result.path).c_str());
+	std::unique_ptr<CGame> game;
+	std::vector<SimulationCommand> commands;
+	u32 turn = 0;
+	u32 turnLength = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(g_BatchReplaySetupMutex);
+		g_ScriptContext = ScriptContext::CreateContext(REPLAY_CONTEXT_SIZE, REPLAY_HEAP_GROWTH_BYTES_GCTRIGGER);
+	}
+
+	std::string type;
+	while (result.error.empty() && (stream >> type).good())
+	{
+		if (type == "start")
+		{
+			std::string attribsStr;
+			std::getline(stream, attribsStr);
+
+			std::lock_guard<std::mutex> lock(g_BatchReplaySetupMutex);
+			game = std::make_unique<CGame>(false);
+			ScriptRequest rq(game->GetSimulation2()->GetScriptInterface());
+			JS::RootedValue attribs(rq.cx);
+			if (!Script::ParseJSON(rq, attribsStr, &attribs))
+			{
+				result.error = "Could not parse the game attributes.";
+				break;
+			}
+
+			try
+			{
+				game->StartGame(&attribs, "");
+				if (LDR_NonprogressiveLoad() != INFO::OK || game->ReallyStartGame() != PSRETURN_OK)
+					result.error = "Could not load the game.";
+			}
+			catch (const PSERROR& err)
+			{
+				result.error = err.what();
+			}
+			if (!result.error.empty())
+				LDR_Cancel();
+
+			result.loadTime = timer_Time() - startTime;
+		}
+		else if (!game)
+			result.error = "The replay doesn't start with the game attributes.";
+		else if (type == "turn")
+			stream >> turn >> turnLength;
+		else if (type == "cmd")
+		{
+			player_id_t player;
+			stream >> player;
+
+			std::string line;
+			std::getline(stream, line);
+			ScriptRequest rq(game->GetSimulation2()->GetScriptInterface());
+			JS::RootedValue data(rq.cx);
+			Script::ParseJSON(rq, line, &data);
+			Script::FreezeObject(rq, data, true);
+			commands.emplace_back(SimulationCommand(player, rq.cx, data));
+		}
+		else if (type == "hash" || type == "hash-quick")
+		{
+			std::string replayHash;
+			stream >> replayHash;
+
+			const bool quick = (type == "hash-quick");
+			if ((quick && !testHashQuick) || (!quick && !testHashFull))
+				continue;
+
+			std::string hash;
+			ENSURE(game->GetSimulation2()->ComputeStateHash(hash, quick));
+			++result.hashChecks;
+			if (Hexify(hash) != replayHash)
+				result.hashMismatches.push_back({ turn, quick, replayHash, Hexify(hash) });
+		}
+		else if (type == "end")
+		{
+			const double turnStartTime = timer_Time();
+			game->GetSimulation2()->Update(turnLength, commands);
+			result.turnTimes.push_back(timer_Time() - turnStartTime);
+			commands.clear();
+
+			result.peakScriptHeapBytes = std::max(result.peakScriptHeapBytes,
+				JS_GetGCParameter(g_ScriptContext->GetGeneralJSContext(), JSGC_BYTES));
+		}
+		else
+			debug_printf("Unrecognised replay token %s\n", type.c_str());
+	}
+
+	if (result.error.empty() && !game)
+		result.error = "The replay doesn't contain a game.";
+
+	if (result.error.empty())
+	{
+		std::string hash;
+		ENSURE(game->GetSimulation2()->ComputeStateHash(hash, false));
+		result.finalHash = Hexify(hash);
+	}
+
+	commands.clear();
+
+	std::lock_guard<std::mutex> lock(g_BatchReplaySetupMutex);
+	game.reset();
+	g_ScriptContext.reset();
+}
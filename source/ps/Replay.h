@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -116,4 +116,34 @@ private:
 	void TestHash(const std::string& hashType, const std::string& replayHash, const bool testHashFull, const bool testHashQuick);
 };
 
+/**
+ * Runs a batch of replay logs with no graphics, each in its own game and script context,
+ * several of them concurrently, and writes a JSON report with the turn timings,
+ * the hash checks and the script heap usage of each replay.
+ * The replays are run with the mods of the first one, incompatible replays are skipped.
+ */
+class CBatchReplayPlayer
+{
+	NONCOPYABLE(CBatchReplayPlayer);
+public:
+	CBatchReplayPlayer() = default;
+
+	/**
+	 * Adds a commands.txt file, or the commands.txt file of each subdirectory of a directory
+	 * (e.g. the replays directory).
+	 */
+	void Add(const OsPath& path);
+
+	/**
+	 * Runs the replays on @p jobs threads (0 to use one per core) and writes the report to @p reportPath.
+	 */
+	void Replay(size_t jobs, const bool testHashFull, const bool testHashQuick, const OsPath& reportPath);
+
+private:
+	struct Result;
+	static void RunReplay(Result& result, const bool testHashFull, const bool testHashQuick);
+
+	std::vector<OsPath> m_Paths;
+};
+
 #endif // INCLUDED_REPLAY
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -33,6 +33,7 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace Threading
 {
@@ -61,7 +62,123 @@ std::unique_ptr<TaskManager> g_TaskManager;
 
 class Thread;
 
-using QueueItem = std::function<void()>;
+/**
+ * Work-stealing deque (Chase & Lev, "Dynamic circular work-stealing deque", with the
+ * memory orderings of Lê et al., "Correct and efficient work-stealing for weak memory models").
+ * The owning worker pushes and pops tasks at the bottom, any other thread can steal from the top.
+ * Tasks are handed over as pointers, since a thief may read a slot which the owner overwrites
+ * before the thief's claim fails.
+ */
+class WorkStealingQueue
+{
+public:
+	WorkStealingQueue()
+	{
+		m_Array = NewArray(INITIAL_CAPACITY);
+	}
+	WorkStealingQueue(const WorkStealingQueue&) = delete;
+	WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+	~WorkStealingQueue()
+	{
+		while (Task* task = Pop())
+			delete task;
+	}
+
+	/**
+	 * Owner only.
+	 */
+	void Push(Task* task)
+	{
+		const i64 bottom = m_Bottom.load(std::memory_order_relaxed);
+		const i64 top = m_Top.load(std::memory_order_acquire);
+		Array* array = m_Array.load(std::memory_order_relaxed);
+		if (bottom - top > static_cast<i64>(array->mask))
+		{
+			// Grow the array. Thieves may still be reading the old one, so it's only freed with the queue.
+			Array* grown = NewArray((array->mask + 1) * 2);
+			for (i64 i = top; i < bottom; ++i)
+				grown->Put(i, array->Get(i));
+			array = grown;
+			m_Array.store(array, std::memory_order_release);
+		}
+		array->Put(bottom, task);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Owner only.
+	 * @return the most recently pushed task, or nullptr if the queue is empty.
+	 */
+	Task* Pop()
+	{
+		const i64 bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		Array* array = m_Array.load(std::memory_order_relaxed);
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		i64 top = m_Top.load(std::memory_order_relaxed);
+		if (top > bottom)
+		{
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Task* task = array->Get(bottom);
+		if (top == bottom)
+		{
+			// Last task: race against the thieves for it.
+			if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				task = nullptr;
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	/**
+	 * May be called from any thread.
+	 * @return the least recently pushed task, or nullptr if the queue is empty or another thread got it first.
+	 */
+	Task* Steal()
+	{
+		i64 top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const i64 bottom = m_Bottom.load(std::memory_order_acquire);
+		if (top >= bottom)
+			return nullptr;
+
+		Task* task = m_Array.load(std::memory_order_acquire)->Get(top);
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return task;
+	}
+
+private:
+	static constexpr size_t INITIAL_CAPACITY = 256;
+
+	struct Array
+	{
+		Array(size_t capacity) : mask(capacity - 1), items(capacity) {}
+
+		Task* Get(i64 i) const { return items[i & mask].load(std::memory_order_relaxed); }
+		void Put(i64 i, Task* task) { items[i & mask].store(task, std::memory_order_relaxed); }
+
+		const size_t mask;
+		std::vector<std::atomic<Task*>> items;
+	};
+
+	Array* NewArray(size_t capacity)
+	{
+		m_Arrays.emplace_back(std::make_unique<Array>(capacity));
+		return m_Arrays.back().get();
+	}
+
+	std::atomic<i64> m_Top = 0;
+	std::atomic<i64> m_Bottom = 0;
+	std::atomic<Array*> m_Array;
+	// Every array the queue used, only accessed by the owner.
+	std::vector<std::unique_ptr<Array>> m_Arrays;
+};
 
 /**
  * Light wrapper around std::thread. Ensures Join has been called.
@@ -92,32 +209,46 @@ protected:
 };
 
 /**
- * Worker thread: process the taskManager queues until killed.
+ * Worker thread: process its own queue, the taskManager queues and steal from the other workers until killed.
  */
 class WorkerThread : public Thread
 {
+	friend class TaskManager::Impl;
 public:
-	WorkerThread(TaskManager::Impl& taskManager);
+	WorkerThread(TaskManager::Impl& taskManager, size_t index);
 	~WorkerThread();
 
 	/**
-	 * Wake the worker.
+	 * Stop processing tasks and wait for the thread to finish.
 	 */
-	void Wake();
+	void Kill();
 
 protected:
 	void RunUntilDeath();
 
-	std::mutex m_Mutex;
-	std::condition_variable m_ConditionVariable;
-
 	TaskManager::Impl& m_TaskManager;
+	const size_t m_Index;
+
+	// Tasks pushed by tasks running on this worker.
+	WorkStealingQueue m_Queue;
 };
 
+namespace
+{
+/**
+ * The worker running on the current thread, if any.
+ */
+thread_local WorkerThread* g_CurrentWorker = nullptr;
+}
+
 /**
  * PImpl-ed implementation of the Task manager.
  *
- * The normal priority queue is processed first, the low priority only if there are no higher-priority tasks
+ * Tasks pushed by a worker go to its own work-stealing queue, so that tasks spawning
+ * subtasks don't contend on a lock. Tasks pushed from other threads go to the global queues.
+ * An idle worker looks for tasks in its own queue first, then in the global normal priority queue,
+ * then steals from the other workers, and processes the low priority queue only if
+ * there are no higher-priority tasks.
  */
 class TaskManager::Impl
 {
@@ -128,6 +259,12 @@ public:
 	~Impl()
 	{
 		ClearQueue();
+		// Stop every worker before destroying any of them, they may be stealing from each other.
+		for (WorkerThread& worker : m_Workers)
+			worker.m_Kill = true;
+		WakeAll();
+		for (WorkerThread& worker : m_Workers)
+			worker.Kill();
 		m_Workers.clear();
 	}
 
@@ -137,24 +274,42 @@ public:
 	void SetupWorkers(size_t numberOfWorkers);
 
 	/**
-	 * Push a task on the global queue.
+	 * Push a task on the queue of the current worker, or on the global queue.
 	 * Takes ownership of @a task.
 	 * May be called from any thread.
 	 */
-	void PushTask(std::function<void()>&& task, TaskPriority priority);
+	void PushTask(Task&& task, TaskPriority priority);
 
 protected:
 	void ClearQueue();
 
 	template<TaskPriority Priority>
-	bool PopTask(std::function<void()>& taskOut);
+	bool PopTask(Task& taskOut);
+
+	/**
+	 * Find a task for the given worker, see the class comment for the order.
+	 */
+	bool FindTask(WorkerThread& worker, Task& taskOut);
+
+	/**
+	 * Sleep until there may be tasks to process or the worker is killed.
+	 */
+	void WaitForTasks(WorkerThread& worker);
+
+	void WakeOne();
+	void WakeAll();
+
+	// Number of queued tasks, which may be briefly negative while a task is taken before being counted.
+	std::atomic<i64> m_QueuedTasks = 0;
 
-	std::atomic<bool> m_HasWork = false;
-	std::atomic<bool> m_HasLowPriorityWork = false;
 	std::mutex m_GlobalMutex;
 	std::mutex m_GlobalLowPriorityMutex;
-	std::deque<QueueItem> m_GlobalQueue;
-	std::deque<QueueItem> m_GlobalLowPriorityQueue;
+	std::deque<Task> m_GlobalQueue;
+	std::deque<Task> m_GlobalLowPriorityQueue;
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_SleepConditionVariable;
+	std::atomic<size_t> m_SleepingWorkers = 0;
 
 	// Ideally this would be a vector, since it does get iterated, but that requires movable types.
 	std::deque<WorkerThread> m_Workers;
@@ -176,20 +331,33 @@ TaskManager::~TaskManager() = default;
 void TaskManager::Impl::SetupWorkers(size_t numberOfWorkers)
 {
 	for (size_t i = 0; i < numberOfWorkers; ++i)
-		m_Workers.emplace_back(*this);
+		m_Workers.emplace_back(*this, i);
+	// Only start once all workers exist, since they steal from each other.
+	for (WorkerThread& worker : m_Workers)
+		worker.Start<WorkerThread, &WorkerThread::RunUntilDeath>(&worker);
 }
 
 void TaskManager::ClearQueue() { m->ClearQueue(); }
 void TaskManager::Impl::ClearQueue()
 {
+	i64 cleared = 0;
 	{
 		std::lock_guard<std::mutex> lock(m_GlobalMutex);
+		cleared += m_GlobalQueue.size();
 		m_GlobalQueue.clear();
 	}
 	{
 		std::lock_guard<std::mutex> lock(m_GlobalLowPriorityMutex);
+		cleared += m_GlobalLowPriorityQueue.size();
 		m_GlobalLowPriorityQueue.clear();
 	}
+	for (WorkerThread& worker : m_Workers)
+		while (Task* task = worker.m_Queue.Steal())
+		{
+			delete task;
+			++cleared;
+		}
+	m_QueuedTasks -= cleared;
 }
 
 size_t TaskManager::GetNumberOfWorkers() const
@@ -197,32 +365,32 @@ size_t TaskManager::GetNumberOfWorkers() const
 	return m->m_Workers.size();
 }
 
-void TaskManager::DoPushTask(std::function<void()>&& task, TaskPriority priority)
+void TaskManager::DoPushTask(Task&& task, TaskPriority priority)
 {
 	m->PushTask(std::move(task), priority);
 }
 
-void TaskManager::Impl::PushTask(std::function<void()>&& task, TaskPriority priority)
+void TaskManager::Impl::PushTask(Task&& task, TaskPriority priority)
 {
-	std::mutex& mutex = priority == TaskPriority::NORMAL ? m_GlobalMutex : m_GlobalLowPriorityMutex;
-	std::deque<QueueItem>& queue = priority == TaskPriority::NORMAL ? m_GlobalQueue : m_GlobalLowPriorityQueue;
-	std::atomic<bool>& hasWork = priority == TaskPriority::NORMAL ? m_HasWork : m_HasLowPriorityWork;
+	if (priority == TaskPriority::NORMAL && g_CurrentWorker && &g_CurrentWorker->m_TaskManager == this)
+		g_CurrentWorker->m_Queue.Push(new Task(std::move(task)));
+	else
 	{
+		std::mutex& mutex = priority == TaskPriority::NORMAL ? m_GlobalMutex : m_GlobalLowPriorityMutex;
+		std::deque<Task>& queue = priority == TaskPriority::NORMAL ? m_GlobalQueue : m_GlobalLowPriorityQueue;
 		std::lock_guard<std::mutex> lock(mutex);
 		queue.emplace_back(std::move(task));
-		hasWork = true;
 	}
 
-	for (WorkerThread& worker : m_Workers)
-		worker.Wake();
+	++m_QueuedTasks;
+	WakeOne();
 }
 
 template<TaskPriority Priority>
-bool TaskManager::Impl::PopTask(std::function<void()>& taskOut)
+bool TaskManager::Impl::PopTask(Task& taskOut)
 {
 	std::mutex& mutex = Priority == TaskPriority::NORMAL ? m_GlobalMutex : m_GlobalLowPriorityMutex;
-	std::deque<QueueItem>& queue = Priority == TaskPriority::NORMAL ? m_GlobalQueue : m_GlobalLowPriorityQueue;
-	std::atomic<bool>& hasWork = Priority == TaskPriority::NORMAL ? m_HasWork : m_HasLowPriorityWork;
+	std::deque<Task>& queue = Priority == TaskPriority::NORMAL ? m_GlobalQueue : m_GlobalLowPriorityQueue;
 
 	// Particularly critical section since we're locking the global queue.
 	std::lock_guard<std::mutex> globalLock(mutex);
@@ -230,12 +398,59 @@ bool TaskManager::Impl::PopTask(std::function<void()>& taskOut)
 	{
 		taskOut = std::move(queue.front());
 		queue.pop_front();
-		hasWork = !queue.empty();
 		return true;
 	}
 	return false;
 }
 
+bool TaskManager::Impl::FindTask(WorkerThread& worker, Task& taskOut)
+{
+	Task* task = worker.m_Queue.Pop();
+	if (!task && !PopTask<TaskPriority::NORMAL>(taskOut))
+	{
+		// Steal from the other workers, starting from the next one so that thieves spread out.
+		for (size_t i = 1; i < m_Workers.size() && !task; ++i)
+			task = m_Workers[(worker.m_Index + i) % m_Workers.size()].m_Queue.Steal();
+		if (!task && !PopTask<TaskPriority::LOW>(taskOut))
+			return false;
+	}
+
+	if (task)
+	{
+		taskOut = std::move(*task);
+		delete task;
+	}
+	--m_QueuedTasks;
+	return true;
+}
+
+void TaskManager::Impl::WaitForTasks(WorkerThread& worker)
+{
+	std::unique_lock<std::mutex> lock(m_SleepMutex);
+	// Pushers check for sleeping workers after counting their task,
+	// so either they see this worker or it sees their task.
+	++m_SleepingWorkers;
+	m_SleepConditionVariable.wait(lock, [this, &worker]() {
+		return worker.m_Kill || m_QueuedTasks > 0;
+	});
+	--m_SleepingWorkers;
+}
+
+void TaskManager::Impl::WakeOne()
+{
+	if (m_SleepingWorkers == 0)
+		return;
+	// Lock so that the notification can't happen between a worker's check and its wait.
+	std::lock_guard<std::mutex> lock(m_SleepMutex);
+	m_SleepConditionVariable.notify_one();
+}
+
+void TaskManager::Impl::WakeAll()
+{
+	std::lock_guard<std::mutex> lock(m_SleepMutex);
+	m_SleepConditionVariable.notify_all();
+}
+
 void TaskManager::Initialise()
 {
 	if (!g_TaskManager)
@@ -248,25 +463,88 @@ TaskManager& TaskManager::Instance()
 	return *g_TaskManager;
 }
 
+// Task groups
+
+class TaskGroup::State
+{
+public:
+	/**
+	 * Run one of the tasks which haven't been started yet.
+	 * @return false if there were none.
+	 */
+	bool RunOne()
+	{
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Pending.empty())
+				return false;
+			task = std::move(m_Pending.front());
+			m_Pending.pop_front();
+		}
+		task();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_Unfinished == 0)
+				m_ConditionVariable.notify_all();
+		}
+		return true;
+	}
+
+	std::mutex m_Mutex;
+	std::condition_variable m_ConditionVariable;
+	std::deque<Task> m_Pending;
+	size_t m_Unfinished = 0;
+};
+
+TaskGroup::TaskGroup(TaskManager& taskManager, TaskPriority priority)
+	: m_TaskManager(taskManager), m_Priority(priority), m_State(std::make_shared<State>())
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+void TaskGroup::DoRun(Task&& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_State->m_Mutex);
+		m_State->m_Pending.emplace_back(std::move(task));
+		++m_State->m_Unfinished;
+	}
+	// The queued task only picks up the group's next pending task, which may have been run by Wait already.
+	m_TaskManager.DoPushTask(Task([state = m_State]() { state->RunOne(); }), m_Priority);
+}
+
+void TaskGroup::Wait()
+{
+	while (m_State->RunOne());
+
+	std::unique_lock<std::mutex> lock(m_State->m_Mutex);
+	m_State->m_ConditionVariable.wait(lock, [this]() { return m_State->m_Unfinished == 0; });
+}
+
 // Thread definition
 
-WorkerThread::WorkerThread(TaskManager::Impl& taskManager)
-	: m_TaskManager(taskManager)
+WorkerThread::WorkerThread(TaskManager::Impl& taskManager, size_t index)
+	: m_TaskManager(taskManager), m_Index(index)
 {
-	Start<WorkerThread, &WorkerThread::RunUntilDeath>(this);
 }
 
 WorkerThread::~WorkerThread()
 {
-	m_Kill = true;
-	m_ConditionVariable.notify_one();
-	if (m_Thread.joinable())
-		m_Thread.join();
+	Kill();
 }
 
-void WorkerThread::Wake()
+void WorkerThread::Kill()
 {
-	m_ConditionVariable.notify_one();
+	if (!m_Thread.joinable())
+		return;
+	m_Kill = true;
+	m_TaskManager.WakeAll();
+	m_Thread.join();
 }
 
 void WorkerThread::RunUntilDeath()
@@ -277,28 +555,22 @@ void WorkerThread::RunUntilDeath()
 	debug_SetThreadName(name.c_str());
 	g_Profiler2.RegisterCurrentThread(name);
 
+	g_CurrentWorker = this;
 
-	std::function<void()> task;
-	bool hasTask = false;
-	std::unique_lock<std::mutex> lock(m_Mutex, std::defer_lock);
+	Task task;
 	while (!m_Kill)
 	{
-		lock.lock();
-		m_ConditionVariable.wait(lock, [this](){
-			return m_Kill || m_TaskManager.m_HasWork || m_TaskManager.m_HasLowPriorityWork;
-		});
-		lock.unlock();
-
-		if (m_Kill)
-			break;
-
-		// Fetch work from the global queues.
-		hasTask = m_TaskManager.PopTask<TaskPriority::NORMAL>(task);
-		if (!hasTask)
-			hasTask = m_TaskManager.PopTask<TaskPriority::LOW>(task);
-		if (hasTask)
+		if (m_TaskManager.FindTask(*this, task))
+		{
 			task();
+			// Destroy the task now, its captures may reference objects its caller waits on.
+			task = Task();
+		}
+		else
+			m_TaskManager.WaitForTasks(*this);
 	}
+
+	g_CurrentWorker = nullptr;
 }
 
 // Defined here - needs access to derived types.
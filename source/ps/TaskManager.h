@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,7 +20,16 @@
 
 #include "ps/Future.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace Threading
@@ -31,6 +40,118 @@ enum class TaskPriority
 	LOW
 };
 
+/**
+ * A move-only type-erased void() callable, used for the queued tasks.
+ * Small closures (such as the packaged task of a Future, or a lambda capturing a few
+ * pointers) are stored inline, so that queuing them doesn't allocate. Larger ones are
+ * moved to the heap.
+ */
+class Task
+{
+public:
+	static constexpr size_t INLINE_SIZE = 48;
+
+	Task() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+	Task(F&& func)
+	{
+		using Func = std::decay_t<F>;
+		if constexpr (IsStoredInline<Func>())
+		{
+			new (m_Storage) Func(std::forward<F>(func));
+			m_Operations = &InlineOperations<Func>::operations;
+		}
+		else
+		{
+			new (m_Storage) Func*(new Func(std::forward<F>(func)));
+			m_Operations = &HeapOperations<Func>::operations;
+		}
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	Task(Task&& o) noexcept
+	{
+		*this = std::move(o);
+	}
+
+	Task& operator=(Task&& o) noexcept
+	{
+		if (this == &o)
+			return *this;
+		Reset();
+		if (o.m_Operations)
+		{
+			o.m_Operations->move(m_Storage, o.m_Storage);
+			m_Operations = o.m_Operations;
+			o.m_Operations = nullptr;
+		}
+		return *this;
+	}
+
+	~Task()
+	{
+		Reset();
+	}
+
+	explicit operator bool() const { return m_Operations; }
+
+	void operator()()
+	{
+		m_Operations->call(m_Storage);
+	}
+
+	template<typename Func>
+	static constexpr bool IsStoredInline()
+	{
+		return sizeof(Func) <= INLINE_SIZE && alignof(Func) <= alignof(std::max_align_t) &&
+			std::is_nothrow_move_constructible_v<Func>;
+	}
+
+private:
+	struct Operations
+	{
+		void (*call)(void* storage);
+		// Move-constructs the callable of @p from into @p to, and destroys the former.
+		void (*move)(void* to, void* from);
+		void (*destroy)(void* storage);
+	};
+
+	template<typename Func>
+	struct InlineOperations
+	{
+		static void Call(void* storage) { (*static_cast<Func*>(storage))(); }
+		static void Move(void* to, void* from)
+		{
+			new (to) Func(std::move(*static_cast<Func*>(from)));
+			static_cast<Func*>(from)->~Func();
+		}
+		static void Destroy(void* storage) { static_cast<Func*>(storage)->~Func(); }
+		static constexpr Operations operations{ Call, Move, Destroy };
+	};
+
+	template<typename Func>
+	struct HeapOperations
+	{
+		static void Call(void* storage) { (**static_cast<Func**>(storage))(); }
+		static void Move(void* to, void* from) { new (to) Func*(*static_cast<Func**>(from)); }
+		static void Destroy(void* storage) { delete *static_cast<Func**>(storage); }
+		static constexpr Operations operations{ Call, Move, Destroy };
+	};
+
+	void Reset()
+	{
+		if (m_Operations)
+			m_Operations->destroy(m_Storage);
+		m_Operations = nullptr;
+	}
+
+	alignas(std::max_align_t) unsigned char m_Storage[INLINE_SIZE];
+	const Operations* m_Operations = nullptr;
+};
+
 /**
  * The task manager creates all worker threads on initialisation,
  * and manages the task queues.
@@ -39,6 +160,7 @@ enum class TaskPriority
 class TaskManager
 {
 	friend class WorkerThread;
+	friend class TaskGroup;
 public:
 	TaskManager();
 	~TaskManager();
@@ -62,6 +184,7 @@ public:
 
 	/**
 	 * Push a task to be executed.
+	 * The only allocation is that of the future's shared state, which holds @p func too.
 	 */
 	template<typename T>
 	Future<std::invoke_result_t<T>> PushTask(T&& func, TaskPriority priority = TaskPriority::NORMAL)
@@ -71,14 +194,146 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Call @p func(i) for every i in [begin, end), and return once all calls are done.
+	 * The range is split into chunks of @p grainSize indices, which the workers and
+	 * the calling thread take in turn. The calling thread doesn't wait for idle workers:
+	 * it processes all the chunks itself if needed, so this can be called from a task too.
+	 */
+	template<typename F>
+	void ParallelFor(size_t begin, size_t end, size_t grainSize, const F& func);
+
 private:
 	TaskManager(size_t numberOfWorkers);
 
-	void DoPushTask(std::function<void()>&& task, TaskPriority priority);
+	void DoPushTask(Task&& task, TaskPriority priority);
 
 	class Impl;
 	const std::unique_ptr<Impl> m;
 };
+
+/**
+ * A set of tasks which can be waited on together.
+ * Tasks are queued on the task manager like any other task, but waiting on the group runs
+ * the group's own tasks which no worker has started yet on the waiting thread,
+ * rather than blocking until a worker gets to them.
+ * Run and Wait must be called from a single thread.
+ */
+class TaskGroup
+{
+public:
+	TaskGroup(TaskManager& taskManager = TaskManager::Instance(), TaskPriority priority = TaskPriority::NORMAL);
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+	~TaskGroup();
+
+	template<typename T>
+	void Run(T&& func)
+	{
+		DoRun(Task(std::forward<T>(func)));
+	}
+
+	/**
+	 * Run or wait on every task of the group, and return once they are all done.
+	 */
+	void Wait();
+
+private:
+	class State;
+
+	void DoRun(Task&& task);
+
+	TaskManager& m_TaskManager;
+	TaskPriority m_Priority;
+	std::shared_ptr<State> m_State;
+};
+
+namespace ParallelForDetail
+{
+/**
+ * State shared between the calling thread and the helper tasks of a ParallelFor.
+ * The helpers may start after the ParallelFor returned (or never), so they hold a reference
+ * to this and only call the function for chunks which aren't done yet.
+ */
+class State
+{
+public:
+	using Body = void (*)(const void* func, size_t first, size_t last);
+
+	State(size_t begin, size_t end, size_t grainSize, Body body, const void* func) :
+		m_Begin(begin), m_End(end), m_GrainSize(grainSize), m_Chunks((end - begin + grainSize - 1) / grainSize),
+		m_Body(body), m_Func(func)
+	{}
+
+	size_t GetNumberOfChunks() const { return m_Chunks; }
+
+	/**
+	 * Process chunks until there are no more to start.
+	 */
+	void Process()
+	{
+		for (size_t chunk = m_NextChunk++; chunk < m_Chunks; chunk = m_NextChunk++)
+		{
+			const size_t first = m_Begin + chunk * m_GrainSize;
+			m_Body(m_Func, first, std::min(first + m_GrainSize, m_End));
+			if (++m_DoneChunks == m_Chunks)
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_ConditionVariable.notify_all();
+			}
+		}
+	}
+
+	/**
+	 * Wait until all chunks are done.
+	 */
+	void Wait()
+	{
+		if (m_DoneChunks == m_Chunks)
+			return;
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_ConditionVariable.wait(lock, [this]() { return m_DoneChunks == m_Chunks; });
+	}
+
+private:
+	const size_t m_Begin, m_End, m_GrainSize, m_Chunks;
+	const Body m_Body;
+	const void* const m_Func;
+
+	std::atomic<size_t> m_NextChunk = 0;
+	std::atomic<size_t> m_DoneChunks = 0;
+	std::mutex m_Mutex;
+	std::condition_variable m_ConditionVariable;
+};
+} // namespace ParallelForDetail
+
+template<typename F>
+void TaskManager::ParallelFor(size_t begin, size_t end, size_t grainSize, const F& func)
+{
+	if (begin >= end)
+		return;
+	grainSize = std::max<size_t>(grainSize, 1);
+	if (end - begin <= grainSize)
+	{
+		for (size_t i = begin; i < end; ++i)
+			func(i);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForDetail::State>(begin, end, grainSize,
+		[](const void* f, size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i)
+				(*static_cast<const F*>(f))(i);
+		}, &func);
+
+	// The calling thread takes a share of the chunks too.
+	const size_t helpers = std::min(state->GetNumberOfChunks() - 1, GetNumberOfWorkers());
+	for (size_t i = 0; i < helpers; ++i)
+		DoPushTask(Task([state]() { state->Process(); }), TaskPriority::NORMAL);
+
+	state->Process();
+	state->Wait();
+}
 } // namespace Threading
 
 #endif // INCLUDED_THREADING_TASKMANAGER
@@ -0,0 +1,92 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "lib/file/file_system.h"
+#include "lib/file/io/io.h"
+#include "ps/ArchiveBuilder.h"
+#include "ps/ConfigDB.h"
+#include "ps/XML/Xeromyces.h"
+
+#include <chrono>
+#include <thread>
+
+class TestArchiveBuilder : public CxxTest::TestSuite
+{
+	OsPath m_Path;
+
+	void Store(const OsPath& pathname, const std::string& contents)
+	{
+		TS_ASSERT_OK(io::Store(pathname, contents.data(), contents.size()));
+	}
+
+	std::string Load(const OsPath& pathname)
+	{
+		CFileInfo fileInfo;
+		TS_ASSERT_OK(GetFileInfo(pathname, &fileInfo));
+		std::string contents(static_cast<size_t>(fileInfo.Size()), '\0');
+		io::BufferPtr buf(io::Allocate(contents.size()));
+		TS_ASSERT_OK(io::Load(pathname, buf.get(), contents.size()));
+		std::copy(buf.get(), buf.get() + contents.size(), contents.begin());
+		return contents;
+	}
+
+	void Build(const OsPath& archive)
+	{
+		CArchiveBuilder builder(m_Path / "mod" / "", m_Path / "cache" / "");
+		builder.Build(archive, true);
+	}
+
+public:
+	void setUp()
+	{
+		m_Path = DataDir() / "_test.archivebuilder" / "";
+		DeleteDirectory(m_Path); // clean up in case the last test run failed
+
+		CConfigDB::Initialise();
+		CXeromyces::Startup();
+	}
+
+	void tearDown()
+	{
+		CXeromyces::Terminate();
+		CConfigDB::Shutdown();
+
+		DeleteDirectory(m_Path);
+	}
+
+	void test_reproducible()
+	{
+		TS_ASSERT_OK(CreateDirectories(m_Path / "mod" / "gui" / "", 0700, false));
+		Store(m_Path / "mod" / "gui" / "page.xml", "<page><include>a.xml</include><include>b.xml</include></page>");
+		Store(m_Path / "mod" / "gui" / "a.xml", "<objects><object name=\"a\"/></objects>");
+		Store(m_Path / "mod" / "gui" / "b.xml", "<objects><object name=\"b\"/></objects>");
+		Store(m_Path / "mod" / "readme.txt", "readme");
+
+		Build(m_Path / "a.zip");
+
+		// Converting the files again later on must not change the archive
+		// (Zip archives store mtimes with a resolution of two seconds).
+		std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+		Build(m_Path / "b.zip");
+
+		const std::string a = Load(m_Path / "a.zip");
+		TS_ASSERT(!a.empty());
+		TS_ASSERT(a == Load(m_Path / "b.zip"));
+	}
+};
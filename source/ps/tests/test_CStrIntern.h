@@ -0,0 +1,61 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "ps/CStrIntern.h"
+
+#include <thread>
+#include <vector>
+
+class TestCStrIntern : public CxxTest::TestSuite
+{
+public:
+	void test_intern()
+	{
+		CStrIntern a("test string");
+		CStrIntern b(std::string("test string"));
+		CStrIntern c("other string");
+		TS_ASSERT(a == b);
+		TS_ASSERT(a != c);
+		TS_ASSERT_EQUALS(a.c_str(), b.c_str());
+		TS_ASSERT_STR_EQUALS(a.string(), "test string");
+		TS_ASSERT(CStrIntern().empty());
+	}
+
+	void test_threads()
+	{
+		// Simulations running on other threads (e.g. batch replays) intern strings concurrently.
+		const size_t numberOfStrings = 1000;
+		std::vector<std::vector<const char*>> interned(4);
+		std::vector<std::thread> threads;
+		for (std::vector<const char*>& strings : interned)
+			threads.emplace_back([&strings, numberOfStrings]() {
+				for (size_t i = 0; i < numberOfStrings; ++i)
+					strings.push_back(CStrIntern("thread string " + std::to_string(i)).c_str());
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+
+		for (size_t i = 0; i < numberOfStrings; ++i)
+		{
+			const CStrIntern str("thread string " + std::to_string(i));
+			for (const std::vector<const char*>& strings : interned)
+				TS_ASSERT_EQUALS(strings[i], str.c_str());
+		}
+	}
+};
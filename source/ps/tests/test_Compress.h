@@ -0,0 +1,143 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "lib/config2.h"
+#include "ps/Compress.h"
+
+#include <ostream>
+#include <random>
+
+class TestCompress : public CxxTest::TestSuite
+{
+	static std::string MakeData(size_t length)
+	{
+		// Mix compressible and random data.
+		std::mt19937 rng(1234);
+		std::string data;
+		data.reserve(length);
+		while (data.size() < length)
+			data += (data.size() / 1000) % 2 ? "some repeated text " : std::string(1, static_cast<char>(rng()));
+		data.resize(length);
+		return data;
+	}
+
+	template<typename Compressor, typename Decompressor>
+	static void TestStreamRoundtrip()
+	{
+		const std::string data = MakeData(500000);
+
+		std::vector<std::string> chunks;
+		Compressor compressor(1000, [&chunks](const std::string& chunk) { chunks.push_back(chunk); });
+		{
+			std::ostream stream(&compressor);
+			// Write in pieces of different sizes, including single characters.
+			for (size_t offset = 0; offset < data.size(); offset += 777)
+			{
+				stream.put(data[offset]);
+				stream.write(data.data() + offset + 1, std::min<size_t>(776, data.size() - offset - 1));
+			}
+			TS_ASSERT(stream.good());
+		}
+		compressor.Finish();
+
+		TS_ASSERT_EQUALS(compressor.GetInputLength(), data.size());
+		TS_ASSERT_LESS_THAN(compressor.GetOutputLength(), data.size());
+		TS_ASSERT_LESS_THAN(1u, chunks.size());
+		size_t outputLength = 0;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			if (i + 1 < chunks.size())
+				TS_ASSERT_EQUALS(chunks[i].size(), 1000u);
+			outputLength += chunks[i].size();
+		}
+		TS_ASSERT_EQUALS(outputLength, compressor.GetOutputLength());
+
+		// Decompress in pieces that don't match the chunks.
+		std::string compressed;
+		for (const std::string& chunk : chunks)
+			compressed += chunk;
+		Decompressor decompressor;
+		std::string out;
+		for (size_t offset = 0; offset < compressed.size(); offset += 333)
+		{
+			TS_ASSERT(!decompressor.IsFinished());
+			TS_ASSERT(decompressor.Decompress(compressed.substr(offset, 333), out));
+		}
+		TS_ASSERT(decompressor.IsFinished());
+		TS_ASSERT(out == data);
+	}
+
+	template<typename Compressor, typename Decompressor>
+	static void TestStreamEmpty()
+	{
+		std::string compressed;
+		Compressor compressor(1000, [&compressed](const std::string& chunk) { compressed += chunk; });
+		compressor.Finish();
+		TS_ASSERT(!compressed.empty());
+
+		Decompressor decompressor;
+		std::string out;
+		TS_ASSERT(decompressor.Decompress(compressed, out));
+		TS_ASSERT(decompressor.IsFinished());
+		TS_ASSERT(out.empty());
+	}
+
+	template<typename Compressor, typename Decompressor>
+	static void TestStreamInvalid()
+	{
+		Decompressor decompressor;
+		std::string out;
+		TS_ASSERT(!decompressor.Decompress("not compressed data", out));
+
+		std::string compressed;
+		Compressor compressor(1000, [&compressed](const std::string& chunk) { compressed += chunk; });
+		std::ostream stream(&compressor);
+		stream << "data";
+		compressor.Finish();
+
+		// Trailing data
+		Decompressor decompressor2;
+		TS_ASSERT(!decompressor2.Decompress(compressed + "x", out));
+	}
+
+public:
+	void test_stream_roundtrip()
+	{
+		TestStreamRoundtrip<CZLibStreamCompressor, CZLibStreamDecompressor>();
+	}
+
+	void test_stream_empty()
+	{
+		TestStreamEmpty<CZLibStreamCompressor, CZLibStreamDecompressor>();
+	}
+
+	void test_stream_invalid()
+	{
+		TestStreamInvalid<CZLibStreamCompressor, CZLibStreamDecompressor>();
+	}
+
+	void test_zstd_stream()
+	{
+#if CONFIG2_ZSTD
+		TestStreamRoundtrip<CZStdStreamCompressor, CZStdStreamDecompressor>();
+		TestStreamEmpty<CZStdStreamCompressor, CZStdStreamDecompressor>();
+		TestStreamInvalid<CZStdStreamCompressor, CZStdStreamDecompressor>();
+#endif
+	}
+};
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,9 +20,13 @@
 #include "ps/Future.h"
 #include "ps/TaskManager.h"
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 class TestTaskManager : public CxxTest::TestSuite
 {
@@ -115,4 +119,93 @@ public:
 			TS_ASSERT_EQUALS(futures[i].Get(), 5);
 #undef ITERATIONS
 	}
+
+	void test_Task()
+	{
+		// The packaged task of a future and small lambdas are stored inline.
+		TS_ASSERT(Threading::Task::IsStoredInline<PackagedTask<int>>());
+		int a = 0, b = 0;
+		auto small = [&a, &b]() { a = 1; b = 2; };
+		TS_ASSERT(Threading::Task::IsStoredInline<decltype(small)>());
+
+		Threading::Task task(small);
+		Threading::Task moved(std::move(task));
+		TS_ASSERT(!task);
+		TS_ASSERT(moved);
+		moved();
+		TS_ASSERT_EQUALS(a, 1);
+		TS_ASSERT_EQUALS(b, 2);
+
+		// Larger closures are moved to the heap.
+		std::array<int, 64> values{};
+		std::shared_ptr<int> counter = std::make_shared<int>(0);
+		auto large = [values, counter]() { *counter += values.size(); };
+		TS_ASSERT(!Threading::Task::IsStoredInline<decltype(large)>());
+		task = Threading::Task(std::move(large));
+		moved = std::move(task);
+		moved();
+		TS_ASSERT_EQUALS(*counter, 64);
+		TS_ASSERT_EQUALS(counter.use_count(), 2);
+		moved = Threading::Task();
+		TS_ASSERT_EQUALS(counter.use_count(), 1);
+	}
+
+	void test_ParallelFor()
+	{
+		Threading::TaskManager& taskManager = Threading::TaskManager::Instance();
+
+		std::vector<std::atomic<int>> calls(10000);
+		taskManager.ParallelFor(0, calls.size(), 7, [&calls](size_t i) { ++calls[i]; });
+		for (const std::atomic<int>& call : calls)
+			TS_ASSERT_EQUALS(call.load(), 1);
+
+		// Empty and partial ranges.
+		taskManager.ParallelFor(5, 5, 1, [&calls](size_t i) { ++calls[i]; });
+		taskManager.ParallelFor(10, 13, 0, [&calls](size_t i) { ++calls[i]; });
+		for (size_t i = 0; i < calls.size(); ++i)
+			TS_ASSERT_EQUALS(calls[i].load(), i >= 10 && i < 13 ? 2 : 1);
+
+		// Nested in tasks, which must not wait for idle workers.
+		std::vector<Future<u64>> futures;
+		for (u64 n = 0; n < 8; ++n)
+			futures.emplace_back(taskManager.PushTask([&taskManager, n]() {
+				std::vector<u64> values(1000);
+				taskManager.ParallelFor(0, values.size(), 16, [&values, n](size_t i) { values[i] = i * n; });
+				u64 sum = 0;
+				for (u64 value : values)
+					sum += value;
+				return sum;
+			}));
+		for (u64 n = 0; n < 8; ++n)
+			TS_ASSERT_EQUALS(futures[n].Get(), n * 999 * 1000 / 2);
+	}
+
+	void test_TaskGroup()
+	{
+		std::atomic<int> tasks_run = 0;
+		{
+			Threading::TaskGroup group;
+			for (int i = 0; i < 1000; ++i)
+				group.Run([&tasks_run]() { ++tasks_run; });
+			group.Wait();
+			TS_ASSERT_EQUALS(tasks_run.load(), 1000);
+
+			// Groups can be reused, and the waiting thread runs the tasks no worker took.
+			std::atomic<bool> go = false;
+			Future<void> blockers[64];
+			for (Future<void>& blocker : blockers)
+				blocker = Threading::TaskManager::Instance().PushTask([&go]() { while (!go) std::this_thread::yield(); });
+			group.Run([&tasks_run]() { ++tasks_run; });
+			group.Wait();
+			TS_ASSERT_EQUALS(tasks_run.load(), 1001);
+			go = true;
+			for (Future<void>& blocker : blockers)
+				blocker.Wait();
+
+			// The destructor waits for the tasks.
+			for (int i = 0; i < 100; ++i)
+				group.Run([&tasks_run]() { ++tasks_run; });
+		}
+		TS_ASSERT_EQUALS(tasks_run.load(), 1101);
+	}
 };
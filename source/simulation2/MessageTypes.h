@@ -253,6 +253,13 @@ public:
 	{
 	}
 
+	// Copyable so that batches of this message can be stored contiguously
+	// (see CComponentManager::SubscribeGloballyToMessageBatches).
+	CMessageOwnershipChanged(const CMessageOwnershipChanged& other) :
+		entity(other.entity), from(other.from), to(other.to)
+	{
+	}
+
 	entity_id_t entity;
 	player_id_t from;
 	player_id_t to;
@@ -275,6 +282,13 @@ public:
 	{
 	}
 
+	// Copyable so that batches of this message can be stored contiguously
+	// (see CComponentManager::SubscribeGloballyToMessageBatches).
+	CMessagePositionChanged(const CMessagePositionChanged& other) :
+		entity(other.entity), inWorld(other.inWorld), x(other.x), z(other.z), a(other.a)
+	{
+	}
+
 	entity_id_t entity;
 	bool inWorld;
 	entity_pos_t x, z;
@@ -40,6 +40,7 @@
 #include "scriptinterface/StructuredClone.h"
 #include "simulation2/MessageTypes.h"
 #include "simulation2/system/ComponentManager.h"
+#include "simulation2/system/FrameArena.h"
 #include "simulation2/system/ParamNode.h"
 #include "simulation2/system/SimContext.h"
 #include "simulation2/components/ICmpAIManager.h"
@@ -587,6 +588,17 @@ void CSimulation2Impl::UpdateComponents(CSimContext& simContext, fixed turnLengt
 		cmpPathfinder->UpdateGrid();
 		cmpPathfinder->StartProcessingMoves(false);
 	}
+
+	// Release the temporaries of this turn.
+	{
+		PROFILE2("Reset Frame Arena");
+		CFrameArena& frameArena = simContext.GetFrameArena();
+		PROFILE2_ATTR("allocations: %u", frameArena.GetStats().allocations);
+		PROFILE2_ATTR("heap allocations: %u", frameArena.GetStats().heapAllocations);
+		PROFILE2_ATTR("bytes: %zu", frameArena.GetStats().bytes);
+		frameArena.Reset();
+		frameArena.ResetStats();
+	}
 }
 
 void CSimulation2Impl::Interpolate(float simFrameLength, float frameOffset, float realFrameLength)
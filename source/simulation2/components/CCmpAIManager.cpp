@@ -30,6 +30,7 @@
 #include "ps/Filesystem.h"
 #include "ps/Profile.h"
 #include "ps/scripting/JSInterface_VFS.h"
+#include "ps/TaskManager.h"
 #include "ps/TemplateLoader.h"
 #include "ps/Util.h"
 #include "scriptinterface/FunctionWrapper.h"
@@ -65,6 +66,10 @@ extern void QuitEngine();
  * The AI can therefore directly use the simulation data via the 'Sim' & 'SimEngine' globals.
  * As a result, a lof of the code is still designed to be "thread-ready", but this no longer matters.
  *
+ * The C++ side of the AI turn does not need JS though: the AI pathfinders are updated
+ * on a worker thread while the simulation builds the gamestate, and are only waited for
+ * when the AI scripts run.
+ *
  * TODO: despite the above, it would still be useful to allow the AI to run tasks asynchronously (and off-thread).
  * This could be implemented by having a separate JS runtime in a different thread,
  * that runs tasks and returns after a distinct # of simulation turns (to maintain determinism).
@@ -224,6 +229,8 @@ public:
 
 	~CAIWorker()
 	{
+		WaitForPathfinderUpdate();
+
 		// Init will always be called.
 		JS_RemoveExtraGCRootsTracer(m_ScriptInterface->GetGeneralJSContext(), Trace, this);
 	}
@@ -492,6 +499,8 @@ public:
 		// this will be run last by InitGame.js, passing the full game representation.
 		// For now it will run for the shared Component.
 		// This is NOT run during deserialization.
+		WaitForPathfinderUpdate();
+
 		ScriptRequest rq(m_ScriptInterface);
 
 		JS::RootedValue state(rq.cx);
@@ -533,25 +542,19 @@ public:
 		const std::map<std::string, pass_class_t>& nonPathfindingPassClassMasks, const std::map<std::string, pass_class_t>& pathfindingPassClassMasks)
 	{
 		ENSURE(m_CommandsComputed);
-		bool dimensionChange = m_PassabilityMap.m_W != passabilityMap.m_W || m_PassabilityMap.m_H != passabilityMap.m_H;
+		WaitForPathfinderUpdate();
 
-		m_PassabilityMap = passabilityMap;
-		if (globallyDirty)
-		{
-			m_LongPathfinder.Reload(&m_PassabilityMap);
-			m_HierarchicalPathfinder.Recompute(&m_PassabilityMap, nonPathfindingPassClassMasks, pathfindingPassClassMasks);
-		}
-		else
-		{
-			m_LongPathfinder.Update(&m_PassabilityMap);
-			m_HierarchicalPathfinder.Update(&m_PassabilityMap, dirtinessGrid);
-		}
+		bool dimensionChange = m_PassabilityMap.m_W != passabilityMap.m_W || m_PassabilityMap.m_H != passabilityMap.m_H;
 
 		ScriptRequest rq(m_ScriptInterface);
 		if (dimensionChange || justDeserialized)
+		{
+			m_PassabilityMap = passabilityMap;
 			Script::ToJSVal(rq, &m_PassabilityMapVal, m_PassabilityMap);
+		}
 		else
 		{
+			PROFILE2("AI copy passability");
 			// Avoid a useless memory reallocation followed by a garbage collection.
 			JS::RootedObject mapObj(rq.cx, &m_PassabilityMapVal.toObject());
 			JS::RootedValue mapData(rq.cx);
@@ -560,12 +563,39 @@ public:
 
 			u32 length = 0;
 			ENSURE(JS::GetArrayLength(rq.cx, dataObj, &length));
-			u32 nbytes = (u32)(length * sizeof(NavcellData));
+			ENSURE(length == static_cast<u32>(passabilityMap.m_W * passabilityMap.m_H));
 
 			bool sharedMemory;
 			JS::AutoCheckCannotGC nogc;
-			memcpy((void*)JS_GetUint16ArrayData(dataObj, &sharedMemory, nogc), m_PassabilityMap.m_Data, nbytes);
+			NavcellData* data = JS_GetUint16ArrayData(dataObj, &sharedMemory, nogc);
+
+			// Both copies were identical to the simulation grid when the dirtiness was last flushed,
+			// so unless the whole grid changed, only the dirty cells need to be copied.
+			size_t copied = length;
+			if (globallyDirty)
+			{
+				m_PassabilityMap = passabilityMap;
+				memcpy(data, m_PassabilityMap.m_Data, length * sizeof(NavcellData));
+			}
+			else
+				copied = m_PassabilityMap.copy_dirty_data(passabilityMap, dirtinessGrid, data);
+			PROFILE2_ATTR("passability bytes: %zu", 2 * copied * sizeof(NavcellData));
 		}
+
+		// The AI pathfinders only read our copy of the grid and are not used before the AI scripts run,
+		// so update them asynchronously. The dirtiness grid is flushed by the caller, so copy it.
+		if (globallyDirty)
+			m_PathfinderUpdate = Threading::TaskManager::Instance().PushTask([this, nonPathfindingPassClassMasks, pathfindingPassClassMasks]() {
+				PROFILE2("AI pathfinder recompute");
+				m_LongPathfinder.Reload(&m_PassabilityMap);
+				m_HierarchicalPathfinder.Recompute(&m_PassabilityMap, nonPathfindingPassClassMasks, pathfindingPassClassMasks);
+			});
+		else
+			m_PathfinderUpdate = Threading::TaskManager::Instance().PushTask([this, dirtinessGrid]() {
+				PROFILE2("AI pathfinder update");
+				m_LongPathfinder.Update(&m_PassabilityMap, dirtinessGrid);
+				m_HierarchicalPathfinder.Update(&m_PassabilityMap, dirtinessGrid);
+			});
 	}
 
 	void UpdateTerritoryMap(const Grid<u8>& territoryMap)
@@ -710,6 +740,7 @@ public:
 		ScriptRequest rq(m_ScriptInterface);
 
 		ENSURE(m_CommandsComputed); // deserializing while we're still actively computing would be bad
+		WaitForPathfinderUpdate();
 
 		CStdDeserializer deserializer(*m_ScriptInterface, stream);
 
@@ -795,8 +826,21 @@ private:
 		out.set(m_PlayerMetadata[path].get());
 	}
 
+	/**
+	 * Wait for the asynchronous update of the AI pathfinders, if any.
+	 * This must be called before the pathfinders or the passability grid are modified or used for paths.
+	 */
+	void WaitForPathfinderUpdate()
+	{
+		// The update must complete (never cancel it) to stay deterministic.
+		m_PathfinderUpdate.Wait();
+	}
+
 	void PerformComputation()
 	{
+		// The AI scripts may compute paths.
+		WaitForPathfinderUpdate();
+
 		// Deserialize the game state, to pass to the AI's HandleMessage
 		ScriptRequest rq(m_ScriptInterface);
 		{
@@ -857,6 +901,7 @@ private:
 	std::map<std::string, pass_class_t> m_PathfindingPassClasses;
 	HierarchicalPathfinder m_HierarchicalPathfinder;
 	LongPathfinder m_LongPathfinder;
+	Future<void> m_PathfinderUpdate;
 
 	bool m_CommandsComputed;
 
@@ -994,18 +1039,8 @@ public:
 		CmpPtr<ICmpAIInterface> cmpAIInterface(GetSystemEntity());
 		ENSURE(cmpAIInterface);
 
-		// Get the game state from AIInterface
-		JS::RootedValue state(rq.cx);
-		if (m_JustDeserialized)
-			cmpAIInterface->GetFullRepresentation(&state, false);
-		else
-			cmpAIInterface->GetRepresentation(&state);
-		LoadPathfinderClasses(state); // add the pathfinding classes to it
-
-		// Update the game state
-		m_Worker.UpdateGameState(state);
-
-		// Update the pathfinding data
+		// Update the pathfinding data first: the AI pathfinders are then updated
+		// on a worker thread while we compute the game state.
 		CmpPtr<ICmpPathfinder> cmpPathfinder(GetSystemEntity());
 		if (cmpPathfinder)
 		{
@@ -1026,6 +1061,17 @@ public:
 			cmpPathfinder->FlushAIPathfinderDirtinessInformation();
 		}
 
+		// Get the game state from AIInterface
+		JS::RootedValue state(rq.cx);
+		if (m_JustDeserialized)
+			cmpAIInterface->GetFullRepresentation(&state, false);
+		else
+			cmpAIInterface->GetRepresentation(&state);
+		LoadPathfinderClasses(state); // add the pathfinding classes to it
+
+		// Update the game state
+		m_Worker.UpdateGameState(state);
+
 		// Update the territory data
 		// Since getting the territory grid can trigger a recalculation, we check NeedUpdateAI first
 		CmpPtr<ICmpTerritoryManager> cmpTerritoryManager(GetSystemEntity());
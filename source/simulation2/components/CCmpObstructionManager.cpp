@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -34,6 +34,7 @@
 #include "graphics/Overlay.h"
 #include "maths/MathUtil.h"
 #include "ps/Profile.h"
+#include "ps/TaskManager.h"
 #include "renderer/Scene.h"
 #include "ps/CLogger.h"
 
@@ -55,6 +56,16 @@ namespace
  */
 constexpr entity_pos_t OBSTRUCTION_SUBDIVISION_SIZE = entity_pos_t::FromInt(32);
 
+/**
+ * Height in terrain tiles of the bands of the grid rasterized by a single task.
+ */
+constexpr int RASTERIZE_BAND_TILES = 16;
+
+/**
+ * Minimum number of shapes to rasterize before splitting the work between tasks.
+ */
+constexpr size_t MIN_SHAPES_FOR_PARALLEL_RASTERIZE = 64;
+
 /**
  * Internal representation of axis-aligned circular shapes for moving units
  */
@@ -80,6 +91,213 @@ struct StaticShape
 	entity_id_t group;
 	entity_id_t group2;
 };
+
+/**
+ * Returns the padding of the bounding boxes of rotated shapes with the given half size in the batch overlap tests,
+ * which accounts for the rounding errors of the fixed-point rotation vectors.
+ */
+CFixedVector2D GetBoxTestPadding(const CFixedVector2D& halfSize)
+{
+	entity_pos_t padding = (halfSize.X + halfSize.Y) / 128 + entity_pos_t::FromFraction(1, 16);
+	return CFixedVector2D(padding, padding);
+}
+
+/**
+ * Returns the bounding box used by the batch overlap tests of unit shapes, which is the shape itself.
+ */
+Geometry::PackedBox GetShapeBox(const UnitShape& shape)
+{
+	CFixedVector2D center(shape.x, shape.z);
+	CFixedVector2D halfSize(shape.clearance, shape.clearance);
+	return Geometry::PackBox(center - halfSize, center + halfSize);
+}
+
+/**
+ * Returns the bounding box used by the batch overlap tests of static shapes.
+ * It is padded so that it still contains the shape (and the shape expanded by some clearance,
+ * if the query box is expanded by twice that clearance) in spite of the rounding errors
+ * of the fixed-point rotation vectors.
+ */
+Geometry::PackedBox GetShapeBox(const StaticShape& shape)
+{
+	CFixedVector2D center(shape.x, shape.z);
+	CFixedVector2D halfSize = Geometry::GetHalfBoundingBox(shape.u, shape.v, CFixedVector2D(shape.hw, shape.hh)) +
+		GetBoxTestPadding(CFixedVector2D(shape.hw, shape.hh));
+	return Geometry::PackBox(center - halfSize, center + halfSize);
+}
+
+/**
+ * Storage of the shapes of one kind, indexed by shape ID.
+ *
+ * The shapes are kept in a dense array sorted by ID. IDs are allocated in increasing order,
+ * so adding a shape is a push_back, and removing a shape leaves a hole which is compacted
+ * once there are enough of them. Queries refer to shapes by their slot in the dense array.
+ * The bounding box of each shape is stored in a parallel array for Geometry::FilterOverlappingBoxes.
+ *
+ * The slot of each ID is looked up in pages of consecutive IDs, which are freed once all their shapes
+ * have been removed, so the lookup only takes memory for the IDs of (roughly) the existing shapes.
+ */
+template<typename T>
+class ShapeStore
+{
+public:
+	void clear()
+	{
+		m_Ids.clear();
+		m_Shapes.clear();
+		m_Boxes.clear();
+		m_SlotPages.clear();
+		m_SlotPageSizes.clear();
+		m_Holes = 0;
+	}
+
+	size_t size() const { return m_Ids.size() - m_Holes; }
+
+	void Insert(u32 id, const T& shape)
+	{
+		ENSURE(m_Ids.empty() || m_Ids.back() < id);
+
+		const size_t page = id / SLOT_PAGE_SIZE;
+		if (page >= m_SlotPages.size())
+		{
+			m_SlotPages.resize(page + 1);
+			m_SlotPageSizes.resize(page + 1, 0);
+		}
+		if (m_SlotPages[page].empty())
+			m_SlotPages[page].resize(SLOT_PAGE_SIZE, NO_SLOT);
+		m_SlotPages[page][id % SLOT_PAGE_SIZE] = static_cast<u32>(m_Ids.size());
+		++m_SlotPageSizes[page];
+		m_Ids.push_back(id);
+		m_Shapes.push_back(shape);
+		m_Boxes.push_back(GetShapeBox(shape));
+	}
+
+	void Erase(u32 id)
+	{
+		const u32 slot = GetSlot(id);
+		m_Boxes[slot] = Geometry::EmptyPackedBox();
+		const size_t page = id / SLOT_PAGE_SIZE;
+		m_SlotPages[page][id % SLOT_PAGE_SIZE] = NO_SLOT;
+		if (--m_SlotPageSizes[page] == 0)
+			std::vector<u32>().swap(m_SlotPages[page]);
+
+		if (++m_Holes >= MIN_HOLES_TO_COMPACT && m_Holes * 4 > m_Ids.size())
+			Compact();
+	}
+
+	T& Get(u32 id) { return m_Shapes[GetSlot(id)]; }
+	const T& Get(u32 id) const { return m_Shapes[GetSlot(id)]; }
+
+	/**
+	 * Returns the shape @p id, or nullptr if there's none.
+	 */
+	const T* Find(u32 id) const
+	{
+		const u32 slot = FindSlot(id);
+		return slot == NO_SLOT ? nullptr : &m_Shapes[slot];
+	}
+
+	/**
+	 * Must be called after changing the position or the size of the shape @p id.
+	 */
+	void UpdateBox(u32 id)
+	{
+		const u32 slot = GetSlot(id);
+		m_Boxes[slot] = GetShapeBox(m_Shapes[slot]);
+	}
+
+	/**
+	 * Replaces the shape IDs in @p ids by their slots.
+	 */
+	void ToSlots(std::vector<u32>& ids) const
+	{
+		for (u32& id : ids)
+			id = GetSlot(id);
+	}
+
+	/**
+	 * Removes from @p slots the shapes whose bounding box doesn't overlap [@p min, @p max].
+	 */
+	void FilterOverlapping(std::vector<u32>& slots, const CFixedVector2D& min, const CFixedVector2D& max) const
+	{
+		slots.resize(Geometry::FilterOverlappingBoxes(m_Boxes.data(), slots.data(), slots.size(), min, max, slots.data()));
+	}
+
+	u32 GetIdAt(u32 slot) const { return m_Ids[slot]; }
+	const T& GetAt(u32 slot) const { return m_Shapes[slot]; }
+
+	/**
+	 * Calls @p func(id, shape) for every shape, in increasing ID order.
+	 */
+	template<typename F>
+	void ForEach(F func) const
+	{
+		for (size_t slot = 0; slot < m_Ids.size(); ++slot)
+			if (FindSlot(m_Ids[slot]) == slot)
+				func(m_Ids[slot], m_Shapes[slot]);
+	}
+
+private:
+	static constexpr u32 NO_SLOT = 0xFFFFFFFF;
+
+	/**
+	 * Minimum number of holes before compacting the arrays.
+	 */
+	static constexpr size_t MIN_HOLES_TO_COMPACT = 64;
+
+	/**
+	 * Number of consecutive IDs per page of slots.
+	 */
+	static constexpr size_t SLOT_PAGE_SIZE = 1024;
+
+	/**
+	 * Returns the slot of the shape @p id, or NO_SLOT if there's none.
+	 */
+	u32 FindSlot(u32 id) const
+	{
+		const size_t page = id / SLOT_PAGE_SIZE;
+		if (page >= m_SlotPages.size() || m_SlotPages[page].empty())
+			return NO_SLOT;
+		return m_SlotPages[page][id % SLOT_PAGE_SIZE];
+	}
+
+	u32 GetSlot(u32 id) const
+	{
+		const u32 slot = FindSlot(id);
+		ENSURE(slot != NO_SLOT);
+		return slot;
+	}
+
+	void Compact()
+	{
+		size_t n = 0;
+		for (size_t slot = 0; slot < m_Ids.size(); ++slot)
+		{
+			if (FindSlot(m_Ids[slot]) != slot)
+				continue;
+			m_Ids[n] = m_Ids[slot];
+			m_Shapes[n] = m_Shapes[slot];
+			m_Boxes[n] = m_Boxes[slot];
+			m_SlotPages[m_Ids[n] / SLOT_PAGE_SIZE][m_Ids[n] % SLOT_PAGE_SIZE] = static_cast<u32>(n);
+			++n;
+		}
+		m_Ids.resize(n);
+		m_Shapes.resize(n);
+		m_Boxes.resize(n);
+		m_Holes = 0;
+	}
+
+	std::vector<u32> m_Ids;
+	std::vector<T> m_Shapes;
+	std::vector<Geometry::PackedBox> m_Boxes;
+
+	// Slot of each shape in the dense arrays, by page of IDs and index in the page.
+	// Pages without shapes are empty.
+	std::vector<std::vector<u32>> m_SlotPages;
+	// Number of shapes in each page.
+	std::vector<u32> m_SlotPageSizes;
+	size_t m_Holes = 0;
+};
 } // anonymous namespace
 /**
  * Serialization helper template for UnitShape
@@ -123,6 +341,37 @@ struct SerializeHelper<StaticShape>
 	}
 };
 
+/**
+ * Serialization helper template for ShapeStore, with the same format as a std::map from IDs to shapes
+ */
+template<typename T>
+struct SerializeHelper<ShapeStore<T>>
+{
+	void operator()(ISerializer& serialize, const char* UNUSED(name), ShapeStore<T>& value) const
+	{
+		serialize.NumberU32_Unbounded("length", static_cast<u32>(value.size()));
+		value.ForEach([&serialize](u32 id, T shape) {
+			serialize.NumberU32_Unbounded("key", id);
+			Serializer(serialize, "value", shape);
+		});
+	}
+
+	void operator()(IDeserializer& deserialize, const char* UNUSED(name), ShapeStore<T>& value) const
+	{
+		value.clear();
+		u32 len;
+		deserialize.NumberU32_Unbounded("length", len);
+		for (u32 i = 0; i < len; ++i)
+		{
+			u32 id;
+			T shape;
+			deserialize.NumberU32_Unbounded("key", id);
+			Serializer(deserialize, "value", shape);
+			value.Insert(id, shape);
+		}
+	}
+};
+
 class CCmpObstructionManager final : public ICmpObstructionManager
 {
 public:
@@ -140,9 +389,8 @@ public:
 	SpatialSubdivision m_UnitSubdivision;
 	SpatialSubdivision m_StaticSubdivision;
 
-	// TODO: using std::map is a bit inefficient; is there a better way to store these?
-	std::map<u32, UnitShape> m_UnitShapes;
-	std::map<u32, StaticShape> m_StaticShapes;
+	ShapeStore<UnitShape> m_UnitShapes;
+	ShapeStore<StaticShape> m_StaticShapes;
 	u32 m_UnitShapeNext; // next allocated id
 	u32 m_StaticShapeNext;
 
@@ -263,26 +511,24 @@ public:
 		m_UnitSubdivision.Reset(x1, z1, OBSTRUCTION_SUBDIVISION_SIZE);
 		m_StaticSubdivision.Reset(x1, z1, OBSTRUCTION_SUBDIVISION_SIZE);
 
-		for (std::map<u32, UnitShape>::iterator it = m_UnitShapes.begin(); it != m_UnitShapes.end(); ++it)
-		{
-			CFixedVector2D center(it->second.x, it->second.z);
-			CFixedVector2D halfSize(it->second.clearance, it->second.clearance);
-			m_UnitSubdivision.Add(it->first, center - halfSize, center + halfSize);
-		}
+		m_UnitShapes.ForEach([this](u32 id, const UnitShape& shape) {
+			CFixedVector2D center(shape.x, shape.z);
+			CFixedVector2D halfSize(shape.clearance, shape.clearance);
+			m_UnitSubdivision.Add(id, center - halfSize, center + halfSize);
+		});
 
-		for (std::map<u32, StaticShape>::iterator it = m_StaticShapes.begin(); it != m_StaticShapes.end(); ++it)
-		{
-			CFixedVector2D center(it->second.x, it->second.z);
-			CFixedVector2D bbHalfSize = Geometry::GetHalfBoundingBox(it->second.u, it->second.v, CFixedVector2D(it->second.hw, it->second.hh));
-			m_StaticSubdivision.Add(it->first, center - bbHalfSize, center + bbHalfSize);
-		}
+		m_StaticShapes.ForEach([this](u32 id, const StaticShape& shape) {
+			CFixedVector2D center(shape.x, shape.z);
+			CFixedVector2D bbHalfSize = Geometry::GetHalfBoundingBox(shape.u, shape.v, CFixedVector2D(shape.hw, shape.hh));
+			m_StaticSubdivision.Add(id, center - bbHalfSize, center + bbHalfSize);
+		});
 	}
 
 	tag_t AddUnitShape(entity_id_t ent, entity_pos_t x, entity_pos_t z, entity_pos_t clearance, flags_t flags, entity_id_t group) override
 	{
 		UnitShape shape = { ent, x, z, clearance, flags, group };
 		u32 id = m_UnitShapeNext++;
-		m_UnitShapes[id] = shape;
+		m_UnitShapes.Insert(id, shape);
 
 		m_UnitSubdivision.Add(id, CFixedVector2D(x - clearance, z - clearance), CFixedVector2D(x + clearance, z + clearance));
 
@@ -300,7 +546,7 @@ public:
 
 		StaticShape shape = { ent, x, z, u, v, w/2, h/2, flags, group, group2 };
 		u32 id = m_StaticShapeNext++;
-		m_StaticShapes[id] = shape;
+		m_StaticShapes.Insert(id, shape);
 
 		CFixedVector2D center(x, z);
 		CFixedVector2D bbHalfSize = Geometry::GetHalfBoundingBox(u, v, CFixedVector2D(w/2, h/2));
@@ -336,7 +582,7 @@ public:
 
 		if (TAG_IS_UNIT(tag))
 		{
-			UnitShape& shape = m_UnitShapes[TAG_TO_INDEX(tag)];
+			UnitShape& shape = m_UnitShapes.Get(TAG_TO_INDEX(tag));
 
 			MakeDirtyUnit(shape.flags, TAG_TO_INDEX(tag), shape); // dirty the old shape region
 
@@ -348,6 +594,7 @@ public:
 
 			shape.x = x;
 			shape.z = z;
+			m_UnitShapes.UpdateBox(TAG_TO_INDEX(tag));
 
 			MakeDirtyUnit(shape.flags, TAG_TO_INDEX(tag), shape); // dirty the new shape region
 		}
@@ -358,7 +605,7 @@ public:
 			CFixedVector2D u(c, -s);
 			CFixedVector2D v(s, c);
 
-			StaticShape& shape = m_StaticShapes[TAG_TO_INDEX(tag)];
+			StaticShape& shape = m_StaticShapes.Get(TAG_TO_INDEX(tag));
 
 			MakeDirtyStatic(shape.flags, TAG_TO_INDEX(tag), shape); // dirty the old shape region
 
@@ -374,6 +621,7 @@ public:
 			shape.z = z;
 			shape.u = u;
 			shape.v = v;
+			m_StaticShapes.UpdateBox(TAG_TO_INDEX(tag));
 
 			MakeDirtyStatic(shape.flags, TAG_TO_INDEX(tag), shape); // dirty the new shape region
 		}
@@ -385,7 +633,7 @@ public:
 
 		if (TAG_IS_UNIT(tag))
 		{
-			UnitShape& shape = m_UnitShapes[TAG_TO_INDEX(tag)];
+			UnitShape& shape = m_UnitShapes.Get(TAG_TO_INDEX(tag));
 			if (moving)
 				shape.flags |= FLAG_MOVING;
 			else
@@ -401,7 +649,7 @@ public:
 
 		if (TAG_IS_UNIT(tag))
 		{
-			UnitShape& shape = m_UnitShapes[TAG_TO_INDEX(tag)];
+			UnitShape& shape = m_UnitShapes.Get(TAG_TO_INDEX(tag));
 			shape.group = group;
 		}
 	}
@@ -412,7 +660,7 @@ public:
 
 		if (TAG_IS_STATIC(tag))
 		{
-			StaticShape& shape = m_StaticShapes[TAG_TO_INDEX(tag)];
+			StaticShape& shape = m_StaticShapes.Get(TAG_TO_INDEX(tag));
 			shape.group = group;
 			shape.group2 = group2;
 		}
@@ -424,18 +672,18 @@ public:
 
 		if (TAG_IS_UNIT(tag))
 		{
-			UnitShape& shape = m_UnitShapes[TAG_TO_INDEX(tag)];
+			UnitShape& shape = m_UnitShapes.Get(TAG_TO_INDEX(tag));
 			m_UnitSubdivision.Remove(TAG_TO_INDEX(tag),
 				CFixedVector2D(shape.x - shape.clearance, shape.z - shape.clearance),
 				CFixedVector2D(shape.x + shape.clearance, shape.z + shape.clearance));
 
 			MakeDirtyUnit(shape.flags, TAG_TO_INDEX(tag), shape);
 
-			m_UnitShapes.erase(TAG_TO_INDEX(tag));
+			m_UnitShapes.Erase(TAG_TO_INDEX(tag));
 		}
 		else
 		{
-			StaticShape& shape = m_StaticShapes[TAG_TO_INDEX(tag)];
+			StaticShape& shape = m_StaticShapes.Get(TAG_TO_INDEX(tag));
 
 			CFixedVector2D center(shape.x, shape.z);
 			CFixedVector2D bbHalfSize = Geometry::GetHalfBoundingBox(shape.u, shape.v, CFixedVector2D(shape.hw, shape.hh));
@@ -443,7 +691,7 @@ public:
 
 			MakeDirtyStatic(shape.flags, TAG_TO_INDEX(tag), shape);
 
-			m_StaticShapes.erase(TAG_TO_INDEX(tag));
+			m_StaticShapes.Erase(TAG_TO_INDEX(tag));
 		}
 	}
 
@@ -453,7 +701,7 @@ public:
 
 		if (TAG_IS_UNIT(tag))
 		{
-			const UnitShape& shape = m_UnitShapes.at(TAG_TO_INDEX(tag));
+			const UnitShape& shape = m_UnitShapes.Get(TAG_TO_INDEX(tag));
 			CFixedVector2D u(entity_pos_t::FromInt(1), entity_pos_t::Zero());
 			CFixedVector2D v(entity_pos_t::Zero(), entity_pos_t::FromInt(1));
 			ObstructionSquare o = { shape.x, shape.z, u, v, shape.clearance, shape.clearance };
@@ -461,7 +709,7 @@ public:
 		}
 		else
 		{
-			const StaticShape& shape = m_StaticShapes.at(TAG_TO_INDEX(tag));
+			const StaticShape& shape = m_StaticShapes.Get(TAG_TO_INDEX(tag));
 			ObstructionSquare o = { shape.x, shape.z, shape.u, shape.v, shape.hw, shape.hh };
 			return o;
 		}
@@ -488,6 +736,9 @@ public:
 	void GetObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const override;
 	void GetUnitObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const override;
 	void GetStaticObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const override;
+	ObstructionCells GetObstructionCellsInRange(entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1) const override;
+	void GetStaticObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const override;
+	void GetUnitObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const override;
 	void GetUnitsOnObstruction(const ObstructionSquare& square, std::vector<entity_id_t>& out, const IObstructionTestFilter& filter, bool strict = false) const override;
 	void GetStaticObstructionsOnObstruction(const ObstructionSquare& square, std::vector<entity_id_t>& out, const IObstructionTestFilter& filter) const override;
 
@@ -663,7 +914,25 @@ private:
 		return (m_WorldX0 <= p.X && p.X <= m_WorldX1 && m_WorldZ0 <= p.Y && p.Y <= m_WorldZ1);
 	}
 
-	void RasterizeHelper(Grid<NavcellData>& grid, ICmpObstructionManager::flags_t requireMask, bool fullUpdate, pass_class_t appliedMask, entity_pos_t clearance = fixed::Zero()) const;
+	/**
+	 * Shapes with the flags @p requireMask are rasterized with the given @p clearance
+	 * and set the bits @p appliedMask of the navcells they cover.
+	 */
+	struct RasterizePass
+	{
+		flags_t requireMask;
+		pass_class_t appliedMask;
+		entity_pos_t clearance;
+	};
+
+	/**
+	 * Rasterizes the given shapes for every pass, restricted to the rows j0 <= j < j1 of the grid.
+	 * The first and last bands must extend beyond the grid, since the rows of the shapes outside
+	 * of the grid are drawn on its border.
+	 */
+	void RasterizeBand(Grid<NavcellData>& grid, const std::vector<RasterizePass>& passes,
+		const std::vector<const StaticShape*>& staticShapes, const std::vector<const UnitShape*>& unitShapes,
+		i16 j0, i16 j1) const;
 };
 
 REGISTER_COMPONENT_TYPE(ObstructionManager)
@@ -874,35 +1143,40 @@ bool CCmpObstructionManager::TestLine(const IObstructionTestFilter& filter, enti
 	if (relaxClearanceForUnits)
 		unitUnitRadius -= entity_pos_t::FromInt(1)/2;
 
-	std::vector<entity_id_t> unitShapes;
+	// The ray can only hit a unit whose square overlaps the ray's bounding box expanded by r
+	// (since unitUnitRadius <= r).
+	std::vector<u32> unitShapes;
 	m_UnitSubdivision.GetInRange(unitShapes, posMin, posMax);
-	for (const entity_id_t& shape : unitShapes)
+	m_UnitShapes.ToSlots(unitShapes);
+	m_UnitShapes.FilterOverlapping(unitShapes, posMin, posMax);
+	for (u32 slot : unitShapes)
 	{
-		std::map<u32, UnitShape>::const_iterator it = m_UnitShapes.find(shape);
-		ENSURE(it != m_UnitShapes.end());
-
-		if (!filter.TestShape(UNIT_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, INVALID_ENTITY))
+		const UnitShape& shape = m_UnitShapes.GetAt(slot);
+		if (!filter.TestShape(UNIT_INDEX_TO_TAG(m_UnitShapes.GetIdAt(slot)), shape.flags, shape.group, INVALID_ENTITY))
 			continue;
 
-		CFixedVector2D center(it->second.x, it->second.z);
-		CFixedVector2D halfSize(it->second.clearance + unitUnitRadius, it->second.clearance + unitUnitRadius);
+		CFixedVector2D center(shape.x, shape.z);
+		CFixedVector2D halfSize(shape.clearance + unitUnitRadius, shape.clearance + unitUnitRadius);
 		if (Geometry::TestRayAASquare(CFixedVector2D(x0, z0) - center, CFixedVector2D(x1, z1) - center, halfSize))
 			return true;
 	}
 
-	std::vector<entity_id_t> staticShapes;
+	// A static shape expanded by r along its own axes can stick out of its bounding box by up to r*sqrt(2),
+	// so expand the ray's bounding box by another r for the box test.
+	std::vector<u32> staticShapes;
 	m_StaticSubdivision.GetInRange(staticShapes, posMin, posMax);
-	for (const entity_id_t& shape : staticShapes)
+	m_StaticShapes.ToSlots(staticShapes);
+	CFixedVector2D expand = CFixedVector2D(r, r) + GetBoxTestPadding(CFixedVector2D(r, r));
+	m_StaticShapes.FilterOverlapping(staticShapes, posMin - expand, posMax + expand);
+	for (u32 slot : staticShapes)
 	{
-		std::map<u32, StaticShape>::const_iterator it = m_StaticShapes.find(shape);
-		ENSURE(it != m_StaticShapes.end());
-
-		if (!filter.TestShape(STATIC_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, it->second.group2))
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		if (!filter.TestShape(STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2))
 			continue;
 
-		CFixedVector2D center(it->second.x, it->second.z);
-		CFixedVector2D halfSize(it->second.hw + r, it->second.hh + r);
-		if (Geometry::TestRaySquare(CFixedVector2D(x0, z0) - center, CFixedVector2D(x1, z1) - center, it->second.u, it->second.v, halfSize))
+		CFixedVector2D center(shape.x, shape.z);
+		CFixedVector2D halfSize(shape.hw + r, shape.hh + r);
+		if (Geometry::TestRaySquare(CFixedVector2D(x0, z0) - center, CFixedVector2D(x1, z1) - center, shape.u, shape.v, halfSize))
 			return true;
 	}
 
@@ -942,43 +1216,42 @@ bool CCmpObstructionManager::TestStaticShape(const IObstructionTestFilter& filte
 	CFixedVector2D posMin(x - bbHalfWidth, z - bbHalfHeight);
 	CFixedVector2D posMax(x + bbHalfWidth, z + bbHalfHeight);
 
-	std::vector<entity_id_t> unitShapes;
+	std::vector<u32> unitShapes;
 	m_UnitSubdivision.GetInRange(unitShapes, posMin, posMax);
-	for (entity_id_t& shape : unitShapes)
+	m_UnitShapes.ToSlots(unitShapes);
+	for (u32 slot : unitShapes)
 	{
-		std::map<u32, UnitShape>::const_iterator it = m_UnitShapes.find(shape);
-		ENSURE(it != m_UnitShapes.end());
-
-		if (!filter.TestShape(UNIT_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, INVALID_ENTITY))
+		const UnitShape& shape = m_UnitShapes.GetAt(slot);
+		if (!filter.TestShape(UNIT_INDEX_TO_TAG(m_UnitShapes.GetIdAt(slot)), shape.flags, shape.group, INVALID_ENTITY))
 			continue;
 
-		CFixedVector2D center1(it->second.x, it->second.z);
+		CFixedVector2D center1(shape.x, shape.z);
 
-		if (Geometry::PointIsInSquare(center1 - center, u, v, CFixedVector2D(halfSize.X + it->second.clearance, halfSize.Y + it->second.clearance)))
+		if (Geometry::PointIsInSquare(center1 - center, u, v, CFixedVector2D(halfSize.X + shape.clearance, halfSize.Y + shape.clearance)))
 		{
 			if (out)
-				out->push_back(it->second.entity);
+				out->push_back(shape.entity);
 			else
 				return true;
 		}
 	}
 
-	std::vector<entity_id_t> staticShapes;
+	std::vector<u32> staticShapes;
 	m_StaticSubdivision.GetInRange(staticShapes, posMin, posMax);
-	for (entity_id_t& shape : staticShapes)
+	m_StaticShapes.ToSlots(staticShapes);
+	m_StaticShapes.FilterOverlapping(staticShapes, posMin - GetBoxTestPadding(halfSize), posMax + GetBoxTestPadding(halfSize));
+	for (u32 slot : staticShapes)
 	{
-		std::map<u32, StaticShape>::const_iterator it = m_StaticShapes.find(shape);
-		ENSURE(it != m_StaticShapes.end());
-
-		if (!filter.TestShape(STATIC_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, it->second.group2))
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		if (!filter.TestShape(STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2))
 			continue;
 
-		CFixedVector2D center1(it->second.x, it->second.z);
-		CFixedVector2D halfSize1(it->second.hw, it->second.hh);
-		if (Geometry::TestSquareSquare(center, u, v, halfSize, center1, it->second.u, it->second.v, halfSize1))
+		CFixedVector2D center1(shape.x, shape.z);
+		CFixedVector2D halfSize1(shape.hw, shape.hh);
+		if (Geometry::TestSquareSquare(center, u, v, halfSize, center1, shape.u, shape.v, halfSize1))
 		{
 			if (out)
-				out->push_back(it->second.entity);
+				out->push_back(shape.entity);
 			else
 				return true;
 		}
@@ -1009,46 +1282,41 @@ bool CCmpObstructionManager::TestUnitShape(const IObstructionTestFilter& filter,
 	CFixedVector2D posMin(x - clearance, z - clearance);
 	CFixedVector2D posMax(x + clearance, z + clearance);
 
-	std::vector<entity_id_t> unitShapes;
+	// The box test is exact for unit shapes.
+	std::vector<u32> unitShapes;
 	m_UnitSubdivision.GetInRange(unitShapes, posMin, posMax);
-	for (const entity_id_t& shape : unitShapes)
+	m_UnitShapes.ToSlots(unitShapes);
+	m_UnitShapes.FilterOverlapping(unitShapes, posMin, posMax);
+	for (u32 slot : unitShapes)
 	{
-		std::map<u32, UnitShape>::const_iterator it = m_UnitShapes.find(shape);
-		ENSURE(it != m_UnitShapes.end());
-
-		if (!filter.TestShape(UNIT_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, INVALID_ENTITY))
+		const UnitShape& shape = m_UnitShapes.GetAt(slot);
+		if (!filter.TestShape(UNIT_INDEX_TO_TAG(m_UnitShapes.GetIdAt(slot)), shape.flags, shape.group, INVALID_ENTITY))
 			continue;
 
-		entity_pos_t c1 = it->second.clearance;
-
-		if (!(
-			it->second.x + c1 < x - clearance ||
-			it->second.x - c1 > x + clearance ||
-			it->second.z + c1 < z - clearance ||
-			it->second.z - c1 > z + clearance))
-		{
-			if (out)
-				out->push_back(it->second.entity);
-			else
-				return true;
-		}
+		if (out)
+			out->push_back(shape.entity);
+		else
+			return true;
 	}
 
-	std::vector<entity_id_t> staticShapes;
+	// A static shape expanded by the clearance along its own axes can stick out of its bounding box
+	// by up to clearance*sqrt(2), so expand the query box by another clearance for the box test.
+	std::vector<u32> staticShapes;
 	m_StaticSubdivision.GetInRange(staticShapes, posMin, posMax);
-	for (const entity_id_t& shape : staticShapes)
+	m_StaticShapes.ToSlots(staticShapes);
+	CFixedVector2D expand = CFixedVector2D(clearance, clearance) + GetBoxTestPadding(CFixedVector2D(clearance, clearance));
+	m_StaticShapes.FilterOverlapping(staticShapes, posMin - expand, posMax + expand);
+	for (u32 slot : staticShapes)
 	{
-		std::map<u32, StaticShape>::const_iterator it = m_StaticShapes.find(shape);
-		ENSURE(it != m_StaticShapes.end());
-
-		if (!filter.TestShape(STATIC_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, it->second.group2))
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		if (!filter.TestShape(STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2))
 			continue;
 
-		CFixedVector2D center1(it->second.x, it->second.z);
-		if (Geometry::PointIsInSquare(center1 - center, it->second.u, it->second.v, CFixedVector2D(it->second.hw + clearance, it->second.hh + clearance)))
+		CFixedVector2D center1(shape.x, shape.z);
+		if (Geometry::PointIsInSquare(center1 - center, shape.u, shape.v, CFixedVector2D(shape.hw + clearance, shape.hh + clearance)))
 		{
 			if (out)
-				out->push_back(it->second.entity);
+				out->push_back(shape.entity);
 			else
 				return true;
 		}
@@ -1093,61 +1361,111 @@ void CCmpObstructionManager::Rasterize(Grid<NavcellData>& grid, const std::vecto
 		}
 	}
 
+	std::vector<RasterizePass> passes;
+	for (const std::pair<const entity_pos_t, u16>& maskPair : pathfindingMasks)
+		passes.push_back({ FLAG_BLOCK_PATHFINDING, maskPair.second, maskPair.first });
+	if (foundationMask)
+		passes.push_back({ FLAG_BLOCK_FOUNDATION, foundationMask, entity_pos_t::Zero() });
+
 	// FLAG_BLOCK_PATHFINDING and FLAG_BLOCK_FOUNDATION are the only flags taken into account by MakeDirty* functions,
 	// so they should be the only ones rasterized using with the help of m_Dirty*Shapes vectors.
+	const flags_t rasterizedFlags = FLAG_BLOCK_PATHFINDING | FLAG_BLOCK_FOUNDATION;
 
-	for (auto& maskPair : pathfindingMasks)
-		RasterizeHelper(grid, FLAG_BLOCK_PATHFINDING, fullUpdate, maskPair.second, maskPair.first);
-
-	RasterizeHelper(grid, FLAG_BLOCK_FOUNDATION, fullUpdate, foundationMask);
+	std::vector<const StaticShape*> staticShapes;
+	std::vector<const UnitShape*> unitShapes;
+	if (fullUpdate)
+	{
+		m_StaticShapes.ForEach([&](u32 UNUSED(id), const StaticShape& shape) {
+			if (shape.flags & rasterizedFlags)
+				staticShapes.push_back(&shape);
+		});
+		m_UnitShapes.ForEach([&](u32 UNUSED(id), const UnitShape& shape) {
+			if (shape.flags & rasterizedFlags)
+				unitShapes.push_back(&shape);
+		});
+	}
+	else
+	{
+		for (u32 id : m_DirtyStaticShapes)
+			if (const StaticShape* shape = m_StaticShapes.Find(id))
+				if (shape->flags & rasterizedFlags)
+					staticShapes.push_back(shape);
+		for (u32 id : m_DirtyUnitShapes)
+			if (const UnitShape* shape = m_UnitShapes.Find(id))
+				if (shape->flags & rasterizedFlags)
+					unitShapes.push_back(shape);
+	}
 
 	m_DirtyStaticShapes.clear();
 	m_DirtyUnitShapes.clear();
-}
 
-void CCmpObstructionManager::RasterizeHelper(Grid<NavcellData>& grid, ICmpObstructionManager::flags_t requireMask, bool fullUpdate, pass_class_t appliedMask, entity_pos_t clearance) const
-{
-	for (auto& pair : m_StaticShapes)
+	if (passes.empty() || (staticShapes.empty() && unitShapes.empty()))
+		return;
+
+	// Small updates aren't worth the overhead of the tasks.
+	const i16 bandRows = RASTERIZE_BAND_TILES * Pathfinding::NAVCELLS_PER_TERRAIN_TILE;
+	const size_t numberOfBands = staticShapes.size() + unitShapes.size() < MIN_SHAPES_FOR_PARALLEL_RASTERIZE ?
+		1 : (grid.m_H + bandRows - 1) / bandRows;
+	if (numberOfBands <= 1)
 	{
-		const StaticShape& shape = pair.second;
-		if (!(shape.flags & requireMask))
-			continue;
+		RasterizeBand(grid, passes, staticShapes, unitShapes, std::numeric_limits<i16>::min(), std::numeric_limits<i16>::max());
+		return;
+	}
 
-		if (!fullUpdate && std::find(m_DirtyStaticShapes.begin(), m_DirtyStaticShapes.end(), pair.first) == m_DirtyStaticShapes.end())
-			continue;
+	// Each band only writes its own rows of the grid, and the masks are combined with bitwise ORs,
+	// so the result doesn't depend on the number of threads.
+	Threading::TaskManager::Instance().ParallelFor(0, numberOfBands, 1, [&](size_t band) {
+		PROFILE2("Async rasterize obstructions");
+		const i16 j0 = band == 0 ? std::numeric_limits<i16>::min() : static_cast<i16>(band * bandRows);
+		const i16 j1 = band == numberOfBands - 1 ? std::numeric_limits<i16>::max() : static_cast<i16>((band + 1) * bandRows);
+		RasterizeBand(grid, passes, staticShapes, unitShapes, j0, j1);
+	});
+}
 
-		// TODO: it might be nice to rasterize with rounded corners for large 'expand' values.
-		ObstructionSquare square = { shape.x, shape.z, shape.u, shape.v, shape.hw, shape.hh };
-		SimRasterize::Spans spans;
-		SimRasterize::RasterizeRectWithClearance(spans, square, clearance, Pathfinding::NAVCELL_SIZE);
-		for (SimRasterize::Span& span : spans)
+void CCmpObstructionManager::RasterizeBand(Grid<NavcellData>& grid, const std::vector<RasterizePass>& passes,
+	const std::vector<const StaticShape*>& staticShapes, const std::vector<const UnitShape*>& unitShapes,
+	i16 j0, i16 j1) const
+{
+	SimRasterize::Spans spans;
+	for (const RasterizePass& pass : passes)
+	{
+		for (const StaticShape* shape : staticShapes)
 		{
-			i16 j = Clamp(span.j, (i16)0, (i16)(grid.m_H-1));
-			i16 i0 = std::max(span.i0, (i16)0);
-			i16 i1 = std::min(span.i1, (i16)grid.m_W);
+			if (!(shape->flags & pass.requireMask))
+				continue;
+
+			// TODO: it might be nice to rasterize with rounded corners for large 'expand' values.
+			ObstructionSquare square = { shape->x, shape->z, shape->u, shape->v, shape->hw, shape->hh };
+			spans.clear();
+			SimRasterize::RasterizeRectWithClearance(spans, square, pass.clearance, Pathfinding::NAVCELL_SIZE, j0, j1);
+			for (SimRasterize::Span& span : spans)
+			{
+				i16 j = Clamp(span.j, (i16)0, (i16)(grid.m_H-1));
+				i16 i0 = std::max(span.i0, (i16)0);
+				i16 i1 = std::min(span.i1, (i16)grid.m_W);
 
-			for (i16 i = i0; i < i1; ++i)
-				grid.set(i, j, grid.get(i, j) | appliedMask);
+				for (i16 i = i0; i < i1; ++i)
+					grid.set(i, j, grid.get(i, j) | pass.appliedMask);
+			}
 		}
-	}
-
-	for (auto& pair : m_UnitShapes)
-	{
-		if (!(pair.second.flags & requireMask))
-			continue;
 
-		if (!fullUpdate && std::find(m_DirtyUnitShapes.begin(), m_DirtyUnitShapes.end(), pair.first) == m_DirtyUnitShapes.end())
-			continue;
-
-		CFixedVector2D center(pair.second.x, pair.second.z);
-		entity_pos_t r = pair.second.clearance + clearance;
-
-		u16 i0, j0, i1, j1;
-		Pathfinding::NearestNavcell(center.X - r, center.Y - r, i0, j0, grid.m_W, grid.m_H);
-		Pathfinding::NearestNavcell(center.X + r, center.Y + r, i1, j1, grid.m_W, grid.m_H);
-		for (u16 j = j0+1; j < j1; ++j)
-			for (u16 i = i0+1; i < i1; ++i)
-				grid.set(i, j, grid.get(i, j) | appliedMask);
+		for (const UnitShape* shape : unitShapes)
+		{
+			if (!(shape->flags & pass.requireMask))
+				continue;
+
+			CFixedVector2D center(shape->x, shape->z);
+			entity_pos_t r = shape->clearance + pass.clearance;
+
+			u16 i0, jMin, i1, jMax;
+			Pathfinding::NearestNavcell(center.X - r, center.Y - r, i0, jMin, grid.m_W, grid.m_H);
+			Pathfinding::NearestNavcell(center.X + r, center.Y + r, i1, jMax, grid.m_W, grid.m_H);
+			const int jBegin = std::max<int>(jMin + 1, j0);
+			const int jEnd = std::min<int>(jMax, j1);
+			for (int j = jBegin; j < jEnd; ++j)
+				for (u16 i = i0+1; i < i1; ++i)
+					grid.set(i, j, grid.get(i, j) | pass.appliedMask);
+		}
 	}
 }
 
@@ -1163,25 +1481,22 @@ void CCmpObstructionManager::GetUnitObstructionsInRange(const IObstructionTestFi
 
 	ENSURE(x0 <= x1 && z0 <= z1);
 
-	std::vector<entity_id_t> unitShapes;
+	std::vector<u32> unitShapes;
 	m_UnitSubdivision.GetInRange(unitShapes, CFixedVector2D(x0, z0), CFixedVector2D(x1, z1));
-	for (entity_id_t& unitShape : unitShapes)
-	{
-		std::map<u32, UnitShape>::const_iterator it = m_UnitShapes.find(unitShape);
-		ENSURE(it != m_UnitShapes.end());
-
-		if (!filter.TestShape(UNIT_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, INVALID_ENTITY))
-			continue;
+	m_UnitShapes.ToSlots(unitShapes);
 
-		entity_pos_t c = it->second.clearance;
+	// Skip the objects which are completely outside the requested range
+	m_UnitShapes.FilterOverlapping(unitShapes, CFixedVector2D(x0, z0), CFixedVector2D(x1, z1));
 
-		// Skip this object if it's completely outside the requested range
-		if (it->second.x + c < x0 || it->second.x - c > x1 || it->second.z + c < z0 || it->second.z - c > z1)
+	CFixedVector2D u(entity_pos_t::FromInt(1), entity_pos_t::Zero());
+	CFixedVector2D v(entity_pos_t::Zero(), entity_pos_t::FromInt(1));
+	for (u32 slot : unitShapes)
+	{
+		const UnitShape& shape = m_UnitShapes.GetAt(slot);
+		if (!filter.TestShape(UNIT_INDEX_TO_TAG(m_UnitShapes.GetIdAt(slot)), shape.flags, shape.group, INVALID_ENTITY))
 			continue;
 
-		CFixedVector2D u(entity_pos_t::FromInt(1), entity_pos_t::Zero());
-		CFixedVector2D v(entity_pos_t::Zero(), entity_pos_t::FromInt(1));
-		squares.emplace_back(ObstructionSquare{ it->second.x, it->second.z, u, v, c, c });
+		squares.emplace_back(ObstructionSquare{ shape.x, shape.z, u, v, shape.clearance, shape.clearance });
 	}
 }
 
@@ -1191,25 +1506,65 @@ void CCmpObstructionManager::GetStaticObstructionsInRange(const IObstructionTest
 
 	ENSURE(x0 <= x1 && z0 <= z1);
 
-	std::vector<entity_id_t> staticShapes;
+	std::vector<u32> staticShapes;
 	m_StaticSubdivision.GetInRange(staticShapes, CFixedVector2D(x0, z0), CFixedVector2D(x1, z1));
-	for (entity_id_t& staticShape : staticShapes)
+	m_StaticShapes.ToSlots(staticShapes);
+	for (u32 slot : staticShapes)
 	{
-		std::map<u32, StaticShape>::const_iterator it = m_StaticShapes.find(staticShape);
-		ENSURE(it != m_StaticShapes.end());
-
-		if (!filter.TestShape(STATIC_INDEX_TO_TAG(it->first), it->second.flags, it->second.group, it->second.group2))
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		if (!filter.TestShape(STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2))
 			continue;
 
-		entity_pos_t r = it->second.hw + it->second.hh; // overestimate the max dist of an edge from the center
+		ObstructionSquare square{ shape.x, shape.z, shape.u, shape.v, shape.hw, shape.hh };
 
 		// Skip this object if its overestimated bounding box is completely outside the requested range
-		if (it->second.x + r < x0 || it->second.x - r > x1 || it->second.z + r < z0 || it->second.z - r > z1)
+		if (!IsStaticObstructionInRange(square, x0, z0, x1, z1))
 			continue;
 
-		// TODO: maybe we should use Geometry::GetHalfBoundingBox to be more precise?
+		squares.emplace_back(square);
+	}
+}
+
+ICmpObstructionManager::ObstructionCells CCmpObstructionManager::GetObstructionCellsInRange(entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1) const
+{
+	// Both subdivisions have the same layout, see ResetSubdivisions.
+	ObstructionCells cells;
+	m_StaticSubdivision.GetDivisionsInRange(CFixedVector2D(x0, z0), CFixedVector2D(x1, z1), cells.i0, cells.j0, cells.i1, cells.j1);
+	return cells;
+}
+
+void CCmpObstructionManager::GetStaticObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const
+{
+	PROFILE("GetObstructionsInCells");
+
+	std::vector<u32> staticShapes;
+	m_StaticSubdivision.GetInDivisions(staticShapes, cells.i0, cells.j0, cells.i1, cells.j1);
+	m_StaticShapes.ToSlots(staticShapes);
+	for (u32 slot : staticShapes)
+	{
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		squares.emplace_back(FilterableObstructionSquare{
+			ObstructionSquare{ shape.x, shape.z, shape.u, shape.v, shape.hw, shape.hh },
+			STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2 });
+	}
+}
+
+void CCmpObstructionManager::GetUnitObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const
+{
+	PROFILE("GetObstructionsInCells");
+
+	std::vector<u32> unitShapes;
+	m_UnitSubdivision.GetInDivisions(unitShapes, cells.i0, cells.j0, cells.i1, cells.j1);
+	m_UnitShapes.ToSlots(unitShapes);
 
-		squares.emplace_back(ObstructionSquare{ it->second.x, it->second.z, it->second.u, it->second.v, it->second.hw, it->second.hh });
+	CFixedVector2D u(entity_pos_t::FromInt(1), entity_pos_t::Zero());
+	CFixedVector2D v(entity_pos_t::Zero(), entity_pos_t::FromInt(1));
+	for (u32 slot : unitShapes)
+	{
+		const UnitShape& shape = m_UnitShapes.GetAt(slot);
+		squares.emplace_back(FilterableObstructionSquare{
+			ObstructionSquare{ shape.x, shape.z, u, v, shape.clearance, shape.clearance },
+			UNIT_INDEX_TO_TAG(m_UnitShapes.GetIdAt(slot)), shape.flags, shape.group, INVALID_ENTITY });
 	}
 }
 
@@ -1232,10 +1587,7 @@ void CCmpObstructionManager::GetUnitsOnObstruction(const ObstructionSquare& squa
 
 	for (const u32& unitShape : unitShapes)
 	{
-		std::map<u32, UnitShape>::const_iterator it = m_UnitShapes.find(unitShape);
-		ENSURE(it != m_UnitShapes.end());
-
-		const UnitShape& shape = it->second;
+		const UnitShape& shape = m_UnitShapes.Get(unitShape);
 
 		if (!filter.TestShape(UNIT_INDEX_TO_TAG(unitShape), shape.flags, shape.group, INVALID_ENTITY))
 			continue;
@@ -1282,15 +1634,14 @@ void CCmpObstructionManager::GetStaticObstructionsOnObstruction(const Obstructio
 	CFixedVector2D center(square.x, square.z);
 	CFixedVector2D expandedBox = Geometry::GetHalfBoundingBox(square.u, square.v, CFixedVector2D(square.hw, square.hh));
 	m_StaticSubdivision.GetInRange(staticShapes, center - expandedBox, center + expandedBox);
+	m_StaticShapes.ToSlots(staticShapes);
+	CFixedVector2D paddedBox = expandedBox + GetBoxTestPadding(CFixedVector2D(square.hw, square.hh));
+	m_StaticShapes.FilterOverlapping(staticShapes, center - paddedBox, center + paddedBox);
 
-	for (const u32& staticShape : staticShapes)
+	for (u32 slot : staticShapes)
 	{
-		std::map<u32, StaticShape>::const_iterator it = m_StaticShapes.find(staticShape);
-		ENSURE(it != m_StaticShapes.end());
-
-		const StaticShape& shape = it->second;
-
-		if (!filter.TestShape(STATIC_INDEX_TO_TAG(staticShape), shape.flags, shape.group, shape.group2))
+		const StaticShape& shape = m_StaticShapes.GetAt(slot);
+		if (!filter.TestShape(STATIC_INDEX_TO_TAG(m_StaticShapes.GetIdAt(slot)), shape.flags, shape.group, shape.group2))
 			continue;
 
 		if (Geometry::TestSquareSquare(
@@ -1329,20 +1680,18 @@ void CCmpObstructionManager::RenderSubmit(SceneCollector& collector)
 				(m_WorldX1-m_WorldX0).ToFloat(), (m_WorldZ1-m_WorldZ0).ToFloat(),
 				0, m_DebugOverlayLines.back(), true);
 
-		for (std::map<u32, UnitShape>::iterator it = m_UnitShapes.begin(); it != m_UnitShapes.end(); ++it)
-		{
+		m_UnitShapes.ForEach([&](u32 UNUSED(id), const UnitShape& shape) {
 			m_DebugOverlayLines.push_back(SOverlayLine());
-			m_DebugOverlayLines.back().m_Color = ((it->second.flags & FLAG_MOVING) ? movingColor : defaultColor);
-			SimRender::ConstructSquareOnGround(GetSimContext(), it->second.x.ToFloat(), it->second.z.ToFloat(), it->second.clearance.ToFloat(), it->second.clearance.ToFloat(), 0, m_DebugOverlayLines.back(), true);
-		}
+			m_DebugOverlayLines.back().m_Color = ((shape.flags & FLAG_MOVING) ? movingColor : defaultColor);
+			SimRender::ConstructSquareOnGround(GetSimContext(), shape.x.ToFloat(), shape.z.ToFloat(), shape.clearance.ToFloat(), shape.clearance.ToFloat(), 0, m_DebugOverlayLines.back(), true);
+		});
 
-		for (std::map<u32, StaticShape>::iterator it = m_StaticShapes.begin(); it != m_StaticShapes.end(); ++it)
-		{
+		m_StaticShapes.ForEach([&](u32 UNUSED(id), const StaticShape& shape) {
 			m_DebugOverlayLines.push_back(SOverlayLine());
 			m_DebugOverlayLines.back().m_Color = defaultColor;
-			float a = atan2f(it->second.v.X.ToFloat(), it->second.v.Y.ToFloat());
-			SimRender::ConstructSquareOnGround(GetSimContext(), it->second.x.ToFloat(), it->second.z.ToFloat(), it->second.hw.ToFloat()*2, it->second.hh.ToFloat()*2, a, m_DebugOverlayLines.back(), true);
-		}
+			float a = atan2f(shape.v.X.ToFloat(), shape.v.Y.ToFloat());
+			SimRender::ConstructSquareOnGround(GetSimContext(), shape.x.ToFloat(), shape.z.ToFloat(), shape.hw.ToFloat()*2, shape.hh.ToFloat()*2, a, m_DebugOverlayLines.back(), true);
+		});
 
 		m_DebugOverlayDirty = false;
 	}
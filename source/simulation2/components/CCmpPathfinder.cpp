@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -63,6 +63,7 @@ void CCmpPathfinder::Init(const CParamNode& UNUSED(paramNode))
 	// Store one vertex pathfinder for each thread (including the main thread).
 	while (m_VertexPathfinders.size() < workerThreads + 1)
 		m_VertexPathfinders.emplace_back(m_GridSize, m_TerrainOnlyGrid);
+	m_VertexObstructionCache = std::make_unique<VertexPathfinderObstructionCache>();
 	m_LongPathfinder = std::make_unique<LongPathfinder>();
 	m_PathfinderHier = std::make_unique<HierarchicalPathfinder>();
 
@@ -150,6 +151,56 @@ struct SerializeHelper<ShortPathRequest>
 	}
 };
 
+template<>
+struct SerializeHelper<LongPathCache::Key>
+{
+	void operator()(ISerializer& serialize, const char* UNUSED(name), const LongPathCache::Key& value)
+	{
+		serialize.NumberU16_Unbounded("pass class", value.passClass);
+		serialize.NumberU8_Unbounded("start ci", value.start.ci);
+		serialize.NumberU8_Unbounded("start cj", value.start.cj);
+		serialize.NumberU16_Unbounded("start region", value.start.r);
+		serialize.NumberU8_Unbounded("goal ci", value.goal.ci);
+		serialize.NumberU8_Unbounded("goal cj", value.goal.cj);
+		serialize.NumberU16_Unbounded("goal region", value.goal.r);
+		serialize.NumberU8_Unbounded("goal type", value.goalType);
+	}
+
+	void operator()(IDeserializer& deserialize, const char* UNUSED(name), LongPathCache::Key& value)
+	{
+		deserialize.NumberU16_Unbounded("pass class", value.passClass);
+		deserialize.NumberU8_Unbounded("start ci", value.start.ci);
+		deserialize.NumberU8_Unbounded("start cj", value.start.cj);
+		deserialize.NumberU16_Unbounded("start region", value.start.r);
+		deserialize.NumberU8_Unbounded("goal ci", value.goal.ci);
+		deserialize.NumberU8_Unbounded("goal cj", value.goal.cj);
+		deserialize.NumberU16_Unbounded("goal region", value.goal.r);
+		deserialize.NumberU8_Unbounded("goal type", value.goalType);
+	}
+};
+
+template<>
+struct SerializeHelper<LongPathCache::Entry>
+{
+	template<typename S>
+	void operator()(S& serialize, const char* UNUSED(name), Serialize::qualify<S, LongPathCache::Entry> value)
+	{
+		Serializer(serialize, "waypoints", value.waypoints);
+		serialize.NumberU32_Unbounded("last used", value.lastUsed);
+	}
+};
+
+template<>
+struct SerializeHelper<LongPathCache>
+{
+	template<typename S>
+	void operator()(S& serialize, const char* UNUSED(name), Serialize::qualify<S, LongPathCache> value)
+	{
+		Serializer(serialize, "entries", value.m_Entries);
+		serialize.NumberU32_Unbounded("clock", value.m_Clock);
+	}
+};
+
 template<typename S>
 void CCmpPathfinder::SerializeCommon(S& serialize)
 {
@@ -157,6 +208,7 @@ void CCmpPathfinder::SerializeCommon(S& serialize)
 	Serializer(serialize, "short requests", m_ShortPathRequests.m_Requests);
 	serialize.NumberU32_Unbounded("next ticket", m_NextAsyncTicket);
 	serialize.NumberU16_Unbounded("grid size", m_GridSize);
+	Serializer(serialize, "long path cache", m_LongPathCache);
 }
 
 void CCmpPathfinder::Serialize(ISerializer& serialize)
@@ -498,10 +550,13 @@ void CCmpPathfinder::UpdateGrid()
 	{
 		SAFE_DELETE(m_Grid);
 		SAFE_DELETE(m_TerrainOnlyGrid);
+		m_LongPathCache.Clear();
 	}
 
 	// Initialise the terrain data when first needed
-	if (!m_Grid)
+	// (this is also the case after deserialization, where the long path cache must be kept as it was serialized)
+	const bool newGrid = !m_Grid;
+	if (newGrid)
 	{
 		m_GridSize = gridSize;
 		m_Grid = new Grid<NavcellData>(m_GridSize, m_GridSize);
@@ -563,11 +618,14 @@ void CCmpPathfinder::UpdateGrid()
 		GetPassabilityClasses(nonPathfindingPassClasses, pathfindingPassClasses);
 		m_LongPathfinder->Reload(m_Grid);
 		m_PathfinderHier->Recompute(m_Grid, nonPathfindingPassClasses, pathfindingPassClasses);
+		if (!newGrid)
+			m_LongPathCache.Clear();
 	}
 	else
 	{
-		m_LongPathfinder->Update(m_Grid);
+		m_LongPathfinder->Update(m_Grid, m_DirtinessInformation.dirtinessGrid);
 		m_PathfinderHier->Update(m_Grid, m_DirtinessInformation.dirtinessGrid);
+		m_LongPathCache.Invalidate(m_DirtinessInformation.dirtinessGrid);
 	}
 
 	// Remember the necessary updates that the AI pathfinder will have to perform as well
@@ -781,9 +839,11 @@ void CCmpPathfinder::PathRequests<T>::Compute(const CCmpPathfinder& cmpPathfinde
 		result.ticket = req.ticket;
 		result.notify = req.notify;
 		if constexpr (std::is_same_v<T, LongPathRequest>)
-			pathfinder.ComputePath(*cmpPathfinder.m_PathfinderHier, req.x0, req.z0, req.goal, req.passClass, result.path);
+			pathfinder.ComputePath(*cmpPathfinder.m_PathfinderHier, req.x0, req.z0, req.goal, req.passClass,
+				cmpPathfinder.m_LongPathCache, m_CacheLookups[workIndex], result.path);
 		else
-			result.path = pathfinder.ComputeShortPath(req, CmpPtr<ICmpObstructionManager>(cmpPathfinder.GetSystemEntity()));
+			result.path = pathfinder.ComputeShortPath(req, CmpPtr<ICmpObstructionManager>(cmpPathfinder.GetSystemEntity()),
+				cmpPathfinder.m_VertexObstructionCache.get());
 		if (workIndex == maxN - 1)
 			m_ComputeDone = true;
 	}
@@ -805,6 +865,47 @@ void CCmpPathfinder::SendRequestedPaths()
 	for (Future<void>& future : m_Futures)
 		future.CancelOrWait();
 
+	if (!m_ShortPathRequests.m_Results.empty())
+	{
+		PROFILE2("ClearVertexObstructionCache");
+		// The obstructions may change before the next batch.
+		PROFILE2_ATTR("hits: %u", m_VertexObstructionCache->GetHits());
+		PROFILE2_ATTR("misses: %u", m_VertexObstructionCache->GetMisses());
+		m_VertexObstructionCache->Clear();
+	}
+
+	if (!m_ShortPathRequests.m_Results.empty())
+	{
+		PROFILE2("VertexPathfinderArenas");
+		CFrameArena::Stats stats;
+		for (VertexPathfinder& pathfinder : m_VertexPathfinders)
+		{
+			stats.allocations += pathfinder.GetArenaStats().allocations;
+			stats.heapAllocations += pathfinder.GetArenaStats().heapAllocations;
+			stats.bytes += pathfinder.GetArenaStats().bytes;
+			pathfinder.ResetArenaStats();
+		}
+		PROFILE2_ATTR("allocations: %u", stats.allocations);
+		PROFILE2_ATTR("heap allocations: %u", stats.heapAllocations);
+		PROFILE2_ATTR("bytes: %zu", stats.bytes);
+	}
+
+	if (!m_LongPathRequests.m_Results.empty())
+	{
+		PROFILE2("UpdateLongPathCache");
+		// Paths are only added to the cache now, in request order, so that the paths computed
+		// from it don't depend on which thread computed what.
+		m_LongPathCache.NextBatch();
+		const u32 hits = m_LongPathCache.GetHits();
+		const u32 misses = m_LongPathCache.GetMisses();
+		for (size_t i = 0; i < m_LongPathRequests.m_Results.size(); ++i)
+			m_LongPathCache.Commit(m_LongPathRequests.m_CacheLookups[i], m_LongPathRequests.m_Results[i].path);
+		PROFILE2_ATTR("hits: %u", m_LongPathCache.GetHits() - hits);
+		PROFILE2_ATTR("misses: %u", m_LongPathCache.GetMisses() - misses);
+		PROFILE2_ATTR("total hit rate: %.1f%%", 100.f * m_LongPathCache.GetHits() / std::max(1u, m_LongPathCache.GetHits() + m_LongPathCache.GetMisses()));
+		PROFILE2_ATTR("entries: %zu", m_LongPathCache.GetNumberOfEntries());
+	}
+
 	{
 		PROFILE2("PostMessages");
 		for (PathResult& path : m_ShortPathRequests.m_Results)
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -39,12 +39,15 @@
 #include "renderer/TerrainOverlay.h"
 #include "simulation2/components/ICmpObstructionManager.h"
 #include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/LongPathCache.h"
 
+#include <type_traits>
 #include <vector>
 
 class HierarchicalPathfinder;
 class LongPathfinder;
 class VertexPathfinder;
+class VertexPathfinderObstructionCache;
 
 class SceneCollector;
 class AtlasOverlay;
@@ -82,6 +85,9 @@ public:
 
 	// Dynamic state:
 
+	// Paths previously computed by the long-range pathfinder, which later requests can reuse.
+	LongPathCache m_LongPathCache;
+
 	// Lazily-constructed dynamic state (not serialized):
 
 	u16 m_GridSize; // Navcells per side of the map.
@@ -96,6 +102,8 @@ public:
 	bool m_TerrainDirty;
 
 	std::vector<VertexPathfinder> m_VertexPathfinders;
+	// Obstructions shared by the short path requests being computed, cleared after each batch.
+	std::unique_ptr<VertexPathfinderObstructionCache> m_VertexObstructionCache;
 	std::unique_ptr<HierarchicalPathfinder> m_PathfinderHier;
 	std::unique_ptr<LongPathfinder> m_LongPathfinder;
 
@@ -111,6 +119,8 @@ public:
 		std::atomic<size_t> m_NextPathToCompute = 0;
 		// This is false until all scheduled paths have been computed.
 		std::atomic<bool> m_ComputeDone = true;
+		// How each computed path used the long path cache, only for long path requests.
+		std::vector<LongPathCache::Lookup> m_CacheLookups;
 
 		void ClearComputed()
 		{
@@ -119,6 +129,7 @@ public:
 			else
 				m_Requests.erase(m_Requests.end() - m_Results.size(), m_Requests.end());
 			m_Results.clear();
+			m_CacheLookups.clear();
 		}
 
 		/**
@@ -131,6 +142,8 @@ public:
 				n = max;
 			m_NextPathToCompute = 0;
 			m_Results.resize(n);
+			if constexpr (std::is_same_v<T, LongPathRequest>)
+				m_CacheLookups.resize(n);
 			m_ComputeDone = n == 0;
 		}
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -98,6 +98,9 @@ public:
 	float m_LastInterpolatedRotX, m_LastInterpolatedRotZ;
 	bool m_ActorFloating;
 
+	// Incremented whenever the serialized state changes, see GetStateVersion.
+	u32 m_StateVersion;
+
 	bool m_EnabledMessageInterpolate;
 
 	static std::string GetSchema()
@@ -165,6 +168,8 @@ public:
 		m_ActorFloating = false;
 
 		m_EnabledMessageInterpolate = false;
+
+		m_StateVersion = 1;
 	}
 
 	void Deinit() override
@@ -271,6 +276,11 @@ public:
 		UpdateMessageSubscriptions();
 	}
 
+	u32 GetStateVersion() const override
+	{
+		return m_StateVersion;
+	}
+
 	void Deserialized()
 	{
 		AdvertiseInterpolatedPositionChanges();
@@ -301,11 +311,14 @@ public:
 			if (!m_InWorld || GetHeightOffset() != y)
 				SetHeightOffset(y);
 			m_InWorld = true;
+			++m_StateVersion;
 		}
 	}
 
 	std::set<entity_id_t>* GetTurrets() override
 	{
+		// The caller may modify the set.
+		++m_StateVersion;
 		return &m_Turrets;
 	}
 
@@ -321,6 +334,7 @@ public:
 
 		m_TurretParent = id;
 		m_TurretPosition = offset;
+		++m_StateVersion;
 
 		if (m_TurretParent != INVALID_ENTITY)
 		{
@@ -345,6 +359,7 @@ public:
 	void MoveOutOfWorld() override
 	{
 		m_InWorld = false;
+		++m_StateVersion;
 
 		AdvertisePositionChanges();
 		AdvertiseInterpolatedPositionChanges();
@@ -354,6 +369,7 @@ public:
 	{
 		m_X = x;
 		m_Z = z;
+		++m_StateVersion;
 
 		if (!m_InWorld)
 		{
@@ -371,6 +387,7 @@ public:
 	{
 		m_X = x;
 		m_Z = z;
+		++m_StateVersion;
 
 		if (!m_InWorld)
 		{
@@ -391,6 +408,7 @@ public:
 		m_LastX = m_PrevX = m_X = x;
 		m_LastZ = m_PrevZ = m_Z = z;
 		m_InWorld = true;
+		++m_StateVersion;
 
 		UpdateXZRotation();
 
@@ -406,6 +424,7 @@ public:
 		// subtract the offset and replace with a new offset
 		m_LastYDifference = dy - GetHeightOffset();
 		m_Y += m_LastYDifference;
+		++m_StateVersion;
 		AdvertiseInterpolatedPositionChanges();
 	}
 
@@ -434,6 +453,7 @@ public:
 		// subtract the absolute height and replace it with a new absolute height
 		m_LastYDifference = y - GetHeightFixed();
 		m_Y += m_LastYDifference;
+		++m_StateVersion;
 		AdvertiseInterpolatedPositionChanges();
 	}
 
@@ -473,6 +493,7 @@ public:
 		m_Y = relative ? GetHeightOffset() : GetHeightFixed();
 		m_RelativeToGround = relative;
 		m_LastYDifference = entity_pos_t::Zero();
+		++m_StateVersion;
 		AdvertiseInterpolatedPositionChanges();
 	}
 
@@ -484,6 +505,7 @@ public:
 	void SetFloating(bool flag) override
 	{
 		m_Floating = flag;
+		++m_StateVersion;
 		AdvertiseInterpolatedPositionChanges();
 	}
 
@@ -496,6 +518,7 @@ public:
 	void SetConstructionProgress(fixed progress) override
 	{
 		m_ConstructionProgress = progress;
+		++m_StateVersion;
 		AdvertiseInterpolatedPositionChanges();
 	}
 
@@ -561,6 +584,7 @@ public:
 			return;
 
 		m_RotY = y;
+		++m_StateVersion;
 
 		AdvertisePositionChanges();
 		UpdateMessageSubscriptions();
@@ -575,6 +599,7 @@ public:
 				y -= cmpPosition->GetRotation().Y;
 		}
 		m_RotY = y;
+		++m_StateVersion;
 		m_InterpolatedRotY = m_RotY.ToFloat();
 
 		if (m_InWorld)
@@ -593,6 +618,7 @@ public:
 	{
 		m_RotX = x;
 		m_RotZ = z;
+		++m_StateVersion;
 
 		if (m_InWorld)
 		{
@@ -831,6 +857,9 @@ public:
 			if (m_InWorld && (m_LastX != m_X || m_LastZ != m_Z))
 				UpdateXZRotation();
 
+			if (m_LastX != m_X || m_LastZ != m_Z || !m_LastYDifference.IsZero())
+				++m_StateVersion;
+
 			// Store the positions from the turn before
 			m_PrevX = m_LastX;
 			m_PrevZ = m_LastZ;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -32,6 +32,7 @@
 #include "simulation2/components/ICmpVisibility.h"
 #include "simulation2/components/ICmpVision.h"
 #include "simulation2/components/ICmpWaterManager.h"
+#include "simulation2/helpers/EntityQueryColumns.h"
 #include "simulation2/helpers/Los.h"
 #include "simulation2/helpers/MapEdgeTiles.h"
 #include "simulation2/helpers/Render.h"
@@ -42,8 +43,11 @@
 #include "lib/timer.h"
 #include "ps/CLogger.h"
 #include "ps/Profile.h"
+#include "ps/TaskManager.h"
 #include "renderer/Scene.h"
 
+#include <atomic>
+
 #define DEBUG_RANGE_MANAGER_BOUNDS 0
 
 namespace
@@ -60,6 +64,12 @@ constexpr int LOS_REGION_RATIO = 8;
  */
 const fixed PARABOLIC_RANGE_TOLERANCE = fixed::FromInt(1)/2;
 
+/**
+ * Number of active queries updated by a single task in ExecuteActiveQueries.
+ * Individual queries are usually cheap, so batch them to amortise the task overhead.
+ */
+constexpr size_t QUERIES_PER_BATCH = 32;
+
 /**
  * Convert an owner ID (-1 = unowned, 0 = gaia, 1..30 = players)
  * into a 32-bit mask for quick set-membership tests.
@@ -355,8 +365,8 @@ public:
 	static void ClassInit(CComponentManager& componentManager)
 	{
 		componentManager.SubscribeGloballyToMessageType(MT_Create);
-		componentManager.SubscribeGloballyToMessageType(MT_PositionChanged);
-		componentManager.SubscribeGloballyToMessageType(MT_OwnershipChanged);
+		componentManager.SubscribeGloballyToMessageBatches(MT_PositionChanged);
+		componentManager.SubscribeGloballyToMessageBatches(MT_OwnershipChanged);
 		componentManager.SubscribeGloballyToMessageType(MT_Destroy);
 		componentManager.SubscribeGloballyToMessageType(MT_VisionRangeChanged);
 		componentManager.SubscribeGloballyToMessageType(MT_VisionSharingChanged);
@@ -389,6 +399,23 @@ public:
 
 	FastSpatialSubdivision m_Subdivision; // spatial index of m_EntityData
 	std::vector<entity_id_t> m_SubdivisionResults;
+	std::vector<FastSpatialSubdivision::Movement> m_SubdivisionMovements;
+	EntityQueryColumns m_EntityColumns; // column-oriented copy of m_EntityData, for filtering
+
+	// Scratch data used to update batches of active queries in parallel (not serialized).
+	struct QueryBatchBuffers
+	{
+		std::vector<entity_id_t> results;
+		std::vector<entity_id_t> added;
+		std::vector<entity_id_t> removed;
+		std::vector<entity_id_t> subdivisionResults;
+	};
+	using RangeUpdateMessages = std::vector<std::pair<entity_id_t, CMessageRangeUpdate>>;
+	// Enabled queries of the current turn, in tag order.
+	std::vector<std::pair<tag_t, Query*>> m_ActiveQueries;
+	// One set of buffers for the main thread and each worker thread.
+	std::vector<QueryBatchBuffers> m_QueryBatchBuffers;
+	std::vector<Future<void>> m_QueryFutures;
 
 	// LOS state:
 	static const player_id_t MAX_LOS_PLAYER_ID = 16;
@@ -452,6 +479,10 @@ public:
 
 		m_SubdivisionResults.reserve(4096);
 
+		size_t workerThreads = Threading::TaskManager::Instance().GetNumberOfWorkers();
+		m_QueryBatchBuffers.resize(workerThreads + 1);
+		m_QueryFutures.resize(workerThreads);
+
 		// The whole map should be visible to Gaia by default, else e.g. animals
 		// will get confused when trying to run from enemies
 		m_LosRevealAll[0] = true;
@@ -558,107 +589,17 @@ public:
 
 			// Remember this entity
 			m_EntityData.insert(ent, entdata);
+			UpdateEntityColumns(ent, entdata);
 			break;
 		}
 		case MT_PositionChanged:
 		{
-			const CMessagePositionChanged& msgData = static_cast<const CMessagePositionChanged&> (msg);
-			entity_id_t ent = msgData.entity;
-
-			EntityMap<EntityData>::iterator it = m_EntityData.find(ent);
-
-			// Ignore if we're not already tracking this entity
-			if (it == m_EntityData.end())
-				break;
-
-			if (msgData.inWorld)
-			{
-				if (it->second.HasFlag<FlagMasks::InWorld>())
-				{
-					CFixedVector2D from(it->second.x, it->second.z);
-					CFixedVector2D to(msgData.x, msgData.z);
-					m_Subdivision.Move(ent, from, to, it->second.size);
-					if (it->second.HasFlag<FlagMasks::SharedVision>())
-						SharingLosMove(it->second.visionSharing, it->second.visionRange, from, to);
-					else
-						LosMove(it->second.owner, it->second.visionRange, from, to);
-					LosRegion oldLosRegion = PosToLosRegionsHelper(it->second.x, it->second.z);
-					LosRegion newLosRegion = PosToLosRegionsHelper(msgData.x, msgData.z);
-					if (oldLosRegion != newLosRegion)
-					{
-						RemoveFromRegion(oldLosRegion, ent);
-						AddToRegion(newLosRegion, ent);
-					}
-				}
-				else
-				{
-					CFixedVector2D to(msgData.x, msgData.z);
-					m_Subdivision.Add(ent, to, it->second.size);
-					if (it->second.HasFlag<FlagMasks::SharedVision>())
-						SharingLosAdd(it->second.visionSharing, it->second.visionRange, to);
-					else
-						LosAdd(it->second.owner, it->second.visionRange, to);
-					AddToRegion(PosToLosRegionsHelper(msgData.x, msgData.z), ent);
-				}
-
-				it->second.SetFlag<FlagMasks::InWorld>(true);
-				it->second.x = msgData.x;
-				it->second.z = msgData.z;
-			}
-			else
-			{
-				if (it->second.HasFlag<FlagMasks::InWorld>())
-				{
-					CFixedVector2D from(it->second.x, it->second.z);
-					m_Subdivision.Remove(ent, from, it->second.size);
-					if (it->second.HasFlag<FlagMasks::SharedVision>())
-						SharingLosRemove(it->second.visionSharing, it->second.visionRange, from);
-					else
-						LosRemove(it->second.owner, it->second.visionRange, from);
-					RemoveFromRegion(PosToLosRegionsHelper(it->second.x, it->second.z), ent);
-				}
-
-				it->second.SetFlag<FlagMasks::InWorld>(false);
-				it->second.x = entity_pos_t::Zero();
-				it->second.z = entity_pos_t::Zero();
-			}
-
-			RequestVisibilityUpdate(ent);
-
+			PositionChanged(static_cast<const CMessagePositionChanged&> (msg), nullptr);
 			break;
 		}
 		case MT_OwnershipChanged:
 		{
-			const CMessageOwnershipChanged& msgData = static_cast<const CMessageOwnershipChanged&> (msg);
-			entity_id_t ent = msgData.entity;
-
-			EntityMap<EntityData>::iterator it = m_EntityData.find(ent);
-
-			// Ignore if we're not already tracking this entity
-			if (it == m_EntityData.end())
-				break;
-
-			if (it->second.HasFlag<FlagMasks::InWorld>())
-			{
-				// Entity vision is taken into account in VisionSharingChanged
-				// when sharing component activated
-				if (!it->second.HasFlag<FlagMasks::SharedVision>())
-				{
-					CFixedVector2D pos(it->second.x, it->second.z);
-					LosRemove(it->second.owner, it->second.visionRange, pos);
-					LosAdd(msgData.to, it->second.visionRange, pos);
-				}
-
-				if (it->second.HasFlag<FlagMasks::RevealShore>())
-				{
-					RevealShore(it->second.owner, false);
-					RevealShore(msgData.to, true);
-				}
-			}
-
-			ENSURE(-128 <= msgData.to && msgData.to <= 127);
-			it->second.owner = (i8)msgData.to;
-
+			OwnershipChanged(static_cast<const CMessageOwnershipChanged&> (msg));
 			break;
 		}
 		case MT_Destroy:
@@ -683,6 +624,7 @@ public:
 			ENSURE(it->second.owner == -1);
 
 			m_EntityData.erase(it);
+			m_EntityColumns.Erase(ent);
 
 			break;
 		}
@@ -746,6 +688,7 @@ public:
 				ENSURE(it->second.owner == (i8)msgData.player);
 				it->second.visionSharing = visionChanged;
 				it->second.SetFlag<FlagMasks::SharedVision>(true);
+				UpdateEntityColumns(ent, it->second);
 				break;
 			}
 
@@ -781,6 +724,139 @@ public:
 		}
 	}
 
+	void HandleMessageBatch(PS::span<const CMessagePositionChanged> msgs) override
+	{
+		// Batches mostly contain each entity once, in increasing order (e.g. from the unit motion manager),
+		// so move the entities between subdivisions all together. When an entity comes again
+		// (or out of order), apply the pending movements first so that its subdivision is known.
+		m_SubdivisionMovements.clear();
+		entity_id_t lastEnt = INVALID_ENTITY;
+		for (const CMessagePositionChanged& msgData : msgs)
+		{
+			if (msgData.entity <= lastEnt)
+			{
+				m_Subdivision.Move(m_SubdivisionMovements);
+				m_SubdivisionMovements.clear();
+			}
+			lastEnt = msgData.entity;
+			PositionChanged(msgData, &m_SubdivisionMovements);
+		}
+		m_Subdivision.Move(m_SubdivisionMovements);
+	}
+
+	void HandleMessageBatch(PS::span<const CMessageOwnershipChanged> msgs) override
+	{
+		for (const CMessageOwnershipChanged& msgData : msgs)
+			OwnershipChanged(msgData);
+	}
+
+	/**
+	 * Update the entity data for a PositionChanged message.
+	 * If @p subdivisionMovements is not null, movements between subdivisions are appended to it
+	 * instead of being applied.
+	 */
+	void PositionChanged(const CMessagePositionChanged& msgData, std::vector<FastSpatialSubdivision::Movement>* subdivisionMovements)
+	{
+		entity_id_t ent = msgData.entity;
+
+		EntityMap<EntityData>::iterator it = m_EntityData.find(ent);
+
+		// Ignore if we're not already tracking this entity
+		if (it == m_EntityData.end())
+			return;
+
+		if (msgData.inWorld)
+		{
+			if (it->second.HasFlag<FlagMasks::InWorld>())
+			{
+				CFixedVector2D from(it->second.x, it->second.z);
+				CFixedVector2D to(msgData.x, msgData.z);
+				if (subdivisionMovements)
+					subdivisionMovements->push_back({ ent, from, to, it->second.size });
+				else
+					m_Subdivision.Move(ent, from, to, it->second.size);
+				if (it->second.HasFlag<FlagMasks::SharedVision>())
+					SharingLosMove(it->second.visionSharing, it->second.visionRange, from, to);
+				else
+					LosMove(it->second.owner, it->second.visionRange, from, to);
+				LosRegion oldLosRegion = PosToLosRegionsHelper(it->second.x, it->second.z);
+				LosRegion newLosRegion = PosToLosRegionsHelper(msgData.x, msgData.z);
+				if (oldLosRegion != newLosRegion)
+				{
+					RemoveFromRegion(oldLosRegion, ent);
+					AddToRegion(newLosRegion, ent);
+				}
+			}
+			else
+			{
+				CFixedVector2D to(msgData.x, msgData.z);
+				m_Subdivision.Add(ent, to, it->second.size);
+				if (it->second.HasFlag<FlagMasks::SharedVision>())
+					SharingLosAdd(it->second.visionSharing, it->second.visionRange, to);
+				else
+					LosAdd(it->second.owner, it->second.visionRange, to);
+				AddToRegion(PosToLosRegionsHelper(msgData.x, msgData.z), ent);
+			}
+
+			it->second.SetFlag<FlagMasks::InWorld>(true);
+			it->second.x = msgData.x;
+			it->second.z = msgData.z;
+		}
+		else
+		{
+			if (it->second.HasFlag<FlagMasks::InWorld>())
+			{
+				CFixedVector2D from(it->second.x, it->second.z);
+				m_Subdivision.Remove(ent, from, it->second.size);
+				if (it->second.HasFlag<FlagMasks::SharedVision>())
+					SharingLosRemove(it->second.visionSharing, it->second.visionRange, from);
+				else
+					LosRemove(it->second.owner, it->second.visionRange, from);
+				RemoveFromRegion(PosToLosRegionsHelper(it->second.x, it->second.z), ent);
+			}
+
+			it->second.SetFlag<FlagMasks::InWorld>(false);
+			it->second.x = entity_pos_t::Zero();
+			it->second.z = entity_pos_t::Zero();
+		}
+
+		UpdateEntityColumns(ent, it->second);
+		RequestVisibilityUpdate(ent);
+	}
+
+	void OwnershipChanged(const CMessageOwnershipChanged& msgData)
+	{
+		entity_id_t ent = msgData.entity;
+
+		EntityMap<EntityData>::iterator it = m_EntityData.find(ent);
+
+		// Ignore if we're not already tracking this entity
+		if (it == m_EntityData.end())
+			return;
+
+		if (it->second.HasFlag<FlagMasks::InWorld>())
+		{
+			// Entity vision is taken into account in VisionSharingChanged
+			// when sharing component activated
+			if (!it->second.HasFlag<FlagMasks::SharedVision>())
+			{
+				CFixedVector2D pos(it->second.x, it->second.z);
+				LosRemove(it->second.owner, it->second.visionRange, pos);
+				LosAdd(msgData.to, it->second.visionRange, pos);
+			}
+
+			if (it->second.HasFlag<FlagMasks::RevealShore>())
+			{
+				RevealShore(it->second.owner, false);
+				RevealShore(msgData.to, true);
+			}
+		}
+
+		ENSURE(-128 <= msgData.to && msgData.to <= 127);
+		it->second.owner = (i8)msgData.to;
+		UpdateEntityColumns(ent, it->second);
+	}
+
 	void SetBounds(entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1) override
 	{
 		// Don't support rectangular looking maps.
@@ -806,6 +882,7 @@ public:
 		std::array<Grid<u16>, MAX_LOS_PLAYER_ID> oldPlayerCounts = m_LosPlayerCounts;
 		Grid<u32> oldStateRevealed = m_LosStateRevealed;
 		FastSpatialSubdivision oldSubdivision = m_Subdivision;
+		EntityQueryColumns oldEntityColumns = m_EntityColumns;
 		Grid<std::set<entity_id_t> > oldLosRegions = m_LosRegions;
 
 		m_Deserializing = true;
@@ -840,6 +917,8 @@ public:
 			debug_warn(L"inconsistent revealed");
 		if (oldSubdivision != m_Subdivision)
 			debug_warn(L"inconsistent subdivs");
+		if (oldEntityColumns != m_EntityColumns)
+			debug_warn(L"inconsistent entity columns");
 		if (oldLosRegions != m_LosRegions)
 			debug_warn(L"inconsistent los regions");
 	}
@@ -855,6 +934,10 @@ public:
 		ENSURE(m_WorldX0.IsZero() && m_WorldZ0.IsZero()); // don't bother implementing non-zero offsets yet
 		ResetSubdivisions(m_WorldX1, m_WorldZ1);
 
+		m_EntityColumns.Reset();
+		for (EntityMap<EntityData>::const_iterator it = m_EntityData.begin(); it != m_EntityData.end(); ++it)
+			UpdateEntityColumns(it->first, it->second);
+
 		m_LosRegionsPerSide = m_LosVerticesPerSide / LOS_REGION_RATIO;
 
 		for (size_t player_id = 0; player_id < m_LosPlayerCounts.size(); ++player_id)
@@ -921,6 +1004,11 @@ public:
 				m_Subdivision.Add(it->first, CFixedVector2D(it->second.x, it->second.z), it->second.size);
 	}
 
+	void UpdateEntityColumns(entity_id_t ent, const EntityData& data)
+	{
+		m_EntityColumns.Set(ent, CalcOwnerMask(data.owner), data.flags, data.x, data.z, data.size);
+	}
+
 	tag_t CreateActiveQuery(entity_id_t source,
 		entity_pos_t minRange, entity_pos_t maxRange,
 		const std::vector<int>& owners, int requiredInterface, u8 flags, bool accountForSize) override
@@ -1110,26 +1198,69 @@ public:
 	{
 		PROFILE3("ExecuteActiveQueries");
 
-		// Store a queue of all messages before sending any, so we can assume
-		// no entities will move until we've finished checking all the ranges
-		std::vector<std::pair<entity_id_t, CMessageRangeUpdate> > messages;
-		std::vector<entity_id_t> results;
-		std::vector<entity_id_t> added;
-		std::vector<entity_id_t> removed;
+		m_ActiveQueries.clear();
+		for (std::pair<const tag_t, Query>& query : m_Queries)
+			if (query.second.enabled)
+				m_ActiveQueries.emplace_back(query.first, &query.second);
 
-		for (std::map<tag_t, Query>::iterator it = m_Queries.begin(); it != m_Queries.end(); ++it)
+		// Store a queue of all messages before sending any, so we can assume
+		// no entities will move until we've finished checking all the ranges.
+		// Updating a query only reads the entity data and the subdivision, so batches
+		// of consecutive queries are processed concurrently, each into its own message queue.
+		// The queues are posted in batch order, i.e. in tag order, so the result is deterministic
+		// whatever the number of threads.
+		const size_t numberOfBatches = (m_ActiveQueries.size() + QUERIES_PER_BATCH - 1) / QUERIES_PER_BATCH;
+		std::vector<RangeUpdateMessages> messages(numberOfBatches);
+		std::atomic<size_t> nextBatch = 0;
+
+		Threading::TaskManager& taskManager = Threading::TaskManager::Instance();
+		// The main thread handles a batch too, so only start workers for the remaining ones.
+		const size_t numberOfTasks = std::min(m_QueryFutures.size(), numberOfBatches > 0 ? numberOfBatches - 1 : 0);
+		for (size_t i = 0; i < numberOfTasks; ++i)
 		{
-			Query& query = it->second;
+			ENSURE(!m_QueryFutures[i].Valid());
+			m_QueryFutures[i] = taskManager.PushTask([this, &nextBatch, &messages, numberOfBatches, &buffers=m_QueryBatchBuffers[i + 1]]() {
+				PROFILE2("Async range queries");
+				for (size_t batch = nextBatch++; batch < numberOfBatches; batch = nextBatch++)
+					ExecuteActiveQueryBatch(batch, buffers, messages[batch]);
+			});
+		}
 
-			if (!query.enabled)
-				continue;
+		for (size_t batch = nextBatch++; batch < numberOfBatches; batch = nextBatch++)
+			ExecuteActiveQueryBatch(batch, m_QueryBatchBuffers.front(), messages[batch]);
+
+		// Use CancelOrWait instead of just Cancel to ensure determinism.
+		for (size_t i = 0; i < numberOfTasks; ++i)
+			m_QueryFutures[i].CancelOrWait();
+
+		CComponentManager& cmpMgr = GetSimContext().GetComponentManager();
+		for (const RangeUpdateMessages& batchMessages : messages)
+			for (const std::pair<entity_id_t, CMessageRangeUpdate>& message : batchMessages)
+				cmpMgr.PostMessage(message.first, message.second);
+	}
+
+	/**
+	 * Update the active queries of the given batch and queue the resulting messages.
+	 * This may be called from worker threads, so it must not modify anything
+	 * but the queries of this batch, @p buffers and @p messages.
+	 */
+	void ExecuteActiveQueryBatch(size_t batch, QueryBatchBuffers& buffers, RangeUpdateMessages& messages) const
+	{
+		std::vector<entity_id_t>& results = buffers.results;
+		std::vector<entity_id_t>& added = buffers.added;
+		std::vector<entity_id_t>& removed = buffers.removed;
+
+		const size_t end = std::min(m_ActiveQueries.size(), (batch + 1) * QUERIES_PER_BATCH);
+		for (size_t i = batch * QUERIES_PER_BATCH; i < end; ++i)
+		{
+			Query& query = *m_ActiveQueries[i].second;
 
 			results.clear();
 			CmpPtr<ICmpPosition> cmpSourcePosition(query.source);
 			if (cmpSourcePosition && cmpSourcePosition->IsInWorld())
 			{
 				results.reserve(query.lastMatch.size());
-				PerformQuery(query, results, cmpSourcePosition->GetPosition2D());
+				PerformQuery(query, results, cmpSourcePosition->GetPosition2D(), buffers.subdivisionResults);
 			}
 
 			// Compute the changes vs the last match
@@ -1150,15 +1281,11 @@ public:
 			messages.resize(messages.size() + 1);
 			std::pair<entity_id_t, CMessageRangeUpdate>& back = messages.back();
 			back.first = query.source.GetId();
-			back.second.tag = it->first;
+			back.second.tag = m_ActiveQueries[i].first;
 			back.second.added.swap(added);
 			back.second.removed.swap(removed);
 			query.lastMatch.swap(results);
 		}
-
-		CComponentManager& cmpMgr = GetSimContext().GetComponentManager();
-		for (size_t i = 0; i < messages.size(); ++i)
-			cmpMgr.PostMessage(messages[i].first, messages[i].second);
 	}
 
 	/**
@@ -1178,6 +1305,15 @@ public:
 		if (!((entity.flags & FlagMasks::AllQuery) & q.flagsMask))
 			return false;
 
+		return TestFilteredEntityQuery(q, id);
+	}
+
+	/**
+	 * Returns whether the given entity matches the given query, assuming
+	 * it has already passed the owner, InWorld and flags tests (ignoring maxRange)
+	 */
+	bool TestFilteredEntityQuery(const Query& q, entity_id_t id) const
+	{
 		// Ignore self
 		if (id == q.source.GetId())
 			return false;
@@ -1193,17 +1329,30 @@ public:
 	 * Returns a list of distinct entity IDs that match the given query, sorted by ID.
 	 */
 	void PerformQuery(const Query& q, std::vector<entity_id_t>& r, CFixedVector2D pos)
+	{
+		PerformQuery(q, r, pos, m_SubdivisionResults);
+	}
+
+	/**
+	 * As above, but using @p subdivisionResults as scratch space
+	 * so that it can be called concurrently.
+	 */
+	void PerformQuery(const Query& q, std::vector<entity_id_t>& r, CFixedVector2D pos, std::vector<entity_id_t>& subdivisionResults) const
 	{
 
 		// Special case: range is ALWAYS_IN_RANGE means check all entities ignoring distance.
+		// The owner and flags tests run over the entity columns, which returns matches sorted by ID.
 		if (q.maxRange == ALWAYS_IN_RANGE)
 		{
-			for (EntityMap<EntityData>::const_iterator it = m_EntityData.begin(); it != m_EntityData.end(); ++it)
-			{
-				if (!TestEntityQuery(q, it->first, it->second))
-					continue;
+			std::vector<u32>& candidates = subdivisionResults;
+			candidates.clear();
+			m_EntityColumns.Filter(q.ownersMask, FlagMasks::InWorld, FlagMasks::AllQuery & q.flagsMask, candidates);
 
-				r.push_back(it->first);
+			for (u32 index : candidates)
+			{
+				entity_id_t id = m_EntityColumns.GetId(index);
+				if (TestFilteredEntityQuery(q, id))
+					r.push_back(id);
 			}
 		}
 		// Not the entire world, so check a parabolic range, or a regular range.
@@ -1214,18 +1363,18 @@ public:
 			CFixedVector3D pos3d = cmpSourcePosition->GetPosition()+
 			    CFixedVector3D(entity_pos_t::Zero(), q.yOrigin, entity_pos_t::Zero()) ;
 			// Get a quick list of entities that are potentially in range, with a cutoff of 2*maxRange.
-			m_SubdivisionResults.clear();
-			m_Subdivision.GetNear(m_SubdivisionResults, pos, q.maxRange * 2);
+			subdivisionResults.clear();
+			m_Subdivision.GetNear(subdivisionResults, pos, q.maxRange * 2);
 
-			for (size_t i = 0; i < m_SubdivisionResults.size(); ++i)
+			for (size_t i = 0; i < subdivisionResults.size(); ++i)
 			{
-				EntityMap<EntityData>::const_iterator it = m_EntityData.find(m_SubdivisionResults[i]);
+				EntityMap<EntityData>::const_iterator it = m_EntityData.find(subdivisionResults[i]);
 				ENSURE(it != m_EntityData.end());
 
 				if (!TestEntityQuery(q, it->first, it->second))
 					continue;
 
-				CmpPtr<ICmpPosition> cmpSecondPosition(GetSimContext(), m_SubdivisionResults[i]);
+				CmpPtr<ICmpPosition> cmpSecondPosition(GetSimContext(), subdivisionResults[i]);
 				if (!cmpSecondPosition || !cmpSecondPosition->IsInWorld())
 					continue;
 				CFixedVector3D secondPosition = cmpSecondPosition->GetPosition();
@@ -1249,16 +1398,42 @@ public:
 			}
 			std::sort(r.begin(), r.end());
 		}
+		// Check a regular range covering most of the world: testing all entities through the
+		// entity columns is cheaper than going through the subdivision, and gives the same result.
+		else if (q.maxRange * 2 >= m_WorldX1 - m_WorldX0)
+		{
+			std::vector<u32>& candidates = subdivisionResults;
+			candidates.clear();
+			m_EntityColumns.Filter(q.ownersMask, FlagMasks::InWorld, FlagMasks::AllQuery & q.flagsMask, candidates);
+
+			for (u32 index : candidates)
+			{
+				entity_id_t id = m_EntityColumns.GetId(index);
+				CFixedVector2D offset = m_EntityColumns.GetPosition(index) - pos;
+
+				// Restrict based on approximate circle-circle distance.
+				entity_pos_t range = q.maxRange + (q.accountForSize ? fixed::FromInt(m_EntityColumns.GetSize(index)) : fixed::Zero());
+				if (offset.CompareLength(range) > 0)
+					continue;
+
+				if (!q.minRange.IsZero())
+					if (offset.CompareLength(q.minRange) < 0)
+						continue;
+
+				if (TestFilteredEntityQuery(q, id))
+					r.push_back(id);
+			}
+		}
 		// check a regular range (i.e. not the entire world, and not parabolic)
 		else
 		{
 			// Get a quick list of entities that are potentially in range
-			m_SubdivisionResults.clear();
-			m_Subdivision.GetNear(m_SubdivisionResults, pos, q.maxRange);
+			subdivisionResults.clear();
+			m_Subdivision.GetNear(subdivisionResults, pos, q.maxRange);
 
-			for (size_t i = 0; i < m_SubdivisionResults.size(); ++i)
+			for (size_t i = 0; i < subdivisionResults.size(); ++i)
 			{
-				EntityMap<EntityData>::const_iterator it = m_EntityData.find(m_SubdivisionResults[i]);
+				EntityMap<EntityData>::const_iterator it = m_EntityData.find(subdivisionResults[i]);
 				ENSURE(it != m_EntityData.end());
 
 				if (!TestEntityQuery(q, it->first, it->second))
@@ -1628,7 +1803,10 @@ public:
 		if (flag == FlagMasks::None)
 			LOGWARNING("CCmpRangeManager: Invalid flag identifier %s for entity %u", identifier.c_str(), ent);
 		else
+		{
 			it->second.SetFlag(flag, value);
+			UpdateEntityColumns(ent, it->second);
+		}
 	}
 
 	// ****************************************************************
@@ -1647,7 +1825,10 @@ public:
 	{
 		EntityMap<EntityData>::iterator it = m_EntityData.find(ent);
 		if (it != m_EntityData.end())
+		{
 			it->second.SetFlag<FlagMasks::ScriptedVisibility>(status);
+			UpdateEntityColumns(ent, it->second);
+		}
 	}
 
 	LosVisibility ComputeLosVisibility(CEntityHandle ent, player_id_t player) const
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -40,8 +40,10 @@
 #include "simulation2/components/ICmpTerritoryInfluence.h"
 #include "simulation2/helpers/Grid.h"
 #include "simulation2/helpers/Render.h"
+#include "simulation2/helpers/TerritoryInfluenceMap.h"
 
 #include <queue>
+#include <set>
 
 class CCmpTerritoryManager;
 
@@ -95,6 +97,12 @@ public:
 	// Saves the cost per tile (to stop territory on impassable tiles)
 	Grid<u8>* m_CostGrid;
 
+	// Influences of the entities as of the last computation of m_Territories
+	TerritoryInfluenceMap m_InfluenceMap;
+
+	// Entities whose influence may have changed since the last computation of m_Territories
+	std::set<entity_id_t> m_DirtyInfluences;
+
 	// Set to true when territories change; will send a TerritoriesChanged message
 	// during the Update phase
 	bool m_TriggerEvent;
@@ -105,6 +113,7 @@ public:
 		player_id_t owner;
 		CColor color;
 		SOverlayTexturedLine overlay;
+		std::vector<CVector2D> boundaryPoints; // unsmoothed points, to detect unchanged boundaries
 	};
 
 	std::vector<SBoundaryLine> m_BoundaryLines;
@@ -192,7 +201,8 @@ public:
 		{
 			const CMessageValueModification& msgData = static_cast<const CMessageValueModification&> (msg);
 			if (msgData.component == L"TerritoryInfluence")
-				MakeDirty();
+				for (entity_id_t ent : msgData.entities)
+					MakeDirtyIfRelevantEntity(ent);
 			break;
 		}
 		case MT_ObstructionMapShapeChanged:
@@ -233,8 +243,14 @@ public:
 	void MakeDirtyIfRelevantEntity(entity_id_t ent)
 	{
 		CmpPtr<ICmpTerritoryInfluence> cmpTerritoryInfluence(GetSimContext(), ent);
-		if (cmpTerritoryInfluence)
-			MakeDirty();
+		if (!cmpTerritoryInfluence)
+			return;
+
+		// Only this entity's influence needs to be recomputed
+		m_DirtyInfluences.insert(ent);
+		++m_DirtyID;
+		m_BoundaryLinesDirty = true;
+		m_TriggerEvent = true;
 	}
 
 	const Grid<u8>& GetTerritoryGrid() override
@@ -264,6 +280,8 @@ public:
 	void MakeDirty()
 	{
 		SAFE_DELETE(m_Territories);
+		// The terrain or colors might have changed too, so don't reuse any boundary line
+		m_BoundaryLines.clear();
 		++m_DirtyID;
 		m_BoundaryLinesDirty = true;
 		m_TriggerEvent = true;
@@ -293,6 +311,12 @@ public:
 
 	void CalculateTerritories();
 
+	/**
+	 * Get the current influence of an entity, in a grid of the given size.
+	 * Returns false if it has no valid influence.
+	 */
+	bool GetInfluence(entity_id_t ent, u16 tilesW, u16 tilesH, TerritoryInfluenceMap::Influence& influence) const;
+
 	u8 GetTerritoryPercentage(player_id_t player) override;
 
 	std::vector<STerritoryBoundary> ComputeBoundaries();
@@ -408,9 +432,43 @@ void CCmpTerritoryManager::CalculateCostGrid()
 	}
 }
 
+bool CCmpTerritoryManager::GetInfluence(entity_id_t ent, u16 tilesW, u16 tilesH, TerritoryInfluenceMap::Influence& influence) const
+{
+	CmpPtr<ICmpTerritoryInfluence> cmpTerritoryInfluence(GetSimContext(), ent);
+	if (!cmpTerritoryInfluence)
+		return false;
+
+	CmpPtr<ICmpOwnership> cmpOwnership(GetSimContext(), ent);
+	if (!cmpOwnership)
+		return false;
+
+	// Ignore Gaia and unassigned or players we can't represent
+	player_id_t owner = cmpOwnership->GetOwner();
+	if (owner <= 0 || owner > TERRITORY_PLAYER_MASK)
+		return false;
+
+	CmpPtr<ICmpPosition> cmpPosition(GetSimContext(), ent);
+	if (!cmpPosition || !cmpPosition->IsInWorld())
+		return false;
+
+	u32 weight = cmpTerritoryInfluence->GetWeight();
+	u32 radius = cmpTerritoryInfluence->GetRadius();
+	if (weight == 0 || radius == 0)
+		return false;
+
+	influence.owner = static_cast<u8>(owner);
+	influence.weight = weight;
+	influence.falloff = weight * (Pathfinding::NAVCELL_SIZE * NAVCELLS_PER_TERRITORY_TILE).ToInt_RoundToNegInfinity() / radius;
+	influence.root = cmpTerritoryInfluence->IsRoot();
+
+	CFixedVector2D pos = cmpPosition->GetPosition2D();
+	NearestTerritoryTile(pos.X, pos.Y, influence.i, influence.j, tilesW, tilesH);
+	return true;
+}
+
 void CCmpTerritoryManager::CalculateTerritories()
 {
-	if (m_Territories)
+	if (m_Territories && m_DirtyInfluences.empty())
 		return;
 
 	PROFILE("CalculateTerritories");
@@ -424,7 +482,15 @@ void CCmpTerritoryManager::CalculateTerritories()
 	const u16 tilesW = m_CostGrid->m_W;
 	const u16 tilesH = m_CostGrid->m_H;
 
-	m_Territories = new Grid<u8>(tilesW, tilesH);
+	if (!m_Territories)
+	{
+		// Recompute everything: start again from all the territory influence entities
+		m_Territories = new Grid<u8>(tilesW, tilesH);
+		m_InfluenceMap.Reset(*m_CostGrid);
+		m_DirtyInfluences.clear();
+		for (const CComponentManager::InterfacePair& pair : GetSimContext().GetComponentManager().GetEntitiesWithInterface(IID_TerritoryInfluence))
+			m_DirtyInfluences.insert(pair.first);
+	}
 
 	// Reset territory counts for all players
 	CmpPtr<ICmpPlayerManager> cmpPlayerManager(GetSystemEntity());
@@ -433,115 +499,42 @@ void CCmpTerritoryManager::CalculateTerritories()
 	for (u16& count : m_TerritoryCellCounts)
 		count = 0;
 
-	// Find all territory influence entities
-	CComponentManager::InterfaceList influences = GetSimContext().GetComponentManager().GetEntitiesWithInterface(IID_TerritoryInfluence);
-
-	// Split influence entities into per-player lists, ignoring any with invalid properties
-	std::map<player_id_t, std::vector<entity_id_t> > influenceEntities;
-	for (const CComponentManager::InterfacePair& pair : influences)
+	// Only the influences that changed are spread again, and only the owners of the tiles
+	// they reach are recomputed
+	for (entity_id_t ent : m_DirtyInfluences)
 	{
-		entity_id_t ent = pair.first;
-
-		CmpPtr<ICmpOwnership> cmpOwnership(GetSimContext(), ent);
-		if (!cmpOwnership)
-			continue;
-
-		// Ignore Gaia and unassigned or players we can't represent
-		player_id_t owner = cmpOwnership->GetOwner();
-		if (owner <= 0 || owner > TERRITORY_PLAYER_MASK)
-			continue;
-
-		influenceEntities[owner].push_back(ent);
+		TerritoryInfluenceMap::Influence influence;
+		if (GetInfluence(ent, tilesW, tilesH, influence))
+			m_InfluenceMap.SetInfluence(ent, influence);
+		else
+			m_InfluenceMap.RemoveInfluence(ent);
 	}
+	m_DirtyInfluences.clear();
 
-	// Store the overall best weight for comparison
-	Grid<u32> bestWeightGrid(tilesW, tilesH);
-	// store the root influences to mark territory as connected
-	std::vector<entity_id_t> rootInfluenceEntities;
-
-	for (const std::pair<const player_id_t, std::vector<entity_id_t>>& pair : influenceEntities)
-	{
-		// entityGrid stores the weight for a single entity, and is reset per entity
-		Grid<u32> entityGrid(tilesW, tilesH);
-		// playerGrid stores the combined weight of all entities for this player
-		Grid<u32> playerGrid(tilesW, tilesH);
-
-		u8 owner = static_cast<u8>(pair.first);
-		const std::vector<entity_id_t>& ents = pair.second;
-		// With 2^16 entities, we're safe against overflows as the weight is also limited to 2^16
-		ENSURE(ents.size() < 1 << 16);
-		// Compute the influence map of the current entity, then add it to the player grid
-		for (entity_id_t ent : ents)
-		{
-			CmpPtr<ICmpPosition> cmpPosition(GetSimContext(), ent);
-			if (!cmpPosition || !cmpPosition->IsInWorld())
-				continue;
-
-			CmpPtr<ICmpTerritoryInfluence> cmpTerritoryInfluence(GetSimContext(), ent);
-			u32 weight = cmpTerritoryInfluence->GetWeight();
-			u32 radius = cmpTerritoryInfluence->GetRadius();
-			if (weight == 0 || radius == 0)
-				continue;
-			u32 falloff = weight * (Pathfinding::NAVCELL_SIZE * NAVCELLS_PER_TERRITORY_TILE).ToInt_RoundToNegInfinity() / radius;
-
-			CFixedVector2D pos = cmpPosition->GetPosition2D();
-			u16 i, j;
-			NearestTerritoryTile(pos.X, pos.Y, i, j, tilesW, tilesH);
+	m_InfluenceMap.UpdateTerritories(*m_Territories);
 
-			if (cmpTerritoryInfluence->IsRoot())
-				rootInfluenceEntities.push_back(ent);
-
-			// Initialise the tile under the entity
-			entityGrid.set(i, j, weight);
-			if (weight > bestWeightGrid.get(i, j))
-			{
-				bestWeightGrid.set(i, j, weight);
-				m_Territories->set(i, j, owner);
-			}
+	// Connectivity can change anywhere when a single tile changes owner, so the
+	// flags are recomputed on the whole grid (which is cheap compared to the influences)
+	for (u16 j = 0; j < tilesH; ++j)
+		for (u16 i = 0; i < tilesW; ++i)
+			m_Territories->set(i, j, m_Territories->get(i, j) & TERRITORY_PLAYER_MASK);
 
-			// Expand influences outwards
-			FLOODFILL(i, j,
-				u32 dg = falloff * m_CostGrid->get(nx, nz);
-
-				// diagonal neighbour -> multiply with approx sqrt(2)
-				if (nx != posX && nz != posZ)
-					dg = (dg * 362) / 256;
-
-				// Don't expand if new cost is not better than previous value for that tile
-				// (arranged to avoid underflow if entityGrid.get(x, z) < dg)
-				if (entityGrid.get(posX, posZ) <= entityGrid.get(nx, nz) + dg)
-					continue;
-
-				// weight of this tile = weight of predecessor - falloff from predecessor
-				u32 newWeight = entityGrid.get(posX, posZ) - dg;
-				u32 totalWeight = playerGrid.get(nx, nz) - entityGrid.get(nx, nz) + newWeight;
-				playerGrid.set(nx, nz, totalWeight);
-				entityGrid.set(nx, nz, newWeight);
-				// if this weight is better than the best thus far, set the owner
-				if (totalWeight > bestWeightGrid.get(nx, nz))
-				{
-					bestWeightGrid.set(nx, nz, totalWeight);
-					m_Territories->set(nx, nz, owner);
-				}
-			);
-
-			entityGrid.reset();
-		}
-	}
+	// Store the root influences to mark territory as connected, ordered by player then entity
+	std::vector<std::pair<u8, entity_id_t>> rootInfluenceEntities;
+	for (const std::pair<const entity_id_t, TerritoryInfluenceMap::Influence>& pair : m_InfluenceMap.GetInfluences())
+		if (pair.second.root)
+			rootInfluenceEntities.emplace_back(pair.second.owner, pair.first);
+	std::sort(rootInfluenceEntities.begin(), rootInfluenceEntities.end());
 
 	// Detect territories connected to a 'root' influence (typically a civ center)
 	// belonging to their player, and mark them with the connected flag
-	for (entity_id_t ent : rootInfluenceEntities)
+	for (const std::pair<u8, entity_id_t>& root : rootInfluenceEntities)
 	{
-		// (These components must be valid else the entities wouldn't be added to this list)
-		CmpPtr<ICmpOwnership> cmpOwnership(GetSimContext(), ent);
-		CmpPtr<ICmpPosition> cmpPosition(GetSimContext(), ent);
+		const TerritoryInfluenceMap::Influence& influence = m_InfluenceMap.GetInfluences().at(root.second);
+		const u16 i = influence.i;
+		const u16 j = influence.j;
 
-		CFixedVector2D pos = cmpPosition->GetPosition2D();
-		u16 i, j;
-		NearestTerritoryTile(pos.X, pos.Y, i, j, tilesW, tilesH);
-
-		u8 owner = (u8)cmpOwnership->GetOwner();
+		u8 owner = influence.owner;
 
 		if (m_Territories->get(i, j) != owner)
 			continue;
@@ -598,7 +591,10 @@ void CCmpTerritoryManager::UpdateBoundaryLines()
 {
 	PROFILE("update boundary lines");
 
-	m_BoundaryLines.clear();
+	// Lines of the boundaries which didn't change are reused as they are, rather than smoothed again
+	std::vector<SBoundaryLine> oldBoundaryLines;
+	oldBoundaryLines.swap(m_BoundaryLines);
+	std::vector<bool> reusedBoundaryLines(oldBoundaryLines.size(), false);
 	m_DebugBoundaryLineNodes.clear();
 
 	if (!CRenderer::IsInitialised())
@@ -634,7 +630,27 @@ void CCmpTerritoryManager::UpdateBoundaryLines()
 		if (cmpPlayer)
 			color = cmpPlayer->GetDisplayedColor();
 
+		if (!m_EnableLineDebugOverlays)
+		{
+			size_t j = 0;
+			for (; j < oldBoundaryLines.size(); ++j)
+				if (!reusedBoundaryLines[j] &&
+				    oldBoundaryLines[j].owner == boundaries[i].owner &&
+				    oldBoundaryLines[j].blinking == boundaries[i].blinking &&
+				    oldBoundaryLines[j].boundaryPoints == boundaries[i].points)
+					break;
+			if (j < oldBoundaryLines.size())
+			{
+				reusedBoundaryLines[j] = true;
+				m_BoundaryLines.push_back(std::move(oldBoundaryLines[j]));
+				m_BoundaryLines.back().color = color;
+				m_BoundaryLines.back().overlay.m_Color = color;
+				continue;
+			}
+		}
+
 		m_BoundaryLines.push_back(SBoundaryLine());
+		m_BoundaryLines.back().boundaryPoints = boundaries[i].points;
 		m_BoundaryLines.back().blinking = boundaries[i].blinking;
 		m_BoundaryLines.back().owner = boundaries[i].owner;
 		m_BoundaryLines.back().color = color;
@@ -714,12 +730,9 @@ void CCmpTerritoryManager::RenderSubmit(SceneCollector& collector, const CFrustu
 player_id_t CCmpTerritoryManager::GetOwner(entity_pos_t x, entity_pos_t z)
 {
 	u16 i, j;
+	CalculateTerritories();
 	if (!m_Territories)
-	{
-		CalculateTerritories();
-		if (!m_Territories)
-			return 0;
-	}
+		return 0;
 
 	NearestTerritoryTile(x, z, i, j, m_Territories->m_W, m_Territories->m_H);
 	return m_Territories->get(i, j) & TERRITORY_PLAYER_MASK;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -91,6 +91,8 @@ public:
 
 REGISTER_COMPONENT_TYPE(Test1A)
 
+std::vector<entity_id_t> g_Test1BUpdateOrder;
+
 class CCmpTest1B : public ICmpTest1
 {
 public:
@@ -139,6 +141,7 @@ public:
 		{
 		case MT_Update:
 			m_x += 10;
+			g_Test1BUpdateOrder.push_back(GetEntityId());
 			break;
 		case MT_Interpolate:
 			m_x += 20;
@@ -758,6 +758,12 @@ private:
 	void Move(CCmpUnitMotionManager::MotionState& state, fixed dt);
 	void PostMove(CCmpUnitMotionManager::MotionState& state, fixed dt);
 
+	/**
+	 * Whether Move() may be called on a worker thread, i.e. doesn't run script.
+	 * Must be called on the main thread, before moving.
+	 */
+	bool CanMoveConcurrently() const;
+
 	/**
 	 * Returns true if we are possibly at our destination.
 	 * Since the concept of being at destination is dependent on why the move was requested,
@@ -1406,6 +1412,21 @@ bool CCmpUnitMotion::HandleObstructedMove(bool moved)
 	return true;
 }
 
+bool CCmpUnitMotion::CanMoveConcurrently() const
+{
+	// Moving asks the target (through ComputeTargetPosition) and the formation controller
+	// whether they are moving, which calls into script for script unit motions.
+	const entity_id_t target = m_MoveRequest.m_Type == MoveRequest::ENTITY || m_MoveRequest.m_Type == MoveRequest::OFFSET ?
+		m_MoveRequest.m_Entity : INVALID_ENTITY;
+	for (entity_id_t ent : { target, m_FormationController })
+	{
+		CmpPtr<ICmpUnitMotion> cmpUnitMotion(GetSimContext(), ent);
+		if (cmpUnitMotion && cmpUnitMotion->GetComponentTypeId() != CID_UnitMotion)
+			return false;
+	}
+	return true;
+}
+
 bool CCmpUnitMotion::TargetHasValidPosition(const MoveRequest& moveRequest) const
 {
 	if (moveRequest.m_Type != MoveRequest::ENTITY)
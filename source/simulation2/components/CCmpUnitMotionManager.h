@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,11 +21,14 @@
 #include "simulation2/system/Component.h"
 #include "ICmpUnitMotionManager.h"
 
+#include "ps/TaskManager.h"
 #include "simulation2/MessageTypes.h"
 #include "simulation2/components/ICmpTerrain.h"
 #include "simulation2/helpers/Grid.h"
 #include "simulation2/system/EntityMap.h"
 
+#include <array>
+
 class CCmpUnitMotion;
 
 class CCmpUnitMotionManager final : public ICmpUnitMotionManager
@@ -120,6 +123,16 @@ public:
 	Grid<std::vector<EntityMap<MotionState>::iterator>> m_MovingUnits;
 	bool m_ComputingMotion;
 
+	// Units to move this turn, in entity order, split into batches for the worker threads.
+	std::vector<MotionState*> m_MoveQueue;
+	// Units to move this turn that must be moved on the main thread, after m_MoveQueue.
+	std::vector<MotionState*> m_SerialMoveQueue;
+	// Occupied squares of m_MovingUnits, by colour ((x + 2 * z) % 5, see PushUnits).
+	std::array<std::vector<std::pair<u16, u16>>, 5> m_PushingSquares;
+	// Squares that have to be pushed after the others, on the main thread.
+	std::vector<std::pair<u16, u16>> m_SerialPushingSquares;
+	std::vector<Future<void>> m_Futures;
+
 	static std::string GetSchema()
 	{
 		return "<a:component type='system'/><empty/>";
@@ -157,7 +170,15 @@ private:
 	void MoveUnits(fixed dt);
 	void MoveFormations(fixed dt);
 	void Move(EntityMap<MotionState>& ents, fixed dt);
+	void MoveQueuedUnits(fixed dt);
+	void MoveQueuedBatch(size_t batch, fixed dt);
+	void MoveQueuedUnit(MotionState& state, fixed dt);
 
+	/**
+	 * Push all pairs of nearby units, returns the number of pairs compared.
+	 */
+	int PushUnits(fixed dt);
+	int PushSquare(u16 x, u16 z, fixed dt);
 	void Push(EntityMap<MotionState>::value_type& a, EntityMap<MotionState>::value_type& b, fixed dt);
 };
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,11 +20,14 @@
 #include "CCmpUnitMotion.h"
 #include "CCmpUnitMotionManager.h"
 
+#include "lib/timer.h"
 #include "maths/MathUtil.h"
 #include "ps/CLogger.h"
 #include "ps/Profile.h"
+#include "simulation2/system/FrameArena.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <unordered_set>
 #include <vector>
@@ -97,6 +100,53 @@ constexpr int MIN_PRESSURE_IF_OBSTRUCTED = 80;
  */
 constexpr entity_pos_t PRESSURE_STATIC_FACTOR =  entity_pos_t::FromInt(2);
 constexpr int PRESSURE_DISTANCE_FACTOR = 5;
+
+/**
+ * Number of units moved by a single task in MoveQueuedUnits.
+ * Moving a unit means a few obstruction tests, so small batches are enough to amortise the task overhead
+ * while still balancing well when a few units have long paths to follow.
+ */
+constexpr size_t UNITS_PER_MOVE_BATCH = 16;
+
+/**
+ * Number of pushing grid squares handled by a single task in PushUnits.
+ */
+constexpr size_t SQUARES_PER_PUSHING_BATCH = 4;
+
+/**
+ * Call @p func for each batch in [0, numberOfBatches), sharing the batches between the calling thread
+ * and up to one task manager worker per future. Returns once all batches have been handled.
+ */
+template<typename Func>
+void RunBatches(std::vector<Future<void>>& futures, size_t numberOfBatches, const Func& func)
+{
+	std::atomic<size_t> nextBatch = 0;
+
+#if DEBUG_RENDER
+	// The debug overlay data is not thread-safe.
+	const size_t numberOfTasks = 0;
+#else
+	// The calling thread handles a batch too, so only start workers for the remaining ones.
+	const size_t numberOfTasks = std::min(futures.size(), numberOfBatches > 0 ? numberOfBatches - 1 : 0);
+#endif
+	Threading::TaskManager& taskManager = Threading::TaskManager::Instance();
+	for (size_t i = 0; i < numberOfTasks; ++i)
+	{
+		ENSURE(!futures[i].Valid());
+		futures[i] = taskManager.PushTask([&nextBatch, numberOfBatches, &func]() {
+			PROFILE2("Async unit motion");
+			for (size_t batch = nextBatch++; batch < numberOfBatches; batch = nextBatch++)
+				func(batch);
+		});
+	}
+
+	for (size_t batch = nextBatch++; batch < numberOfBatches; batch = nextBatch++)
+		func(batch);
+
+	// Use CancelOrWait instead of just Cancel to ensure determinism.
+	for (size_t i = 0; i < numberOfTasks; ++i)
+		futures[i].CancelOrWait();
+}
 }
 
 #if DEBUG_RENDER
@@ -270,6 +320,7 @@ void CCmpUnitMotionManager::Init(const CParamNode&)
 	else
 		m_PushingPressureDecay = entity_pos_t::FromInt(6) / 10;
 
+	m_Futures.resize(Threading::TaskManager::Instance().GetNumberOfWorkers());
 }
 
 template<>
@@ -416,7 +467,9 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 #endif
 
 	PROFILE2("MotionMgr_Move");
-	std::unordered_set<std::vector<EntityMap<MotionState>::iterator>*> assigned;
+	using Subdivision = std::vector<EntityMap<MotionState>::iterator>;
+	std::unordered_set<Subdivision*, std::hash<Subdivision*>, std::equal_to<Subdivision*>, CFrameArena::Allocator<Subdivision*>> assigned(
+		0, std::hash<Subdivision*>(), std::equal_to<Subdivision*>(), GetSimContext().GetFrameArena());
 	for (EntityMap<MotionState>::iterator it = ents.begin(); it != ents.end(); ++it)
 	{
 		if (!it->second.cmpPosition->IsInWorld())
@@ -437,13 +490,25 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 			it->second.pos.X.ToInt_RoundToZero() / PUSHING_GRID_SIZE,
 			it->second.pos.Y.ToInt_RoundToZero() / PUSHING_GRID_SIZE
 		);
+		if (subdiv.empty())
+		{
+			u16 x = it->second.pos.X.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
+			u16 z = it->second.pos.Y.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
+			m_PushingSquares[(x + 2 * z) % m_PushingSquares.size()].emplace_back(x, z);
+		}
 		subdiv.emplace_back(it);
 		assigned.emplace(&subdiv);
+		if (!it->second.needUpdate || it->second.cmpUnitMotion->CanMoveConcurrently())
+			m_MoveQueue.emplace_back(&it->second);
+		else
+			m_SerialMoveQueue.emplace_back(&it->second);
 	}
 
+	MoveQueuedUnits(dt);
+
+#if DEBUG_RENDER
 	for (std::vector<EntityMap<MotionState>::iterator>* vec : assigned)
 	{
-#if DEBUG_RENDER
 		{
 			SOverlayLine gridL;
 			auto it = (*vec)[0];
@@ -465,42 +530,20 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 			gridL.m_Color = CColor(1, 1, 0, 1);
 			debugDataMotionMgr.m_Lines.push_back(gridL);
 		}
-#endif
-		for (EntityMap<MotionState>::iterator& it : *vec)
-		{
-			if (it->second.needUpdate)
-				it->second.cmpUnitMotion->Move(it->second, dt);
-			// Decay pressure after moving so we can get the full 0-MAX_PRESSURE range of values.
-			it->second.pushingPressure = (m_PushingPressureDecay * it->second.pushingPressure).ToInt_RoundToZero();
-		}
 	}
+#endif
 
 	// Skip pushing entirely if the radius is 0
 	if (&ents == &m_Units && IsPushingActivated())
 	{
 		PROFILE2("MotionMgr_Pushing");
+#if DEBUG_RENDER
 		for (std::vector<EntityMap<MotionState>::iterator>* vec : assigned)
-		{
-			ENSURE(!vec->empty());
-			std::vector< std::vector<EntityMap<MotionState>::iterator>* > consider = { vec };
-
-			int x = (*vec)[0]->second.pos.X.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
-			int z = (*vec)[0]->second.pos.Y.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
-			if (x + 1 < m_MovingUnits.width())
-				consider.push_back(&m_MovingUnits.get(x + 1, z));
-			if (x > 0)
-				consider.push_back(&m_MovingUnits.get(x - 1, z));
-			if (z + 1 < m_MovingUnits.height())
-				consider.push_back(&m_MovingUnits.get(x, z + 1));
-			if (z > 0)
-				consider.push_back(&m_MovingUnits.get(x, z - 1));
-
 			for (EntityMap<MotionState>::iterator& it : *vec)
 			{
 				if (it->second.ignore)
 					continue;
 
-#if DEBUG_RENDER
 				// Plop a sphere at the unit end-pos.
 				{
 					SOverlaySphere sph;
@@ -529,18 +572,20 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 										  it->second.pos.Y.ToDouble()));
 				line.m_Color = CColor(1, 0, 1, 0.5);
 				debugDataMotionMgr.m_Lines.push_back(line);
+			}
 #endif
-				for (std::vector<EntityMap<MotionState>::iterator>* vec2 : consider)
-					for (EntityMap<MotionState>::iterator& it2 : *vec2)
-						if (it->first < it2->first && !it2->second.ignore)
-						{
 #if DEBUG_STATS
-							++comparisons;
+		double pushingStart = timer_Time();
+		int pushingComparisons =
+#endif
+		PushUnits(dt);
+#if DEBUG_STATS
+		double pushingTime = timer_Time() - pushingStart;
+		if (pushingComparisons > 0)
+			printf(">> %s pushing: %i comparisons in %f secs, %f comparisons per second\n", m_Futures.empty() || DEBUG_RENDER ? "serial" : "parallel",
+				pushingComparisons, pushingTime, pushingComparisons / pushingTime);
+		comparisons += pushingComparisons;
 #endif
-							Push(*it, *it2, dt);
-						}
-			}
-		}
 	}
 
 	if (IsPushingActivated())
@@ -622,12 +667,17 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 	}
 	{
 		PROFILE2("MotionMgr_PostMove");
+		// Deliver the position changes to the components that handle them in bulk (e.g. the range manager)
+		// all at once. Anything else that PostMove sends flushes them first.
+		CComponentManager& componentManager = GetSimContext().GetComponentManager();
+		componentManager.BeginMessageBatching();
 		for (EntityMap<MotionState>::value_type& data : ents)
 		{
 			if (!data.second.needUpdate)
 				continue;
 			data.second.cmpUnitMotion->PostMove(data.second, dt);
 		}
+		componentManager.EndMessageBatching();
 	}
 #if DEBUG_STATS
 	int size = 0;
@@ -639,6 +689,116 @@ void CCmpUnitMotionManager::Move(EntityMap<MotionState>& ents, fixed dt)
 #endif
 	for (std::vector<EntityMap<MotionState>::iterator>* vec : assigned)
 		vec->clear();
+	for (std::vector<std::pair<u16, u16>>& squares : m_PushingSquares)
+		squares.clear();
+	m_SerialPushingSquares.clear();
+	m_MoveQueue.clear();
+	m_SerialMoveQueue.clear();
+}
+
+void CCmpUnitMotionManager::MoveQueuedUnits(fixed dt)
+{
+	// Moving a unit only reads shared state (obstructions, terrain, other entities' positions,
+	// which are only committed in PostMove) and writes its own motion state and paths.
+	// Consecutive batches of the queue are therefore moved concurrently; everything
+	// that affects other entities (position changes, messages, path requests) is done
+	// after pushing, in entity order, so the result does not depend on the number of threads.
+	const size_t numberOfBatches = (m_MoveQueue.size() + UNITS_PER_MOVE_BATCH - 1) / UNITS_PER_MOVE_BATCH;
+	RunBatches(m_Futures, numberOfBatches, [this, dt](size_t batch) {
+		MoveQueuedBatch(batch, dt);
+	});
+
+	// Units whose target or formation controller has a scripted unit motion run script when moving,
+	// which may only be done on the main thread. (Their result doesn't depend on the other units' moves either.)
+	for (MotionState* state : m_SerialMoveQueue)
+		MoveQueuedUnit(*state, dt);
+}
+
+void CCmpUnitMotionManager::MoveQueuedBatch(size_t batch, fixed dt)
+{
+	const size_t end = std::min(m_MoveQueue.size(), (batch + 1) * UNITS_PER_MOVE_BATCH);
+	for (size_t i = batch * UNITS_PER_MOVE_BATCH; i < end; ++i)
+		MoveQueuedUnit(*m_MoveQueue[i], dt);
+}
+
+void CCmpUnitMotionManager::MoveQueuedUnit(MotionState& state, fixed dt)
+{
+	if (state.needUpdate)
+		state.cmpUnitMotion->Move(state, dt);
+	// Decay pressure after moving so we can get the full 0-MAX_PRESSURE range of values.
+	state.pushingPressure = (m_PushingPressureDecay * state.pushingPressure).ToInt_RoundToZero();
+}
+
+int CCmpUnitMotionManager::PushUnits(fixed dt)
+{
+	// Units push the units of their own square and of the neighbouring squares (except diagonals),
+	// where the neighbours are those of the square the first unit of the square has moved to.
+	// A square thus modifies the units of itself and of its four neighbours if that unit is still in it.
+	// Squares of the same colour ((x + 2 * z) % 5) are at least three squares apart, so never modify the same units,
+	// and are handled concurrently, one colour after the other. The few squares whose first unit has
+	// left them are pushed afterwards, serially.
+	// Push only accumulates into the push vector and (saturated) pressure, and never reads them,
+	// so the result does not depend on the order of the pairs nor on the number of threads.
+	for (std::vector<std::pair<u16, u16>>& squares : m_PushingSquares)
+		squares.erase(std::remove_if(squares.begin(), squares.end(), [this](const std::pair<u16, u16>& square) {
+			const CFixedVector2D& pos = m_MovingUnits.get(square.first, square.second)[0]->second.pos;
+			if (pos.X.ToInt_RoundToZero() / PUSHING_GRID_SIZE == square.first && pos.Y.ToInt_RoundToZero() / PUSHING_GRID_SIZE == square.second)
+				return false;
+			m_SerialPushingSquares.push_back(square);
+			return true;
+		}), squares.end());
+
+	std::atomic<int> comparisons = 0;
+	for (const std::vector<std::pair<u16, u16>>& squares : m_PushingSquares)
+	{
+		const size_t numberOfBatches = (squares.size() + SQUARES_PER_PUSHING_BATCH - 1) / SQUARES_PER_PUSHING_BATCH;
+		RunBatches(m_Futures, numberOfBatches, [this, &squares, &comparisons, dt](size_t batch) {
+			int batchComparisons = 0;
+			const size_t end = std::min(squares.size(), (batch + 1) * SQUARES_PER_PUSHING_BATCH);
+			for (size_t i = batch * SQUARES_PER_PUSHING_BATCH; i < end; ++i)
+				batchComparisons += PushSquare(squares[i].first, squares[i].second, dt);
+			comparisons += batchComparisons;
+		});
+	}
+
+	for (const std::pair<u16, u16>& square : m_SerialPushingSquares)
+		comparisons += PushSquare(square.first, square.second, dt);
+	return comparisons;
+}
+
+int CCmpUnitMotionManager::PushSquare(u16 x, u16 z, fixed dt)
+{
+	std::vector<EntityMap<MotionState>::iterator>& units = m_MovingUnits.get(x, z);
+	ENSURE(!units.empty());
+	std::vector<EntityMap<MotionState>::iterator>* consider[5] = { &units, nullptr, nullptr, nullptr, nullptr };
+
+	const int cx = units[0]->second.pos.X.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
+	const int cz = units[0]->second.pos.Y.ToInt_RoundToZero() / PUSHING_GRID_SIZE;
+	if (cx + 1 < m_MovingUnits.width())
+		consider[1] = &m_MovingUnits.get(cx + 1, cz);
+	if (cx > 0)
+		consider[2] = &m_MovingUnits.get(cx - 1, cz);
+	if (cz + 1 < m_MovingUnits.height())
+		consider[3] = &m_MovingUnits.get(cx, cz + 1);
+	if (cz > 0)
+		consider[4] = &m_MovingUnits.get(cx, cz - 1);
+
+	int comparisons = 0;
+	for (EntityMap<MotionState>::iterator& it : units)
+	{
+		if (it->second.ignore)
+			continue;
+
+		for (std::vector<EntityMap<MotionState>::iterator>* vec : consider)
+			if (vec)
+				for (EntityMap<MotionState>::iterator& it2 : *vec)
+					if (it->first < it2->first && !it2->second.ignore)
+					{
+						++comparisons;
+						Push(*it, *it2, dt);
+					}
+	}
+	return comparisons;
 }
 
 // TODO: ought to better simulate in-flight pushing, e.g. if units would cross in-between turns.
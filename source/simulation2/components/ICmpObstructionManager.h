@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -23,6 +23,7 @@
 #include "maths/FixedVector2D.h"
 #include "simulation2/helpers/Position.h"
 
+#include <tuple>
 #include <vector>
 
 class IObstructionTestFilter;
@@ -308,6 +309,58 @@ public:
 	virtual void GetObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const = 0;
 	virtual void GetStaticObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const = 0;
 	virtual void GetUnitObstructionsInRange(const IObstructionTestFilter& filter, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1, std::vector<ObstructionSquare>& squares) const = 0;
+
+	/**
+	 * The (inclusive) range of subdivision cells in which the Get*ObstructionsInRange functions
+	 * look for obstructions. Those functions return exactly the obstructions in the cells of their
+	 * range which pass the filter and Is*ObstructionInRange, so callers making many queries over
+	 * nearby ranges can fetch the obstructions of the shared cells once with Get*ObstructionsInCells,
+	 * and then select the ones of each query themselves.
+	 */
+	struct ObstructionCells
+	{
+		u32 i0, j0, i1, j1;
+
+		bool operator<(const ObstructionCells& o) const
+		{
+			return std::tie(i0, j0, i1, j1) < std::tie(o.i0, o.j0, o.i1, o.j1);
+		}
+	};
+
+	/**
+	 * An obstruction square with the arguments to pass to IObstructionTestFilter::TestShape.
+	 */
+	struct FilterableObstructionSquare
+	{
+		ObstructionSquare square;
+		tag_t tag;
+		flags_t flags;
+		entity_id_t group;
+		entity_id_t group2;
+	};
+
+	virtual ObstructionCells GetObstructionCellsInRange(entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1) const = 0;
+	virtual void GetStaticObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const = 0;
+	virtual void GetUnitObstructionsInCells(const ObstructionCells& cells, std::vector<FilterableObstructionSquare>& squares) const = 0;
+
+	/**
+	 * Returns whether GetStaticObstructionsInRange includes a static obstruction from the cells of the range.
+	 * This tests an overestimated bounding box of the square.
+	 */
+	static bool IsStaticObstructionInRange(const ObstructionSquare& square, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1)
+	{
+		entity_pos_t r = square.hw + square.hh; // overestimate the max dist of an edge from the center
+		// TODO: maybe we should use Geometry::GetHalfBoundingBox to be more precise?
+		return !(square.x + r < x0 || square.x - r > x1 || square.z + r < z0 || square.z - r > z1);
+	}
+
+	/**
+	 * Returns whether GetUnitObstructionsInRange includes a unit obstruction from the cells of the range.
+	 */
+	static bool IsUnitObstructionInRange(const ObstructionSquare& square, entity_pos_t x0, entity_pos_t z0, entity_pos_t x1, entity_pos_t z1)
+	{
+		return square.x - square.hw <= x1 && square.z - square.hh <= z1 && square.x + square.hw >= x0 && square.z + square.hh >= z0;
+	}
 	virtual void GetStaticObstructionsOnObstruction(const ObstructionSquare& square, std::vector<entity_id_t>& out, const IObstructionTestFilter& filter) const = 0;
 
 	/**
@@ -1,4 +1,4 @@
-/* Copyright (C) 2010 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,6 +20,13 @@
 
 #include "simulation2/system/Interface.h"
 
+#include <vector>
+
+/**
+ * Entities whose Test1B component received MT_Update, in the order they received it.
+ */
+extern std::vector<entity_id_t> g_Test1BUpdateOrder;
+
 /**
  * Component for testing the simulation system.
  */
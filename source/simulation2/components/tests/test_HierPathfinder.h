@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -520,4 +520,70 @@ public:
 		TS_ASSERT_EQUALS(hierPath.m_Chunks[pathClassMask["1"]][0].m_RegionsID.size(), 2);
 		TS_ASSERT_EQUALS(hierPath.m_Chunks[pathClassMask["1"]][0].m_RegionsID.back(), 4);
 	}
+	void test_parallel_update_matches_recompute()
+	{
+		pathClassMask = std::map<std::string, pass_class_t> {
+			{ "1", 1 },
+			{ "2", 2 },
+		};
+		nonPathClassMask = std::map<std::string, pass_class_t> {
+			{ "3", 4 }
+		};
+
+		// Scatter obstacles over every chunk, with some walls to create several global regions.
+		Grid<NavcellData> grid(mapSize, mapSize);
+		u32 seed = 12345;
+		const auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+		for (u16 j = 0; j < mapSize; ++j)
+			for (u16 i = 0; i < mapSize; ++i)
+				grid.set(i, j, random() % 4 == 0 ? 3 : (random() % 8 == 0 ? 2 : 0));
+		for (u16 j = 0; j < mapSize; ++j)
+			grid.set(100, j, 7);
+
+		HierarchicalPathfinder hierPath;
+		hierPath.Recompute(&grid, nonPathClassMask, pathClassMask);
+
+		// Recomputing must give the same global region IDs every time.
+		HierarchicalPathfinder otherHierPath;
+		otherHierPath.Recompute(&grid, nonPathClassMask, pathClassMask);
+		TS_ASSERT(hierPath.m_GlobalRegions == otherHierPath.m_GlobalRegions);
+		TS_ASSERT(hierPath.m_Edges == otherHierPath.m_Edges);
+
+		// Change navcells in most chunks, and open the wall.
+		Grid<u8> dirtyGrid(mapSize, mapSize);
+		for (u16 j = 0; j < mapSize; ++j)
+			for (u16 i = 0; i < mapSize; ++i)
+				if (random() % 16 == 0)
+				{
+					grid.set(i, j, grid.get(i, j) ^ 1);
+					dirtyGrid.set(i, j, 1);
+				}
+		for (u16 j = 50; j < 70; ++j)
+		{
+			grid.set(100, j, 0);
+			dirtyGrid.set(100, j, 1);
+		}
+		hierPath.Update(&grid, dirtyGrid);
+
+		otherHierPath.Recompute(&grid, nonPathClassMask, pathClassMask);
+		for (const std::pair<const std::string, pass_class_t>& passClassMask : pathClassMask)
+		{
+			const pass_class_t passClass = passClassMask.second;
+			TS_ASSERT(hierPath.m_Chunks[passClass] == otherHierPath.m_Chunks[passClass]);
+			TS_ASSERT(hierPath.m_Edges[passClass] == otherHierPath.m_Edges[passClass]);
+
+			// Global region IDs differ, but they must group the same navcells.
+			std::map<HierarchicalPathfinder::GlobalRegionID, HierarchicalPathfinder::GlobalRegionID> idMap;
+			std::map<HierarchicalPathfinder::GlobalRegionID, HierarchicalPathfinder::GlobalRegionID> otherIdMap;
+			for (u16 j = 0; j < mapSize; ++j)
+				for (u16 i = 0; i < mapSize; ++i)
+				{
+					const HierarchicalPathfinder::GlobalRegionID id = hierPath.GetGlobalRegion(i, j, passClass);
+					const HierarchicalPathfinder::GlobalRegionID otherId = otherHierPath.GetGlobalRegion(i, j, passClass);
+					TS_ASSERT_EQUALS(id == 0, otherId == 0);
+					TS_ASSERT_EQUALS(idMap.emplace(id, otherId).first->second, otherId);
+					TS_ASSERT_EQUALS(otherIdMap.emplace(otherId, id).first->second, id);
+				}
+		}
+	}
 };
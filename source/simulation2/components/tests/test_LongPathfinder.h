@@ -0,0 +1,194 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulation2/system/ComponentTest.h"
+
+#define TEST
+
+#include "maths/Vector2D.h"
+#include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/HierarchicalPathfinder.h"
+#include "simulation2/helpers/JumpPointCache.h"
+#include "simulation2/helpers/LongPathCache.h"
+#include "simulation2/helpers/LongPathfinder.h"
+
+#include <random>
+
+class TestLongPathfinder : public CxxTest::TestSuite
+{
+public:
+	void setUp()
+	{
+	}
+
+	void tearDown()
+	{
+	}
+
+	const pass_class_t PASS_1 = 1;
+	const pass_class_t PASS_2 = 2;
+
+	const u16 mapSize = 160;
+
+	template<typename Row>
+	void assert_same_rows(const std::vector<Row>& a, const std::vector<Row>& b)
+	{
+		TS_ASSERT_EQUALS(a.size(), b.size());
+		for (size_t j = 0; j < std::min(a.size(), b.size()); ++j)
+			TS_ASSERT(a[j].data == b[j].data);
+	}
+
+	void assert_same_cache(const JumpPointCache& updated, const Grid<NavcellData>& grid, pass_class_t passClass)
+	{
+		JumpPointCache rebuilt;
+		rebuilt.reset(&grid, passClass);
+
+		TS_ASSERT_EQUALS(updated.m_Width, rebuilt.m_Width);
+		TS_ASSERT_EQUALS(updated.m_Height, rebuilt.m_Height);
+		assert_same_rows(updated.m_JumpPointsRight, rebuilt.m_JumpPointsRight);
+		assert_same_rows(updated.m_JumpPointsLeft, rebuilt.m_JumpPointsLeft);
+		assert_same_rows(updated.m_JumpPointsUp, rebuilt.m_JumpPointsUp);
+		assert_same_rows(updated.m_JumpPointsDown, rebuilt.m_JumpPointsDown);
+	}
+
+	void test_jump_point_cache_update()
+	{
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<int> position(1, mapSize - 12);
+		std::uniform_int_distribution<int> extent(1, 10);
+		std::uniform_int_distribution<int> passability(0, 3);
+
+		// The map is surrounded by impassable navcells for both classes.
+		Grid<NavcellData> grid(mapSize, mapSize);
+		Grid<u8> dirtinessGrid(mapSize, mapSize);
+		for (u16 j = 0; j < mapSize; ++j)
+			for (u16 i = 0; i < mapSize; ++i)
+				if (i == 0 || j == 0 || i == mapSize - 1 || j == mapSize - 1)
+					grid.set(i, j, PASS_1 | PASS_2);
+
+		LongPathfinder longPath;
+		longPath.Reload(&grid);
+		for (pass_class_t passClass : { PASS_1, PASS_2 })
+		{
+			longPath.m_JumpPointCache[passClass] = std::make_shared<JumpPointCache>();
+			longPath.m_JumpPointCache[passClass]->reset(&grid, passClass);
+		}
+
+		// Place and remove random obstructions, as buildings would.
+		for (int step = 0; step < 50; ++step)
+		{
+			dirtinessGrid.reset();
+
+			int i0 = position(engine);
+			int j0 = position(engine);
+			int i1 = i0 + extent(engine);
+			int j1 = j0 + extent(engine);
+			NavcellData value = passability(engine);
+			for (int j = j0; j < j1; ++j)
+				for (int i = i0; i < i1; ++i)
+				{
+					grid.set(i, j, value);
+					dirtinessGrid.set(i, j, 1);
+				}
+
+			longPath.Update(&grid, dirtinessGrid);
+
+			assert_same_cache(*longPath.m_JumpPointCache[PASS_1], grid, PASS_1);
+			assert_same_cache(*longPath.m_JumpPointCache[PASS_2], grid, PASS_2);
+		}
+	}
+	void assert_valid_path(const WaypointPath& path, entity_pos_t x0, entity_pos_t z0, const Grid<NavcellData>& grid, pass_class_t passClass)
+	{
+		TS_ASSERT(!path.m_Waypoints.empty());
+		entity_pos_t x = x0;
+		entity_pos_t z = z0;
+		for (std::vector<Waypoint>::const_reverse_iterator it = path.m_Waypoints.rbegin(); it != path.m_Waypoints.rend(); ++it)
+		{
+			TS_ASSERT(Pathfinding::CheckLineMovement(x, z, it->x, it->z, passClass, grid));
+			x = it->x;
+			z = it->z;
+		}
+	}
+
+	void test_long_path_cache()
+	{
+		// A wall splits the map, with a gap that all paths must go through.
+		Grid<NavcellData> grid(mapSize, mapSize);
+		for (u16 j = 0; j < mapSize; ++j)
+			for (u16 i = 0; i < mapSize; ++i)
+				if (i == 0 || j == 0 || i == mapSize - 1 || j == mapSize - 1 || (i == 80 && (j < 100 || j >= 110)))
+					grid.set(i, j, PASS_1);
+
+		std::map<std::string, pass_class_t> pathfindingPassClasses = { { "1", PASS_1 } };
+		HierarchicalPathfinder hierPath;
+		hierPath.Recompute(&grid, {}, pathfindingPassClasses);
+		LongPathfinder longPath;
+		longPath.Reload(&grid);
+
+		LongPathCache cache;
+		PathGoal goal;
+		goal.type = PathGoal::POINT;
+
+		// The first path is computed from scratch, and cached.
+		goal.x = fixed::FromInt(140);
+		goal.z = fixed::FromInt(30);
+		LongPathCache::Lookup lookup;
+		WaypointPath path;
+		longPath.ComputePath(hierPath, fixed::FromInt(20), fixed::FromInt(20), goal, PASS_1, cache, lookup, path);
+		TS_ASSERT(lookup.status == LongPathCache::Status::MISS);
+		assert_valid_path(path, fixed::FromInt(20), fixed::FromInt(20), grid, PASS_1);
+		cache.NextBatch();
+		cache.Commit(lookup, path);
+		TS_ASSERT_EQUALS(cache.GetNumberOfEntries(), 1);
+
+		// A similar journey reuses it.
+		goal.x = fixed::FromInt(141);
+		goal.z = fixed::FromInt(35);
+		path.m_Waypoints.clear();
+		longPath.ComputePath(hierPath, fixed::FromInt(25), fixed::FromInt(18), goal, PASS_1, cache, lookup, path);
+		TS_ASSERT(lookup.status == LongPathCache::Status::HIT);
+		assert_valid_path(path, fixed::FromInt(25), fixed::FromInt(18), grid, PASS_1);
+		TS_ASSERT_EQUALS(path.m_Waypoints.front().x, goal.x);
+		TS_ASSERT_EQUALS(path.m_Waypoints.front().z, goal.z);
+		cache.NextBatch();
+		cache.Commit(lookup, path);
+		TS_ASSERT_EQUALS(cache.GetHits(), 1);
+		TS_ASSERT_EQUALS(cache.GetMisses(), 1);
+
+		// Changes away from the corridor and its chunks keep the entry.
+		Grid<u8> dirtinessGrid(mapSize, mapSize);
+		dirtinessGrid.set(20, 140, 1);
+		cache.Invalidate(dirtinessGrid);
+		TS_ASSERT_EQUALS(cache.GetNumberOfEntries(), 1);
+
+		// Closing the gap removes it.
+		dirtinessGrid.reset();
+		for (u16 j = 100; j < 110; ++j)
+		{
+			grid.set(80, j, PASS_1);
+			dirtinessGrid.set(80, j, 1);
+		}
+		hierPath.Update(&grid, dirtinessGrid);
+		longPath.Update(&grid, dirtinessGrid);
+		cache.Invalidate(dirtinessGrid);
+		TS_ASSERT_EQUALS(cache.GetNumberOfEntries(), 0);
+
+		path.m_Waypoints.clear();
+		longPath.ComputePath(hierPath, fixed::FromInt(25), fixed::FromInt(18), goal, PASS_1, cache, lookup, path);
+		TS_ASSERT(lookup.status != LongPathCache::Status::HIT);
+	}
+};
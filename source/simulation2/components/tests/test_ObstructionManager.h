@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -19,6 +19,10 @@
 
 #include "simulation2/components/ICmpObstructionManager.h"
 #include "simulation2/components/ICmpObstruction.h"
+#include "simulation2/helpers/Geometry.h"
+#include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/Pathfinding.h"
+#include "simulation2/helpers/Rasterize.h"
 
 class MockObstruction : public ICmpObstruction
 {
@@ -510,6 +514,292 @@ public:
 		TS_ASSERT_EQUALS(obSquare3.v, CFixedVector2D(fixed::FromInt(0), fixed::FromInt(1)));
 	}
 
+	/**
+	 * Verifies that shapes are still found after many of them got removed and moved,
+	 * and that the queries agree with a brute-force search.
+	 */
+	void test_many_shapes()
+	{
+		struct Unit
+		{
+			tag_t tag;
+			entity_id_t ent;
+			entity_pos_t x, z, c;
+		};
+		std::vector<Unit> units;
+
+		const ICmpObstructionManager::flags_t flags = ICmpObstructionManager::FLAG_BLOCK_PATHFINDING;
+		for (entity_id_t i = 0; i < 400; ++i)
+		{
+			Unit unit{ tag_t(), 100 + i, entity_pos_t::FromInt(20 + (i * 37) % 300) / 2, entity_pos_t::FromInt(20 + (i * 91) % 280) / 2, entity_pos_t::FromInt(1 + i % 5) / 2 };
+			unit.tag = cmp->AddUnitShape(unit.ent, unit.x, unit.z, unit.c, flags, unit.ent);
+			units.push_back(unit);
+		}
+
+		// Remove most of the shapes, which leaves enough holes to be compacted.
+		std::vector<Unit> remaining;
+		for (size_t i = 0; i < units.size(); ++i)
+		{
+			if (i % 3 == 0)
+				remaining.push_back(units[i]);
+			else
+				cmp->RemoveShape(units[i].tag);
+		}
+
+		for (size_t i = 0; i < remaining.size(); i += 2)
+		{
+			remaining[i].x += entity_pos_t::FromInt(3);
+			remaining[i].z -= entity_pos_t::FromInt(2);
+			cmp->MoveShape(remaining[i].tag, remaining[i].x, remaining[i].z, entity_angle_t::Zero());
+		}
+
+		for (const Unit& unit : remaining)
+		{
+			ObstructionSquare square = cmp->GetObstruction(unit.tag);
+			TS_ASSERT_EQUALS(square.x, unit.x);
+			TS_ASSERT_EQUALS(square.z, unit.z);
+			TS_ASSERT_EQUALS(square.hw, unit.c);
+		}
+
+		// Only consider the shapes added above.
+		SkipTagRequireFlagsObstructionFilter filter(tag_t(), flags);
+		for (int q = 0; q < 20; ++q)
+		{
+			entity_pos_t x = entity_pos_t::FromInt(15 + q * 7);
+			entity_pos_t z = entity_pos_t::FromInt(140 - q * 5);
+			entity_pos_t clearance = entity_pos_t::FromInt(1 + q % 4);
+
+			std::vector<entity_id_t> expected;
+			std::vector<ObstructionSquare> expectedSquares;
+			for (const Unit& unit : remaining)
+			{
+				if (unit.x + unit.c < x - clearance || unit.x - unit.c > x + clearance ||
+				    unit.z + unit.c < z - clearance || unit.z - unit.c > z + clearance)
+					continue;
+				expected.push_back(unit.ent);
+				expectedSquares.push_back(cmp->GetObstruction(unit.tag));
+			}
+
+			std::vector<entity_id_t> out;
+			TS_ASSERT_EQUALS(cmp->TestUnitShape(filter, x, z, clearance, &out), !expected.empty());
+			TS_ASSERT_EQUALS(out, expected);
+
+			std::vector<ObstructionSquare> squares;
+			cmp->GetUnitObstructionsInRange(filter, x - clearance, z - clearance, x + clearance, z + clearance, squares);
+			TS_ASSERT_EQUALS(squares.size(), expectedSquares.size());
+			for (size_t i = 0; i < std::min(squares.size(), expectedSquares.size()); ++i)
+			{
+				TS_ASSERT_EQUALS(squares[i].x, expectedSquares[i].x);
+				TS_ASSERT_EQUALS(squares[i].z, expectedSquares[i].z);
+			}
+		}
+
+		// Rotated static shapes, again removing most of them.
+		struct Building
+		{
+			tag_t tag;
+			entity_id_t ent;
+			entity_pos_t x, z, w, h;
+			entity_angle_t a;
+		};
+		std::vector<Building> buildings;
+
+		const ICmpObstructionManager::flags_t staticFlags = ICmpObstructionManager::FLAG_DELETE_UPON_CONSTRUCTION;
+		for (entity_id_t i = 0; i < 300; ++i)
+		{
+			Building building{ tag_t(), 1000 + i, entity_pos_t::FromInt(20 + (i * 53) % 300) / 2, entity_pos_t::FromInt(20 + (i * 29) % 280) / 2,
+				entity_pos_t::FromInt(2 + i % 4), entity_pos_t::FromInt(1 + i % 3), entity_angle_t::FromInt(i % 7) / 2 };
+			building.tag = cmp->AddStaticShape(building.ent, building.x, building.z, building.a, building.w, building.h, staticFlags, building.ent);
+			buildings.push_back(building);
+		}
+
+		std::vector<Building> remainingBuildings;
+		for (size_t i = 0; i < buildings.size(); ++i)
+		{
+			if (i % 3 == 1)
+				remainingBuildings.push_back(buildings[i]);
+			else
+				cmp->RemoveShape(buildings[i].tag);
+		}
+
+		for (size_t i = 0; i < remainingBuildings.size(); i += 2)
+		{
+			remainingBuildings[i].x -= entity_pos_t::FromInt(2);
+			remainingBuildings[i].a += entity_angle_t::FromInt(1);
+			cmp->MoveShape(remainingBuildings[i].tag, remainingBuildings[i].x, remainingBuildings[i].z, remainingBuildings[i].a);
+		}
+
+		for (const Building& building : remainingBuildings)
+		{
+			ObstructionSquare square = cmp->GetObstruction(building.tag);
+			TS_ASSERT_EQUALS(square.x, building.x);
+			TS_ASSERT_EQUALS(square.z, building.z);
+			TS_ASSERT_EQUALS(square.hw, building.w / 2);
+			TS_ASSERT_EQUALS(square.hh, building.h / 2);
+		}
+
+		SkipTagRequireFlagsObstructionFilter staticFilter(tag_t(), staticFlags);
+		for (int q = 0; q < 20; ++q)
+		{
+			const CFixedVector2D center(entity_pos_t::FromInt(15 + q * 7), entity_pos_t::FromInt(140 - q * 5));
+			const entity_angle_t a = entity_angle_t::FromInt(q % 5) / 3;
+			const CFixedVector2D halfSize(entity_pos_t::FromInt(1 + q % 4), entity_pos_t::FromInt(2 + q % 3));
+
+			fixed sin, cos;
+			sincos_approx(a, sin, cos);
+			const CFixedVector2D u(cos, -sin);
+			const CFixedVector2D v(sin, cos);
+
+			std::vector<entity_id_t> expected;
+			for (const Building& building : remainingBuildings)
+			{
+				ObstructionSquare square = cmp->GetObstruction(building.tag);
+				if (Geometry::TestSquareSquare(center, u, v, halfSize,
+					CFixedVector2D(square.x, square.z), square.u, square.v, CFixedVector2D(square.hw, square.hh)))
+					expected.push_back(building.ent);
+			}
+
+			std::vector<entity_id_t> out;
+			TS_ASSERT_EQUALS(cmp->TestStaticShape(staticFilter, center.X, center.Y, a, halfSize.X * 2, halfSize.Y * 2, &out), !expected.empty());
+			std::sort(out.begin(), out.end());
+			TS_ASSERT_EQUALS(out, expected);
+		}
+
+		testHelper->Roundtrip();
+	}
+
+	/**
+	 * Verifies that selecting the obstructions of the cells of a range which pass the filter and the range test
+	 * gives the same obstructions, in the same order, as querying the range.
+	 */
+	void test_obstructions_in_cells()
+	{
+		const ICmpObstructionManager::flags_t flags = ICmpObstructionManager::FLAG_BLOCK_MOVEMENT;
+		for (entity_id_t i = 0; i < 120; ++i)
+		{
+			// Place the shapes around the boundaries of the cells, and rotate some of the buildings
+			// so that their overestimated boxes reach cells their actual boxes aren't in.
+			entity_pos_t x = entity_pos_t::FromInt(32 + (i * 37) % 160) / 2;
+			entity_pos_t z = entity_pos_t::FromInt(32 + (i * 53) % 150) / 2;
+			if (i % 2)
+				cmp->AddStaticShape(100 + i, x, z, entity_angle_t::FromInt(i % 4) / 3, entity_pos_t::FromInt(2 + i % 7), entity_pos_t::FromInt(1 + i % 3),
+					flags | (i % 3 ? 0 : ICmpObstructionManager::FLAG_MOVING), 100 + i % 5, i % 4 ? INVALID_ENTITY : 100 + i % 3);
+			else
+				cmp->AddUnitShape(100 + i, x, z, entity_pos_t::FromInt(1 + i % 4) / 2,
+					flags | (i % 3 ? 0 : ICmpObstructionManager::FLAG_MOVING), 100 + i % 5);
+		}
+
+		for (int q = 0; q < 40; ++q)
+		{
+			entity_pos_t x0 = entity_pos_t::FromInt(q * 3) - entity_pos_t::FromInt(q % 4) / 3;
+			entity_pos_t z0 = entity_pos_t::FromInt(80 - q * 2);
+			entity_pos_t x1 = x0 + entity_pos_t::FromInt(10 + q % 5 * 9);
+			entity_pos_t z1 = z0 + entity_pos_t::FromInt(25 - q % 3 * 7);
+			ControlGroupMovementObstructionFilter filter(q % 2 == 0, 100 + q % 6);
+
+			std::vector<ObstructionSquare> expected;
+			cmp->GetStaticObstructionsInRange(filter, x0, z0, x1, z1, expected);
+			size_t expectedStatic = expected.size();
+			cmp->GetUnitObstructionsInRange(filter, x0, z0, x1, z1, expected);
+
+			ICmpObstructionManager::ObstructionCells cells = cmp->GetObstructionCellsInRange(x0, z0, x1, z1);
+			std::vector<ICmpObstructionManager::FilterableObstructionSquare> inCells;
+			cmp->GetStaticObstructionsInCells(cells, inCells);
+			size_t inCellsStatic = inCells.size();
+			cmp->GetUnitObstructionsInCells(cells, inCells);
+
+			std::vector<ObstructionSquare> squares;
+			size_t squaresStatic = 0;
+			for (size_t i = 0; i < inCells.size(); ++i)
+			{
+				const ICmpObstructionManager::FilterableObstructionSquare& square = inCells[i];
+				if (!filter.TestShape(square.tag, square.flags, square.group, square.group2))
+					continue;
+				if (i < inCellsStatic ?
+				    !ICmpObstructionManager::IsStaticObstructionInRange(square.square, x0, z0, x1, z1) :
+				    !ICmpObstructionManager::IsUnitObstructionInRange(square.square, x0, z0, x1, z1))
+					continue;
+				squares.push_back(square.square);
+				if (i < inCellsStatic)
+					++squaresStatic;
+			}
+
+			TS_ASSERT_EQUALS(squaresStatic, expectedStatic);
+			TS_ASSERT_EQUALS(squares.size(), expected.size());
+			for (size_t i = 0; i < std::min(squares.size(), expected.size()); ++i)
+			{
+				TS_ASSERT_EQUALS(squares[i].x, expected[i].x);
+				TS_ASSERT_EQUALS(squares[i].z, expected[i].z);
+				TS_ASSERT_EQUALS(squares[i].hw, expected[i].hw);
+				TS_ASSERT_EQUALS(squares[i].u.X, expected[i].u.X);
+			}
+		}
+	}
+
+	/**
+	 * Verifies that rasterizing many shapes (which is split in bands of rows between tasks)
+	 * gives the same grid as rasterizing each shape in turn.
+	 */
+	void test_rasterize_bands()
+	{
+		const ICmpObstructionManager::flags_t flags = ICmpObstructionManager::FLAG_BLOCK_PATHFINDING;
+		for (int i = 0; i < 300; ++i)
+		{
+			// Some of the shapes stick out of the grid.
+			entity_pos_t x = entity_pos_t::FromInt((i * 97) % 1010) - entity_pos_t::FromInt(5);
+			entity_pos_t z = entity_pos_t::FromInt((i * 61) % 1010) - entity_pos_t::FromInt(5);
+			if (i % 3 == 0)
+				cmp->AddUnitShape(100 + i, x, z, entity_pos_t::FromInt(1 + i % 3) / 2, flags, 100 + i);
+			else
+				cmp->AddStaticShape(100 + i, x, z, entity_angle_t::FromInt(i % 7), entity_pos_t::FromInt(2 + i % 29), entity_pos_t::FromInt(3 + i % 17), flags, 100 + i);
+		}
+
+		std::vector<PathfinderPassability> passClasses;
+		for (int i = 0; i < 3; ++i)
+		{
+			passClasses.emplace_back(1 << i, CParamNode());
+			passClasses.back().m_Clearance = entity_pos_t::FromInt(i) / 2;
+			passClasses.back().m_Obstructions = PathfinderPassability::PATHFINDING;
+		}
+
+		Grid<NavcellData> grid(1000, 1000);
+		cmp->Rasterize(grid, passClasses, true);
+
+		Grid<NavcellData> expected(1000, 1000);
+		for (const PathfinderPassability& passClass : passClasses)
+		{
+			for (int i = 0; i < 300; ++i)
+			{
+				entity_pos_t x = entity_pos_t::FromInt((i * 97) % 1010) - entity_pos_t::FromInt(5);
+				entity_pos_t z = entity_pos_t::FromInt((i * 61) % 1010) - entity_pos_t::FromInt(5);
+				if (i % 3 == 0)
+				{
+					entity_pos_t r = entity_pos_t::FromInt(1 + i % 3) / 2 + passClass.m_Clearance;
+					u16 i0, j0, i1, j1;
+					Pathfinding::NearestNavcell(x - r, z - r, i0, j0, expected.m_W, expected.m_H);
+					Pathfinding::NearestNavcell(x + r, z + r, i1, j1, expected.m_W, expected.m_H);
+					for (u16 j = j0 + 1; j < j1; ++j)
+						for (u16 ii = i0 + 1; ii < i1; ++ii)
+							expected.set(ii, j, expected.get(ii, j) | passClass.m_Mask);
+					continue;
+				}
+
+				SimRasterize::Spans spans;
+				SimRasterize::RasterizeRectWithClearance(spans,
+					cmp->GetStaticShapeObstruction(x, z, entity_angle_t::FromInt(i % 7), entity_pos_t::FromInt(2 + i % 29), entity_pos_t::FromInt(3 + i % 17)),
+					passClass.m_Clearance, Pathfinding::NAVCELL_SIZE);
+				for (const SimRasterize::Span& span : spans)
+				{
+					i16 j = Clamp(span.j, (i16)0, (i16)(expected.m_H - 1));
+					for (i16 ii = std::max(span.i0, (i16)0); ii < std::min(span.i1, (i16)expected.m_W); ++ii)
+						expected.set(ii, j, expected.get(ii, j) | passClass.m_Mask);
+				}
+			}
+		}
+
+		TS_ASSERT(grid == expected);
+	}
+
 	/**
 	 * Verifies the calculations of distances between shapes.
 	 */
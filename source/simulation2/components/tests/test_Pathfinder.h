@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -133,6 +133,90 @@ public:
 		}
 	}
 
+	/**
+	 * Mark some random rectangles of @p dirtinessGrid as dirty, and change the matching cells of @p grid.
+	 */
+	void DirtyRandomRectangles(Grid<NavcellData>& grid, Grid<u8>& dirtinessGrid, size_t count, u16 maxSize, std::mt19937& engine)
+	{
+		std::uniform_int_distribution<u16> sizeDistribution(1, maxSize);
+		std::uniform_int_distribution<u16> xDistribution(0, grid.m_W - maxSize);
+		std::uniform_int_distribution<u16> zDistribution(0, grid.m_H - maxSize);
+		for (size_t n = 0; n < count; ++n)
+		{
+			u16 x0 = xDistribution(engine), z0 = zDistribution(engine);
+			u16 w = sizeDistribution(engine), h = sizeDistribution(engine);
+			NavcellData value = static_cast<NavcellData>(engine());
+			for (u16 j = z0; j < z0 + h; ++j)
+				for (u16 i = x0; i < x0 + w; ++i)
+				{
+					grid.set(i, j, value);
+					dirtinessGrid.set(i, j, 1);
+				}
+		}
+	}
+
+	void test_grid_copy_dirty_data()
+	{
+		std::mt19937 engine(42);
+		Grid<NavcellData> source(200, 150);
+		for (size_t i = 0; i < source.m_W * source.m_H; ++i)
+			source.m_Data[i] = static_cast<NavcellData>(engine());
+
+		Grid<NavcellData> copy(source);
+		std::vector<NavcellData> mirror(source.m_Data, source.m_Data + source.m_W * source.m_H);
+
+		for (int turn = 0; turn < 10; ++turn)
+		{
+			Grid<u8> dirtinessGrid(source.m_W, source.m_H);
+			DirtyRandomRectangles(source, dirtinessGrid, 5, 20, engine);
+
+			size_t copied = copy.copy_dirty_data(source, dirtinessGrid, mirror.data());
+			TS_ASSERT(copy == source);
+			TS_ASSERT(std::equal(mirror.begin(), mirror.end(), source.m_Data));
+			TS_ASSERT_LESS_THAN(copied, static_cast<size_t>(source.m_W * source.m_H));
+		}
+
+		// Nothing dirty, nothing copied.
+		Grid<u8> dirtinessGrid(source.m_W, source.m_H);
+		TS_ASSERT_EQUALS(copy.copy_dirty_data(source, dirtinessGrid), 0u);
+	}
+
+	/**
+	 * Compare copying the whole passability grid to the AI (and its JS mirror) with copying
+	 * only the dirty cells, for a large map where a few buildings are placed or destroyed each turn.
+	 */
+	void test_ai_passability_copy_performance_DISABLED()
+	{
+		constexpr u16 size = 1024;
+		constexpr int turns = 200;
+		std::mt19937 engine(42);
+
+		Grid<NavcellData> source(size, size);
+		Grid<NavcellData> copy(size, size);
+		std::vector<NavcellData> mirror(size * size);
+
+		double fullTime = 0, dirtyTime = 0;
+		size_t fullBytes = 0, dirtyBytes = 0;
+		for (int turn = 0; turn < turns; ++turn)
+		{
+			Grid<u8> dirtinessGrid(size, size);
+			DirtyRandomRectangles(source, dirtinessGrid, 6, 32, engine);
+
+			double t = timer_Time();
+			copy = source;
+			memcpy(mirror.data(), copy.m_Data, size * size * sizeof(NavcellData));
+			fullTime += timer_Time() - t;
+			fullBytes += 2 * size * size * sizeof(NavcellData);
+
+			t = timer_Time();
+			dirtyBytes += 2 * copy.copy_dirty_data(source, dirtinessGrid, mirror.data()) * sizeof(NavcellData);
+			dirtyTime += timer_Time() - t;
+		}
+
+		printf("\nFull copy:  %zu bytes, %f us per turn\n", fullBytes / turns, 1000000 * fullTime / turns);
+		printf("Dirty copy: %zu bytes, %f us per turn\n", dirtyBytes / turns, 1000000 * dirtyTime / turns);
+	}
+
 	void test_performance_DISABLED()
 	{
 		CTerrain terrain;
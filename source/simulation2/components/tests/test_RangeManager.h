@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -15,6 +15,7 @@
  * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "lib/timer.h"
 #include "maths/Matrix3D.h"
 #include "simulation2/system/ComponentTest.h"
 #include "simulation2/components/ICmpRangeManager.h"
@@ -269,6 +270,200 @@ public:
 
 	}
 
+	void test_global_queries()
+	{
+		ComponentTestHelper test(g_ScriptContext);
+
+		ICmpRangeManager* cmp = test.Add<ICmpRangeManager>(CID_RangeManager, "", SYSTEM_ENTITY);
+
+		MockPositionRgm position;
+		test.AddMock(100, IID_Position, position);
+
+		cmp->SetBounds(entity_pos_t::FromInt(0), entity_pos_t::FromInt(0), entity_pos_t::FromInt(512), entity_pos_t::FromInt(512));
+
+		// Entities 100 to 120, owned alternately by players 1 and 2, all in world except 105.
+		for (entity_id_t ent = 100; ent <= 120; ++ent)
+		{
+			{ CMessageCreate msg(ent); cmp->HandleMessage(msg, false); }
+			{ CMessageOwnershipChanged msg(ent, -1, ent % 2 + 1); cmp->HandleMessage(msg, false); }
+			if (ent != 105)
+			{
+				CMessagePositionChanged msg(ent, true, entity_pos_t::FromInt(ent), entity_pos_t::FromInt(ent), entity_angle_t::Zero());
+				cmp->HandleMessage(msg, false);
+			}
+		}
+		cmp->Verify();
+
+		std::vector<entity_id_t> expected = { 101, 103, 107, 109, 111, 113, 115, 117, 119 };
+		std::vector<entity_id_t> entities = cmp->ExecuteQuery(100, fixed::Zero(), ALWAYS_IN_RANGE, {2}, 0, false);
+		std::sort(entities.begin(), entities.end());
+		TS_ASSERT_EQUALS(entities, expected);
+
+		// A range covering the whole map gives the same result.
+		entities = cmp->ExecuteQuery(100, fixed::Zero(), fixed::FromInt(1000), {2}, 0, false);
+		std::sort(entities.begin(), entities.end());
+		TS_ASSERT_EQUALS(entities, expected);
+
+		// The source is excluded.
+		entities = cmp->ExecuteQuery(100, fixed::Zero(), ALWAYS_IN_RANGE, {1}, 0, false);
+		TS_ASSERT_EQUALS(entities.size(), 10);
+		TS_ASSERT(std::find(entities.begin(), entities.end(), 100) == entities.end());
+
+		{ CMessageOwnershipChanged msg(103, 2, -1); cmp->HandleMessage(msg, false); }
+		{ CMessageDestroy msg(103); cmp->HandleMessage(msg, false); }
+		{ CMessageOwnershipChanged msg(107, 2, 1); cmp->HandleMessage(msg, false); }
+		cmp->Verify();
+
+		expected = { 101, 109, 111, 113, 115, 117, 119 };
+		entities = cmp->ExecuteQuery(100, fixed::Zero(), ALWAYS_IN_RANGE, {2}, 0, false);
+		std::sort(entities.begin(), entities.end());
+		TS_ASSERT_EQUALS(entities, expected);
+	}
+
+	void test_query_performance_DISABLED()
+	{
+		ComponentTestHelper test(g_ScriptContext);
+
+		ICmpRangeManager* cmp = test.Add<ICmpRangeManager>(CID_RangeManager, "", SYSTEM_ENTITY);
+
+		MockPositionRgm position;
+		position.m_Pos = CFixedVector3D(fixed::FromInt(512), fixed::Zero(), fixed::FromInt(512));
+		test.AddMock(100, IID_Position, position);
+
+		cmp->SetBounds(entity_pos_t::FromInt(0), entity_pos_t::FromInt(0), entity_pos_t::FromInt(1024), entity_pos_t::FromInt(1024));
+		{ CMessageCreate msg(100); cmp->HandleMessage(msg, false); }
+		{ CMessageOwnershipChanged msg(100, -1, 1); cmp->HandleMessage(msg, false); }
+		{ CMessagePositionChanged msg(100, true, position.m_Pos.X, position.m_Pos.Z, entity_angle_t::Zero()); cmp->HandleMessage(msg, false); }
+
+		boost::mt19937 rng;
+		for (entity_id_t ent = 101; ent < 101 + 10000; ++ent)
+		{
+			double x = boost::random::uniform_real_distribution<double>(0.0, 1024.0)(rng);
+			double z = boost::random::uniform_real_distribution<double>(0.0, 1024.0)(rng);
+			{ CMessageCreate msg(ent); cmp->HandleMessage(msg, false); }
+			{ CMessageOwnershipChanged msg(ent, -1, ent % 8); cmp->HandleMessage(msg, false); }
+			{ CMessagePositionChanged msg(ent, true, entity_pos_t::FromDouble(x), entity_pos_t::FromDouble(z), entity_angle_t::Zero()); cmp->HandleMessage(msg, false); }
+		}
+
+		const std::vector<std::pair<const char*, entity_pos_t>> ranges = {
+			{ "global", ALWAYS_IN_RANGE },
+			{ "whole map", entity_pos_t::FromInt(1024) },
+			{ "80m", entity_pos_t::FromInt(80) }
+		};
+		for (const std::pair<const char*, entity_pos_t>& range : ranges)
+		{
+			size_t found = 0;
+			double t = timer_Time();
+			for (size_t i = 0; i < 1000; ++i)
+				found += cmp->ExecuteQuery(100, fixed::Zero(), range.second, {2, 3}, 0, false).size();
+			t = timer_Time() - t;
+			printf("\n%s query over 10k entities: %f us (%zu matches)\n", range.first, t * 1000.0, found / 1000);
+		}
+	}
+
+	void test_position_changed_batches()
+	{
+		// Position changes posted within a batching scope must give the same state as
+		// handling them one by one, once they have been flushed.
+		ComponentTestHelper test(g_ScriptContext);
+		ICmpRangeManager* cmp = test.Add<ICmpRangeManager>(CID_RangeManager, "", SYSTEM_ENTITY);
+		CComponentManager& componentManager = test.GetComponentManager();
+
+		ComponentTestHelper reference(g_ScriptContext);
+		ICmpRangeManager* cmpReference = reference.Add<ICmpRangeManager>(CID_RangeManager, "", SYSTEM_ENTITY);
+
+		cmp->SetBounds(entity_pos_t::FromInt(0), entity_pos_t::FromInt(0), entity_pos_t::FromInt(512), entity_pos_t::FromInt(512));
+		cmpReference->SetBounds(entity_pos_t::FromInt(0), entity_pos_t::FromInt(0), entity_pos_t::FromInt(512), entity_pos_t::FromInt(512));
+
+		const entity_id_t firstEnt = 100;
+		const size_t numberOfEntities = 64;
+		std::vector<MockPositionRgm> positions(numberOfEntities);
+		for (size_t i = 0; i < numberOfEntities; ++i)
+		{
+			const entity_id_t ent = firstEnt + i;
+			test.AddMock(ent, IID_Position, positions[i]);
+			reference.AddMock(ent, IID_Position, positions[i]);
+			{ CMessageCreate msg(ent); componentManager.PostMessage(ent, msg); cmpReference->HandleMessage(msg, true); }
+			{ CMessageOwnershipChanged msg(ent, -1, 1); componentManager.PostMessage(ent, msg); cmpReference->HandleMessage(msg, true); }
+		}
+
+		auto checkQueries = [&](ICmpRangeManager* cmpA, ICmpRangeManager* cmpB) {
+			for (int x = 0; x < 512; x += 64)
+				for (int z = 0; z < 512; z += 64)
+				{
+					const CFixedVector2D pos(entity_pos_t::FromInt(x), entity_pos_t::FromInt(z));
+					TS_ASSERT_EQUALS(
+						cmpA->ExecuteQueryAroundPos(pos, entity_pos_t::Zero(), entity_pos_t::FromInt(48), {1}, 0, false),
+						cmpB->ExecuteQueryAroundPos(pos, entity_pos_t::Zero(), entity_pos_t::FromInt(48), {1}, 0, false));
+				}
+		};
+
+		boost::mt19937 rng;
+		auto randomPositionChange = [&rng](entity_id_t ent) {
+			double x = boost::random::uniform_real_distribution<double>(0.0, 512.0)(rng);
+			double z = boost::random::uniform_real_distribution<double>(0.0, 512.0)(rng);
+			bool inWorld = boost::random::uniform_real_distribution<double>(0.0, 1.0)(rng) < 0.9;
+			return CMessagePositionChanged(ent, inWorld, entity_pos_t::FromDouble(x), entity_pos_t::FromDouble(z), entity_angle_t::Zero());
+		};
+
+		for (size_t round = 0; round < 8; ++round)
+		{
+			componentManager.BeginMessageBatching();
+			for (size_t i = 0; i < numberOfEntities; ++i)
+			{
+				CMessagePositionChanged msg = randomPositionChange(firstEnt + i);
+				componentManager.PostMessage(msg.entity, msg);
+				cmpReference->HandleMessage(msg, true);
+			}
+			// Some entities move again within the same batch.
+			for (size_t i = round; i < numberOfEntities; i += 7)
+			{
+				CMessagePositionChanged msg = randomPositionChange(firstEnt + i);
+				componentManager.PostMessage(msg.entity, msg);
+				cmpReference->HandleMessage(msg, true);
+			}
+			componentManager.EndMessageBatching();
+
+			checkQueries(cmp, cmpReference);
+		}
+
+		// Collected messages are delivered before any other message is sent.
+		{
+			const CFixedVector2D pos(entity_pos_t::FromInt(256), entity_pos_t::FromInt(256));
+			componentManager.BeginMessageBatching();
+			CMessagePositionChanged msg(firstEnt, true, pos.X, pos.Y, entity_angle_t::Zero());
+			componentManager.PostMessage(firstEnt, msg);
+			cmpReference->HandleMessage(msg, true);
+			TS_ASSERT_EQUALS(cmp->ExecuteQueryAroundPos(pos, entity_pos_t::Zero(), entity_pos_t::FromInt(1), {1}, 0, false).size(), 0);
+
+			CMessageTurnStart turnStart;
+			componentManager.BroadcastMessage(turnStart);
+			TS_ASSERT_EQUALS(cmp->ExecuteQueryAroundPos(pos, entity_pos_t::Zero(), entity_pos_t::FromInt(1), {1}, 0, false).size(), 1);
+			componentManager.EndMessageBatching();
+
+			checkQueries(cmp, cmpReference);
+		}
+
+		// Collected messages are delivered before scripts call native components.
+		{
+			const CFixedVector2D pos(entity_pos_t::FromInt(128), entity_pos_t::FromInt(128));
+			componentManager.BeginMessageBatching();
+			CMessagePositionChanged msg(firstEnt, true, pos.X, pos.Y, entity_angle_t::Zero());
+			componentManager.PostMessage(firstEnt, msg);
+			cmpReference->HandleMessage(msg, true);
+			TS_ASSERT_EQUALS(cmp->ExecuteQueryAroundPos(pos, entity_pos_t::Zero(), entity_pos_t::FromInt(1), {1}, 0, false).size(), 0);
+
+			int found = 0;
+			TS_ASSERT(test.GetScriptInterface().Eval(
+				"Engine.QueryInterface(SYSTEM_ENTITY, IID_RangeManager).ExecuteQueryAroundPos({ \"x\": 128, \"y\": 128 }, 0, 1, [1], 0, false).length",
+				found));
+			TS_ASSERT_EQUALS(found, 1);
+			componentManager.EndMessageBatching();
+
+			checkQueries(cmp, cmpReference);
+		}
+	}
+
 	void test_IsInTargetParabolicRange()
 	{
 		ComponentTestHelper test(g_ScriptContext);
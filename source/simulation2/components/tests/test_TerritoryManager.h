@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,8 +21,13 @@
 #include "graphics/Terrain.h"
 #include "graphics/TerritoryBoundary.h"
 #include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/TerritoryInfluenceMap.h"
 #include "simulation2/components/ICmpTerritoryManager.h"
 
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <queue>
+
 class TestCmpTerritoryManager : public CxxTest::TestSuite
 {
 public:
@@ -247,7 +252,153 @@ public:
 		TestBoundaryPointsEqual(threesOuter->points, threesOuterExpectedPoints);
 	}
 
+	void test_incremental_influences()
+	{
+		const u16 w = 61, h = 47;
+		boost::mt19937 rng;
+		auto random = [&rng](u32 min, u32 max) { return boost::random::uniform_int_distribution<u32>(min, max)(rng); };
+
+		// Mostly passable tiles, with some impassable and off-world ones
+		Grid<u8> costGrid(w, h);
+		for (u16 j = 0; j < h; ++j)
+			for (u16 i = 0; i < w; ++i)
+			{
+				const u32 r = random(0, 9);
+				costGrid.set(i, j, r < 7 ? 1 : r < 9 ? 40 : 255);
+			}
+
+		auto randomInfluence = [&]() {
+			TerritoryInfluenceMap::Influence influence;
+			influence.owner = random(1, 4);
+			influence.i = random(0, w - 1);
+			influence.j = random(0, h - 1);
+			influence.weight = random(1, 6) * 10000;
+			influence.falloff = influence.weight / random(2, 20);
+			influence.root = random(0, 1) == 1;
+			return influence;
+		};
+
+		TerritoryInfluenceMap influenceMap;
+		influenceMap.Reset(costGrid);
+		Grid<u8> territories(w, h);
+
+		std::map<entity_id_t, TerritoryInfluenceMap::Influence> influences;
+		entity_id_t nextEnt = 1;
+		for (size_t step = 0; step < 200; ++step)
+		{
+			const u32 change = random(0, 9);
+			if (influences.empty() || change < 3)
+			{
+				influences[nextEnt] = randomInfluence();
+				influenceMap.SetInfluence(nextEnt, influences[nextEnt]);
+				++nextEnt;
+			}
+			else
+			{
+				std::map<entity_id_t, TerritoryInfluenceMap::Influence>::iterator it = influences.begin();
+				std::advance(it, random(0, influences.size() - 1));
+				if (change < 5)
+				{
+					influenceMap.RemoveInfluence(it->first);
+					influences.erase(it);
+				}
+				else
+				{
+					// Move, or change owner, or both
+					TerritoryInfluenceMap::Influence influence = it->second;
+					if (change < 8)
+					{
+						influence.i = std::min<u32>(w - 1, std::max<int>(0, influence.i + random(0, 6) - 3));
+						influence.j = std::min<u32>(h - 1, std::max<int>(0, influence.j + random(0, 6) - 3));
+					}
+					if (change >= 7)
+						influence.owner = random(1, 4);
+					it->second = influence;
+					influenceMap.SetInfluence(it->first, influence);
+				}
+			}
+
+			// Update the territories over a few changes at a time
+			if (random(0, 2) != 0)
+				continue;
+
+			influenceMap.UpdateTerritories(territories);
+
+			TerritoryInfluenceMap fullInfluenceMap;
+			fullInfluenceMap.Reset(costGrid);
+			for (const std::pair<const entity_id_t, TerritoryInfluenceMap::Influence>& pair : influences)
+				fullInfluenceMap.SetInfluence(pair.first, pair.second);
+			Grid<u8> fullTerritories(w, h);
+			fullInfluenceMap.UpdateTerritories(fullTerritories);
+
+			TS_ASSERT(territories == fullTerritories);
+			TS_ASSERT(territories == ComputeOwnersReference(costGrid, influences));
+		}
+	}
+
 private:
+	/// Computes the owner of each tile by spreading each player's influences in turn,
+	/// the way the territory manager did before it could update the territories incrementally.
+	Grid<u8> ComputeOwnersReference(const Grid<u8>& costGrid, const std::map<entity_id_t, TerritoryInfluenceMap::Influence>& influences)
+	{
+		const u16 w = costGrid.m_W, h = costGrid.m_H;
+		Grid<u8> territories(w, h);
+		Grid<u32> bestWeightGrid(w, h);
+
+		std::map<u8, std::vector<TerritoryInfluenceMap::Influence>> playerInfluences;
+		for (const std::pair<const entity_id_t, TerritoryInfluenceMap::Influence>& pair : influences)
+			playerInfluences[pair.second.owner].push_back(pair.second);
+
+		const int NEIGHBOURS_X[8] = {1,-1, 0, 0, 1,-1, 1,-1};
+		const int NEIGHBOURS_Z[8] = {0, 0, 1,-1, 1,-1,-1, 1};
+		for (const std::pair<const u8, std::vector<TerritoryInfluenceMap::Influence>>& pair : playerInfluences)
+		{
+			Grid<u32> playerGrid(w, h);
+			for (const TerritoryInfluenceMap::Influence& influence : pair.second)
+			{
+				Grid<u32> entityGrid(w, h);
+				entityGrid.set(influence.i, influence.j, influence.weight);
+				if (influence.weight > bestWeightGrid.get(influence.i, influence.j))
+				{
+					bestWeightGrid.set(influence.i, influence.j, influence.weight);
+					territories.set(influence.i, influence.j, pair.first);
+				}
+
+				std::queue<std::pair<u16, u16>> openTiles;
+				openTiles.emplace(influence.i, influence.j);
+				while (!openTiles.empty())
+				{
+					const u16 x = openTiles.front().first;
+					const u16 z = openTiles.front().second;
+					openTiles.pop();
+					for (int n = 0; n < 8; ++n)
+					{
+						const u16 nx = x + NEIGHBOURS_X[n];
+						const u16 nz = z + NEIGHBOURS_Z[n];
+						if (nx >= w || nz >= h)
+							continue;
+						u32 dg = influence.falloff * costGrid.get(nx, nz);
+						if (nx != x && nz != z)
+							dg = (dg * 362) / 256;
+						if (entityGrid.get(x, z) <= entityGrid.get(nx, nz) + dg)
+							continue;
+						const u32 newWeight = entityGrid.get(x, z) - dg;
+						const u32 totalWeight = playerGrid.get(nx, nz) - entityGrid.get(nx, nz) + newWeight;
+						playerGrid.set(nx, nz, totalWeight);
+						entityGrid.set(nx, nz, newWeight);
+						if (totalWeight > bestWeightGrid.get(nx, nz))
+						{
+							bestWeightGrid.set(nx, nz, totalWeight);
+							territories.set(nx, nz, pair.first);
+						}
+						openTiles.emplace(nx, nz);
+					}
+				}
+			}
+		}
+		return territories;
+	}
+
 	/// Parses a string representation of a grid into an actual Grid structure, such that the (i,j) axes are located in the bottom
 	/// left hand side of the map. Note: leaves all custom bits in the grid values at zero (anything outside
 	/// ICmpTerritoryManager::TERRITORY_PLAYER_MASK).
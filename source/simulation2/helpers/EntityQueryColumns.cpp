@@ -0,0 +1,275 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "precompiled.h"
+
+#include "EntityQueryColumns.h"
+
+#include "lib/sysdep/arch.h"
+#include "lib/sysdep/arch/x86_x64/simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if COMPILER_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if ARCH_AARCH64
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+/**
+ * Minimum number of holes before compacting the columns.
+ */
+constexpr size_t MIN_HOLES_TO_COMPACT = 64;
+
+/**
+ * Filter kernel: writes to @p out the indices of the entities passing the filter, returns their number.
+ * @p out must have room for @p count indices.
+ */
+using FilterFunc = size_t (*)(const u32* ownerMasks, const u8* flags, size_t count, u32 ownersMask, u8 requiredFlags, u8 anyFlags, u32* out);
+
+inline bool PassesFilter(u32 ownerMask, u8 flags, u32 ownersMask, u8 requiredFlags, u8 anyFlags)
+{
+	return (ownerMask & ownersMask) && (flags & requiredFlags) == requiredFlags && (flags & anyFlags);
+}
+
+size_t FilterFallback(const u32* ownerMasks, const u8* flags, size_t count, u32 ownersMask, u8 requiredFlags, u8 anyFlags, u32* out)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+		if (PassesFilter(ownerMasks[i], flags[i], ownersMask, requiredFlags, anyFlags))
+			out[n++] = static_cast<u32>(i);
+	return n;
+}
+
+#if COMPILER_HAS_SSE2
+size_t FilterSSE2(const u32* ownerMasks, const u8* flags, size_t count, u32 ownersMask, u8 requiredFlags, u8 anyFlags, u32* out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i owners = _mm_set1_epi32(static_cast<int>(ownersMask));
+	const __m128i required = _mm_set1_epi32(requiredFlags);
+	const __m128i any = _mm_set1_epi32(anyFlags);
+
+	size_t n = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i ownerMask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ownerMasks + i));
+
+		// Widen four u8 flags to four u32 lanes.
+		int packedFlags;
+		std::memcpy(&packedFlags, flags + i, sizeof(packedFlags));
+		const __m128i flag = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedFlags), zero), zero);
+
+		const __m128i ownerFail = _mm_cmpeq_epi32(_mm_and_si128(ownerMask, owners), zero);
+		const __m128i anyFail = _mm_cmpeq_epi32(_mm_and_si128(flag, any), zero);
+		const __m128i requiredPass = _mm_cmpeq_epi32(_mm_and_si128(flag, required), required);
+		const __m128i pass = _mm_andnot_si128(_mm_or_si128(ownerFail, anyFail), requiredPass);
+
+		const int mask = _mm_movemask_ps(_mm_castsi128_ps(pass));
+		if (!mask)
+			continue;
+		for (int lane = 0; lane < 4; ++lane)
+			if (mask & (1 << lane))
+				out[n++] = static_cast<u32>(i + lane);
+	}
+
+	for (; i < count; ++i)
+		if (PassesFilter(ownerMasks[i], flags[i], ownersMask, requiredFlags, anyFlags))
+			out[n++] = static_cast<u32>(i);
+	return n;
+}
+#endif
+
+#if ARCH_AARCH64
+size_t FilterNEON(const u32* ownerMasks, const u8* flags, size_t count, u32 ownersMask, u8 requiredFlags, u8 anyFlags, u32* out)
+{
+	const uint32x4_t owners = vdupq_n_u32(ownersMask);
+	const uint32x4_t required = vdupq_n_u32(requiredFlags);
+	const uint32x4_t any = vdupq_n_u32(anyFlags);
+
+	size_t n = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint32x4_t ownerMask = vld1q_u32(ownerMasks + i);
+
+		// Widen four u8 flags to four u32 lanes.
+		u32 packedFlags;
+		std::memcpy(&packedFlags, flags + i, sizeof(packedFlags));
+		const uint16x8_t flag16 = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packedFlags)));
+		const uint32x4_t flag = vmovl_u16(vget_low_u16(flag16));
+
+		const uint32x4_t pass = vandq_u32(
+			vandq_u32(vtstq_u32(ownerMask, owners), vtstq_u32(flag, any)),
+			vceqq_u32(vandq_u32(flag, required), required));
+
+		if (vmaxvq_u32(pass) == 0)
+			continue;
+		if (vgetq_lane_u32(pass, 0))
+			out[n++] = static_cast<u32>(i);
+		if (vgetq_lane_u32(pass, 1))
+			out[n++] = static_cast<u32>(i + 1);
+		if (vgetq_lane_u32(pass, 2))
+			out[n++] = static_cast<u32>(i + 2);
+		if (vgetq_lane_u32(pass, 3))
+			out[n++] = static_cast<u32>(i + 3);
+	}
+
+	for (; i < count; ++i)
+		if (PassesFilter(ownerMasks[i], flags[i], ownersMask, requiredFlags, anyFlags))
+			out[n++] = static_cast<u32>(i);
+	return n;
+}
+#endif
+
+FilterFunc ChooseFilter()
+{
+#if COMPILER_HAS_SSE2
+	if (HostHasSSE2())
+		return FilterSSE2;
+#endif
+#if ARCH_AARCH64
+	return FilterNEON;
+#else
+	return FilterFallback;
+#endif
+}
+} // anonymous namespace
+
+void EntityQueryColumns::Reset()
+{
+	m_Ids.clear();
+	m_OwnerMasks.clear();
+	m_Flags.clear();
+	m_X.clear();
+	m_Z.clear();
+	m_Sizes.clear();
+	m_Indices.clear();
+	m_Holes = 0;
+}
+
+void EntityQueryColumns::Set(entity_id_t id, u32 ownerMask, u8 flags, entity_pos_t x, entity_pos_t z, u32 size)
+{
+	u32 index = GetIndex(id);
+	if (index == NO_INDEX)
+	{
+		if (id >= m_Indices.size())
+			m_Indices.resize(id + 1, NO_INDEX);
+
+		// Entity IDs are almost always allocated in increasing order, so this is usually a push_back.
+		std::vector<entity_id_t>::iterator it = std::lower_bound(m_Ids.begin(), m_Ids.end(), id);
+		index = static_cast<u32>(it - m_Ids.begin());
+		if (it != m_Ids.end() && *it == id)
+		{
+			// Reuse the hole left by a previous entity with the same ID.
+			--m_Holes;
+		}
+		else
+		{
+			m_Ids.insert(it, id);
+			m_OwnerMasks.insert(m_OwnerMasks.begin() + index, 0);
+			m_Flags.insert(m_Flags.begin() + index, 0);
+			m_X.insert(m_X.begin() + index, entity_pos_t::Zero());
+			m_Z.insert(m_Z.begin() + index, entity_pos_t::Zero());
+			m_Sizes.insert(m_Sizes.begin() + index, 0);
+			for (u32 i = index + 1; i < m_Ids.size(); ++i)
+				if (m_Indices[m_Ids[i]] != NO_INDEX)
+					++m_Indices[m_Ids[i]];
+		}
+		m_Indices[id] = index;
+	}
+
+	m_OwnerMasks[index] = ownerMask;
+	m_Flags[index] = flags;
+	m_X[index] = x;
+	m_Z[index] = z;
+	m_Sizes[index] = size;
+}
+
+void EntityQueryColumns::Erase(entity_id_t id)
+{
+	u32 index = GetIndex(id);
+	if (index == NO_INDEX)
+		return;
+
+	// An owner mask of 0 never passes the filter.
+	m_OwnerMasks[index] = 0;
+	m_Flags[index] = 0;
+	m_Indices[id] = NO_INDEX;
+
+	if (++m_Holes >= MIN_HOLES_TO_COMPACT && m_Holes * 4 > m_Ids.size())
+		Compact();
+}
+
+void EntityQueryColumns::Compact()
+{
+	size_t n = 0;
+	for (size_t i = 0; i < m_Ids.size(); ++i)
+	{
+		if (m_Indices[m_Ids[i]] != i)
+			continue;
+		m_Ids[n] = m_Ids[i];
+		m_OwnerMasks[n] = m_OwnerMasks[i];
+		m_Flags[n] = m_Flags[i];
+		m_X[n] = m_X[i];
+		m_Z[n] = m_Z[i];
+		m_Sizes[n] = m_Sizes[i];
+		m_Indices[m_Ids[n]] = static_cast<u32>(n);
+		++n;
+	}
+	m_Ids.resize(n);
+	m_OwnerMasks.resize(n);
+	m_Flags.resize(n);
+	m_X.resize(n);
+	m_Z.resize(n);
+	m_Sizes.resize(n);
+	m_Holes = 0;
+}
+
+void EntityQueryColumns::Filter(u32 ownersMask, u8 requiredFlags, u8 anyFlags, std::vector<u32>& out) const
+{
+	// Pick the kernel on first use, once CPU detection is available.
+	static const FilterFunc filter = ChooseFilter();
+
+	const size_t offset = out.size();
+	out.resize(offset + m_Ids.size());
+	const size_t count = filter(m_OwnerMasks.data(), m_Flags.data(), m_Ids.size(), ownersMask, requiredFlags, anyFlags, out.data() + offset);
+	out.resize(offset + count);
+}
+
+bool EntityQueryColumns::operator==(const EntityQueryColumns& other) const
+{
+	if (m_Ids.size() - m_Holes != other.m_Ids.size() - other.m_Holes)
+		return false;
+
+	for (size_t i = 0; i < m_Ids.size(); ++i)
+	{
+		if (m_Indices[m_Ids[i]] != i)
+			continue;
+		const u32 j = other.GetIndex(m_Ids[i]);
+		if (j == NO_INDEX ||
+		    m_OwnerMasks[i] != other.m_OwnerMasks[j] || m_Flags[i] != other.m_Flags[j] ||
+		    m_X[i] != other.m_X[j] || m_Z[i] != other.m_Z[j] || m_Sizes[i] != other.m_Sizes[j])
+			return false;
+	}
+	return true;
+}
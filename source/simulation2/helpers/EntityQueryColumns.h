@@ -0,0 +1,90 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_ENTITYQUERYCOLUMNS
+#define INCLUDED_ENTITYQUERYCOLUMNS
+
+#include "maths/FixedVector2D.h"
+#include "simulation2/helpers/Position.h"
+#include "simulation2/system/Entity.h"
+
+#include <vector>
+
+/**
+ * Column-oriented copy of the per-entity data that range queries filter on.
+ *
+ * Each field is stored in its own contiguous array, so that the owner and flag
+ * tests of a query can be run over many entities at once with SIMD instructions.
+ * Entities are kept sorted by ID, so the filtering results are sorted by ID too.
+ * Removing an entity leaves a hole (which never matches any filter);
+ * holes are compacted once there are enough of them.
+ */
+class EntityQueryColumns
+{
+public:
+	/**
+	 * Remove all entities.
+	 */
+	void Reset();
+
+	/**
+	 * Add the entity @p id, or update its data if it's already known.
+	 */
+	void Set(entity_id_t id, u32 ownerMask, u8 flags, entity_pos_t x, entity_pos_t z, u32 size);
+
+	/**
+	 * Remove the entity @p id, if it's known.
+	 */
+	void Erase(entity_id_t id);
+
+	/**
+	 * Append to @p out the column index of every entity whose owner mask intersects @p ownersMask,
+	 * whose flags contain all of @p requiredFlags, and whose flags contain any of @p anyFlags.
+	 * Indices are appended in increasing entity ID order.
+	 */
+	void Filter(u32 ownersMask, u8 requiredFlags, u8 anyFlags, std::vector<u32>& out) const;
+
+	entity_id_t GetId(u32 index) const { return m_Ids[index]; }
+	CFixedVector2D GetPosition(u32 index) const { return CFixedVector2D(m_X[index], m_Z[index]); }
+	u32 GetSize(u32 index) const { return m_Sizes[index]; }
+
+	/**
+	 * Returns whether both contain the same entities with the same data, ignoring holes.
+	 */
+	bool operator==(const EntityQueryColumns& other) const;
+	bool operator!=(const EntityQueryColumns& other) const { return !(*this == other); }
+
+private:
+	static constexpr u32 NO_INDEX = 0xFFFFFFFF;
+
+	u32 GetIndex(entity_id_t id) const { return id < m_Indices.size() ? m_Indices[id] : NO_INDEX; }
+
+	void Compact();
+
+	std::vector<entity_id_t> m_Ids;
+	std::vector<u32> m_OwnerMasks;
+	std::vector<u8> m_Flags;
+	std::vector<entity_pos_t> m_X;
+	std::vector<entity_pos_t> m_Z;
+	std::vector<u32> m_Sizes;
+
+	// Column index of each entity, indexed by entity ID.
+	std::vector<u32> m_Indices;
+	size_t m_Holes = 0;
+};
+
+#endif // INCLUDED_ENTITYQUERYCOLUMNS
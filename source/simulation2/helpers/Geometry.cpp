@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -19,9 +19,105 @@
 
 #include "Geometry.h"
 
+#include "lib/sysdep/arch.h"
+#include "lib/sysdep/arch/x86_x64/simd.h"
+
+#include <limits>
+
+#if COMPILER_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if ARCH_AARCH64
+#include <arm_neon.h>
+#endif
+
 namespace Geometry
 {
 
+namespace
+{
+using FilterBoxesFunc = size_t (*)(const PackedBox* boxes, const u32* indices, size_t count, const PackedBox& query, u32* out);
+
+size_t FilterOverlappingBoxesFallback(const PackedBox* boxes, const u32* indices, size_t count, const PackedBox& query, u32* out)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PackedBox& box = boxes[indices[i]];
+		if (box.v[0] <= query.v[0] && box.v[1] <= query.v[1] && box.v[2] <= query.v[2] && box.v[3] <= query.v[3])
+			out[n++] = indices[i];
+	}
+	return n;
+}
+
+#if COMPILER_HAS_SSE2
+size_t FilterOverlappingBoxesSSE2(const PackedBox* boxes, const u32* indices, size_t count, const PackedBox& query, u32* out)
+{
+	const __m128i q = _mm_load_si128(reinterpret_cast<const __m128i*>(query.v));
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const __m128i box = _mm_load_si128(reinterpret_cast<const __m128i*>(boxes[indices[i]].v));
+		if (!_mm_movemask_epi8(_mm_cmpgt_epi32(box, q)))
+			out[n++] = indices[i];
+	}
+	return n;
+}
+#endif
+
+#if ARCH_AARCH64
+size_t FilterOverlappingBoxesNEON(const PackedBox* boxes, const u32* indices, size_t count, const PackedBox& query, u32* out)
+{
+	const int32x4_t q = vld1q_s32(query.v);
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const int32x4_t box = vld1q_s32(boxes[indices[i]].v);
+		if (!vmaxvq_u32(vcgtq_s32(box, q)))
+			out[n++] = indices[i];
+	}
+	return n;
+}
+#endif
+
+FilterBoxesFunc ChooseFilterOverlappingBoxes()
+{
+#if COMPILER_HAS_SSE2
+	if (HostHasSSE2())
+		return FilterOverlappingBoxesSSE2;
+#endif
+#if ARCH_AARCH64
+	return FilterOverlappingBoxesNEON;
+#else
+	return FilterOverlappingBoxesFallback;
+#endif
+}
+} // anonymous namespace
+
+PackedBox PackBox(const CFixedVector2D& min, const CFixedVector2D& max)
+{
+	return PackedBox{ { min.X.GetInternalValue(), min.Y.GetInternalValue(), -max.X.GetInternalValue(), -max.Y.GetInternalValue() } };
+}
+
+PackedBox EmptyPackedBox()
+{
+	const i32 inf = std::numeric_limits<i32>::max();
+	return PackedBox{ { inf, inf, inf, inf } };
+}
+
+size_t FilterOverlappingBoxes(const PackedBox* boxes, const u32* indices, size_t count,
+	const CFixedVector2D& min, const CFixedVector2D& max, u32* out)
+{
+	// Pick the kernel on first use, once CPU detection is available.
+	static const FilterBoxesFunc filter = ChooseFilterOverlappingBoxes();
+
+	// The box [x0, x1] overlaps [min, max] if x0 <= max.X and -x1 <= -min.X (and the same for z),
+	// so the query is packed the other way around.
+	const PackedBox query{ { max.X.GetInternalValue(), max.Y.GetInternalValue(), -min.X.GetInternalValue(), -min.Y.GetInternalValue() } };
+	return filter(boxes, indices, count, query, out);
+}
+
 // TODO: all of these things could be optimised quite easily
 
 CFixedVector2D GetHalfBoundingBox(const CFixedVector2D& u, const CFixedVector2D& v, const CFixedVector2D& halfSize)
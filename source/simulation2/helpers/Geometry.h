@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -125,6 +125,36 @@ bool TestSquareSquare(
 		const CFixedVector2D& c0, const CFixedVector2D& u0, const CFixedVector2D& v0, const CFixedVector2D& halfSize0,
 		const CFixedVector2D& c1, const CFixedVector2D& u1, const CFixedVector2D& v1, const CFixedVector2D& halfSize1);
 
+/**
+ * Axis-aligned box stored as the raw fixed-point values of (x0, z0, -x1, -z1),
+ * so that FilterOverlappingBoxes can test it against another box with a single
+ * four-lane comparison.
+ */
+struct alignas(16) PackedBox
+{
+	i32 v[4];
+};
+
+/**
+ * Returns the packed box [@p min, @p max].
+ */
+PackedBox PackBox(const CFixedVector2D& min, const CFixedVector2D& max);
+
+/**
+ * Returns a packed box which overlaps no other box.
+ */
+PackedBox EmptyPackedBox();
+
+/**
+ * Batch overlap test of axis-aligned boxes against the box [@p min, @p max]
+ * (boxes which only share an edge or a corner are considered overlapping).
+ * Copies to @p out, in their original order, the elements of @p indices whose box
+ * in @p boxes overlaps it, and returns their number.
+ * @p out may be the same array as @p indices.
+ */
+size_t FilterOverlappingBoxes(const PackedBox* boxes, const u32* indices, size_t count,
+	const CFixedVector2D& min, const CFixedVector2D& max, u32* out);
+
 /**
  * Used in Footprint when spawning units:
  * Given a grid point (x, y) on the rectangle [-x_max, x_max] x [-y_max, y_max],
@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,7 +20,9 @@
 
 #include "simulation2/serialization/SerializeTemplates.h"
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 
 #ifdef NDEBUG
 #define GRID_BOUNDS_DEBUG 0
@@ -123,6 +125,51 @@ public:
 	}
 	bool operator!=(const Grid& g) const { return !(*this==g); }
 
+	/**
+	 * Copy from @p g, which must have the same size, only the cells marked in @p dirtinessGrid:
+	 * each row is copied between its first and last dirty cells.
+	 * If @p mirror is not null, it must point to m_W * m_H elements and receives the same copies.
+	 * Returns the number of copied cells.
+	 */
+	size_t copy_dirty_data(const Grid& g, const Grid<u8>& dirtinessGrid, T* mirror = nullptr)
+	{
+#if GRID_BOUNDS_DEBUG
+		ENSURE(compare_sizes(&g) && compare_sizes(&dirtinessGrid));
+#endif
+		size_t copied = 0;
+		for (u16 j = 0; j < m_H; ++j)
+		{
+			const u8* row = &dirtinessGrid.m_Data[j * m_W];
+			const u8* rowEnd = row + m_W;
+
+			// Most rows are usually clean, so check them a word at a time (without branches) first.
+			u64 anyDirty = 0;
+			size_t i = 0;
+			for (; i + sizeof(u64) <= m_W; i += sizeof(u64))
+			{
+				u64 word;
+				memcpy(&word, row + i, sizeof(word));
+				anyDirty |= word;
+			}
+			for (; i < m_W; ++i)
+				anyDirty |= row[i];
+			if (!anyDirty)
+				continue;
+
+			const u8* first = std::find_if(row, rowEnd, [](u8 dirty) { return dirty != 0; });
+			const u8* last = std::find_if(std::reverse_iterator<const u8*>(rowEnd), std::reverse_iterator<const u8*>(first),
+				[](u8 dirty) { return dirty != 0; }).base();
+
+			const size_t begin = j * m_W + (first - row);
+			const size_t end = j * m_W + (last - row);
+			std::copy(g.m_Data + begin, g.m_Data + end, m_Data + begin);
+			if (mirror)
+				std::copy(g.m_Data + begin, g.m_Data + end, mirror + begin);
+			copied += end - begin;
+		}
+		return copied;
+	}
+
 	bool blank() const
 	{
 		return m_W == 0 && m_H == 0;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,6 +21,7 @@
 
 #include "graphics/Overlay.h"
 #include "ps/Profile.h"
+#include "ps/TaskManager.h"
 #include "renderer/Scene.h"
 
 #include "simulation2/helpers/Grid.h"
@@ -385,19 +386,26 @@ void HierarchicalPathfinder::Recompute(Grid<NavcellData>* grid,
 	// Reset global regions.
 	m_NextGlobalRegionID = 1;
 
-	for (auto& passClassMask : allPassClasses)
+	// Compute the regions within each chunk. The chunks of all passability classes
+	// are independent, so they can all be flood-filled at once.
+	std::vector<InitRegionsJob> jobs;
+	jobs.reserve(allPassClasses.size() * m_ChunksW * m_ChunksH);
+	for (const std::pair<const std::string, pass_class_t>& passClassMask : allPassClasses)
 	{
 		pass_class_t passClass = passClassMask.second;
+		std::vector<Chunk>& chunks = m_Chunks[passClass];
+		chunks.resize(m_ChunksW*m_ChunksH);
+		for (u8 cj = 0; cj < m_ChunksH; ++cj)
+			for (u8 ci = 0; ci < m_ChunksW; ++ci)
+				jobs.push_back({ &chunks[cj*m_ChunksW + ci], ci, cj, passClass });
+	}
+	InitRegionsInParallel(grid, jobs);
 
-		// Compute the regions within each chunk
-		m_Chunks[passClass].resize(m_ChunksW*m_ChunksH);
-		for (int cj = 0; cj < m_ChunksH; ++cj)
-		{
-			for (int ci = 0; ci < m_ChunksW; ++ci)
-			{
-				m_Chunks[passClass].at(cj*m_ChunksW + ci).InitRegions(ci, cj, grid, passClass);
-			}
-		}
+	// Edges and global regions are computed serially, in a fixed order, so global region IDs
+	// are the same whatever the number of threads.
+	for (const std::pair<const std::string, pass_class_t>& passClassMask : allPassClasses)
+	{
+		pass_class_t passClass = passClassMask.second;
 
 		// Construct the search graph over the regions.
 		EdgesMap& edges = m_Edges[passClass];
@@ -455,6 +463,9 @@ void HierarchicalPathfinder::Update(Grid<NavcellData>* grid, const Grid<u8>& dir
 	// That's quite annoying, but I can't think of an easy way around it.
 	// If we could be sure that a region's topology hasn't changed, we could skip removing its global region
 	// but that's non trivial as we have no easy way to determine said topology (regions could "switch" IDs on update for now).
+	// The regions of dirty chunks are recomputed in parallel, then edges are reconnected serially
+	// in chunk order, so the result is the same as updating the chunks one after the other.
+	std::vector<std::pair<u8, u8>> dirtyChunks;
 	for (u8 cj = 0; cj <  m_ChunksH; ++cj)
 	{
 		int j0 = cj * CHUNK_SIZE;
@@ -464,38 +475,51 @@ void HierarchicalPathfinder::Update(Grid<NavcellData>* grid, const Grid<u8>& dir
 			// Skip chunks where no navcells are dirty.
 			int i0 = ci * CHUNK_SIZE;
 			int i1 = std::min(i0 + CHUNK_SIZE, (int)dirtinessGrid.m_W);
-			if (!dirtinessGrid.any_set_in_square(i0, j0, i1, j1))
-				continue;
+			if (dirtinessGrid.any_set_in_square(i0, j0, i1, j1))
+				dirtyChunks.emplace_back(ci, cj);
+		}
+	}
 
-			for (const std::pair<const std::string, pass_class_t>& passClassMask : m_PassClassMasks)
-			{
-				pass_class_t passClass = passClassMask.second;
-				Chunk& a = m_Chunks[passClass].at(ci + cj*m_ChunksW);
+	std::vector<InitRegionsJob> jobs;
+	jobs.reserve(dirtyChunks.size() * m_PassClassMasks.size());
+	for (const std::pair<const std::string, pass_class_t>& passClassMask : m_PassClassMasks)
+	{
+		pass_class_t passClass = passClassMask.second;
+		EdgesMap& edgeMap = m_Edges[passClass];
+		std::map<RegionID, GlobalRegionID>& globalRegions = m_GlobalRegions[passClass];
+		for (const std::pair<u8, u8>& dirtyChunk : dirtyChunks)
+		{
+			const u8 ci = dirtyChunk.first;
+			const u8 cj = dirtyChunk.second;
+			Chunk& a = m_Chunks[passClass].at(ci + cj*m_ChunksW);
 
-				// Clean up edges and global region ID
-				EdgesMap& edgeMap = m_Edges[passClass];
-				for (u16 i : a.m_RegionsID)
+			// Clean up edges and global region ID
+			for (u16 i : a.m_RegionsID)
+			{
+				RegionID reg{ci, cj, i};
+				globalRegions.erase(reg);
+				for (const RegionID& neighbor : edgeMap[reg])
 				{
-					RegionID reg{ci, cj, i};
-					m_GlobalRegions[passClass].erase(reg);
-					for (const RegionID& neighbor : edgeMap[reg])
-					{
-						edgeMap[neighbor].erase(reg);
-						if (edgeMap[neighbor].empty())
-							edgeMap.erase(neighbor);
-					}
-					edgeMap.erase(reg);
+					edgeMap[neighbor].erase(reg);
+					if (edgeMap[neighbor].empty())
+						edgeMap.erase(neighbor);
 				}
+				edgeMap.erase(reg);
+			}
+
+			jobs.push_back({ &a, ci, cj, passClass });
+		}
+	}
 
-				// Recompute regions inside this chunk.
-				a.InitRegions(ci, cj, grid, passClass);
+	// Recompute regions inside the dirty chunks.
+	InitRegionsInParallel(grid, jobs);
 
-				for (u16 i : a.m_RegionsID)
-					needNewGlobalRegionMap[passClass].push_back(RegionID{ci, cj, i});
+	for (const InitRegionsJob& job : jobs)
+	{
+		for (u16 i : job.chunk->m_RegionsID)
+			needNewGlobalRegionMap[job.passClass].push_back(RegionID{job.ci, job.cj, i});
 
-				UpdateEdges(ci, cj, passClass, edgeMap);
-			}
-		}
+		UpdateEdges(job.ci, job.cj, job.passClass, m_Edges[job.passClass]);
 	}
 
 	UpdateGlobalRegions(needNewGlobalRegionMap);
@@ -507,6 +531,14 @@ void HierarchicalPathfinder::Update(Grid<NavcellData>* grid, const Grid<u8>& dir
 	}
 }
 
+void HierarchicalPathfinder::InitRegionsInParallel(Grid<NavcellData>* grid, const std::vector<InitRegionsJob>& jobs)
+{
+	Threading::TaskManager::Instance().ParallelFor(0, jobs.size(), 1, [&](size_t i) {
+		PROFILE2("Async hierarchical regions");
+		jobs[i].chunk->InitRegions(jobs[i].ci, jobs[i].cj, grid, jobs[i].passClass);
+	});
+}
+
 void HierarchicalPathfinder::ComputeNeighbors(EdgesMap& edges, Chunk& a, Chunk& b, bool transpose, bool opposite) const
 {
 	// For each edge between chunks, we loop over every adjacent pair of
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -27,6 +27,7 @@
 
 #include <map>
 #include <set>
+#include <vector>
 
 /**
  * Hierarchical pathfinder.
@@ -64,6 +65,9 @@ class HierarchicalPathfinder
 	friend class TestHierarchicalPathfinder;
 #endif
 public:
+	static const u8 CHUNK_SIZE = 96; // number of navcells per side
+									 // TODO: figure out best number. Probably 64 < n < 128
+
 	typedef u32 GlobalRegionID;
 
 	struct RegionID
@@ -162,9 +166,6 @@ public:
 	void RenderSubmit(SceneCollector& collector);
 
 private:
-	static const u8 CHUNK_SIZE = 96; // number of navcells per side
-									 // TODO: figure out best number. Probably 64 < n < 128
-
 	struct Chunk
 	{
 		u8 m_ChunkI, m_ChunkJ; // chunk ID
@@ -198,6 +199,19 @@ private:
 
 	typedef std::map<RegionID, std::set<RegionID> > EdgesMap;
 
+	struct InitRegionsJob
+	{
+		Chunk* chunk;
+		u8 ci, cj;
+		pass_class_t passClass;
+	};
+
+	/**
+	 * Flood-fills the regions of every chunk in @p jobs, using the task manager's workers.
+	 * Each chunk is only written by its own job, so the result doesn't depend on the number of threads.
+	 */
+	void InitRegionsInParallel(Grid<NavcellData>* grid, const std::vector<InitRegionsJob>& jobs);
+
 	void ComputeNeighbors(EdgesMap& edges, Chunk& a, Chunk& b, bool transpose, bool opposite) const;
 	void RecomputeAllEdges(pass_class_t passClass, EdgesMap& edges);
 	void UpdateEdges(u8 ci, u8 cj, pass_class_t passClass, EdgesMap& edges);
@@ -0,0 +1,168 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "precompiled.h"
+
+#include "LongPathCache.h"
+
+#include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/PathGoal.h"
+
+#include <algorithm>
+
+bool LongPathCache::Stitch(const Key& key, entity_pos_t x0, entity_pos_t z0, const PathGoal& goal,
+	const Grid<NavcellData>& grid, WaypointPath& path) const
+{
+	std::map<Key, Entry>::const_iterator it = m_Entries.find(key);
+	if (it == m_Entries.end())
+		return false;
+
+	const std::vector<Waypoint>& corridor = it->second.waypoints;
+	const size_t size = corridor.size();
+
+	// Join the start to the corridor waypoint furthest along among the last few ones.
+	size_t startJoin = size;
+	for (size_t k = size - std::min(size, JOIN_SEARCH_WAYPOINTS); k < size; ++k)
+		if (Pathfinding::CheckLineMovement(x0, z0, corridor[k].x, corridor[k].z, key.passClass, grid))
+		{
+			startJoin = k;
+			break;
+		}
+	if (startJoin == size)
+		return false;
+
+	// Join the goal to the corridor waypoint furthest back among the first few ones before the start join.
+	size_t goalJoin = std::min(startJoin + 1, JOIN_SEARCH_WAYPOINTS);
+	while (goalJoin > 0)
+	{
+		--goalJoin;
+		if (Pathfinding::CheckLineMovement(goal.x, goal.z, corridor[goalJoin].x, corridor[goalJoin].z, key.passClass, grid))
+		{
+			path.m_Waypoints.emplace_back(Waypoint{ goal.x, goal.z });
+			path.m_Waypoints.insert(path.m_Waypoints.end(), corridor.begin() + goalJoin, corridor.begin() + startJoin + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void LongPathCache::Commit(const Lookup& lookup, const WaypointPath& path)
+{
+	switch (lookup.status)
+	{
+	case Status::UNCACHED:
+		return;
+	case Status::HIT:
+	{
+		++m_Hits;
+		std::map<Key, Entry>::iterator it = m_Entries.find(lookup.key);
+		if (it != m_Entries.end())
+			it->second.lastUsed = m_Clock;
+		return;
+	}
+	case Status::MISS:
+	{
+		++m_Misses;
+		// Several requests of a batch may have computed a path for the same key, keep the first one.
+		// Paths without waypoints between the start and the goal aren't worth caching.
+		if (path.m_Waypoints.size() < 2 || m_Entries.find(lookup.key) != m_Entries.end())
+			return;
+		Entry& entry = m_Entries[lookup.key];
+		entry.waypoints.assign(path.m_Waypoints.begin() + 1, path.m_Waypoints.end());
+		entry.lastUsed = m_Clock;
+		EvictLeastRecentlyUsed();
+		return;
+	}
+	}
+}
+
+void LongPathCache::NextBatch()
+{
+	++m_Clock;
+}
+
+void LongPathCache::EvictLeastRecentlyUsed()
+{
+	while (m_Entries.size() > MAX_ENTRIES)
+	{
+		// Ties are broken by the key order, which keeps this deterministic.
+		std::map<Key, Entry>::iterator oldest = m_Entries.begin();
+		for (std::map<Key, Entry>::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+			if (it->second.lastUsed < oldest->second.lastUsed)
+				oldest = it;
+		m_Entries.erase(oldest);
+	}
+}
+
+void LongPathCache::Invalidate(const Grid<u8>& dirtinessGrid)
+{
+	if (m_Entries.empty())
+		return;
+
+	const int chunkSize = HierarchicalPathfinder::CHUNK_SIZE;
+	const int w = dirtinessGrid.m_W;
+	const int h = dirtinessGrid.m_H;
+
+	// Find the dirty chunks first, so that most corridor segments can be skipped quickly.
+	Grid<u8> dirtyChunks((w + chunkSize - 1) / chunkSize, (h + chunkSize - 1) / chunkSize);
+	bool anyDirty = false;
+	for (u16 cj = 0; cj < dirtyChunks.m_H; ++cj)
+		for (u16 ci = 0; ci < dirtyChunks.m_W; ++ci)
+			if (dirtinessGrid.any_set_in_square(ci * chunkSize, cj * chunkSize,
+				std::min((ci + 1) * chunkSize, w), std::min((cj + 1) * chunkSize, h)))
+			{
+				dirtyChunks.set(ci, cj, 1);
+				anyDirty = true;
+			}
+	if (!anyDirty)
+		return;
+
+	const auto isDirtyRegion = [&dirtyChunks](const HierarchicalPathfinder::RegionID& region) {
+		return region.ci >= dirtyChunks.m_W || region.cj >= dirtyChunks.m_H || dirtyChunks.get(region.ci, region.cj);
+	};
+
+	const auto isDirtySegment = [&](const Waypoint& a, const Waypoint& b) {
+		u16 ia, ja, ib, jb;
+		Pathfinding::NearestNavcell(a.x, a.z, ia, ja, w, h);
+		Pathfinding::NearestNavcell(b.x, b.z, ib, jb, w, h);
+		const int i0 = std::min(ia, ib);
+		const int j0 = std::min(ja, jb);
+		const int i1 = std::max(ia, ib) + 1;
+		const int j1 = std::max(ja, jb) + 1;
+		if (!dirtyChunks.any_set_in_square(i0 / chunkSize, j0 / chunkSize, (i1 - 1) / chunkSize + 1, (j1 - 1) / chunkSize + 1))
+			return false;
+		return dirtinessGrid.any_set_in_square(i0, j0, i1, j1);
+	};
+
+	for (std::map<Key, Entry>::iterator it = m_Entries.begin(); it != m_Entries.end();)
+	{
+		const std::vector<Waypoint>& waypoints = it->second.waypoints;
+		bool dirty = isDirtyRegion(it->first.start) || isDirtyRegion(it->first.goal);
+		for (size_t k = 1; !dirty && k < waypoints.size(); ++k)
+			dirty = isDirtySegment(waypoints[k - 1], waypoints[k]);
+
+		if (dirty)
+			it = m_Entries.erase(it);
+		else
+			++it;
+	}
+}
+
+void LongPathCache::Clear()
+{
+	m_Entries.clear();
+}
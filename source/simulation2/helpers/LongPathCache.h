@@ -0,0 +1,142 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_LONGPATHCACHE
+#define INCLUDED_LONGPATHCACHE
+
+#include "simulation2/helpers/HierarchicalPathfinder.h"
+#include "simulation2/helpers/Pathfinding.h"
+#include "simulation2/serialization/SerializeTemplates.h"
+
+#include <map>
+#include <vector>
+
+template<typename T>
+class Grid;
+
+/**
+ * Cache of long paths between hierarchical regions.
+ *
+ * Units trained in batches or sent to a rally point often request paths for nearly
+ * the same journey. Paths are cached per passability class, start region, goal region
+ * and goal type, and a request matching a cached entry reuses its corridor, joining it
+ * to the exact start and goal with straight lines if those are clear.
+ *
+ * Unlike the jump point cache, a cached path is not what the pathfinder would compute
+ * from scratch, so the cache is part of the simulation state: it is serialized, and it is
+ * only modified between path computations, in the order the paths were requested.
+ * It is only read while paths are computed asynchronously.
+ */
+class LongPathCache
+{
+	friend struct SerializeHelper<LongPathCache>;
+public:
+	struct Key
+	{
+		Key() : passClass(0), start(0, 0, 0), goal(0, 0, 0), goalType(0) { }
+
+		pass_class_t passClass;
+		HierarchicalPathfinder::RegionID start;
+		HierarchicalPathfinder::RegionID goal;
+		u8 goalType;
+
+		bool operator<(const Key& b) const
+		{
+			if (passClass != b.passClass)
+				return passClass < b.passClass;
+			if (!(start == b.start))
+				return start < b.start;
+			if (!(goal == b.goal))
+				return goal < b.goal;
+			return goalType < b.goalType;
+		}
+	};
+
+	enum class Status : u8
+	{
+		// The path can't be cached, e.g. because the start and goal are on the same navcell.
+		UNCACHED,
+		// The path was computed from scratch and can be added to the cache.
+		MISS,
+		// The path was built from a cached one.
+		HIT
+	};
+
+	/**
+	 * Result of looking up a path request, as returned by LongPathfinder::ComputePath.
+	 */
+	struct Lookup
+	{
+		Key key;
+		Status status = Status::UNCACHED;
+	};
+
+	/**
+	 * Builds a path from @p x0, @p z0 to the point goal @p goal out of the cached corridor for @p key.
+	 * The waypoints are in reverse order, starting with the goal, like WaypointPath.
+	 * Returns false if there is no such entry, or if the start or goal can't be joined to it.
+	 */
+	bool Stitch(const Key& key, entity_pos_t x0, entity_pos_t z0, const PathGoal& goal,
+		const Grid<NavcellData>& grid, WaypointPath& path) const;
+
+	/**
+	 * Adds the path computed for a request to the cache, or marks the entry it was built from as used.
+	 * Must be called in request order, while no path is being computed.
+	 */
+	void Commit(const Lookup& lookup, const WaypointPath& path);
+
+	/**
+	 * Advances the clock used to evict the least recently used entries.
+	 */
+	void NextBatch();
+
+	/**
+	 * Removes the entries that may have been affected by the navcells flagged in @p dirtinessGrid:
+	 * those whose start or goal chunk was recomputed, and those whose corridor crosses a dirty navcell.
+	 */
+	void Invalidate(const Grid<u8>& dirtinessGrid);
+
+	void Clear();
+
+	size_t GetNumberOfEntries() const { return m_Entries.size(); }
+
+	u32 GetHits() const { return m_Hits; }
+	u32 GetMisses() const { return m_Misses; }
+
+private:
+	struct Entry
+	{
+		// Waypoints of the corridor, in reverse order, excluding the goal of the path that created it.
+		std::vector<Waypoint> waypoints;
+		u32 lastUsed = 0;
+	};
+
+	// Number of waypoints tried at each end of a corridor to join it to a start or goal.
+	static constexpr size_t JOIN_SEARCH_WAYPOINTS = 4;
+	static constexpr size_t MAX_ENTRIES = 512;
+
+	void EvictLeastRecentlyUsed();
+
+	std::map<Key, Entry> m_Entries;
+	u32 m_Clock = 0;
+
+	// Statistics for the profiler, not serialized.
+	u32 m_Hits = 0;
+	u32 m_Misses = 0;
+};
+
+#endif // INCLUDED_LONGPATHCACHE
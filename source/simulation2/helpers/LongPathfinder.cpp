@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -24,6 +24,7 @@
 
 #include "Geometry.h"
 #include "HierarchicalPathfinder.h"
+#include "JumpPointCache.h"
 
 #include <mutex>
 
@@ -32,350 +33,6 @@ namespace
 static std::mutex g_DebugMutex;
 }
 
-/**
- * Jump point cache.
- *
- * The JPS algorithm wants to efficiently either find the first jump point
- * in some direction from some cell (not counting the cell itself),
- * if it is reachable without crossing any impassable cells;
- * or know that there is no such reachable jump point.
- * The jump point is always on a passable cell.
- * We cache that data to allow fast lookups, which helps performance
- * significantly (especially on sparse maps).
- * Recalculation might be expensive but the underlying passability data
- * changes relatively rarely.
- *
- * To allow the algorithm to detect goal cells, we want to treat them as
- * jump points too. (That means the algorithm will push those cells onto
- * its open queue, and will eventually pop a goal cell and realise it's done.)
- * (Goals might be circles/squares/etc, not just a single cell.)
- * But the goal generally changes for every path request, so we can't cache
- * it like the normal jump points.
- * Instead, if there's no jump point from some cell then we'll cache the
- * first impassable cell as an 'obstruction jump point'
- * (with a flag to distinguish from a real jump point), and then the caller
- * can test whether the goal includes a cell that's closer than the first
- * (obstruction or real) jump point,
- * and treat the goal cell as a jump point in that case.
- *
- * We only ever need to find the jump point relative to a passable cell;
- * the cache is allowed to return bogus values for impassable cells.
- */
-class JumpPointCache
-{
-	/**
-	 * Simple space-inefficient row storage.
-	 */
-	struct RowRaw
-	{
-		std::vector<u16> data;
-
-		size_t GetMemoryUsage() const
-		{
-			return data.capacity() * sizeof(u16);
-		}
-
-		RowRaw(int length)
-		{
-			data.resize(length);
-		}
-
-		/**
-		 * Set cells x0 <= x < x1 to have jump point x1.
-		 */
-		void SetRange(int x0, int x1, bool obstruction)
-		{
-			ENSURE(0 <= x0 && x0 <= x1 && x1 < (int)data.size());
-			for (int x = x0; x < x1; ++x)
-				data[x] = (x1 << 1) | (obstruction ? 1 : 0);
-		}
-
-		/**
-		 * Returns the coordinate of the next jump point xp (where x < xp),
-		 * and whether it's an obstruction point or jump point.
-		 */
-		void Get(int x, int& xp, bool& obstruction) const
-		{
-			ENSURE(0 <= x && x < (int)data.size());
-			xp = data[x] >> 1;
-			obstruction = data[x] & 1;
-		}
-
-		void Finish() { }
-	};
-
-	struct RowTree
-	{
-		/**
-		 * Represents an interval [u15 x0, u16 x1)
-		 * with a boolean obstruction flag,
-		 * packed into a single u32.
-		 */
-		struct Interval
-		{
-			Interval() : data(0) { }
-
-			Interval(int x0, int x1, bool obstruction)
-			{
-				ENSURE(0 <= x0 && x0 < 0x8000);
-				ENSURE(0 <= x1 && x1 < 0x10000);
-				data = ((u32)x0 << 17) | (u32)(obstruction ? 0x10000 : 0) | (u32)x1;
-			}
-
-			int x0() { return data >> 17; }
-			int x1() { return data & 0xFFFF; }
-			bool obstruction() { return (data & 0x10000) != 0; }
-
-			u32 data;
-		};
-
-		std::vector<Interval> data;
-
-		size_t GetMemoryUsage() const
-		{
-			return data.capacity() * sizeof(Interval);
-		}
-
-		RowTree(int UNUSED(length))
-		{
-		}
-
-		void SetRange(int x0, int x1, bool obstruction)
-		{
-			ENSURE(0 <= x0 && x0 <= x1);
-			data.emplace_back(x0, x1, obstruction);
-		}
-
-		/**
-		 * Recursive helper function for Finish().
-		 * Given two ranges [x0, pivot) and [pivot, x1) in the sorted array 'data',
-		 * the pivot element is added onto the binary tree (stored flattened in an
-		 * array), and then each range is split into two sub-ranges with a pivot in
-		 * the middle (to ensure the tree remains balanced) and ConstructTree recurses.
-		 */
-		void ConstructTree(std::vector<Interval>& tree, size_t x0, size_t pivot, size_t x1, size_t idx_tree)
-		{
-			ENSURE(x0 < data.size());
-			ENSURE(x1 <= data.size());
-			ENSURE(x0 <= pivot);
-			ENSURE(pivot < x1);
-			ENSURE(idx_tree < tree.size());
-
-			tree[idx_tree] = data[pivot];
-
-			if (x0 < pivot)
-				ConstructTree(tree, x0, (x0 + pivot) / 2, pivot, (idx_tree << 1) + 1);
-			if (pivot + 1 < x1)
-				ConstructTree(tree, pivot + 1, (pivot + x1) / 2, x1, (idx_tree << 1) + 2);
-		}
-
-		void Finish()
-		{
-			// Convert the sorted interval list into a balanced binary tree
-
-			std::vector<Interval> tree;
-
-			if (!data.empty())
-			{
-				size_t depth = ceil_log2(data.size() + 1);
-				tree.resize((1 << depth) - 1);
-				ConstructTree(tree, 0, data.size() / 2, data.size(), 0);
-			}
-
-			data.swap(tree);
-		}
-
-		void Get(int x, int& xp, bool& obstruction) const
-		{
-			// Search the binary tree for an interval which contains x
-			int i = 0;
-			while (true)
-			{
-				ENSURE(i < (int)data.size());
-				Interval interval = data[i];
-				if (x < interval.x0())
-					i = (i << 1) + 1;
-				else if (x >= interval.x1())
-					i = (i << 1) + 2;
-				else
-				{
-					ENSURE(interval.x0() <= x && x < interval.x1());
-					xp = interval.x1();
-					obstruction = interval.obstruction();
-					return;
-				}
-			}
-		}
-	};
-
-	// Pick one of the row implementations
-	typedef RowRaw Row;
-
-public:
-	int m_Width;
-	int m_Height;
-	std::vector<Row> m_JumpPointsRight;
-	std::vector<Row> m_JumpPointsLeft;
-	std::vector<Row> m_JumpPointsUp;
-	std::vector<Row> m_JumpPointsDown;
-
-	/**
-	 * Compute the cached obstruction/jump points for each cell,
-	 * in a single direction. By default the code assumes the rightwards
-	 * (+i) direction; set 'transpose' to switch to upwards (+j),
-	 * and/or set 'mirror' to reverse the direction.
-	 */
-	void ComputeRows(std::vector<Row>& rows,
-		const Grid<NavcellData>& terrain, pass_class_t passClass,
-		bool transpose, bool mirror)
-	{
-		int w = terrain.m_W;
-		int h = terrain.m_H;
-
-		if (transpose)
-			std::swap(w, h);
-
-		// Check the terrain passability, adjusted for transpose/mirror
-#define TERRAIN_IS_PASSABLE(i, j) \
-	IS_PASSABLE( \
-		mirror \
-		? (transpose ? terrain.get((j), w-1-(i)) : terrain.get(w-1-(i), (j))) \
-		: (transpose ? terrain.get((j), (i)) : terrain.get((i), (j))) \
-	, passClass)
-
-		rows.reserve(h);
-		for (int j = 0; j < h; ++j)
-			rows.emplace_back(w);
-
-		for (int j = 1; j < h - 1; ++j)
-		{
-			// Find the first passable cell.
-			// Then, find the next jump/obstruction point after that cell,
-			// and store that point for the passable range up to that cell,
-			// then repeat.
-
-			int i = 0;
-			while (i < w)
-			{
-				// Restart the 'while' loop until we reach a passable cell
-				if (!TERRAIN_IS_PASSABLE(i, j))
-				{
-					++i;
-					continue;
-				}
-
-				// i is now a passable cell; find the next jump/obstruction point.
-				// (We assume the map is surrounded by impassable cells, so we don't
-				// need to explicitly check for world bounds here.)
-
-				int i0 = i;
-				while (true)
-				{
-					++i;
-
-					// Check if we hit an obstructed tile
-					if (!TERRAIN_IS_PASSABLE(i, j))
-					{
-						rows[j].SetRange(i0, i, true);
-						break;
-					}
-
-					// Check if we reached a jump point
-					if ((!TERRAIN_IS_PASSABLE(i - 1, j - 1) && TERRAIN_IS_PASSABLE(i, j - 1)) ||
-						(!TERRAIN_IS_PASSABLE(i - 1, j + 1) && TERRAIN_IS_PASSABLE(i, j + 1)))
-					{
-						rows[j].SetRange(i0, i, false);
-						break;
-					}
-				}
-			}
-
-			rows[j].Finish();
-		}
-#undef TERRAIN_IS_PASSABLE
-	}
-
-	void reset(const Grid<NavcellData>* terrain, pass_class_t passClass)
-	{
-		PROFILE2("JumpPointCache reset");
-		TIMER(L"JumpPointCache reset");
-
-		m_Width = terrain->m_W;
-		m_Height = terrain->m_H;
-
-		ComputeRows(m_JumpPointsRight, *terrain, passClass, false, false);
-		ComputeRows(m_JumpPointsLeft, *terrain, passClass, false, true);
-		ComputeRows(m_JumpPointsUp, *terrain, passClass, true, false);
-		ComputeRows(m_JumpPointsDown, *terrain, passClass, true, true);
-	}
-
-	size_t GetMemoryUsage() const
-	{
-		size_t bytes = 0;
-		for (int i = 0; i < m_Width; ++i)
-		{
-			bytes += m_JumpPointsUp[i].GetMemoryUsage();
-			bytes += m_JumpPointsDown[i].GetMemoryUsage();
-		}
-		for (int j = 0; j < m_Height; ++j)
-		{
-			bytes += m_JumpPointsRight[j].GetMemoryUsage();
-			bytes += m_JumpPointsLeft[j].GetMemoryUsage();
-		}
-		return bytes;
-	}
-
-	/**
-	 * Returns the next jump point (or goal point) to explore,
-	 * at (ip, j) where i < ip.
-	 * Returns i if there is no such point.
-	 */
-	int GetJumpPointRight(int i, int j, const PathGoal& goal) const
-	{
-		int ip;
-		bool obstruction;
-		m_JumpPointsRight[j].Get(i, ip, obstruction);
-		// Adjust ip to be a goal cell, if there is one closer than the jump point;
-		// and then return the new ip if there is a goal,
-		// or the old ip if there is a (non-obstruction) jump point
-		if (goal.NavcellRectContainsGoal(i + 1, j, ip - 1, j, &ip, NULL) || !obstruction)
-			return ip;
-		return i;
-	}
-
-	int GetJumpPointLeft(int i, int j, const PathGoal& goal) const
-	{
-		int mip; // mirrored value, because m_JumpPointsLeft is generated from a mirrored map
-		bool obstruction;
-		m_JumpPointsLeft[j].Get(m_Width - 1 - i, mip, obstruction);
-		int ip = m_Width - 1 - mip;
-		if (goal.NavcellRectContainsGoal(i - 1, j, ip + 1, j, &ip, NULL) || !obstruction)
-			return ip;
-		return i;
-	}
-
-	int GetJumpPointUp(int i, int j, const PathGoal& goal) const
-	{
-		int jp;
-		bool obstruction;
-		m_JumpPointsUp[i].Get(j, jp, obstruction);
-		if (goal.NavcellRectContainsGoal(i, j + 1, i, jp - 1, NULL, &jp) || !obstruction)
-			return jp;
-		return j;
-	}
-
-	int GetJumpPointDown(int i, int j, const PathGoal& goal) const
-	{
-		int mjp; // mirrored value
-		bool obstruction;
-		m_JumpPointsDown[i].Get(m_Height - 1 - j, mjp, obstruction);
-		int jp = m_Height - 1 - mjp;
-		if (goal.NavcellRectContainsGoal(i, j - 1, i, jp + 1, NULL, &jp) || !obstruction)
-			return jp;
-		return j;
-	}
-};
-
 //////////////////////////////////////////////////////////
 
 LongPathfinder::LongPathfinder() :
@@ -384,6 +41,16 @@ LongPathfinder::LongPathfinder() :
 {
 }
 
+void LongPathfinder::Update(Grid<NavcellData>* passabilityGrid, const Grid<u8>& dirtinessGrid)
+{
+	m_Grid = passabilityGrid;
+	ASSERT(passabilityGrid->m_H == passabilityGrid->m_W);
+	ASSERT(m_GridSize == passabilityGrid->m_H);
+
+	for (std::pair<const pass_class_t, std::shared_ptr<JumpPointCache>>& cache : m_JumpPointCache)
+		cache.second->Update(m_Grid, cache.first, dirtinessGrid);
+}
+
 #define PASSABLE(i, j) IS_PASSABLE(state.terrain->get(i, j), state.passClass)
 
 // Calculate heuristic cost from tile i,j to goal
@@ -712,7 +379,8 @@ void LongPathfinder::AddJumpedDiag(int i, int j, int di, int dj, PathCost g, Pat
 	}
 }
 
-void LongPathfinder::ComputeJPSPath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal, pass_class_t passClass, WaypointPath& path) const
+void LongPathfinder::ComputeJPSPath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal, pass_class_t passClass, WaypointPath& path,
+	const LongPathCache* cache, LongPathCache::Lookup* lookup) const
 {
 	PROFILE2("ComputePathJPS");
 	PathfinderState state = { 0 };
@@ -730,8 +398,8 @@ void LongPathfinder::ComputeJPSPath(const HierarchicalPathfinder& hierPath, enti
 		{
 			m_JumpPointCache[passClass] = std::make_shared<JumpPointCache>();
 			m_JumpPointCache[passClass]->reset(m_Grid, passClass);
-			debug_printf("PATHFINDER: JPC memory: %d kB\n", (int)state.jpc->GetMemoryUsage() / 1024);
 			state.jpc = m_JumpPointCache[passClass].get();
+			debug_printf("PATHFINDER: JPC memory: %d kB\n", (int)state.jpc->GetMemoryUsage() / 1024);
 		}
 	}
 
@@ -767,6 +435,21 @@ void LongPathfinder::ComputeJPSPath(const HierarchicalPathfinder& hierPath, enti
 	ENSURE((state.goal.x / Pathfinding::NAVCELL_SIZE).ToInt_RoundToNegInfinity() == state.iGoal);
 	ENSURE((state.goal.z / Pathfinding::NAVCELL_SIZE).ToInt_RoundToNegInfinity() == state.jGoal);
 
+	if (cache)
+	{
+		lookup->key.passClass = passClass;
+		lookup->key.start = hierPath.Get(i0, j0, passClass);
+		lookup->key.goal = hierPath.Get(state.iGoal, state.jGoal, passClass);
+		lookup->key.goalType = static_cast<u8>(origGoal.type);
+		if (cache->Stitch(lookup->key, x0, z0, state.goal, *m_Grid, path))
+		{
+			lookup->status = LongPathCache::Status::HIT;
+			ImprovePathWaypoints(path, passClass, origGoal.maxdist, x0, z0);
+			return;
+		}
+		lookup->status = LongPathCache::Status::MISS;
+	}
+
 	state.passClass = passClass;
 
 	state.steps = 0;
@@ -1008,6 +691,20 @@ void LongPathfinder::ComputePath(const HierarchicalPathfinder& hierPath, entity_
 
 	ComputeJPSPath(hierPath, x0, z0, origGoal, passClass, path);
 }
+
+void LongPathfinder::ComputePath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal,
+	pass_class_t passClass, const LongPathCache& cache, LongPathCache::Lookup& lookup, WaypointPath& path) const
+{
+	lookup.status = LongPathCache::Status::UNCACHED;
+	if (!m_Grid)
+	{
+		LOGERROR("The pathfinder grid hasn't been setup yet, aborting ComputeJPSPath");
+		return;
+	}
+
+	ComputeJPSPath(hierPath, x0, z0, origGoal, passClass, path, &cache, &lookup);
+}
+
 void LongPathfinder::ComputePath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal,
 	pass_class_t passClass, std::vector<CircularRegion> excludedRegions, WaypointPath& path)
 {
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -24,6 +24,7 @@
 #include "renderer/Scene.h"
 #include "renderer/TerrainOverlay.h"
 #include "simulation2/helpers/Grid.h"
+#include "simulation2/helpers/LongPathCache.h"
 #include "simulation2/helpers/PriorityQueue.h"
 
 #include <map>
@@ -161,8 +162,15 @@ class LongOverlay;
 
 class HierarchicalPathfinder;
 
+#ifdef TEST
+class TestLongPathfinder;
+#endif
+
 class LongPathfinder
 {
+#ifdef TEST
+	friend class TestLongPathfinder;
+#endif
 public:
 	LongPathfinder();
 	~LongPathfinder();
@@ -190,14 +198,11 @@ public:
 		m_JumpPointCache.clear();
 	}
 
-	void Update(Grid<NavcellData>* passabilityGrid)
-	{
-		m_Grid = passabilityGrid;
-		ASSERT(passabilityGrid->m_H == passabilityGrid->m_W);
-		ASSERT(m_GridSize == passabilityGrid->m_H);
-
-		m_JumpPointCache.clear();
-	}
+	/**
+	 * Update the pathfinder after some navcells of the passability grid have changed.
+	 * The jump point caches are only recomputed around the navcells flagged in dirtinessGrid.
+	 */
+	void Update(Grid<NavcellData>* passabilityGrid, const Grid<u8>& dirtinessGrid);
 
 	/**
 	 * Compute a tile-based path from the given point to the goal, and return the set of waypoints.
@@ -207,6 +212,13 @@ public:
 	void ComputePath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal,
 	    pass_class_t passClass, WaypointPath& path) const;
 
+	/**
+	 * Same as above, but first tries to build the path out of a corridor from @p cache.
+	 * @param lookup is set to whether the cache was used, and to the key the path can be cached with.
+	 */
+	void ComputePath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal,
+		pass_class_t passClass, const LongPathCache& cache, LongPathCache::Lookup& lookup, WaypointPath& path) const;
+
 	/**
 	 * Compute a tile-based path from the given point to the goal, excluding the regions
 	 * specified in excludedRegions (which are treated as impassable) and return the set of waypoints.
@@ -258,7 +270,8 @@ private:
 	 * See LongPathfinder.cpp for implementation details
 	 * TODO: cleanup documentation
 	 */
-	void ComputeJPSPath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal, pass_class_t passClass, WaypointPath& path) const;
+	void ComputeJPSPath(const HierarchicalPathfinder& hierPath, entity_pos_t x0, entity_pos_t z0, const PathGoal& origGoal, pass_class_t passClass, WaypointPath& path,
+		const LongPathCache* cache = nullptr, LongPathCache::Lookup* lookup = nullptr) const;
 	void GetDebugDataJPS(u32& steps, double& time, Grid<u8>& grid) const;
 
 	// Helper functions for ComputePath
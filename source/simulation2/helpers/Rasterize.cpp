@@ -1,4 +1,4 @@
-/* Copyright (C) 2015 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -24,7 +24,7 @@
 
 void SimRasterize::RasterizeRectWithClearance(Spans& spans,
 	const ICmpObstructionManager::ObstructionSquare& shape,
-	entity_pos_t clearance, entity_pos_t cellSize)
+	entity_pos_t clearance, entity_pos_t cellSize, i16 jMin, i16 jMax)
 {
 	// A long-standing issue with the pathfinding has been that the long-range one
 	// uses a AA navcell grid, while the short-range uses an accurate vector representation.
@@ -56,6 +56,12 @@ void SimRasterize::RasterizeRectWithClearance(Spans& spans,
 	if (j1 <= j0)
 		return; // empty bounds - this shouldn't happen
 
+	// Rows are independent, so clipping them doesn't change the spans of the remaining ones.
+	j0 = std::max(j0, jMin);
+	j1 = std::min(j1, jMax);
+	if (j1 <= j0)
+		return;
+
 
 	rasterClearance = rasterClearance.Multiply(rasterClearance);
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2012 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -26,6 +26,8 @@
 #include "simulation2/components/ICmpObstructionManager.h"
 #include "simulation2/helpers/Position.h"
 
+#include <limits>
+
 namespace SimRasterize
 {
 
@@ -45,10 +47,12 @@ typedef std::vector<Span> Spans;
  * Converts an ObstructionSquare @p shape (a rotated rectangle),
  * expanded by the given @p clearance,
  * into a list of spans of cells that are strictly inside the shape.
+ * Only the rows @p jMin <= j < @p jMax are rasterized.
  */
 void RasterizeRectWithClearance(Spans& spans,
 	const ICmpObstructionManager::ObstructionSquare& shape,
-	entity_pos_t clearance, entity_pos_t cellSize);
+	entity_pos_t clearance, entity_pos_t cellSize,
+	i16 jMin = std::numeric_limits<i16>::min(), i16 jMax = std::numeric_limits<i16>::max());
 
 }
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2016 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -246,13 +246,32 @@ public:
 	 */
 	void GetInRange(std::vector<uint32_t>& out, CFixedVector2D posMin, CFixedVector2D posMax) const
 	{
-		out.clear();
+		u32 i0, j0, i1, j1;
+		GetDivisionsInRange(posMin, posMax, i0, j0, i1, j1);
+		GetInDivisions(out, i0, j0, i1, j1);
+	}
+
+	/**
+	 * Returns the (inclusive) range of divisions that GetInRange looks up for the given
+	 * axis-aligned square range. Ranges with the same divisions give the same items.
+	 */
+	void GetDivisionsInRange(CFixedVector2D posMin, CFixedVector2D posMax, u32& i0, u32& j0, u32& i1, u32& j1) const
+	{
 		ENSURE(posMin.X <= posMax.X && posMin.Y <= posMax.Y);
 
-		u32 i0 = GetI0(posMin.X);
-		u32 j0 = GetJ0(posMin.Y);
-		u32 i1 = GetI1(posMax.X);
-		u32 j1 = GetJ1(posMax.Y);
+		i0 = GetI0(posMin.X);
+		j0 = GetJ0(posMin.Y);
+		i1 = GetI1(posMax.X);
+		j1 = GetJ1(posMax.Y);
+	}
+
+	/**
+	 * Returns a sorted list of unique items that includes all items
+	 * within the given (inclusive) range of divisions.
+	 */
+	void GetInDivisions(std::vector<uint32_t>& out, u32 i0, u32 j0, u32 i1, u32 j1) const
+	{
+		out.clear();
 		for (u32 j = j0; j <= j1; ++j)
 		{
 			for (u32 i = i0; i <= i1; ++i)
@@ -510,6 +529,66 @@ public:
 		}
 	}
 
+	struct Movement
+	{
+		entity_id_t item;
+		CFixedVector2D oldPosition;
+		CFixedVector2D newPosition;
+		u32 size;
+	};
+
+	/**
+	 * Equivalent to calling Move() for each movement in turn (except for the order of items
+	 * within a subdivision), but each subdivision is only scanned once for all the items leaving it.
+	 * Each item must appear at most once. @p movements is reordered.
+	 */
+	void Move(std::vector<Movement>& movements)
+	{
+		constexpr u32 FOUND = std::numeric_limits<u32>::max();
+
+		// Drop the movements that stay in the same subdivision, and group the others by the subdivision they leave.
+		movements.erase(std::remove_if(movements.begin(), movements.end(), [this](const Movement& movement) {
+			return movement.size > SUBDIVISION_SIZE || SubdivisionIdx(movement.newPosition) == SubdivisionIdx(movement.oldPosition);
+		}), movements.end());
+		std::sort(movements.begin(), movements.end(), [this](const Movement& a, const Movement& b) {
+			const size_t idxA = SubdivisionIdx(a.oldPosition);
+			const size_t idxB = SubdivisionIdx(b.oldPosition);
+			return idxA < idxB || (idxA == idxB && a.item < b.item);
+		});
+
+		std::vector<Movement>::iterator first = movements.begin();
+		while (first != movements.end())
+		{
+			const size_t idx = SubdivisionIdx(first->oldPosition);
+			std::vector<Movement>::iterator last = std::find_if(first, movements.end(), [this, idx](const Movement& movement) {
+				return SubdivisionIdx(movement.oldPosition) != idx;
+			});
+
+			// Erase the leaving items in a single pass, marking the ones found
+			// (only those are added to their new subdivision, like Move() does).
+			std::vector<entity_id_t>& oldSubdivision = m_SpatialDivisionsData[idx];
+			size_t n = 0;
+			while (n < oldSubdivision.size())
+			{
+				std::vector<Movement>::iterator it = std::lower_bound(first, last, oldSubdivision[n], [](const Movement& movement, entity_id_t item) {
+					return movement.item < item;
+				});
+				if (it == last || it->item != oldSubdivision[n])
+				{
+					++n;
+					continue;
+				}
+				it->size = FOUND;
+				oldSubdivision[n] = oldSubdivision.back();
+				oldSubdivision.pop_back();
+			}
+
+			for (; first != last; ++first)
+				if (first->size == FOUND)
+					m_SpatialDivisionsData[SubdivisionIdx(first->newPosition)].push_back(first->item);
+		}
+	}
+
 	/**
 	 * Returns a (non sorted) list of items that are either in the square or close to it.
 	 * It's the responsibility of the querier to do proper distance checking and entity sorting.
@@ -0,0 +1,212 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "precompiled.h"
+
+#include "TerritoryInfluenceMap.h"
+
+#include <algorithm>
+#include <queue>
+
+void TerritoryInfluenceMap::Reset(const Grid<u8>& costGrid)
+{
+	m_CostGrid = costGrid;
+	m_Influences.clear();
+	m_PlayerWeights.clear();
+	m_InfluenceWeights = Grid<u32>(costGrid.m_W, costGrid.m_H);
+
+	// Every tile must be written by the next update
+	m_DirtyRects.clear();
+	if (costGrid.m_W && costGrid.m_H)
+		m_DirtyRects.push_back({ 0, 0, static_cast<u16>(costGrid.m_W - 1), static_cast<u16>(costGrid.m_H - 1) });
+}
+
+void TerritoryInfluenceMap::SetInfluence(entity_id_t ent, const Influence& influence)
+{
+	std::map<entity_id_t, Influence>::iterator it = m_Influences.find(ent);
+	if (it != m_Influences.end())
+	{
+		if (it->second == influence)
+			return;
+		Apply(it->second, false);
+		it->second = influence;
+	}
+	else
+		m_Influences.emplace(ent, influence);
+
+	Apply(influence, true);
+}
+
+void TerritoryInfluenceMap::RemoveInfluence(entity_id_t ent)
+{
+	std::map<entity_id_t, Influence>::iterator it = m_Influences.find(ent);
+	if (it == m_Influences.end())
+		return;
+
+	Apply(it->second, false);
+	m_Influences.erase(it);
+}
+
+void TerritoryInfluenceMap::Apply(const Influence& influence, bool add)
+{
+	const u16 tilesW = m_CostGrid.m_W;
+	const u16 tilesH = m_CostGrid.m_H;
+
+	if (m_PlayerWeights.size() <= influence.owner)
+		m_PlayerWeights.resize(influence.owner + 1);
+	Grid<u32>& playerWeights = m_PlayerWeights[influence.owner];
+	if (playerWeights.m_W == 0)
+		playerWeights = Grid<u32>(tilesW, tilesH);
+
+	Rect rect = { influence.i, influence.j, influence.i, influence.j };
+
+	// Expand the influence outwards. The weight of each tile is the highest weight
+	// of its neighbours minus the falloff onto it, so it doesn't depend on the
+	// order in which tiles are visited.
+	const int NUM_NEIGHBOURS = 8;
+	const int NEIGHBOURS_X[NUM_NEIGHBOURS] = {1,-1, 0, 0, 1,-1, 1,-1};
+	const int NEIGHBOURS_Z[NUM_NEIGHBOURS] = {0, 0, 1,-1, 1,-1,-1, 1};
+
+	m_InfluenceWeights.set(influence.i, influence.j, influence.weight);
+	std::queue<std::pair<u16, u16>> openTiles;
+	openTiles.emplace(influence.i, influence.j);
+	while (!openTiles.empty())
+	{
+		const u16 posX = openTiles.front().first;
+		const u16 posZ = openTiles.front().second;
+		openTiles.pop();
+		for (int n = 0; n < NUM_NEIGHBOURS; ++n)
+		{
+			const u16 nx = posX + NEIGHBOURS_X[n];
+			const u16 nz = posZ + NEIGHBOURS_Z[n];
+			// Check the bounds, underflow will cause the values to be big again
+			if (nx >= tilesW || nz >= tilesH)
+				continue;
+
+			u32 dg = influence.falloff * m_CostGrid.get(nx, nz);
+
+			// diagonal neighbour -> multiply with approx sqrt(2)
+			if (nx != posX && nz != posZ)
+				dg = (dg * 362) / 256;
+
+			// Don't expand if new cost is not better than previous value for that tile
+			// (arranged to avoid underflow if m_InfluenceWeights.get(x, z) < dg)
+			if (m_InfluenceWeights.get(posX, posZ) <= m_InfluenceWeights.get(nx, nz) + dg)
+				continue;
+
+			// weight of this tile = weight of predecessor - falloff from predecessor
+			m_InfluenceWeights.set(nx, nz, m_InfluenceWeights.get(posX, posZ) - dg);
+			rect.i0 = std::min(rect.i0, nx);
+			rect.j0 = std::min(rect.j0, nz);
+			rect.i1 = std::max(rect.i1, nx);
+			rect.j1 = std::max(rect.j1, nz);
+			openTiles.emplace(nx, nz);
+		}
+	}
+
+	// Update the weights of the player (except under the influence itself), and clear ours for the next call
+	for (u16 j = rect.j0; j <= rect.j1; ++j)
+		for (u16 i = rect.i0; i <= rect.i1; ++i)
+		{
+			const u32 weight = m_InfluenceWeights.get(i, j);
+			if (weight == 0)
+				continue;
+			m_InfluenceWeights.set(i, j, 0);
+			if (i == influence.i && j == influence.j)
+				continue;
+			if (add)
+				playerWeights.set(i, j, playerWeights.get(i, j) + weight);
+			else
+				playerWeights.set(i, j, playerWeights.get(i, j) - weight);
+		}
+
+	m_DirtyRects.push_back(rect);
+}
+
+u8 TerritoryInfluenceMap::ComputeOwner(u16 i, u16 j, const std::vector<u32>* sourceWeights) const
+{
+	// Players are compared in increasing ID order, so ties go to the lowest ID
+	u8 owner = 0;
+	u32 bestWeight = 0;
+	for (size_t player = 1; player < m_PlayerWeights.size(); ++player)
+	{
+		u32 weight = m_PlayerWeights[player].m_W ? m_PlayerWeights[player].get(i, j) : 0;
+		if (sourceWeights)
+			weight = std::max(weight, (*sourceWeights)[player]);
+		if (weight > bestWeight)
+		{
+			bestWeight = weight;
+			owner = static_cast<u8>(player);
+		}
+	}
+	return owner;
+}
+
+void TerritoryInfluenceMap::UpdateTerritories(Grid<u8>& territories)
+{
+	if (m_DirtyRects.empty())
+		return;
+
+	ENSURE(territories.m_W == m_CostGrid.m_W && territories.m_H == m_CostGrid.m_H);
+
+	// Overlapping areas would be computed several times, so just do everything
+	// when there are more dirty tiles than tiles
+	size_t dirtyArea = 0;
+	for (const Rect& rect : m_DirtyRects)
+		dirtyArea += static_cast<size_t>(rect.i1 - rect.i0 + 1) * (rect.j1 - rect.j0 + 1);
+	if (dirtyArea > static_cast<size_t>(territories.m_W) * territories.m_H)
+	{
+		m_DirtyRects.clear();
+		m_DirtyRects.push_back({ 0, 0, static_cast<u16>(territories.m_W - 1), static_cast<u16>(territories.m_H - 1) });
+	}
+
+	for (const Rect& rect : m_DirtyRects)
+		for (u16 j = rect.j0; j <= rect.j1; ++j)
+			for (u16 i = rect.i0; i <= rect.i1; ++i)
+				territories.set(i, j, ComputeOwner(i, j, nullptr));
+
+	// Tiles under influences compare the weights of the influences on them, rather than the summed weights
+	std::vector<std::pair<u32, const Influence*>> sources;
+	for (const std::pair<const entity_id_t, Influence>& pair : m_Influences)
+	{
+		const Influence& influence = pair.second;
+		for (const Rect& rect : m_DirtyRects)
+			if (rect.i0 <= influence.i && influence.i <= rect.i1 && rect.j0 <= influence.j && influence.j <= rect.j1)
+			{
+				sources.emplace_back(influence.j * territories.m_W + influence.i, &influence);
+				break;
+			}
+	}
+	std::sort(sources.begin(), sources.end(), [](const std::pair<u32, const Influence*>& a, const std::pair<u32, const Influence*>& b) {
+		return a.first < b.first;
+	});
+
+	std::vector<u32> sourceWeights(m_PlayerWeights.size());
+	for (size_t begin = 0, end = 0; begin < sources.size(); begin = end)
+	{
+		std::fill(sourceWeights.begin(), sourceWeights.end(), 0);
+		for (end = begin; end < sources.size() && sources[end].first == sources[begin].first; ++end)
+		{
+			const Influence& influence = *sources[end].second;
+			sourceWeights[influence.owner] = std::max(sourceWeights[influence.owner], influence.weight);
+		}
+		const Influence& influence = *sources[begin].second;
+		territories.set(influence.i, influence.j, ComputeOwner(influence.i, influence.j, &sourceWeights));
+	}
+
+	m_DirtyRects.clear();
+}
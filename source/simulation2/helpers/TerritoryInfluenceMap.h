@@ -0,0 +1,112 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_TERRITORYINFLUENCEMAP
+#define INCLUDED_TERRITORYINFLUENCEMAP
+
+#include "simulation2/helpers/Grid.h"
+#include "simulation2/system/Entity.h"
+
+#include <map>
+#include <vector>
+
+/**
+ * Computes which player owns each territory tile, from the influences of the
+ * players' entities, and updates it incrementally when influences change.
+ *
+ * Each influence spreads its weight from its tile, losing some of it on each
+ * tile according to its falloff and the cost of that tile. A tile is owned by
+ * the player with the highest summed weight on it (a tile under an influence
+ * only counts the weight of that influence itself, not the sum), and ties go
+ * to the lowest player ID.
+ *
+ * Changing an influence only reflows that influence, and only recomputes the
+ * owners of the tiles it reaches. The result is the same as recomputing from
+ * scratch. Factored out of CCmpTerritoryManager for testing.
+ */
+class TerritoryInfluenceMap
+{
+public:
+	struct Influence
+	{
+		u8 owner;
+		u16 i, j;
+		u32 weight;
+		u32 falloff;
+		bool root;
+
+		bool operator==(const Influence& other) const
+		{
+			return owner == other.owner && i == other.i && j == other.j &&
+				weight == other.weight && falloff == other.falloff && root == other.root;
+		}
+		bool operator!=(const Influence& other) const { return !(*this == other); }
+	};
+
+	/**
+	 * Remove all influences, and use @p costGrid (the cost of spreading influence
+	 * onto each tile) from now on.
+	 */
+	void Reset(const Grid<u8>& costGrid);
+
+	/**
+	 * Add the influence of @p ent, or replace it if it already has one.
+	 */
+	void SetInfluence(entity_id_t ent, const Influence& influence);
+
+	/**
+	 * Remove the influence of @p ent, if it has one.
+	 */
+	void RemoveInfluence(entity_id_t ent);
+
+	/**
+	 * Write into @p territories the owner of every tile whose owner may have
+	 * changed since the last call (or since Reset), replacing all the bits of
+	 * those tiles. Other tiles are left untouched.
+	 */
+	void UpdateTerritories(Grid<u8>& territories);
+
+	const std::map<entity_id_t, Influence>& GetInfluences() const { return m_Influences; }
+
+private:
+	struct Rect
+	{
+		u16 i0, j0, i1, j1; // inclusive
+	};
+
+	/**
+	 * Spread @p influence, and add its weight to (or subtract it from) the weights of its owner.
+	 */
+	void Apply(const Influence& influence, bool add);
+
+	u8 ComputeOwner(u16 i, u16 j, const std::vector<u32>* sourceWeights) const;
+
+	Grid<u8> m_CostGrid;
+
+	std::map<entity_id_t, Influence> m_Influences;
+
+	// Summed weights of each player's influences (excluding the tiles under the influences), indexed by player ID
+	std::vector<Grid<u32>> m_PlayerWeights;
+
+	// Weights of a single influence, only used within Apply and kept zeroed otherwise
+	Grid<u32> m_InfluenceWeights;
+
+	// Areas whose owners must be recomputed
+	std::vector<Rect> m_DirtyRects;
+};
+
+#endif // INCLUDED_TERRITORYINFLUENCEMAP
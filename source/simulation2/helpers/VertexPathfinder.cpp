@@ -267,7 +267,7 @@ typedef PriorityQueueHeap<u16, fixed, fixed> VertexPriorityQueue;
  */
 static void AddTerrainEdges(std::vector<Edge>& edges, std::vector<Vertex>& vertexes,
 	int i0, int j0, int i1, int j1,
-	pass_class_t passClass, const Grid<NavcellData>& grid)
+	pass_class_t passClass, const Grid<NavcellData>& grid, CFrameArena& arena)
 {
 
 	// Clamp the coordinates so we won't attempt to sample outside of the grid.
@@ -330,8 +330,8 @@ static void AddTerrainEdges(std::vector<Edge>& edges, std::vector<Vertex>& verte
 	}
 
 	// XXX rewrite this stuff
-	std::vector<u16> segmentsR;
-	std::vector<u16> segmentsL;
+	CFrameArena::Vector<u16> segmentsR(arena);
+	CFrameArena::Vector<u16> segmentsL(arena);
 	for (int j = j0; j < j1; ++j)
 	{
 		segmentsR.clear();
@@ -388,8 +388,8 @@ static void AddTerrainEdges(std::vector<Edge>& edges, std::vector<Vertex>& verte
 			}
 		}
 	}
-	std::vector<u16> segmentsU;
-	std::vector<u16> segmentsD;
+	CFrameArena::Vector<u16> segmentsU(arena);
+	CFrameArena::Vector<u16> segmentsD(arena);
 	for (int i = i0; i < i1; ++i)
 	{
 		segmentsU.clear();
@@ -518,6 +518,108 @@ struct SquareSort
 	}
 };
 
+/**
+ * Computes the search graph vertexes and collision edges of @p obstruction.square
+ * for a unit of the given clearance.
+ */
+static void ConvertObstruction(VertexPathfinderObstruction& obstruction, bool isStatic, entity_pos_t clearance)
+{
+	const ICmpObstructionManager::ObstructionSquare& square = obstruction.square.square;
+	CFixedVector2D center(square.x, square.z);
+	CFixedVector2D u = square.u;
+	CFixedVector2D v = square.v;
+
+	entity_pos_t pathfindClearance = clearance;
+	if (!isStatic)
+		pathfindClearance = clearance - entity_pos_t::FromInt(1)/2;
+
+	// Expand the vertexes by the moving unit's collision radius, to find the
+	// closest we can get to it
+
+	CFixedVector2D hd0(square.hw + pathfindClearance + EDGE_EXPAND_DELTA,   square.hh + pathfindClearance + EDGE_EXPAND_DELTA);
+	CFixedVector2D hd1(square.hw + pathfindClearance + EDGE_EXPAND_DELTA, -(square.hh + pathfindClearance + EDGE_EXPAND_DELTA));
+
+	// Check whether this is an axis-aligned square
+	bool aa = (u.X == fixed::FromInt(1) && u.Y == fixed::Zero() && v.X == fixed::Zero() && v.Y == fixed::FromInt(1));
+
+	obstruction.isStatic = isStatic;
+	obstruction.aa = aa;
+
+	for (Vertex& vert : obstruction.vertexes)
+	{
+		vert.g = vert.h = fixed::Zero();
+		vert.pred = 0;
+		vert.status = Vertex::UNEXPLORED;
+		vert.quadInward = QUADRANT_NONE;
+		vert.quadOutward = QUADRANT_ALL;
+	}
+
+	obstruction.vertexes[0].p = CFixedVector2D(center.X - hd0.Dot(u), center.Y + hd0.Dot(v));
+	obstruction.vertexes[1].p = CFixedVector2D(center.X - hd1.Dot(u), center.Y + hd1.Dot(v));
+	obstruction.vertexes[2].p = CFixedVector2D(center.X + hd0.Dot(u), center.Y - hd0.Dot(v));
+	obstruction.vertexes[3].p = CFixedVector2D(center.X + hd1.Dot(u), center.Y - hd1.Dot(v));
+	if (aa)
+	{
+		obstruction.vertexes[0].quadInward = QUADRANT_BR;
+		obstruction.vertexes[1].quadInward = QUADRANT_TR;
+		obstruction.vertexes[2].quadInward = QUADRANT_TL;
+		obstruction.vertexes[3].quadInward = QUADRANT_BL;
+		for (Vertex& vert : obstruction.vertexes)
+			vert.quadOutward = (~vert.quadInward) & 0xF;
+	}
+
+	// Compute the edges:
+
+	CFixedVector2D h0(square.hw + pathfindClearance, square.hh + pathfindClearance);
+	CFixedVector2D h1(square.hw + pathfindClearance, -(square.hh + pathfindClearance));
+
+	obstruction.edgeVertexes[0] = CFixedVector2D(center.X - h0.Dot(u), center.Y + h0.Dot(v));
+	obstruction.edgeVertexes[1] = CFixedVector2D(center.X - h1.Dot(u), center.Y + h1.Dot(v));
+	obstruction.edgeVertexes[2] = CFixedVector2D(center.X + h0.Dot(u), center.Y - h0.Dot(v));
+	obstruction.edgeVertexes[3] = CFixedVector2D(center.X + h1.Dot(u), center.Y - h1.Dot(v));
+}
+
+const std::vector<VertexPathfinderObstruction>& VertexPathfinderObstructionCache::Get(const ICmpObstructionManager::ObstructionCells& cells, entity_pos_t clearance, CmpPtr<ICmpObstructionManager> cmpObstructionManager) const
+{
+	Entry* entry;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::unique_ptr<Entry>& slot = m_Entries[Key{ cells, clearance }];
+		if (slot)
+			++m_Hits;
+		else
+		{
+			++m_Misses;
+			slot = std::make_unique<Entry>();
+		}
+		entry = slot.get();
+	}
+
+	// Convert the obstructions outside of the lock, other entries can be computed in the meantime.
+	std::call_once(entry->computed, [&]() {
+		PROFILE2("ComputeObstructionCacheEntry");
+		std::vector<ICmpObstructionManager::FilterableObstructionSquare> squares;
+		cmpObstructionManager->GetStaticObstructionsInCells(cells, squares);
+		size_t staticShapesNb = squares.size();
+		cmpObstructionManager->GetUnitObstructionsInCells(cells, squares);
+
+		entry->obstructions.resize(squares.size());
+		for (size_t i = 0; i < squares.size(); ++i)
+		{
+			entry->obstructions[i].square = squares[i];
+			ConvertObstruction(entry->obstructions[i], i < staticShapesNb, clearance);
+		}
+	});
+	return entry->obstructions;
+}
+
+void VertexPathfinderObstructionCache::Clear()
+{
+	m_Entries.clear();
+	m_Hits = 0;
+	m_Misses = 0;
+}
+
 /**
  * Functor for sorting unaligned edges by approximate proximity to a fixed point.
  */
@@ -531,7 +633,8 @@ struct UnalignedEdgesSort
 	}
 };
 
-WaypointPath VertexPathfinder::ComputeShortPath(const ShortPathRequest& request, CmpPtr<ICmpObstructionManager> cmpObstructionManager) const
+WaypointPath VertexPathfinder::ComputeShortPath(const ShortPathRequest& request, CmpPtr<ICmpObstructionManager> cmpObstructionManager,
+	const VertexPathfinderObstructionCache* cache) const
 {
 	PROFILE2("ComputeShortPath");
 
@@ -586,102 +689,65 @@ WaypointPath VertexPathfinder::ComputeShortPath(const ShortPathRequest& request,
 	const size_t GOAL_VERTEX_ID = 1;
 
 	// Find all the obstruction squares that might affect us
-	std::vector<ICmpObstructionManager::ObstructionSquare> squares;
-	size_t staticShapesNb = 0;
 	ControlGroupMovementObstructionFilter filter(request.avoidMovingUnits, request.group);
-	cmpObstructionManager->GetStaticObstructionsInRange(filter, rangeXMin - request.clearance, rangeZMin - request.clearance, rangeXMax + request.clearance, rangeZMax + request.clearance, squares);
-	staticShapesNb = squares.size();
-	cmpObstructionManager->GetUnitObstructionsInRange(filter, rangeXMin - request.clearance, rangeZMin - request.clearance, rangeXMax + request.clearance, rangeZMax + request.clearance, squares);
-
-	// Change array capacities to reduce reallocations
-	m_Vertexes.reserve(m_Vertexes.size() + squares.size()*4);
-	m_EdgeSquares.reserve(m_EdgeSquares.size() + squares.size()); // (assume most squares are AA)
-
-	entity_pos_t pathfindClearance = request.clearance;
-
-	// Convert each obstruction square into collision edges and search graph vertexes
-	for (size_t i = 0; i < squares.size(); ++i)
+	entity_pos_t queryXMin = rangeXMin - request.clearance;
+	entity_pos_t queryZMin = rangeZMin - request.clearance;
+	entity_pos_t queryXMax = rangeXMax + request.clearance;
+	entity_pos_t queryZMax = rangeZMax + request.clearance;
+	const std::vector<VertexPathfinderObstruction>* obstructions;
+	if (cache)
+		obstructions = &cache->Get(cmpObstructionManager->GetObstructionCellsInRange(queryXMin, queryZMin, queryXMax, queryZMax),
+			request.clearance, cmpObstructionManager);
+	else
 	{
-		CFixedVector2D center(squares[i].x, squares[i].z);
-		CFixedVector2D u = squares[i].u;
-		CFixedVector2D v = squares[i].v;
-
-		if (i >= staticShapesNb)
-			pathfindClearance = request.clearance - entity_pos_t::FromInt(1)/2;
-
-		// Expand the vertexes by the moving unit's collision radius, to find the
-		// closest we can get to it
-
-		CFixedVector2D hd0(squares[i].hw + pathfindClearance + EDGE_EXPAND_DELTA,   squares[i].hh + pathfindClearance + EDGE_EXPAND_DELTA);
-		CFixedVector2D hd1(squares[i].hw + pathfindClearance + EDGE_EXPAND_DELTA, -(squares[i].hh + pathfindClearance + EDGE_EXPAND_DELTA));
-
-		// Check whether this is an axis-aligned square
-		bool aa = (u.X == fixed::FromInt(1) && u.Y == fixed::Zero() && v.X == fixed::Zero() && v.Y == fixed::FromInt(1));
-
-		Vertex vert;
-		vert.status = Vertex::UNEXPLORED;
-		vert.quadInward = QUADRANT_NONE;
-		vert.quadOutward = QUADRANT_ALL;
+		std::vector<ICmpObstructionManager::ObstructionSquare> squares;
+		cmpObstructionManager->GetStaticObstructionsInRange(filter, queryXMin, queryZMin, queryXMax, queryZMax, squares);
+		size_t staticShapesNb = squares.size();
+		cmpObstructionManager->GetUnitObstructionsInRange(filter, queryXMin, queryZMin, queryXMax, queryZMax, squares);
 
-		vert.p.X = center.X - hd0.Dot(u);
-		vert.p.Y = center.Y + hd0.Dot(v);
-		if (aa)
+		m_Obstructions.resize(squares.size());
+		for (size_t i = 0; i < squares.size(); ++i)
 		{
-			vert.quadInward = QUADRANT_BR;
-			vert.quadOutward = (~vert.quadInward) & 0xF;
-		}
-		if (vert.p.X >= rangeXMin && vert.p.Y >= rangeZMin && vert.p.X <= rangeXMax && vert.p.Y <= rangeZMax)
-			m_Vertexes.push_back(vert);
-
-		vert.p.X = center.X - hd1.Dot(u);
-		vert.p.Y = center.Y + hd1.Dot(v);
-		if (aa)
-		{
-			vert.quadInward = QUADRANT_TR;
-			vert.quadOutward = (~vert.quadInward) & 0xF;
+			// These passed the filter already, so the other fields of the square are unused.
+			m_Obstructions[i].square.square = squares[i];
+			ConvertObstruction(m_Obstructions[i], i < staticShapesNb, request.clearance);
 		}
-		if (vert.p.X >= rangeXMin && vert.p.Y >= rangeZMin && vert.p.X <= rangeXMax && vert.p.Y <= rangeZMax)
-			m_Vertexes.push_back(vert);
+		obstructions = &m_Obstructions;
+	}
 
-		vert.p.X = center.X + hd0.Dot(u);
-		vert.p.Y = center.Y - hd0.Dot(v);
-		if (aa)
-		{
-			vert.quadInward = QUADRANT_TL;
-			vert.quadOutward = (~vert.quadInward) & 0xF;
-		}
-		if (vert.p.X >= rangeXMin && vert.p.Y >= rangeZMin && vert.p.X <= rangeXMax && vert.p.Y <= rangeZMax)
-			m_Vertexes.push_back(vert);
+	// Change array capacities to reduce reallocations
+	m_Vertexes.reserve(m_Vertexes.size() + obstructions->size()*4);
+	m_EdgeSquares.reserve(m_EdgeSquares.size() + obstructions->size()); // (assume most squares are AA)
 
-		vert.p.X = center.X + hd1.Dot(u);
-		vert.p.Y = center.Y - hd1.Dot(v);
-		if (aa)
+	// Add the collision edges and search graph vertexes of each obstruction
+	for (const VertexPathfinderObstruction& obstruction : *obstructions)
+	{
+		if (cache)
 		{
-			vert.quadInward = QUADRANT_BL;
-			vert.quadOutward = (~vert.quadInward) & 0xF;
+			// Select the obstructions GetStatic/UnitObstructionsInRange would have returned.
+			const ICmpObstructionManager::FilterableObstructionSquare& square = obstruction.square;
+			if (!filter.TestShape(square.tag, square.flags, square.group, square.group2))
+				continue;
+			if (obstruction.isStatic ?
+			    !ICmpObstructionManager::IsStaticObstructionInRange(square.square, queryXMin, queryZMin, queryXMax, queryZMax) :
+			    !ICmpObstructionManager::IsUnitObstructionInRange(square.square, queryXMin, queryZMin, queryXMax, queryZMax))
+				continue;
 		}
-		if (vert.p.X >= rangeXMin && vert.p.Y >= rangeZMin && vert.p.X <= rangeXMax && vert.p.Y <= rangeZMax)
-			m_Vertexes.push_back(vert);
-
-		// Add the edges:
 
-		CFixedVector2D h0(squares[i].hw + pathfindClearance, squares[i].hh + pathfindClearance);
-		CFixedVector2D h1(squares[i].hw + pathfindClearance, -(squares[i].hh + pathfindClearance));
+		for (const Vertex& vert : obstruction.vertexes)
+			if (vert.p.X >= rangeXMin && vert.p.Y >= rangeZMin && vert.p.X <= rangeXMax && vert.p.Y <= rangeZMax)
+				m_Vertexes.push_back(vert);
 
-		CFixedVector2D ev0(center.X - h0.Dot(u), center.Y + h0.Dot(v));
-		CFixedVector2D ev1(center.X - h1.Dot(u), center.Y + h1.Dot(v));
-		CFixedVector2D ev2(center.X + h0.Dot(u), center.Y - h0.Dot(v));
-		CFixedVector2D ev3(center.X + h1.Dot(u), center.Y - h1.Dot(v));
-		if (aa)
-			m_EdgeSquares.emplace_back(Square{ ev1, ev3 });
+		const CFixedVector2D* ev = obstruction.edgeVertexes;
+		if (obstruction.aa)
+			m_EdgeSquares.emplace_back(Square{ ev[1], ev[3] });
 		else
 		{
-			m_Edges.emplace_back(Edge{ ev0, ev1 });
-			m_Edges.emplace_back(Edge{ ev1, ev2 });
-			m_Edges.emplace_back(Edge{ ev2, ev3 });
-			m_Edges.emplace_back(Edge{ ev3, ev0 });
+			m_Edges.emplace_back(Edge{ ev[0], ev[1] });
+			m_Edges.emplace_back(Edge{ ev[1], ev[2] });
+			m_Edges.emplace_back(Edge{ ev[2], ev[3] });
+			m_Edges.emplace_back(Edge{ ev[3], ev[0] });
 		}
-
 	}
 
 	// Add terrain obstructions
@@ -689,7 +755,7 @@ WaypointPath VertexPathfinder::ComputeShortPath(const ShortPathRequest& request,
 		u16 i0, j0, i1, j1;
 		Pathfinding::NearestNavcell(rangeXMin, rangeZMin, i0, j0, m_GridSize, m_GridSize);
 		Pathfinding::NearestNavcell(rangeXMax, rangeZMax, i1, j1, m_GridSize, m_GridSize);
-		AddTerrainEdges(m_Edges, m_Vertexes, i0, j0, i1, j1, request.passClass, *m_TerrainOnlyGrid);
+		AddTerrainEdges(m_Edges, m_Vertexes, i0, j0, i1, j1, request.passClass, *m_TerrainOnlyGrid, m_Arena);
 	}
 
 	// Clip out vertices that are inside an edgeSquare (i.e. trivially unreachable)
@@ -888,6 +954,8 @@ WaypointPath VertexPathfinder::ComputeShortPath(const ShortPathRequest& request,
 	m_EdgesBottom.clear();
 	m_EdgesTop.clear();
 
+	m_Arena.Reset();
+
 	return path;
 }
 
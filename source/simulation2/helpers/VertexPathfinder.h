@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -19,10 +19,15 @@
 #define INCLUDED_VERTEXPATHFINDER
 
 #include "graphics/Overlay.h"
+#include "simulation2/components/ICmpObstructionManager.h"
 #include "simulation2/helpers/Pathfinding.h"
 #include "simulation2/system/CmpPtr.h"
+#include "simulation2/system/FrameArena.h"
 
 #include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 // A vertex around the corners of an obstruction
@@ -68,10 +73,76 @@ struct EdgeAA
 	fixed c1;
 };
 
-class ICmpObstructionManager;
 class CSimContext;
 class SceneCollector;
 
+/**
+ * An obstruction square converted into the search graph vertexes and collision edges
+ * of the vertex pathfinder, for a given clearance.
+ */
+struct VertexPathfinderObstruction
+{
+	ICmpObstructionManager::FilterableObstructionSquare square;
+	bool isStatic;
+	bool aa; // Whether the edges are an axis-aligned Square{ edgeVertexes[1], edgeVertexes[3] }.
+	Vertex vertexes[4];
+	CFixedVector2D edgeVertexes[4];
+};
+
+/**
+ * Cache of the obstructions around the short path requests of a turn, shared by all vertex pathfinders.
+ *
+ * Requests with the same clearance whose ranges span the same obstruction subdivision cells
+ * (typically units of a group moving together) get the obstructions of those cells, already
+ * converted into vertexes and edges, from a single query. Each request then selects the obstructions
+ * passing its filter and range test, exactly like ICmpObstructionManager::Get*ObstructionsInRange
+ * would, so the cache doesn't change the computed paths.
+ *
+ * Entries are computed by the first pathfinder needing them, which may be on any thread.
+ * The cache must be cleared whenever the obstructions change, i.e. after each batch of requests.
+ */
+class VertexPathfinderObstructionCache
+{
+public:
+	/**
+	 * Returns the obstructions of the given cells converted for the given clearance.
+	 * Thread-safe, the returned reference is valid until Clear.
+	 */
+	const std::vector<VertexPathfinderObstruction>& Get(const ICmpObstructionManager::ObstructionCells& cells, entity_pos_t clearance, CmpPtr<ICmpObstructionManager> cmpObstructionManager) const;
+
+	void Clear();
+
+	// Number of lookups since the last Clear.
+	u32 GetHits() const { return m_Hits; }
+	u32 GetMisses() const { return m_Misses; }
+
+private:
+	struct Key
+	{
+		ICmpObstructionManager::ObstructionCells cells;
+		entity_pos_t clearance;
+
+		bool operator<(const Key& o) const
+		{
+			if (clearance != o.clearance)
+				return clearance < o.clearance;
+			return cells < o.cells;
+		}
+	};
+
+	struct Entry
+	{
+		std::once_flag computed;
+		std::vector<VertexPathfinderObstruction> obstructions;
+	};
+
+	mutable std::mutex m_Mutex;
+	mutable std::map<Key, std::unique_ptr<Entry>> m_Entries;
+
+	mutable std::atomic<u32> m_Hits = 0;
+	mutable std::atomic<u32> m_Misses = 0;
+};
+
 class VertexPathfinder
 {
 public:
@@ -84,9 +155,17 @@ public:
 	 * The path is based on the full set of obstructions that pass the filter, such that
 	 * a unit of clearance 'clearance' will be able to follow the path with no collisions.
 	 * The path is restricted to a box of radius 'range' from the starting point.
+	 * If @p cache is given, the obstructions are taken from it rather than queried from the obstruction manager.
 	 * Defined in CCmpPathfinder_Vertex.cpp
 	 */
-	WaypointPath ComputeShortPath(const ShortPathRequest& request, CmpPtr<ICmpObstructionManager> cmpObstructionManager) const;
+	WaypointPath ComputeShortPath(const ShortPathRequest& request, CmpPtr<ICmpObstructionManager> cmpObstructionManager,
+		const VertexPathfinderObstructionCache* cache = nullptr) const;
+
+	/**
+	 * Counters of the temporary allocations of ComputeShortPath, see CFrameArena.
+	 */
+	const CFrameArena::Stats& GetArenaStats() const { return m_Arena.GetStats(); }
+	void ResetArenaStats() { m_Arena.ResetStats(); }
 
 private:
 
@@ -110,6 +189,13 @@ private:
 	// (Edges are one-sided so intersections are fine in one direction, but not the other direction.)
 	mutable std::vector<Edge> m_Edges;
 	mutable std::vector<Square> m_EdgeSquares; // Axis-aligned squares; equivalent to 4 edges.
+
+	// Obstructions queried for the current request, when not using a cache.
+	mutable std::vector<VertexPathfinderObstruction> m_Obstructions;
+
+	// Temporaries of the current request; there is one pathfinder per thread,
+	// so the arena is never shared.
+	mutable CFrameArena m_Arena;
 };
 
 /**
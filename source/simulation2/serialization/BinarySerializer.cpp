@@ -335,7 +335,7 @@ void CBinarySerializerScriptImpl::HandleScriptVal(JS::HandleValue val)
 			if (!idstr)
 				throw PSERROR_Serialize_ScriptError("JS_ValueToString failed");
 
-			ScriptString("prop name", idstr);
+			PropertyName(idstr);
 
 			if (!JS_GetPropertyById(rq.cx, obj, id, &propval))
 				throw PSERROR_Serialize_ScriptError("JS_GetPropertyById failed");
@@ -462,6 +462,63 @@ void CBinarySerializerScriptImpl::ScriptString(const char* name, JS::HandleStrin
 	}
 }
 
+void CBinarySerializerScriptImpl::PropertyName(JS::HandleString string)
+{
+	ScriptRequest rq(m_ScriptInterface);
+
+	std::string key;
+	{
+		size_t length;
+		JS::AutoCheckCannotGC nogc;
+		if (JS::StringHasLatin1Chars(string))
+		{
+			const JS::Latin1Char* chars = JS_GetLatin1StringCharsAndLength(rq.cx, nogc, string, &length);
+			if (!chars)
+				throw PSERROR_Serialize_ScriptError("JS_GetLatin1StringCharsAndLength failed");
+			key.reserve(length + 1);
+			key.push_back(1);
+			key.append(reinterpret_cast<const char*>(chars), length);
+		}
+		else
+		{
+			const char16_t* chars = JS_GetTwoByteStringCharsAndLength(rq.cx, nogc, string, &length);
+			if (!chars)
+				throw PSERROR_Serialize_ScriptError("JS_GetTwoByteStringCharsAndLength failed");
+			key.reserve(length * 2 + 1);
+			key.push_back(0);
+			key.append(reinterpret_cast<const char*>(chars), length * 2);
+		}
+	}
+
+	const u32 nextIndex = static_cast<u32>(m_PropertyNames.size()) + 1;
+	const std::pair<std::unordered_map<std::string, u32>::iterator, bool> inserted = m_PropertyNames.emplace(std::move(key), nextIndex);
+	if (!inserted.second)
+	{
+		PropertyNameIndex(inserted.first->second);
+		return;
+	}
+
+	PropertyNameIndex(0);
+	ScriptString("prop name", string);
+}
+
+void CBinarySerializerScriptImpl::PropertyNameIndex(u32 index)
+{
+	// Use a variable-length encoding (7 bits per byte, least significant first),
+	// since there are typically only a few hundred different names
+	while (index >= 0x80)
+	{
+		m_Serializer.NumberU8_Unbounded("prop name index", static_cast<u8>(index | 0x80));
+		index >>= 7;
+	}
+	m_Serializer.NumberU8_Unbounded("prop name index", static_cast<u8>(index));
+}
+
+void CBinarySerializerScriptImpl::ResetPropertyNames()
+{
+	m_PropertyNames.clear();
+}
+
 void CBinarySerializerScriptImpl::Trace(JSTracer *trc, void *data)
 {
 	CBinarySerializerScriptImpl* serializer = static_cast<CBinarySerializerScriptImpl*>(data);
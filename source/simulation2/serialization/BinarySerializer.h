@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -26,6 +26,7 @@
 
 #include <ostream>
 #include <streambuf>
+#include <unordered_map>
 
 /**
  * Wrapper for redirecting ostream writes to CBinarySerializer's impl
@@ -88,9 +89,26 @@ public:
 
 	void ScriptString(const char* name, JS::HandleString string);
 	void HandleScriptVal(JS::HandleValue val);
+
+	/**
+	 * Forgets the property names written so far, so that the following data
+	 * can be read independently of the previous one.
+	 */
+	void ResetPropertyNames();
 private:
 	static void Trace(JSTracer* trc, void* data);
 
+	/**
+	 * Property names are interned per stream: the first occurrence of a name
+	 * writes index 0 followed by the string, later occurrences only write the
+	 * (1-based) index of the name in the order of first occurrence.
+	 */
+	void PropertyName(JS::HandleString string);
+	void PropertyNameIndex(u32 index);
+
+	// Raw characters of the names, prefixed by their isLatin1 flag
+	std::unordered_map<std::string, u32> m_PropertyNames;
+
 	const ScriptInterface& m_ScriptInterface;
 	ISerializer& m_Serializer;
 
@@ -194,7 +212,6 @@ protected:
 
 	virtual void PutString(const char* name, const std::string& value)
 	{
-		// TODO: maybe should intern strings, particularly to save space with script property names
 		PutNumber("string length", (uint32_t)value.length());
 		m_Impl.Put(name, (u8*)value.data(), value.length());
 	}
@@ -214,6 +231,11 @@ protected:
 		return m_RawStream;
 	}
 
+	void ResetScriptPropertyNames()
+	{
+		m_ScriptImpl->ResetPropertyNames();
+	}
+
 protected:
 	T m_Impl;
 
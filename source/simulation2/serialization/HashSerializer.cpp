@@ -1,4 +1,4 @@
-/* Copyright (C) 2017 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -19,28 +19,40 @@
 
 #include "HashSerializer.h"
 
-CHashSerializer::CHashSerializer(const ScriptInterface& scriptInterface) :
-	CBinarySerializer<CHashSerializerImpl>(scriptInterface)
+template<typename HashFunc>
+CHashSerializerBase<HashFunc>::CHashSerializerBase(const ScriptInterface& scriptInterface) :
+	CBinarySerializer<CHashSerializerImpl<HashFunc>>(scriptInterface)
 {
 }
 
-size_t CHashSerializer::GetHashLength()
+template<typename HashFunc>
+size_t CHashSerializerBase<HashFunc>::GetHashLength()
 {
-	return m_Impl.GetHashLength();
+	return this->m_Impl.GetHashLength();
 }
 
-const u8* CHashSerializer::ComputeHash()
+template<typename HashFunc>
+const u8* CHashSerializerBase<HashFunc>::ComputeHash()
 {
-	return m_Impl.ComputeHash();
+	// The next hash must not depend on the property names interned before
+	this->ResetScriptPropertyNames();
+	return this->m_Impl.ComputeHash();
 }
 
-size_t CHashSerializerImpl::GetHashLength()
+template<typename HashFunc>
+size_t CHashSerializerImpl<HashFunc>::GetHashLength()
 {
 	return HashFunc::DIGESTSIZE;
 }
 
-const u8* CHashSerializerImpl::ComputeHash()
+template<typename HashFunc>
+const u8* CHashSerializerImpl<HashFunc>::ComputeHash()
 {
 	m_Hash.Final(m_HashData);
 	return m_HashData;
 }
+
+template class CHashSerializerImpl<MD5>;
+template class CHashSerializerImpl<XXHash64>;
+template class CHashSerializerBase<MD5>;
+template class CHashSerializerBase<XXHash64>;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2017 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,13 +21,15 @@
 #include "BinarySerializer.h"
 
 #include "maths/MD5.h"
+#include "maths/XXHash.h"
 
+/**
+ * Serializer backend which only computes a hash of the serialized data.
+ * HashFunc must provide DIGESTSIZE, Update and Final (e.g. MD5 or XXHash64).
+ */
+template<typename HashFunc>
 class CHashSerializerImpl
 {
-	// We don't care about cryptographic strength, just about detection of
-	// unintended changes and about performance, so MD5 is an adequate choice
-	typedef MD5 HashFunc;
-
 public:
 	size_t GetHashLength();
 	const u8* ComputeHash();
@@ -42,13 +44,26 @@ private:
 	u8 m_HashData[HashFunc::DIGESTSIZE];
 };
 
-class CHashSerializer : public CBinarySerializer<CHashSerializerImpl>
+template<typename HashFunc>
+class CHashSerializerBase : public CBinarySerializer<CHashSerializerImpl<HashFunc>>
 {
 public:
-	CHashSerializer(const ScriptInterface& scriptInterface);
+	CHashSerializerBase(const ScriptInterface& scriptInterface);
 
 	size_t GetHashLength();
+
+	/**
+	 * Returns the hash of everything serialized since the previous call
+	 * (or since construction), and starts a new hash.
+	 */
 	const u8* ComputeHash();
 };
 
+// We don't care about cryptographic strength, just about detection of
+// unintended changes and about performance. MD5 is an adequate choice for
+// hashes that are compared between machines; XXHash64 is several times faster
+// and is preferable for hashes that are only used locally.
+using CHashSerializer = CHashSerializerBase<MD5>;
+using CFastHashSerializer = CHashSerializerBase<XXHash64>;
+
 #endif // INCLUDED_HASHSERIALIZER
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -54,6 +54,8 @@ void CStdDeserializer::TraceMember(JSTracer *trc)
 {
 	for (JS::Heap<JSObject*>& backref : m_ScriptBackrefs)
 		JS::TraceEdge(trc, &backref, "StdDeserializer::m_ScriptBackrefs");
+	for (JS::Heap<jsid>& name : m_PropertyNames)
+		JS::TraceEdge(trc, &name, "StdDeserializer::m_PropertyNames");
 }
 
 void CStdDeserializer::Get(const char* name, u8* data, size_t len)
@@ -204,30 +206,14 @@ JS::Value CStdDeserializer::ReadScriptVal(const char* UNUSED(name), JS::HandleOb
 
 		uint32_t numProps;
 		NumberU32_Unbounded("num props", numProps);
-		bool isLatin1;
+		JS::RootedId propid(rq.cx);
 		for (uint32_t i = 0; i < numProps; ++i)
 		{
-			Bool("isLatin1", isLatin1);
-			if (isLatin1)
-			{
-				std::vector<JS::Latin1Char> propname;
-				ReadStringLatin1("prop name", propname);
-				JS::RootedValue propval(rq.cx, ReadScriptVal("prop value", nullptr));
-
-				std::u16string prp(propname.begin(), propname.end());;
-// TODO: Should ask upstream about getting a variant of JS_SetProperty with a length param.
-				if (!JS_SetUCProperty(rq.cx, obj, (const char16_t*)prp.data(), prp.length(), propval))
-					throw PSERROR_Deserialize_ScriptError();
-			}
-			else
-			{
-				std::u16string propname;
-				ReadStringUTF16("prop name", propname);
-				JS::RootedValue propval(rq.cx, ReadScriptVal("prop value", nullptr));
+			ReadPropertyName(&propid);
+			JS::RootedValue propval(rq.cx, ReadScriptVal("prop value", nullptr));
 
-				if (!JS_SetUCProperty(rq.cx, obj, (const char16_t*)propname.data(), propname.length(), propval))
-					throw PSERROR_Deserialize_ScriptError();
-			}
+			if (!JS_SetPropertyById(rq.cx, obj, propid, propval))
+				throw PSERROR_Deserialize_ScriptError();
 		}
 
 		return JS::ObjectValue(*obj);
@@ -453,6 +439,38 @@ void CStdDeserializer::ReadStringUTF16(const char* name, std::u16string& str)
 	Get(name, (u8*)str.data(), len*2);
 }
 
+void CStdDeserializer::ReadPropertyName(JS::MutableHandleId out)
+{
+	u32 index = 0;
+	for (u32 shift = 0; ; shift += 7)
+	{
+		if (shift > 28)
+			throw PSERROR_Deserialize_OutOfBounds("prop name index");
+
+		u8 byte;
+		NumberU8_Unbounded("prop name index", byte);
+		index |= static_cast<u32>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+
+	if (index != 0)
+	{
+		if (index > m_PropertyNames.size())
+			throw PSERROR_Deserialize_OutOfBounds("prop name index");
+		out.set(m_PropertyNames[index - 1]);
+		return;
+	}
+
+	// First occurrence of this name
+	ScriptRequest rq(m_ScriptInterface);
+	JS::RootedString name(rq.cx);
+	ScriptString("prop name", &name);
+	if (!JS_StringToId(rq.cx, name, out))
+		throw PSERROR_Deserialize_ScriptError("JS_StringToId failed");
+	m_PropertyNames.emplace_back(out.get());
+}
+
 void CStdDeserializer::ScriptString(const char* name, JS::MutableHandleString out)
 {
 #if BYTE_ORDER != LITTLE_ENDIAN
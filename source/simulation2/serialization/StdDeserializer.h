@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -49,6 +49,12 @@ private:
 	void ReadStringLatin1(const char* name, std::vector<JS::Latin1Char>& str);
 	void ReadStringUTF16(const char* name, std::u16string& str);
 
+	/**
+	 * Reads a property name, interned as by CBinarySerializerScriptImpl.
+	 */
+	void ReadPropertyName(JS::MutableHandleId out);
+	std::vector<JS::Heap<jsid>> m_PropertyNames;
+
 	virtual void AddScriptBackref(JS::HandleObject obj);
 	virtual void GetScriptBackref(size_t tag, JS::MutableHandleObject ret);
 	std::vector<JS::Heap<JSObject*> > m_ScriptBackrefs;
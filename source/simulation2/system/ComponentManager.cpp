@@ -33,6 +33,7 @@
 #include "simulation2/system/ParamNode.h"
 #include "simulation2/system/SimContext.h"
 
+#include <algorithm>
 #include <string_view>
 
 /**
@@ -57,10 +58,22 @@ public:
 	JS::PersistentRootedValue msg;
 };
 
+namespace
+{
+/**
+ * Orders the per-type component lists, which are sorted by entity ID.
+ */
+bool ComponentEntityLess(const CComponentManager::InterfacePair& pair, entity_id_t ent)
+{
+	return pair.first < ent;
+}
+} // anonymous namespace
+
 CComponentManager::CComponentManager(CSimContext& context, std::shared_ptr<ScriptContext> cx, bool skipScriptFunctions) :
 	m_NextScriptComponentTypeId(CID__LastNative),
 	m_ScriptInterface("Engine", "Simulation", cx),
-	m_SimContext(context), m_CurrentlyHotloading(false)
+	m_SimContext(context), m_CurrentlyHotloading(false),
+	m_MessageBatchingDepth(0), m_MessageDispatchDepth(0), m_MessageBatchingDispatchDepth(0)
 {
 	context.SetComponentManager(this);
 
@@ -210,7 +223,7 @@ void CComponentManager::Script_RegisterComponentType_Common(int iid, const std::
 		if (ctPrevious.iid != iid)
 		{
 			// ...though it only matters if any components exist with this type
-			if (!m_ComponentsByTypeId[cid].empty())
+			if ((size_t)cid < m_ComponentsByTypeId.size() && !m_ComponentsByTypeId[cid].empty())
 			{
 				ScriptException::Raise(rq, "Hotloading script component type mustn't change interface ID");
 				return;
@@ -218,17 +231,14 @@ void CComponentManager::Script_RegisterComponentType_Common(int iid, const std::
 		}
 
 		// Remove the old component type's message subscriptions
-		std::map<MessageTypeId, std::vector<ComponentTypeId> >::iterator it;
-		for (it = m_LocalMessageSubscriptions.begin(); it != m_LocalMessageSubscriptions.end(); ++it)
+		for (std::vector<ComponentTypeId>& types : m_LocalMessageSubscriptions)
 		{
-			std::vector<ComponentTypeId>& types = it->second;
 			std::vector<ComponentTypeId>::iterator ctit = find(types.begin(), types.end(), cid);
 			if (ctit != types.end())
 				types.erase(ctit);
 		}
-		for (it = m_GlobalMessageSubscriptions.begin(); it != m_GlobalMessageSubscriptions.end(); ++it)
+		for (std::vector<ComponentTypeId>& types : m_GlobalMessageSubscriptions)
 		{
-			std::vector<ComponentTypeId>& types = it->second;
 			std::vector<ComponentTypeId>::iterator ctit = find(types.begin(), types.end(), cid);
 			if (ctit != types.end())
 				types.erase(ctit);
@@ -308,13 +318,12 @@ void CComponentManager::Script_RegisterComponentType_Common(int iid, const std::
 
 	m_CurrentComponent = CID__Invalid;
 
-	if (mustReloadComponents)
+	if (mustReloadComponents && (size_t)cid < m_ComponentsByTypeId.size())
 	{
 		// For every script component with this cid, we need to switch its
 		// prototype from the old constructor's prototype property to the new one's
-		const std::map<entity_id_t, IComponent*>& comps = m_ComponentsByTypeId[cid];
-		std::map<entity_id_t, IComponent*>::const_iterator eit = comps.begin();
-		for (; eit != comps.end(); ++eit)
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			JS::RootedValue instance(rq.cx, eit->second->GetJSInstance());
 			if (!instance.isNull())
@@ -484,14 +493,12 @@ void CComponentManager::ResetState()
 	m_DynamicMessageSubscriptionsNonsyncByComponent.clear();
 
 	// Delete all IComponents in reverse order of creation.
-	std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::reverse_iterator iit = m_ComponentsByTypeId.rbegin();
-	for (; iit != m_ComponentsByTypeId.rend(); ++iit)
+	for (ComponentTypeId cid = (ComponentTypeId)m_ComponentsByTypeId.size() - 1; cid >= 0; --cid)
 	{
-		std::map<entity_id_t, IComponent*>::iterator eit = iit->second.begin();
-		for (; eit != iit->second.end(); ++eit)
+		for (const InterfacePair& pair : m_ComponentsByTypeId[cid])
 		{
-			eit->second->Deinit();
-			m_ComponentTypesById[iit->first].dealloc(eit->second);
+			pair.second->Deinit();
+			m_ComponentTypesById[cid].dealloc(pair.second);
 		}
 	}
 
@@ -509,6 +516,9 @@ void CComponentManager::ResetState()
 	m_SystemEntity = CEntityHandle();
 
 	m_DestructionQueue.clear();
+	m_PositionChangedBatch.clear();
+	m_OwnershipChangedBatch.clear();
+	m_StateDigests.clear();
 
 	// Reset IDs
 	m_NextEntityId = SYSTEM_ENTITY + 1;
@@ -552,6 +562,8 @@ void CComponentManager::SubscribeToMessageType(MessageTypeId mtid)
 {
 	// TODO: verify mtid
 	ENSURE(m_CurrentComponent != CID__Invalid);
+	if ((size_t)mtid >= m_LocalMessageSubscriptions.size())
+		m_LocalMessageSubscriptions.resize(mtid + 1);
 	std::vector<ComponentTypeId>& types = m_LocalMessageSubscriptions[mtid];
 	types.push_back(m_CurrentComponent);
 	std::sort(types.begin(), types.end()); // TODO: just sort once at the end of LoadComponents
@@ -561,11 +573,38 @@ void CComponentManager::SubscribeGloballyToMessageType(MessageTypeId mtid)
 {
 	// TODO: verify mtid
 	ENSURE(m_CurrentComponent != CID__Invalid);
+	if ((size_t)mtid >= m_GlobalMessageSubscriptions.size())
+		m_GlobalMessageSubscriptions.resize(mtid + 1);
 	std::vector<ComponentTypeId>& types = m_GlobalMessageSubscriptions[mtid];
 	types.push_back(m_CurrentComponent);
 	std::sort(types.begin(), types.end()); // TODO: just sort once at the end of LoadComponents
 }
 
+void CComponentManager::SubscribeGloballyToMessageBatches(MessageTypeId mtid)
+{
+	ENSURE(m_CurrentComponent != CID__Invalid);
+	ENSURE(mtid == MT_PositionChanged || mtid == MT_OwnershipChanged);
+	SubscribeGloballyToMessageType(mtid);
+	if ((size_t)mtid >= m_BatchedMessageSubscriptions.size())
+		m_BatchedMessageSubscriptions.resize(mtid + 1);
+	std::vector<ComponentTypeId>& types = m_BatchedMessageSubscriptions[mtid];
+	types.push_back(m_CurrentComponent);
+	std::sort(types.begin(), types.end());
+}
+
+void CComponentManager::BeginMessageBatching()
+{
+	if (m_MessageBatchingDepth++ == 0)
+		m_MessageBatchingDispatchDepth = m_MessageDispatchDepth;
+}
+
+void CComponentManager::EndMessageBatching()
+{
+	ENSURE(m_MessageBatchingDepth > 0);
+	if (--m_MessageBatchingDepth == 0)
+		FlushMessageBatches();
+}
+
 void CComponentManager::FlattenDynamicSubscriptions()
 {
 	std::map<MessageTypeId, CDynamicSubscription>::iterator it;
@@ -737,7 +776,9 @@ IComponent* CComponentManager::ConstructComponent(CEntityHandle ent, ComponentTy
 		return NULL;
 	}
 
-	std::map<entity_id_t, IComponent*>& emap2 = m_ComponentsByTypeId[cid];
+	if ((size_t)cid >= m_ComponentsByTypeId.size())
+		m_ComponentsByTypeId.resize(cid + 1);
+	InterfaceList& emap2 = m_ComponentsByTypeId[cid];
 
 	// If this is a scripted component, construct the appropriate JS object first
 	JS::RootedValue obj(rq.cx);
@@ -761,7 +802,11 @@ IComponent* CComponentManager::ConstructComponent(CEntityHandle ent, ComponentTy
 
 	// Store a reference to the new component
 	emap1.insert(std::make_pair(ent.GetId(), component));
-	emap2.insert(std::make_pair(ent.GetId(), component));
+	// Entity IDs are mostly allocated in increasing order, so this is usually an append.
+	if (emap2.empty() || emap2.back().first < ent.GetId())
+		emap2.emplace_back(ent.GetId(), component);
+	else
+		emap2.insert(std::lower_bound(emap2.begin(), emap2.end(), ent.GetId(), ComponentEntityLess), InterfacePair(ent.GetId(), component));
 	// TODO: We need to more careful about this - if an entity is constructed by a component
 	// while we're iterating over all components, this will invalidate the iterators and everything
 	// will break.
@@ -913,17 +958,18 @@ void CComponentManager::FlushDestroyedComponents()
 			FlattenDynamicSubscriptions();
 
 			// Destroy the components, and remove from m_ComponentsByTypeId:
-			std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::iterator iit = m_ComponentsByTypeId.begin();
-			for (; iit != m_ComponentsByTypeId.end(); ++iit)
+			for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 			{
-				std::map<entity_id_t, IComponent*>::iterator eit = iit->second.find(ent);
-				if (eit != iit->second.end())
+				IComponent* component = FindComponent(m_ComponentsByTypeId[cid], ent);
+				if (component)
 				{
-					eit->second->Deinit();
-					RemoveComponentDynamicSubscriptions(eit->second);
-					m_ComponentTypesById[iit->first].dealloc(eit->second);
-					iit->second.erase(ent);
-					handle.GetComponentCache()->interfaces[m_ComponentTypesById[iit->first].iid] = NULL;
+					component->Deinit();
+					RemoveComponentDynamicSubscriptions(component);
+					m_StateDigests.erase(component);
+					m_ComponentTypesById[cid].dealloc(component);
+					InterfaceList& comps = m_ComponentsByTypeId[cid];
+					comps.erase(std::lower_bound(comps.begin(), comps.end(), ent, ComponentEntityLess));
+					handle.GetComponentCache()->interfaces[m_ComponentTypesById[cid].iid] = NULL;
 				}
 			}
 
@@ -995,87 +1041,89 @@ void CComponentManager::PostMessage(entity_id_t ent, const CMessage& msg)
 {
 	PROFILE2_IFSPIKE("Post Message", 0.0005);
 	PROFILE2_ATTR("%s", msg.GetScriptHandlerName());
+
+	// Batch subscribers must have received every collected message before any other handler runs
+	const bool collected = CanCollectMessage(msg);
+	if (!collected)
+		FlushMessageBatches();
+	++m_MessageDispatchDepth;
+
 	// Send the message to components of ent, that subscribed locally to this message
-	std::map<MessageTypeId, std::vector<ComponentTypeId> >::const_iterator it;
-	it = m_LocalMessageSubscriptions.find(msg.GetType());
-	if (it != m_LocalMessageSubscriptions.end())
+	if ((size_t)msg.GetType() < m_LocalMessageSubscriptions.size())
 	{
-		std::vector<ComponentTypeId>::const_iterator ctit = it->second.begin();
-		for (; ctit != it->second.end(); ++ctit)
+		const std::vector<ComponentTypeId>& types = m_LocalMessageSubscriptions[msg.GetType()];
+		for (size_t i = 0; i < types.size(); ++i)
 		{
-			// Find the component instances of this type (if any)
-			std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator emap = m_ComponentsByTypeId.find(*ctit);
-			if (emap == m_ComponentsByTypeId.end())
+			// Find the component instance of this type (if any)
+			if ((size_t)types[i] >= m_ComponentsByTypeId.size())
 				continue;
 
-			// Send the message to all of them
-			std::map<entity_id_t, IComponent*>::const_iterator eit = emap->second.find(ent);
-			if (eit != emap->second.end())
-				eit->second->HandleMessage(msg, false);
+			IComponent* component = FindComponent(m_ComponentsByTypeId[types[i]], ent);
+			if (component)
+				component->HandleMessage(msg, false);
 		}
 	}
 
-	SendGlobalMessage(ent, msg);
+	// Collect the message only once the local handlers have run, so that scripts among them
+	// see the batch subscribers in the same state as if the message wasn't batched.
+	if (collected)
+		CollectMessage(msg);
+	SendGlobalMessage(ent, msg, collected);
+	--m_MessageDispatchDepth;
 }
 
 void CComponentManager::BroadcastMessage(const CMessage& msg)
 {
+	const bool collected = CanCollectMessage(msg);
+	if (!collected)
+		FlushMessageBatches();
+	++m_MessageDispatchDepth;
+
 	// Send the message to components of all entities that subscribed locally to this message
-	std::map<MessageTypeId, std::vector<ComponentTypeId> >::const_iterator it;
-	it = m_LocalMessageSubscriptions.find(msg.GetType());
-	if (it != m_LocalMessageSubscriptions.end())
+	if ((size_t)msg.GetType() < m_LocalMessageSubscriptions.size())
 	{
-		std::vector<ComponentTypeId>::const_iterator ctit = it->second.begin();
-		for (; ctit != it->second.end(); ++ctit)
-		{
-			// Find the component instances of this type (if any)
-			std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator emap = m_ComponentsByTypeId.find(*ctit);
-			if (emap == m_ComponentsByTypeId.end())
-				continue;
-
-			// Send the message to all of them
-			std::map<entity_id_t, IComponent*>::const_iterator eit = emap->second.begin();
-			for (; eit != emap->second.end(); ++eit)
-				eit->second->HandleMessage(msg, false);
-		}
+		const std::vector<ComponentTypeId>& types = m_LocalMessageSubscriptions[msg.GetType()];
+		for (size_t i = 0; i < types.size(); ++i)
+			SendMessageToComponentType(types[i], msg, false);
 	}
 
-	SendGlobalMessage(INVALID_ENTITY, msg);
+	if (collected)
+		CollectMessage(msg);
+	SendGlobalMessage(INVALID_ENTITY, msg, collected);
+	--m_MessageDispatchDepth;
 }
 
-void CComponentManager::SendGlobalMessage(entity_id_t ent, const CMessage& msg)
+void CComponentManager::SendGlobalMessage(entity_id_t ent, const CMessage& msg, bool collected)
 {
 	PROFILE2_IFSPIKE("SendGlobalMessage", 0.001);
 	PROFILE2_ATTR("%s", msg.GetScriptHandlerName());
 	// (Common functionality for PostMessage and BroadcastMessage)
 
 	// Send the message to components of all entities that subscribed globally to this message
-	std::map<MessageTypeId, std::vector<ComponentTypeId> >::const_iterator it;
-	it = m_GlobalMessageSubscriptions.find(msg.GetType());
-	if (it != m_GlobalMessageSubscriptions.end())
+	if ((size_t)msg.GetType() < m_GlobalMessageSubscriptions.size())
 	{
-		std::vector<ComponentTypeId>::const_iterator ctit = it->second.begin();
-		for (; ctit != it->second.end(); ++ctit)
+		const std::vector<ComponentTypeId>& types = m_GlobalMessageSubscriptions[msg.GetType()];
+		for (size_t i = 0; i < types.size(); ++i)
 		{
 			// Special case: Messages for local entities shouldn't be sent to script
 			// components that subscribed globally, so that we don't have to worry about
 			// them accidentally picking up non-network-synchronised data.
 			if (ENTITY_IS_LOCAL(ent))
 			{
-				std::map<ComponentTypeId, ComponentType>::const_iterator cit = m_ComponentTypesById.find(*ctit);
+				std::map<ComponentTypeId, ComponentType>::const_iterator cit = m_ComponentTypesById.find(types[i]);
 				if (cit != m_ComponentTypesById.end() && cit->second.type == CT_Script)
 					continue;
 			}
 
-			// Find the component instances of this type (if any)
-			std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator emap = m_ComponentsByTypeId.find(*ctit);
-			if (emap == m_ComponentsByTypeId.end())
+			// Batch subscribers get collected messages later, and the others straight away
+			if (IsBatchSubscriber(msg.GetType(), types[i]))
+			{
+				if (!collected)
+					SendMessageBatch(types[i], msg);
 				continue;
+			}
 
-			// Send the message to all of them
-			std::map<entity_id_t, IComponent*>::const_iterator eit = emap->second.begin();
-			for (; eit != emap->second.end(); ++eit)
-				eit->second->HandleMessage(msg, true);
+			SendMessageToComponentType(types[i], msg, true);
 		}
 	}
 
@@ -1090,6 +1138,127 @@ void CComponentManager::SendGlobalMessage(entity_id_t ent, const CMessage& msg)
 	}
 }
 
+template<typename Func>
+void CComponentManager::ForEachComponentOfType(ComponentTypeId cid, const Func& func)
+{
+	if ((size_t)cid >= m_ComponentsByTypeId.size())
+		return;
+
+	// Index the list afresh after each call: it may construct or destroy components,
+	// which can reallocate the list or shift its elements.
+	size_t i = 0;
+	while (i < m_ComponentsByTypeId[cid].size())
+	{
+		const entity_id_t ent = m_ComponentsByTypeId[cid][i].first;
+		func(m_ComponentsByTypeId[cid][i].second);
+
+		// Carry on from the first entity after this one, as a std::map iterator would.
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+		if (i < comps.size() && comps[i].first == ent)
+			++i;
+		else
+			i = std::upper_bound(comps.begin(), comps.end(), ent,
+				[](entity_id_t id, const InterfacePair& pair) { return id < pair.first; }) - comps.begin();
+	}
+}
+
+void CComponentManager::SendMessageToComponentType(ComponentTypeId cid, const CMessage& msg, bool global)
+{
+	ForEachComponentOfType(cid, [&msg, global](IComponent* component) {
+		component->HandleMessage(msg, global);
+	});
+}
+
+bool CComponentManager::CanCollectMessage(const CMessage& msg) const
+{
+	// Only collect the messages posted by the caller of BeginMessageBatching, not by the handlers it triggers.
+	return m_MessageBatchingDepth > 0 && m_MessageDispatchDepth == m_MessageBatchingDispatchDepth &&
+		(size_t)msg.GetType() < m_BatchedMessageSubscriptions.size() &&
+		!m_BatchedMessageSubscriptions[msg.GetType()].empty();
+}
+
+bool CComponentManager::IsBatchSubscriber(MessageTypeId mtid, ComponentTypeId cid) const
+{
+	return (size_t)mtid < m_BatchedMessageSubscriptions.size() &&
+		std::binary_search(m_BatchedMessageSubscriptions[mtid].begin(), m_BatchedMessageSubscriptions[mtid].end(), cid);
+}
+
+void CComponentManager::SendMessageBatch(ComponentTypeId cid, const CMessage& msg)
+{
+	switch (msg.GetType())
+	{
+	case MT_PositionChanged:
+	{
+		PS::span<const CMessagePositionChanged> msgs(&static_cast<const CMessagePositionChanged&>(msg), 1);
+		ForEachComponentOfType(cid, [msgs](IComponent* component) { component->HandleMessageBatch(msgs); });
+		break;
+	}
+	case MT_OwnershipChanged:
+	{
+		PS::span<const CMessageOwnershipChanged> msgs(&static_cast<const CMessageOwnershipChanged&>(msg), 1);
+		ForEachComponentOfType(cid, [msgs](IComponent* component) { component->HandleMessageBatch(msgs); });
+		break;
+	}
+	default:
+		debug_warn(L"Message type can't be batched");
+	}
+}
+
+void CComponentManager::CollectMessage(const CMessage& msg)
+{
+	switch (msg.GetType())
+	{
+	case MT_PositionChanged:
+		FlushMessageBatch(m_OwnershipChangedBatch);
+		m_PositionChangedBatch.push_back(static_cast<const CMessagePositionChanged&>(msg));
+		break;
+	case MT_OwnershipChanged:
+		FlushMessageBatch(m_PositionChangedBatch);
+		m_OwnershipChangedBatch.push_back(static_cast<const CMessageOwnershipChanged&>(msg));
+		break;
+	default:
+		debug_warn(L"Message type can't be batched");
+	}
+}
+
+void CComponentManager::FlushMessageBatches()
+{
+	// At most one of them is non-empty.
+	FlushMessageBatch(m_PositionChangedBatch);
+	FlushMessageBatch(m_OwnershipChangedBatch);
+}
+
+template<typename T>
+void CComponentManager::FlushMessageBatch(std::vector<T>& batch)
+{
+	if (batch.empty())
+		return;
+
+	PROFILE2("Flush Message Batch");
+	PROFILE2_ATTR("%s: %zu", batch.front().GetScriptHandlerName(), batch.size());
+
+	std::vector<T> msgs;
+	msgs.swap(batch);
+
+	++m_MessageDispatchDepth;
+	const PS::span<const T> span(msgs.data(), msgs.size());
+	for (ComponentTypeId cid : m_BatchedMessageSubscriptions[msgs.front().GetType()])
+		ForEachComponentOfType(cid, [span](IComponent* component) { component->HandleMessageBatch(span); });
+	--m_MessageDispatchDepth;
+
+	// Keep the memory for the next batch.
+	msgs.clear();
+	batch.swap(msgs);
+}
+
+IComponent* CComponentManager::FindComponent(const InterfaceList& components, entity_id_t ent)
+{
+	InterfaceList::const_iterator it = std::lower_bound(components.begin(), components.end(), ent, ComponentEntityLess);
+	if (it == components.end() || it->first != ent)
+		return NULL;
+	return it->second;
+}
+
 std::string CComponentManager::GenerateSchema() const
 {
 	std::string schema =
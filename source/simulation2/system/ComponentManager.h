@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -18,6 +18,7 @@
 #ifndef INCLUDED_COMPONENTMANAGER
 #define INCLUDED_COMPONENTMANAGER
 
+#include "maths/XXHash.h"
 #include "ps/Filesystem.h"
 #include "scriptinterface/ScriptInterface.h"
 #include "simulation2/helpers/Player.h"
@@ -35,6 +36,8 @@ class CParamNode;
 class CMessage;
 class CSimContext;
 class CDynamicSubscription;
+class CMessageOwnershipChanged;
+class CMessagePositionChanged;
 
 class CComponentManager
 {
@@ -110,6 +113,37 @@ public:
 	 */
 	void SubscribeGloballyToMessageType(MessageTypeId mtid);
 
+	/**
+	 * Subscribe the current component type globally to the given message type, like
+	 * SubscribeGloballyToMessageType, but receiving the messages through HandleMessageBatch.
+	 * Messages posted within a BeginMessageBatching/EndMessageBatching scope are collected
+	 * into a contiguous buffer and delivered together; other ones are delivered one at a time.
+	 * Only MT_PositionChanged and MT_OwnershipChanged can be batched.
+	 * Must only be called by a native component type's ClassInit.
+	 */
+	void SubscribeGloballyToMessageBatches(MessageTypeId mtid);
+
+	/**
+	 * Start collecting batchable messages (see SubscribeGloballyToMessageBatches) posted
+	 * by the caller, until the matching EndMessageBatching. Scopes can be nested.
+	 *
+	 * Only messages posted directly by the caller are collected, not those posted by the
+	 * message handlers it triggers. A collected message is still sent at once to its other
+	 * handlers, script ones included. Collected messages are delivered before any other message
+	 * is sent, and before any script calls a native component method, so that batch subscribers
+	 * are up to date whenever scripts or the handlers of other messages look at them.
+	 * Native handlers of a collected message, and the caller itself, must not rely on batch
+	 * subscribers having seen the collected messages.
+	 */
+	void BeginMessageBatching();
+	void EndMessageBatching();
+
+	/**
+	 * Deliver the messages collected so far to the batch subscribers.
+	 * Called before scripts call native component methods.
+	 */
+	void FlushMessageBatches();
+
 	/**
 	 * Subscribe the given component instance to all messages of the given message type.
 	 * The component's HandleMessage will be called on any BroadcastMessage or PostMessage of
@@ -289,7 +323,32 @@ private:
 	const CParamNode& Script_GetTemplate(const std::string& templateName);
 
 	CMessage* ConstructMessage(int mtid, JS::HandleValue data);
-	void SendGlobalMessage(entity_id_t ent, const CMessage& msg);
+	void SendGlobalMessage(entity_id_t ent, const CMessage& msg, bool collected);
+
+	bool CanCollectMessage(const CMessage& msg) const;
+	bool IsBatchSubscriber(MessageTypeId mtid, ComponentTypeId cid) const;
+	void SendMessageBatch(ComponentTypeId cid, const CMessage& msg);
+	void CollectMessage(const CMessage& msg);
+	template<typename T>
+	void FlushMessageBatch(std::vector<T>& batch);
+
+	/**
+	 * Call @p func on every component of the given type, in increasing entity ID order.
+	 * Components may be added or removed by @p func while this runs.
+	 */
+	template<typename Func>
+	void ForEachComponentOfType(ComponentTypeId cid, const Func& func);
+
+	/**
+	 * Send a message to every component of the given type, in increasing entity ID order.
+	 * Components may be added or removed by the message handlers while this runs.
+	 */
+	void SendMessageToComponentType(ComponentTypeId cid, const CMessage& msg, bool global);
+
+	/**
+	 * Returns the component of the given entity in a list sorted by entity ID, or NULL.
+	 */
+	static IComponent* FindComponent(const InterfaceList& components, entity_id_t ent);
 
 	void FlattenDynamicSubscriptions();
 	void RemoveComponentDynamicSubscriptions(IComponent* component);
@@ -310,9 +369,10 @@ private:
 	std::map<ComponentTypeId, ComponentType> m_ComponentTypesById;
 	std::vector<CComponentManager::ComponentTypeId> m_ScriptedSystemComponents;
 	std::vector<std::unordered_map<entity_id_t, IComponent*> > m_ComponentsByInterface; // indexed by InterfaceId
-	std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> > m_ComponentsByTypeId;
-	std::map<MessageTypeId, std::vector<ComponentTypeId> > m_LocalMessageSubscriptions;
-	std::map<MessageTypeId, std::vector<ComponentTypeId> > m_GlobalMessageSubscriptions;
+	std::vector<InterfaceList> m_ComponentsByTypeId; // indexed by ComponentTypeId, each sorted by entity ID
+	std::vector<std::vector<ComponentTypeId> > m_LocalMessageSubscriptions; // indexed by MessageTypeId
+	std::vector<std::vector<ComponentTypeId> > m_GlobalMessageSubscriptions; // indexed by MessageTypeId
+	std::vector<std::vector<ComponentTypeId> > m_BatchedMessageSubscriptions; // indexed by MessageTypeId, subset of the global ones
 	std::map<std::string, ComponentTypeId> m_ComponentTypeIdsByName;
 	std::map<std::string, MessageTypeId> m_MessageTypeIdsByName;
 	std::map<MessageTypeId, std::string> m_MessageTypeNamesById;
@@ -328,6 +388,23 @@ private:
 
 	std::vector<entity_id_t> m_DestructionQueue;
 
+	// Messages collected for batch subscribers; at most one of these is non-empty at a time,
+	// so that the batches are delivered in posting order.
+	std::vector<CMessagePositionChanged> m_PositionChangedBatch;
+	std::vector<CMessageOwnershipChanged> m_OwnershipChangedBatch;
+	int m_MessageBatchingDepth;
+	int m_MessageDispatchDepth;
+	int m_MessageBatchingDispatchDepth; // dispatch depth of the outermost BeginMessageBatching
+
+	// Hashes of the last serialized state of the components which track their state version
+	// (see IComponent::GetStateVersion), so that ComputeStateHash can skip unchanged components.
+	struct StateDigest
+	{
+		u32 version;
+		u8 digest[XXHash64::DIGESTSIZE];
+	};
+	mutable std::unordered_map<const IComponent*, StateDigest> m_StateDigests;
+
 	ComponentTypeId m_NextScriptComponentTypeId;
 	entity_id_t m_NextEntityId;
 	entity_id_t m_NextLocalEntityId;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -58,13 +58,12 @@ bool CComponentManager::DumpDebugState(std::ostream& stream, bool includeDebugIn
 	std::map<entity_id_t, std::map<ComponentTypeId, IComponent*> > components;
 	//std::map<ComponentTypeId, std::string> names;
 
-	std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator ctit = m_ComponentsByTypeId.begin();
-	for (; ctit != m_ComponentsByTypeId.end(); ++ctit)
+	for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 	{
-		std::map<entity_id_t, IComponent*>::const_iterator eit = ctit->second.begin();
-		for (; eit != ctit->second.end(); ++eit)
+		InterfaceList::const_iterator eit = m_ComponentsByTypeId[cid].begin();
+		for (; eit != m_ComponentsByTypeId[cid].end(); ++eit)
 		{
-			components[eit->first][ctit->first] = eit->second;
+			components[eit->first][cid] = eit->second;
 		}
 	}
 
@@ -104,21 +103,27 @@ bool CComponentManager::ComputeStateHash(std::string& outHash, bool quick) const
 	// be fast enough to run every turn but will typically detect any
 	// out-of-syncs fairly soon
 
+	// Components that track their state version are hashed on their own,
+	// and only the hash of their state is included, so that it can be reused
+	// until their state changes
+
 	CHashSerializer serializer(m_ScriptInterface);
+	CFastHashSerializer digestSerializer(m_ScriptInterface);
 
 	serializer.StringASCII("rng", SerializeRNG(m_RNG), 0, 32);
 	serializer.NumberU32_Unbounded("next entity id", m_NextEntityId);
 
-	std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator cit = m_ComponentsByTypeId.begin();
-	for (; cit != m_ComponentsByTypeId.end(); ++cit)
+	for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 	{
 		// In quick mode, only check unit positions
-		if (quick && !(cit->first == CID_Position))
+		if (quick && !(cid == CID_Position))
 			continue;
 
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+
 		// Only emit component types if they have a component that will be serialized
 		bool needsSerialization = false;
-		for (std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.begin(); eit != cit->second.end(); ++eit)
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			// Don't serialize local entities
 			if (ENTITY_IS_LOCAL(eit->first))
@@ -131,16 +136,32 @@ bool CComponentManager::ComputeStateHash(std::string& outHash, bool quick) const
 		if (!needsSerialization)
 			continue;
 
-		serializer.NumberI32_Unbounded("component type id", cit->first);
+		serializer.NumberI32_Unbounded("component type id", cid);
 
-		for (std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.begin(); eit != cit->second.end(); ++eit)
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			// Don't serialize local entities
 			if (ENTITY_IS_LOCAL(eit->first))
 				continue;
 
 			serializer.NumberU32_Unbounded("entity id", eit->first);
-			eit->second->Serialize(serializer);
+
+			const u32 version = eit->second->GetStateVersion();
+			if (version == 0)
+			{
+				eit->second->Serialize(serializer);
+				continue;
+			}
+
+			// Only rehash the component if its state changed since the last time
+			StateDigest& stateDigest = m_StateDigests[eit->second];
+			if (stateDigest.version != version)
+			{
+				eit->second->Serialize(digestSerializer);
+				memcpy(stateDigest.digest, digestSerializer.ComputeHash(), sizeof(stateDigest.digest));
+				stateDigest.version = version;
+			}
+			serializer.RawBytes("state digest", stateDigest.digest, sizeof(stateDigest.digest));
 		}
 	}
 
@@ -189,18 +210,18 @@ bool CComponentManager::SerializeState(std::ostream& stream) const
 	serializer.StringASCII("rng", SerializeRNG(m_RNG), 0, 32);
 	serializer.NumberU32_Unbounded("next entity id", m_NextEntityId);
 
-	std::map<ComponentTypeId, std::map<entity_id_t, IComponent*> >::const_iterator cit;
-
 	uint32_t numSystemComponentTypes = 0;
 	uint32_t numComponentTypes = 0;
 	std::set<ComponentTypeId> serializedSystemComponentTypes;
 	std::set<ComponentTypeId> serializedComponentTypes;
 
-	for (cit = m_ComponentsByTypeId.begin(); cit != m_ComponentsByTypeId.end(); ++cit)
+	for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 	{
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+
 		// Only emit component types if they have a component that will be serialized
 		bool needsSerialization = false;
-		for (std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.begin(); eit != cit->second.end(); ++eit)
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			// Don't serialize local entities, and handle SYSTEM_ENTITY separately
 			if (ENTITY_IS_LOCAL(eit->first) || eit->first == SYSTEM_ENTITY)
@@ -213,24 +234,26 @@ bool CComponentManager::SerializeState(std::ostream& stream) const
 		if (needsSerialization)
 		{
 			numComponentTypes++;
-			serializedComponentTypes.insert(cit->first);
+			serializedComponentTypes.insert(cid);
 		}
 
-		if (cit->second.find(SYSTEM_ENTITY) != cit->second.end())
+		if (FindComponent(comps, SYSTEM_ENTITY))
 		{
 			numSystemComponentTypes++;
-			serializedSystemComponentTypes.insert(cit->first);
+			serializedSystemComponentTypes.insert(cid);
 		}
 	}
 
 	serializer.NumberU32_Unbounded("num system component types", numSystemComponentTypes);
 
-	for (cit = m_ComponentsByTypeId.begin(); cit != m_ComponentsByTypeId.end(); ++cit)
+	for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 	{
-		if (serializedSystemComponentTypes.find(cit->first) == serializedSystemComponentTypes.end())
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+
+		if (serializedSystemComponentTypes.find(cid) == serializedSystemComponentTypes.end())
 			continue;
 
-		std::map<ComponentTypeId, ComponentType>::const_iterator ctit = m_ComponentTypesById.find(cit->first);
+		std::map<ComponentTypeId, ComponentType>::const_iterator ctit = m_ComponentTypesById.find(cid);
 		if (ctit == m_ComponentTypesById.end())
 		{
 			debug_warn(L"Invalid ctit"); // this should never happen
@@ -239,23 +262,25 @@ bool CComponentManager::SerializeState(std::ostream& stream) const
 
 		serializer.StringASCII("name", ctit->second.name, 0, 255);
 
-		std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.find(SYSTEM_ENTITY);
-		if (eit == cit->second.end())
+		IComponent* component = FindComponent(comps, SYSTEM_ENTITY);
+		if (!component)
 		{
-			debug_warn(L"Invalid eit"); // this should never happen
+			debug_warn(L"Invalid component"); // this should never happen
 			return false;
 		}
-		eit->second->Serialize(serializer);
+		component->Serialize(serializer);
 	}
 
 	serializer.NumberU32_Unbounded("num component types", numComponentTypes);
 
-	for (cit = m_ComponentsByTypeId.begin(); cit != m_ComponentsByTypeId.end(); ++cit)
+	for (ComponentTypeId cid = 0; cid < (ComponentTypeId)m_ComponentsByTypeId.size(); ++cid)
 	{
-		if (serializedComponentTypes.find(cit->first) == serializedComponentTypes.end())
+		const InterfaceList& comps = m_ComponentsByTypeId[cid];
+
+		if (serializedComponentTypes.find(cid) == serializedComponentTypes.end())
 			continue;
 
-		std::map<ComponentTypeId, ComponentType>::const_iterator ctit = m_ComponentTypesById.find(cit->first);
+		std::map<ComponentTypeId, ComponentType>::const_iterator ctit = m_ComponentTypesById.find(cid);
 		if (ctit == m_ComponentTypesById.end())
 		{
 			debug_warn(L"Invalid ctit"); // this should never happen
@@ -266,7 +291,7 @@ bool CComponentManager::SerializeState(std::ostream& stream) const
 
 		// Count the components before serializing any of them
 		uint32_t numComponents = 0;
-		for (std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.begin(); eit != cit->second.end(); ++eit)
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			// Don't serialize local entities or SYSTEM_ENTITY
 			if (ENTITY_IS_LOCAL(eit->first) || eit->first == SYSTEM_ENTITY)
@@ -279,7 +304,7 @@ bool CComponentManager::SerializeState(std::ostream& stream) const
 		serializer.NumberU32_Unbounded("num components", numComponents);
 
 		// Serialize the components now
-		for (std::map<entity_id_t, IComponent*>::const_iterator eit = cit->second.begin(); eit != cit->second.end(); ++eit)
+		for (InterfaceList::const_iterator eit = comps.begin(); eit != comps.end(); ++eit)
 		{
 			// Don't serialize local entities or SYSTEM_ENTITY
 			if (ENTITY_IS_LOCAL(eit->first) || eit->first == SYSTEM_ENTITY)
@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -71,6 +71,11 @@ public:
 		return m_Context;
 	}
 
+	CComponentManager& GetComponentManager()
+	{
+		return m_ComponentManager;
+	}
+
 	/**
 	 * Call this once to initialise the test helper with a component.
 	 */
@@ -0,0 +1,55 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "precompiled.h"
+
+#include "FrameArena.h"
+
+#include <cstdlib>
+#include <new>
+
+void* CFrameArena::allocate(size_t n, const void* hint, size_t alignment)
+{
+	++m_Stats.allocations;
+	m_Stats.bytes += n;
+
+	if (n > MAX_ARENA_ALLOCATION)
+	{
+		ENSURE(alignment <= alignof(std::max_align_t));
+		++m_Stats.heapAllocations;
+		void* p = std::malloc(n);
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	const size_t numberOfBlocks = m_Arena.GetNumberOfBlocks();
+	void* p = m_Arena.allocate(n, hint, alignment);
+	m_Stats.heapAllocations += m_Arena.GetNumberOfBlocks() - numberOfBlocks;
+	return p;
+}
+
+void CFrameArena::deallocate(void* p, size_t n)
+{
+	if (n > MAX_ARENA_ALLOCATION)
+		std::free(p);
+}
+
+void CFrameArena::Reset()
+{
+	m_Arena.Rewind();
+}
@@ -0,0 +1,86 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_FRAMEARENA
+#define INCLUDED_FRAMEARENA
+
+#include "lib/allocators/DynamicArena.h"
+#include "lib/allocators/STLAllocators.h"
+
+#include <vector>
+
+/**
+ * Bump allocator for the short-lived containers built by the simulation code.
+ * Deallocation is a no-op: the memory is reclaimed all at once by Reset, which keeps
+ * the blocks for the next allocations so that a warm arena doesn't touch the heap.
+ *
+ * The arena of CSimContext is reset at the end of each turn by CSimulation2, so containers
+ * allocated from it must not outlive the turn (and it may only be used from the main thread).
+ * An arena isn't thread-safe: code running on worker threads should own one arena
+ * per worker and reset it itself (see e.g. VertexPathfinder).
+ *
+ * Usage:
+ *   CFrameArena::Vector<entity_id_t> ents(GetSimContext().GetFrameArena());
+ */
+class CFrameArena
+{
+	NONCOPYABLE(CFrameArena);
+public:
+	template<typename T>
+	using Allocator = ProxyAllocator<T, CFrameArena>;
+
+	template<typename T>
+	using Vector = std::vector<T, Allocator<T>>;
+
+	struct Stats
+	{
+		// Number of allocations served, i.e. heap calls that would have been made otherwise.
+		u32 allocations = 0;
+		// Number of heap calls actually made, for new blocks and large allocations.
+		u32 heapAllocations = 0;
+		size_t bytes = 0;
+	};
+
+	CFrameArena() = default;
+
+	void* allocate(size_t n, const void* hint, size_t alignment);
+	void deallocate(void* p, size_t n);
+
+	/**
+	 * Makes all the memory available again. All the containers allocated
+	 * from the arena must have been destroyed.
+	 */
+	void Reset();
+
+	/**
+	 * Counters since the last call to ResetStats (they aren't reset by Reset).
+	 */
+	const Stats& GetStats() const { return m_Stats; }
+	void ResetStats() { m_Stats = Stats(); }
+
+private:
+	static constexpr size_t BLOCK_SIZE = 256 * KiB;
+
+	// Larger allocations are forwarded to the heap (and freed by deallocate),
+	// so that growing vectors don't waste most of the blocks.
+	static constexpr size_t MAX_ARENA_ALLOCATION = BLOCK_SIZE / 4;
+
+	Allocators::DynamicArena<BLOCK_SIZE> m_Arena;
+	Stats m_Stats;
+};
+
+#endif // INCLUDED_FRAMEARENA
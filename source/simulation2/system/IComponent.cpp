@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -19,6 +19,7 @@
 
 #include "IComponent.h"
 
+#include "simulation2/MessageTypes.h"
 #include "simulation2/system/ComponentManager.h"
 
 #include <string>
@@ -47,6 +48,18 @@ void IComponent::HandleMessage(const CMessage& UNUSED(msg), bool UNUSED(global))
 {
 }
 
+void IComponent::HandleMessageBatch(PS::span<const CMessagePositionChanged> msgs)
+{
+	for (const CMessagePositionChanged& msg : msgs)
+		HandleMessage(msg, true);
+}
+
+void IComponent::HandleMessageBatch(PS::span<const CMessageOwnershipChanged> msgs)
+{
+	for (const CMessageOwnershipChanged& msg : msgs)
+		HandleMessage(msg, true);
+}
+
 bool IComponent::NewJSObject(const ScriptInterface& UNUSED(scriptInterface), JS::MutableHandleObject UNUSED(out)) const
 {
 	return false;
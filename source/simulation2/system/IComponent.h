@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -22,10 +22,13 @@
 #include "Message.h"
 #include "Entity.h"
 #include "SimContext.h"
+#include "ps/containers/Span.h"
 #include "scriptinterface/ScriptForward.h"
 
 class CParamNode;
 class CMessage;
+class CMessageOwnershipChanged;
+class CMessagePositionChanged;
 class ISerializer;
 class IDeserializer;
 
@@ -48,6 +51,14 @@ public:
 
 	virtual void HandleMessage(const CMessage& msg, bool global);
 
+	/**
+	 * Handle a batch of global messages, in posting order, for component types that
+	 * subscribed with CComponentManager::SubscribeGloballyToMessageBatches.
+	 * By default each message is passed to HandleMessage.
+	 */
+	virtual void HandleMessageBatch(PS::span<const CMessagePositionChanged> msgs);
+	virtual void HandleMessageBatch(PS::span<const CMessageOwnershipChanged> msgs);
+
 	CEntityHandle GetEntityHandle() const { return m_EntityHandle; }
 	void SetEntityHandle(CEntityHandle ent) { m_EntityHandle = ent; }
 
@@ -62,6 +73,13 @@ public:
 	virtual void Serialize(ISerializer& serialize) = 0;
 	virtual void Deserialize(const CParamNode& paramNode, IDeserializer& deserialize) = 0;
 
+	/**
+	 * Returns a counter which changes whenever the state written by Serialize changes,
+	 * so that CComponentManager::ComputeStateHash can reuse the hash of unchanged components.
+	 * Returns 0 by default, meaning the component doesn't track its changes and is always hashed.
+	 */
+	virtual u32 GetStateVersion() const { return 0; }
+
 	/**
 	 * Returns false by default, indicating that a scripted wrapper of this IComponent is not supported.
 	 * Derrived classes should return true if they implement such a wrapper.
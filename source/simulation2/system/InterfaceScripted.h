@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -21,6 +21,7 @@
 #include "scriptinterface/FunctionWrapper.h"
 #include "scriptinterface/ScriptConversions.h"
 #include "scriptinterface/ScriptInterface.h"
+#include "simulation2/system/ComponentManager.h"
 
 #define BEGIN_INTERFACE_WRAPPER(iname) \
 	JSClass class_ICmp##iname = { \
@@ -46,6 +47,8 @@
 template <typename T, JSClass* jsClass>
 inline T* ComponentGetter(const ScriptRequest& rq, JS::CallArgs& args)
 {
+	// Scripts must see the batch subscribers up to date (see CComponentManager::BeginMessageBatching).
+	ScriptInterface::ObjectFromCBData<CComponentManager>(rq)->FlushMessageBatches();
 	return ScriptInterface::GetPrivate<T>(rq, args, jsClass);
 }
 
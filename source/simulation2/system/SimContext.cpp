@@ -1,4 +1,4 @@
-/* Copyright (C) 2016 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,11 +20,13 @@
 #include "SimContext.h"
 
 #include "ComponentManager.h"
+#include "FrameArena.h"
 
 #include "ps/Game.h"
 
 CSimContext::CSimContext() :
-	m_ComponentManager(NULL), m_UnitManager(NULL), m_Terrain(NULL)
+	m_ComponentManager(NULL), m_UnitManager(NULL), m_Terrain(NULL),
+	m_FrameArena(std::make_unique<CFrameArena>())
 {
 }
 
@@ -65,6 +67,11 @@ ScriptInterface& CSimContext::GetScriptInterface() const
 	return GetComponentManager().GetScriptInterface();
 }
 
+CFrameArena& CSimContext::GetFrameArena() const
+{
+	return *m_FrameArena;
+}
+
 int CSimContext::GetCurrentDisplayedPlayer() const
 {
 	return g_Game ? g_Game->GetViewedPlayerID() : -1;
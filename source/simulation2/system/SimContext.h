@@ -1,4 +1,4 @@
-/* Copyright (C) 2016 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -20,7 +20,10 @@
 
 #include "Entity.h"
 
+#include <memory>
+
 class CComponentManager;
+class CFrameArena;
 class CUnitManager;
 class CTerrain;
 class ScriptInterface;
@@ -45,6 +48,12 @@ public:
 
 	ScriptInterface& GetScriptInterface() const;
 
+	/**
+	 * Returns the arena for temporary containers of the main thread.
+	 * It is reset at the end of each turn (see CFrameArena).
+	 */
+	CFrameArena& GetFrameArena() const;
+
 	void SetSystemEntity(CEntityHandle ent) { m_SystemEntity = ent; }
 	CEntityHandle GetSystemEntity() const { ASSERT(m_SystemEntity.GetId() == SYSTEM_ENTITY); return m_SystemEntity; }
 
@@ -59,6 +68,8 @@ private:
 	CUnitManager* m_UnitManager;
 	CTerrain* m_Terrain;
 
+	std::unique_ptr<CFrameArena> m_FrameArena;
+
 	CEntityHandle m_SystemEntity;
 
 	friend class CSimulation2Impl;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -23,9 +23,11 @@
 #include "simulation2/system/ParamNode.h"
 #include "simulation2/system/SimContext.h"
 #include "simulation2/serialization/ISerializer.h"
+#include "simulation2/components/ICmpPosition.h"
 #include "simulation2/components/ICmpTest.h"
 #include "simulation2/components/ICmpTemplateManager.h"
 
+#include "lib/timer.h"
 #include "ps/CLogger.h"
 #include "ps/Filesystem.h"
 #include "ps/XML/Xeromyces.h"
@@ -244,6 +246,69 @@ public:
 		TS_ASSERT_EQUALS(static_cast<ICmpTest2*> (man.QueryInterface(ent4, IID_Test2))->GetX(), 21150);
 	}
 
+	void test_SendMessage_entity_order()
+	{
+		CSimContext context;
+		CComponentManager man(context, g_ScriptContext);
+		man.LoadComponentTypes();
+
+		// Add entities out of ID order, and remove one from the middle
+		CParamNode noParam;
+		const entity_id_t ents[] = { 5, 3, 7, 4, 6 };
+		for (entity_id_t ent : ents)
+			man.AddComponent(man.AllocateEntityHandle(ent), CID_Test1B, noParam);
+		man.DestroyComponentsSoon(4);
+		man.FlushDestroyedComponents();
+
+		CMessageUpdate msg(fixed::FromInt(100));
+		g_Test1BUpdateOrder.clear();
+		man.BroadcastMessage(msg);
+
+		TS_ASSERT_EQUALS(g_Test1BUpdateOrder, std::vector<entity_id_t>({ 3, 5, 6, 7 }));
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(3, IID_Test1))->GetX(), 12010);
+		TS_ASSERT(man.QueryInterface(4, IID_Test1) == NULL);
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(5, IID_Test1))->GetX(), 12010);
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(6, IID_Test1))->GetX(), 12010);
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(7, IID_Test1))->GetX(), 12010);
+
+		g_Test1BUpdateOrder.clear();
+		man.PostMessage(6, msg);
+
+		TS_ASSERT_EQUALS(g_Test1BUpdateOrder, std::vector<entity_id_t>({ 6 }));
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(5, IID_Test1))->GetX(), 12010);
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(6, IID_Test1))->GetX(), 12020);
+		TS_ASSERT_EQUALS(static_cast<ICmpTest1*> (man.QueryInterface(7, IID_Test1))->GetX(), 12010);
+	}
+
+	void test_BroadcastMessage_performance_DISABLED()
+	{
+		CSimContext context;
+		CComponentManager man(context, g_ScriptContext);
+		man.LoadComponentTypes();
+
+		CParamNode noParam;
+		for (entity_id_t ent = 2; ent < 2 + 5000; ++ent)
+		{
+			CEntityHandle hnd = man.AllocateEntityHandle(ent);
+			man.AddComponent(hnd, CID_Test1B, noParam);
+			man.AddComponent(hnd, CID_Test2A, noParam);
+		}
+
+		CMessageUpdate msg(fixed::FromInt(100));
+		double t = timer_Time();
+		for (size_t i = 0; i < 1000; ++i)
+			man.BroadcastMessage(msg);
+		t = timer_Time() - t;
+		printf("\nMT_Update broadcast to 5k entities: %f us\n", t * 1000.0);
+
+		t = timer_Time();
+		for (size_t i = 0; i < 1000; ++i)
+			for (entity_id_t ent = 2; ent < 2 + 5000; ++ent)
+				man.PostMessage(ent, msg);
+		t = timer_Time() - t;
+		printf("MT_Update posted to 5k entities: %f us\n", t * 1000.0);
+	}
+
 	void test_ParamNode()
 	{
 		CSimContext context;
@@ -730,6 +795,67 @@ public:
 		TS_ASSERT(man2.QueryInterface(ent3, IID_Test2) == NULL);
 	}
 
+	void test_state_hash_cached()
+	{
+		CSimContext context;
+		CComponentManager man(context, g_ScriptContext);
+		man.LoadComponentTypes();
+
+		entity_id_t ent1 = 10, ent2 = 20;
+		CEntityHandle hnd1 = man.AllocateEntityHandle(ent1);
+		CEntityHandle hnd2 = man.AllocateEntityHandle(ent2);
+		CParamNode noParam;
+
+		CParamNode positionParam;
+		TS_ASSERT_EQUALS(CParamNode::LoadXMLString(positionParam,
+			"<Position><Anchor>upright</Anchor><Altitude>0</Altitude><Floating>false</Floating><FloatDepth>0</FloatDepth><TurnRate>6</TurnRate></Position>"), PSRETURN_OK);
+
+		// Position tracks its state version, Test1A doesn't.
+		man.AddComponent(hnd1, CID_Position, positionParam.GetChild("Position"));
+		man.AddComponent(hnd1, CID_Test1A, noParam);
+		man.AddComponent(hnd2, CID_Position, positionParam.GetChild("Position"));
+
+		ICmpPosition* cmpPosition = static_cast<ICmpPosition*> (man.QueryInterface(ent1, IID_Position));
+		cmpPosition->JumpTo(entity_pos_t::FromInt(100), entity_pos_t::FromInt(200));
+
+		std::string hash, quickHash, hash2, quickHash2;
+		TS_ASSERT(man.ComputeStateHash(hash, false));
+		TS_ASSERT(man.ComputeStateHash(quickHash, true));
+
+		// The cached component hashes give the same result.
+		TS_ASSERT(man.ComputeStateHash(hash2, false));
+		TS_ASSERT(man.ComputeStateHash(quickHash2, true));
+		TS_ASSERT_EQUALS(hash, hash2);
+		TS_ASSERT_EQUALS(quickHash, quickHash2);
+
+		// A copy of the state which has no cached hashes (e.g. on a rejoining client) gives the same result too.
+		std::stringstream stateStream;
+		TS_ASSERT(man.SerializeState(stateStream));
+
+		CSimContext context2;
+		CComponentManager man2(context2, g_ScriptContext);
+		man2.LoadComponentTypes();
+		TS_ASSERT(man2.DeserializeState(stateStream));
+
+		TS_ASSERT(man2.ComputeStateHash(hash2, false));
+		TS_ASSERT(man2.ComputeStateHash(quickHash2, true));
+		TS_ASSERT_EQUALS(hash, hash2);
+		TS_ASSERT_EQUALS(quickHash, quickHash2);
+
+		// Changes are detected, and the updated hashes still match.
+		cmpPosition->MoveTo(entity_pos_t::FromInt(101), entity_pos_t::FromInt(200));
+		TS_ASSERT(man.ComputeStateHash(hash, false));
+		TS_ASSERT(man.ComputeStateHash(quickHash, true));
+		TS_ASSERT_DIFFERS(hash, hash2);
+		TS_ASSERT_DIFFERS(quickHash, quickHash2);
+
+		static_cast<ICmpPosition*> (man2.QueryInterface(ent1, IID_Position))->MoveTo(entity_pos_t::FromInt(101), entity_pos_t::FromInt(200));
+		TS_ASSERT(man2.ComputeStateHash(hash2, false));
+		TS_ASSERT(man2.ComputeStateHash(quickHash2, true));
+		TS_ASSERT_EQUALS(hash, hash2);
+		TS_ASSERT_EQUALS(quickHash, quickHash2);
+	}
+
 	void test_script_serialization()
 	{
 		CSimContext context;
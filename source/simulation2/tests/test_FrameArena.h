@@ -0,0 +1,83 @@
+/* Copyright (C) 2023 Wildfire Games.
+ * This file is part of 0 A.D.
+ *
+ * 0 A.D. is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * 0 A.D. is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with 0 A.D.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/self_test.h"
+
+#include "simulation2/system/FrameArena.h"
+
+class TestFrameArena : public CxxTest::TestSuite
+{
+public:
+	void test_reuse()
+	{
+		CFrameArena arena;
+		const u32* data;
+		{
+			CFrameArena::Vector<u32> v(arena);
+			v.reserve(16);
+			for (u32 i = 0; i < 16; ++i)
+				v.push_back(i);
+			data = v.data();
+		}
+		TS_ASSERT_EQUALS(arena.GetStats().allocations, 1u);
+		TS_ASSERT_EQUALS(arena.GetStats().heapAllocations, 0u);
+		TS_ASSERT_EQUALS(arena.GetStats().bytes, 16 * sizeof(u32));
+
+		arena.Reset();
+		{
+			CFrameArena::Vector<u32> v(arena);
+			v.reserve(16);
+			TS_ASSERT_EQUALS(v.data(), data);
+		}
+		TS_ASSERT_EQUALS(arena.GetStats().allocations, 2u);
+
+		arena.ResetStats();
+		TS_ASSERT_EQUALS(arena.GetStats().allocations, 0u);
+		TS_ASSERT_EQUALS(arena.GetStats().bytes, 0u);
+	}
+
+	void test_large_allocations()
+	{
+		CFrameArena arena;
+		{
+			CFrameArena::Vector<u8> v(arena);
+			v.resize(1 * MiB, 1);
+			TS_ASSERT_EQUALS(v[1 * MiB - 1], 1);
+		}
+		TS_ASSERT_EQUALS(arena.GetStats().allocations, 1u);
+		TS_ASSERT_EQUALS(arena.GetStats().heapAllocations, 1u);
+
+		// Fill more than one block.
+		for (int i = 0; i < 16; ++i)
+		{
+			CFrameArena::Vector<u8> v(arena);
+			v.resize(32 * KiB);
+		}
+		TS_ASSERT_EQUALS(arena.GetStats().allocations, 17u);
+		TS_ASSERT_EQUALS(arena.GetStats().heapAllocations, 2u);
+
+		// The blocks are kept by Reset.
+		arena.Reset();
+		arena.ResetStats();
+		for (int i = 0; i < 16; ++i)
+		{
+			CFrameArena::Vector<u8> v(arena);
+			v.resize(32 * KiB);
+		}
+		TS_ASSERT_EQUALS(arena.GetStats().heapAllocations, 0u);
+	}
+};
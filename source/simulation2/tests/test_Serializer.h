@@ -1,4 +1,4 @@
-/* Copyright (C) 2022 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -348,31 +348,31 @@ public:
 		/* expected: */
 			"({x:123, y:[1, 1.5, \"2\", \"test\", (void 0), null, true, false]})",
 		/* expected stream: */
-			116,
+			126,
 			"\x03" // SCRIPT_TYPE_OBJECT
 			"\x02\0\0\0" // num props
-			"\x01\x01\0\0\0" "x" // "x"
+			"\x00" "\x01\x01\0\0\0" "x" // "x"
 			"\x05" // SCRIPT_TYPE_INT
 			"\x7b\0\0\0" // 123
-			"\x01\x01\0\0\0" "y" // "y"
+			"\x00" "\x01\x01\0\0\0" "y" // "y"
 			"\x02" // SCRIPT_TYPE_ARRAY
 			"\x08\0\0\0" // array length
 			"\x08\0\0\0" // num props
-			"\x01\x01\0\0\0" "0" // "0"
+			"\x00" "\x01\x01\0\0\0" "0" // "0"
 			"\x05" "\x01\0\0\0" // SCRIPT_TYPE_INT 1
-			"\x01\x01\0\0\0" "1" // "1"
+			"\x00" "\x01\x01\0\0\0" "1" // "1"
 			"\x06" "\0\0\0\0\0\0\xf8\x3f" // SCRIPT_TYPE_DOUBLE 1.5
-			"\x01\x01\0\0\0" "2" // "2"
+			"\x00" "\x01\x01\0\0\0" "2" // "2"
 			"\x04" "\x01\x01\0\0\0" "2" // SCRIPT_TYPE_STRING "2"
-			"\x01\x01\0\0\0" "3" // "3"
+			"\x00" "\x01\x01\0\0\0" "3" // "3"
 			"\x04" "\x01\x04\0\0\0" "test" // SCRIPT_TYPE_STRING "test"
-			"\x01\x01\0\0\0" "4" // "4"
+			"\x00" "\x01\x01\0\0\0" "4" // "4"
 			"\x00" // SCRIPT_TYPE_VOID
-			"\x01\x01\0\0\0" "5" // "5"
+			"\x00" "\x01\x01\0\0\0" "5" // "5"
 			"\x01" // SCRIPT_TYPE_NULL
-			"\x01\x01\0\0\0" "6" // "6"
+			"\x00" "\x01\x01\0\0\0" "6" // "6"
 			"\x07" "\x01" // SCRIPT_TYPE_BOOLEAN true
-			"\x01\x01\0\0\0" "7" // "7"
+			"\x00" "\x01\x01\0\0\0" "7" // "7"
 			"\x07" "\x00", // SCRIPT_TYPE_BOOLEAN false
 		/* expected debug: */
 			"script: {\n"
@@ -675,7 +675,7 @@ public:
 		/* expected: */
 			"({})",
 		/* expected stream: */
-			169,
+			133,
 			"\x0f" // SCRIPT_TYPE_MAP
 			"\x01\0\0\0" // size
 
@@ -690,10 +690,10 @@ public:
 				"\x03\0\0\0" "155" // "155"
 				"\x03" // SCRIPT_TYPE_OBJECT
 				"\x02\0\0\0" // num props
-					"\x01\x03\0\0\0" "add" // "add"
+					"\x00" "\x01\x03\0\0\0" "add" // "add"
 					"\x05" // SCRIPT_TYPE_INT
 					"\0\0\0\0" // 0
-					"\x01\x08\0\0\0" "multiply" // "multiply"
+					"\x00" "\x01\x08\0\0\0" "multiply" // "multiply"
 					"\x05" // SCRIPT_TYPE_INT
 					"\x01\0\0\0" // 1
 
@@ -702,10 +702,10 @@ public:
 				"\x04\0\0\0" "2300" // "2300"
 				"\x03" // SCRIPT_TYPE_OBJECT
 				"\x02\0\0\0" // num props
-					"\x01\x03\0\0\0" "add" // "add"
+					"\x01" // interned "add"
 					"\x05" // SCRIPT_TYPE_INT
 					"\0\0\0\0" // 0
-					"\x01\x08\0\0\0" "multiply" // "multiply"
+					"\x02" // interned "multiply"
 					"\x06" // SCRIPT_TYPE_DOUBLE
 					"\x9a\x99\x99\x99\x99\x99\xf1\x3f" // 1.1
 
@@ -714,10 +714,10 @@ public:
 				"\x03\0\0\0" "159" // "159"
 				"\x03" // SCRIPT_TYPE_OBJECT
 				"\x02\0\0\0" // num props
-					"\x01\x03\0\0\0" "add" // "add"
+					"\x01" // interned "add"
 					"\x05" // SCRIPT_TYPE_INT
 					"\0\0\0\0" // 0
-					"\x01\x08\0\0\0" "multiply" // "multiply"
+					"\x02" // interned "multiply"
 					"\x05" // SCRIPT_TYPE_INT
 					"\x01\0\0\0" // 1
 		);
@@ -755,7 +755,7 @@ public:
 		/* expected: */
 			"({})",
 		/* expected stream: */
-			28,
+			29,
 			"\x10" // SCRIPT_TYPE_SET
 			"\x02\0\0\0" // size
 
@@ -764,7 +764,7 @@ public:
 
 			"\x03" // SCRIPT_TYPE_OBJECT
 			"\x01\0\0\0" // num props
-				"\x01\x03\0\0\0" "bar" // "bar"
+				"\x00" "\x01\x03\0\0\0" "bar" // "bar"
 				"\x08" // SCRIPT_TYPE_BACKREF
 				"\x02\0\0\0" // ref to object #2, i.e. "b", with #1 being "a"
 		);
@@ -786,6 +786,36 @@ public:
 		helper_script_roundtrip("prop order 2", "var x={}; x.d=3; x.a=1; x.f=2; x.b=7; x", "({d:3, a:1, f:2, b:7})");
 	}
 
+	void test_script_property_names()
+	{
+		helper_script_roundtrip("interned names", "[{a:1}, {a:2}]", "[{a:1}, {a:2}]",
+		/* expected stream: */
+			51,
+			"\x02" // SCRIPT_TYPE_ARRAY
+			"\x02\0\0\0" // array length
+			"\x02\0\0\0" // num props
+			"\x00" "\x01\x01\0\0\0" "0" // "0"
+			"\x03" // SCRIPT_TYPE_OBJECT
+			"\x01\0\0\0" // num props
+			"\x00" "\x01\x01\0\0\0" "a" // "a"
+			"\x05" "\x01\0\0\0" // SCRIPT_TYPE_INT 1
+			"\x00" "\x01\x01\0\0\0" "1" // "1"
+			"\x03" // SCRIPT_TYPE_OBJECT
+			"\x01\0\0\0" // num props
+			"\x02" // interned "a"
+			"\x05" "\x02\0\0\0" // SCRIPT_TYPE_INT 2
+		);
+
+		// Indices above 127 take several bytes
+		std::string expected = "[{";
+		for (int i = 0; i < 200; ++i)
+			expected += (i ? ", k" : "k") + std::to_string(i) + ":" + std::to_string(i);
+		expected += "}, {k150:1, k199:2, k0:3}]";
+		helper_script_roundtrip("many interned names",
+			"var x = {}; for (var i = 0; i < 200; ++i) x['k' + i] = i; [x, {k150: 1, k199: 2, k0: 3}]",
+			expected.c_str());
+	}
+
 	void test_script_array_sparse()
 	{
 		helper_script_roundtrip("array_sparse", "[,1,2,,4,,]", "[, 1, 2, , 4, ,]");
@@ -796,13 +826,13 @@ public:
 		const char stream[] = "\x02" // SCRIPT_TYPE_ARRAY
 					"\x04\0\0\0" // num props
 					"\x04\0\0\0" // array length
-					"\x01\x01\0\0\0" "0" // "0"
+					"\x00" "\x01\x01\0\0\0" "0" // "0"
 					"\x05" "\0\0\0\x80" // SCRIPT_TYPE_INT -2147483648 (JS_INT_MIN)
-					"\x01\x01\0\0\0" "1" // "1"
+					"\x00" "\x01\x01\0\0\0" "1" // "1"
 					"\x06" "\0\0\x20\0\0\0\xE0\xC1" // SCRIPT_TYPE_DOUBLE -2147483649 (JS_INT_MIN-1)
-					"\x01\x01\0\0\0" "2" // "2"
+					"\x00" "\x01\x01\0\0\0" "2" // "2"
 					"\x05" "\xFF\xFF\xFF\x7F" // SCRIPT_TYPE_INT 2147483647 (JS_INT_MAX)
-					"\x01\x01\0\0\0" "3" // "3"
+					"\x00" "\x01\x01\0\0\0" "3" // "3"
 					"\x06" "\0\0\0\0\0\0\xE0\x41" // SCRIPT_TYPE_DOUBLE 2147483648 (JS_INT_MAX+1)
 		;
 
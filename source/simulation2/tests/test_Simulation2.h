@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 Wildfire Games.
+/* Copyright (C) 2023 Wildfire Games.
  * This file is part of 0 A.D.
  *
  * 0 A.D. is free software: you can redistribute it and/or modify
@@ -26,6 +26,10 @@
 #include "ps/CLogger.h"
 #include "ps/Filesystem.h"
 #include "ps/XML/Xeromyces.h"
+#include "scriptinterface/ScriptContext.h"
+
+#include <mutex>
+#include <thread>
 
 class TestSimulation2 : public CxxTest::TestSuite
 {
@@ -131,6 +135,47 @@ public:
 		sim.BroadcastMessage(msg);
 	}
 
+	void test_concurrent_simulations()
+	{
+		// Run the same game twice at once, like batch replays do: each simulation has its own
+		// thread and script context, is set up and destroyed one at a time, and creates entities
+		// while the other one is updated.
+		std::mutex setupMutex;
+		bool loaded[2] = { false, false };
+		std::string hashes[2];
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < 2; ++i)
+			threads.emplace_back([this, &setupMutex, &loaded, &hashes, i]() {
+				std::unique_ptr<CSimulation2> sim;
+				{
+					std::lock_guard<std::mutex> lock(setupMutex);
+					g_ScriptContext = ScriptContext::CreateContext();
+					sim = std::make_unique<CSimulation2>(nullptr, g_ScriptContext, &m_Terrain);
+					loaded[i] = sim->LoadScripts(L"simulation/components/addentity/");
+					sim->ResetState(true, true);
+					sim->AddEntity(L"test1");
+					sim->AddEntity(L"test1-inherit");
+				}
+
+				for (int turn = 0; turn < 100; ++turn)
+				{
+					sim->AddEntity(turn % 2 ? L"test1" : L"test1-inherit");
+					sim->Update(200);
+				}
+				sim->ComputeStateHash(hashes[i], false);
+
+				std::lock_guard<std::mutex> lock(setupMutex);
+				sim.reset();
+				g_ScriptContext.reset();
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+
+		TS_ASSERT(loaded[0] && loaded[1]);
+		TS_ASSERT(!hashes[0].empty());
+		TS_ASSERT_EQUALS(hashes[0], hashes[1]);
+	}
+
 	void test_hotload_scripts()
 	{
 		CSimulation2 sim(NULL, g_ScriptContext, &m_Terrain);